@@ -1,157 +1,468 @@
-/**
- * @file args.cpp
- * @brief Command-line argument parsing implementation for eTree
- *
- * This file implements the argument parsing logic that processes command-line
- * options and populates the Args structure. It supports both Unix-style (-a)
- * and Windows-style (/a) option formats, as well as long options (--all).
- */
-
-#include "args.h"
-#include <cctype>
-#include <string>
-
-/**
- * @brief Default constructor for Args structure
- *
- * Initializes all options to their default values:
- * - folder: current directory (".")
- * - All boolean flags: false
- * - maxLevel: 0 (unlimited depth)
- * - Strings: empty
- */
-Args::Args()
-    : folder("."), excludePattern(""), csvOut(""), maxLevel(0),
-      showHidden(false), showDirsOnly(false), showSize(false), showPerms(false),
-      nocolors(false), showHelp(false), showVersion(false) {}
-
-/**
- * @brief Parse command-line arguments and populate Args structure
- *
- * This function processes command-line arguments in several formats:
- * - Short options: -a, -s, -p (can be combined: -asp)
- * - Long options: --help, --version
- * - Options with values: -l2, -l 2, -I*.tmp, -I *.tmp, -o file.csv
- * - Windows-style: /a, /s, /p (converted to Unix-style internally)
- * - Positional argument: directory path (if not starting with -)
- *
- * @param argc Number of command-line arguments (from main)
- * @param argv Array of command-line argument strings (from main)
- * @param args Reference to Args structure to populate with parsed values
- * @return true if all arguments were recognized and valid, false if unknown
- * options found
- */
-bool parseArgs(int argc, char *argv[], Args &args) {
-  bool foundUnknown = false; // Track if we encounter any unrecognized arguments
-
-  // Process each argument (skip argv[0] which is the program name)
-  for (int i = 1; i < argc; ++i) {
-    std::string arg = argv[i]; // Current argument
-    std::string next =
-        (i + 1 < argc ? argv[i + 1]
-                      : ""); // Next argument (for options with values)
-
-    // Convert Windows-style /option to Unix-style -option
-    if (arg.size() > 1 && arg[0] == '/')
-      arg = "-" + arg.substr(1);
-
-    // Version flag: -v or --version
-    // Show version and exit immediately
-    if (arg == "-v" || arg == "--version") {
-      args.showVersion = true;
-      return true;
-    }
-
-    // Help flag: -? or --help
-    // Show usage information and exit immediately
-    if (arg == "-?" || arg == "--help") {
-      args.showHelp = true;
-      return true;
-    }
-
-    // No colors flag: -nc
-    // Disable ANSI color codes in output
-    if (arg == "-nc") {
-      args.nocolors = true;
-      continue;
-    }
-
-    // Output file option: -o filename
-    // Specify CSV/TSV output file
-    if (arg == "-o" && !next.empty()) {
-      args.csvOut = next;
-      ++i; // Skip next argument since we consumed it
-      continue;
-    }
-
-    // Level/depth limit option: -l, -l2, -l 2
-    // Limit directory traversal depth
-    if (arg.rfind("-l", 0) == 0) {
-      if (arg.length() > 2) {
-        // Format: -l2 (number attached to option)
-        args.maxLevel = std::stoi(arg.substr(2));
-      } else if (!next.empty() && std::isdigit(next[0])) {
-        // Format: -l 2 (number as separate argument)
-        args.maxLevel = std::stoi(next);
-        ++i; // Skip next argument
-      } else {
-        // Format: -l (no number specified, default to 1)
-        args.maxLevel = 1;
-      }
-      continue;
-    }
-
-    // Exclude pattern option: -I, -I*.tmp, -I *.tmp
-    // Specify wildcard pattern for files/folders to exclude
-    if (arg.rfind("-I", 0) == 0) {
-      if (arg.length() > 2) {
-        // Format: -I*.tmp (pattern attached to option)
-        args.excludePattern = arg.substr(2);
-      } else if (!next.empty()) {
-        // Format: -I *.tmp (pattern as separate argument)
-        args.excludePattern = next;
-        ++i; // Skip next argument
-      }
-      continue;
-    }
-
-    // Combined short options: -asp, -dsp, etc.
-    // Process each character as a separate flag
-    if (arg.size() >= 2 && arg[0] == '-') {
-      for (size_t j = 1; j < arg.size(); ++j) {
-        switch (arg[j]) {
-        case 'd': // Directories only
-          args.showDirsOnly = true;
-          break;
-        case 'a': // Show hidden files
-          args.showHidden = true;
-          break;
-        case 's': // Show file sizes
-          args.showSize = true;
-          break;
-        case 'p': // Show permissions
-          args.showPerms = true;
-          break;
-        case 'l': // Level (handled above, skip here)
-        case 'I': // Exclude pattern (handled above, skip here)
-        case 'o': // Output file (handled above, skip here)
-          break;
-        default:
-          // Unknown option character
-          foundUnknown = true;
-        }
-      }
-      continue;
-    }
-
-    // Positional argument: directory path
-    // Only accept one directory path; additional paths are errors
-    if (args.folder == ".")
-      args.folder = arg;
-    else
-      foundUnknown = true; // Multiple directory paths specified
-  }
-
-  // Return true only if no unknown arguments were found
-  return !foundUnknown;
-}
+/**
+ * @file args.cpp
+ * @brief Command-line argument parsing implementation for eTree
+ *
+ * This file implements the argument parsing logic that processes command-line
+ * options and populates the Args structure. It supports both Unix-style (-a)
+ * and Windows-style (/a) option formats, as well as long options (--all).
+ */
+
+#include "args.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+/**
+ * @brief Append the patterns listed in a file to the exclude list
+ *
+ * One pattern per line; blank lines and lines starting with # are skipped
+ * and Windows line endings are accepted.
+ *
+ * @param filename Pattern file to read
+ * @param patterns Receives the patterns
+ * @return true if the file could be read, false otherwise
+ */
+static bool loadPatternFile(const std::string &filename,
+                            std::vector<std::string> &patterns) {
+  std::ifstream file(filename);
+  if (!file) {
+    std::cerr << "Error: Could not open pattern file " << filename
+              << std::endl;
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(file, line)) {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.empty() || line[0] == '#')
+      continue;
+    patterns.push_back(line);
+  }
+  return true;
+}
+
+/**
+ * @brief Default constructor for Args structure
+ *
+ * Initializes all options to their default values:
+ * - folder: current directory (".")
+ * - All boolean flags: false
+ * - maxLevel: 0 (unlimited depth)
+ * - jobs: 1 (serial walk)
+ * - memLimit: 0 (no limit)
+ * - sizeBase: 0 (exact byte counts)
+ * - topCount: 0 (print the tree), topBy: size
+ * - sortBy: name
+ * - Strings: empty
+ */
+Args::Args()
+    : folder("."), csvOut(""), outputFile(""), maxLevel(0), jobs(1),
+      memLimit(0), sizeBase(0), topCount(0), topBy(TOP_SIZE),
+      sortBy(SORT_NAME), showHidden(false), showDirsOnly(false),
+      showSize(false), showPerms(false), nocolors(false), ioUring(false),
+      gitignore(false), arrowOut(false), refresh(false), watch(false),
+      du(false), dirsFirst(false), unsorted(false), showHelp(false),
+      showVersion(false) {}
+
+/**
+ * @brief Parse command-line arguments and populate Args structure
+ *
+ * This function processes command-line arguments in several formats:
+ * - Short options: -a, -s, -p, -h (can be combined: -asp)
+ * - Long options: --help, --version
+ * - Options with values: -l2, -l 2, -I*.tmp, -I *.tmp, -o file.csv, -j4
+ * - Repeatable: -I and -P (one pattern each), --exclude-from FILE (one
+ *   pattern per line)
+ * - Windows-style: /a, /s, /p (converted to Unix-style internally)
+ * - Positional argument: directory path (if not starting with -)
+ *
+ * @param argc Number of command-line arguments (from main)
+ * @param argv Array of command-line argument strings (from main)
+ * @param args Reference to Args structure to populate with parsed values
+ * @return true if all arguments were recognized and valid, false if unknown
+ * options found
+ */
+bool parseArgs(int argc, char *argv[], Args &args) {
+  bool foundUnknown = false; // Track if we encounter any unrecognized arguments
+  bool rankGiven = false;    // --by seen (it only ranks a --top report)
+
+  // Process each argument (skip argv[0] which is the program name)
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i]; // Current argument
+    std::string next =
+        (i + 1 < argc ? argv[i + 1]
+                      : ""); // Next argument (for options with values)
+
+    // Convert Windows-style /option to Unix-style -option
+    if (arg.size() > 1 && arg[0] == '/')
+      arg = "-" + arg.substr(1);
+
+    // Version flag: -v or --version
+    // Show version and exit immediately
+    if (arg == "-v" || arg == "--version") {
+      args.showVersion = true;
+      return true;
+    }
+
+    // Help flag: -? or --help
+    // Show usage information and exit immediately
+    if (arg == "-?" || arg == "--help") {
+      args.showHelp = true;
+      return true;
+    }
+
+    // No colors flag: -nc
+    // Disable ANSI color codes in output
+    if (arg == "-nc") {
+      args.nocolors = true;
+      continue;
+    }
+
+    // Output file option: -o filename
+    // Specify CSV/TSV output file
+    if (arg == "-o" && !next.empty()) {
+      args.csvOut = next;
+      ++i; // Skip next argument since we consumed it
+      continue;
+    }
+
+    // Level/depth limit option: -l, -l2, -l 2
+    // Limit directory traversal depth
+    if (arg.rfind("-l", 0) == 0) {
+      if (arg.length() > 2) {
+        // Format: -l2 (number attached to option)
+        args.maxLevel = std::stoi(arg.substr(2));
+      } else if (!next.empty() && std::isdigit(next[0])) {
+        // Format: -l 2 (number as separate argument)
+        args.maxLevel = std::stoi(next);
+        ++i; // Skip next argument
+      } else {
+        // Format: -l (no number specified, default to 1)
+        args.maxLevel = 1;
+      }
+      continue;
+    }
+
+#ifndef _WIN32
+    // Tree output file option: --output filename
+    // Write the tree directly to a file instead of standard output
+    if (arg == "--output" && !next.empty()) {
+      args.outputFile = next;
+      ++i; // Skip next argument since we consumed it
+      continue;
+    }
+
+    // Snapshot options: --snapshot filename, --refresh filename
+    // Save the walked tree as an index; --refresh first reuses the index
+    // for every directory that has not changed since it was saved
+    if ((arg == "--snapshot" || arg == "--refresh") && !next.empty()) {
+      args.snapshotFile = next;
+      args.refresh = arg == "--refresh";
+      ++i; // Skip next argument since we consumed it
+      continue;
+    }
+
+    // Diff option: --diff OLD NEW
+    // Compare two exports or snapshots instead of walking a directory
+    if (arg == "--diff" && i + 2 < argc) {
+      args.diffOld = argv[i + 1];
+      args.diffNew = argv[i + 2];
+      i += 2; // Skip both file names
+      continue;
+    }
+
+    // Watch flag: --watch
+    // After the tree, keep running and print entries as they change
+    if (arg == "--watch") {
+      args.watch = true;
+      continue;
+    }
+
+    // Disk usage flag: --du
+    // Show each folder's total size, size on disk and files; implies -s
+    if (arg == "--du") {
+      args.du = true;
+      args.showSize = true;
+      continue;
+    }
+
+    // Top-N report option: --top N
+    // Print only the N largest files (or see --by) instead of the tree
+    if (arg == "--top" && !next.empty()) {
+      if (std::isdigit(static_cast<unsigned char>(next[0])))
+        args.topCount = std::stoul(next);
+      if (args.topCount == 0)
+        foundUnknown = true;
+      ++i; // Skip next argument since we consumed it
+      continue;
+    }
+
+    // Top-N ranking option: --by size|mtime|count
+    if (arg == "--by" && !next.empty()) {
+      if (next == "size")
+        args.topBy = TOP_SIZE;
+      else if (next == "mtime")
+        args.topBy = TOP_MTIME;
+      else if (next == "count")
+        args.topBy = TOP_COUNT;
+      else
+        foundUnknown = true;
+      rankGiven = true;
+      ++i; // Skip next argument since we consumed it
+      continue;
+    }
+
+    // Sort option: --sort name|natural|size|mtime|ext|none (or --sort=KEY)
+    // Order in which each folder's entries are listed
+    if (arg == "--sort" || arg.rfind("--sort=", 0) == 0) {
+      std::string key = arg.size() > 6 ? arg.substr(7) : next;
+      if (key == "name")
+        args.sortBy = SORT_NAME;
+      else if (key == "natural")
+        args.sortBy = SORT_NATURAL;
+      else if (key == "size")
+        args.sortBy = SORT_SIZE;
+      else if (key == "mtime")
+        args.sortBy = SORT_MTIME;
+      else if (key == "ext")
+        args.sortBy = SORT_EXT;
+      else if (key == "none")
+        args.sortBy = SORT_NONE;
+      else
+        foundUnknown = true;
+      if (arg.size() == 6 && !next.empty())
+        ++i; // Skip next argument since we consumed it
+      continue;
+    }
+
+    // Folders-first flag: --dirsfirst
+    // List each folder's subfolders before its files
+    if (arg == "--dirsfirst") {
+      args.dirsFirst = true;
+      continue;
+    }
+
+    // Ignore-file flag: --gitignore
+    // Skip whatever .gitignore/.ignore files exclude (pruning whole subtrees)
+    if (arg == "--gitignore") {
+      args.gitignore = true;
+      continue;
+    }
+
+    // SI size flag: --si
+    // Show sizes in powers of 1000 (kB, MB, ...); implies -s
+    if (arg == "--si") {
+      args.sizeBase = 1000;
+      args.showSize = true;
+      continue;
+    }
+
+    // Memory limit option: --mem-limit SIZE (bytes, or K, M, G, T suffix)
+    // Sort folders too large for SIZE in runs spilled to a temporary file
+    if (arg == "--mem-limit" && !next.empty()) {
+      char *end = nullptr;
+      const unsigned long long value = std::strtoull(next.c_str(), &end, 10);
+      const size_t unit = std::string("KMGT").find(
+          static_cast<char>(std::toupper(static_cast<unsigned char>(*end))));
+      const unsigned shift =
+          *end == '\0' ? 0
+          : end[1] == '\0' && unit != std::string::npos
+              ? 10 * static_cast<unsigned>(unit + 1)
+              : 64;
+      if (std::isdigit(static_cast<unsigned char>(next[0])) && shift < 64 &&
+          value <= (UINT64_MAX >> shift))
+        args.memLimit = static_cast<uint64_t>(value) << shift;
+      if (args.memLimit == 0)
+        foundUnknown = true;
+      ++i; // Skip next argument since we consumed it
+      continue;
+    }
+
+    // io_uring flag: --io-uring
+    // Batch each directory's metadata calls (falls back if unavailable)
+    if (arg == "--io-uring") {
+      args.ioUring = true;
+      continue;
+    }
+
+    // Parallel walk option: -j, -j4, -j 4
+    // Number of threads enumerating directories (-j alone: one per core)
+    if (arg.rfind("-j", 0) == 0) {
+      if (arg.length() > 2) {
+        // Format: -j4 (number attached to option)
+        args.jobs = std::stoi(arg.substr(2));
+      } else if (!next.empty() && std::isdigit(next[0])) {
+        // Format: -j 4 (number as separate argument)
+        args.jobs = std::stoi(next);
+        ++i; // Skip next argument
+      } else {
+        // Format: -j (no number specified, use all hardware threads)
+        args.jobs = static_cast<int>(std::thread::hardware_concurrency());
+      }
+      if (args.jobs < 1)
+        args.jobs = 1;
+      continue;
+    }
+
+    // Include pattern option: -P, -P*.proto, -P 'src/**/*.proto' (repeatable)
+    // Show only matching files and the directories leading to them
+    if (arg.rfind("-P", 0) == 0) {
+      if (arg.length() > 2) {
+        // Format: -P*.proto (pattern attached to option)
+        args.includePatterns.push_back(arg.substr(2));
+      } else if (!next.empty()) {
+        // Format: -P *.proto (pattern as separate argument)
+        args.includePatterns.push_back(next);
+        ++i; // Skip next argument
+      }
+      continue;
+    }
+#endif
+
+    // Exclude pattern file option: --exclude-from FILE
+    // Add every pattern listed in FILE (one per line)
+    if (arg == "--exclude-from" && !next.empty()) {
+      if (!loadPatternFile(next, args.excludePatterns))
+        foundUnknown = true;
+      ++i; // Skip next argument since we consumed it
+      continue;
+    }
+
+    // Exclude pattern option: -I, -I*.tmp, -I *.tmp (may be repeated)
+    // Add a wildcard pattern for files/folders to exclude
+    if (arg.rfind("-I", 0) == 0) {
+      if (arg.length() > 2) {
+        // Format: -I*.tmp (pattern attached to option)
+        args.excludePatterns.push_back(arg.substr(2));
+      } else if (!next.empty()) {
+        // Format: -I *.tmp (pattern as separate argument)
+        args.excludePatterns.push_back(next);
+        ++i; // Skip next argument
+      }
+      continue;
+    }
+
+    // Combined short options: -asp, -dsp, etc.
+    // Process each character as a separate flag
+    if (arg.size() >= 2 && arg[0] == '-') {
+      for (size_t j = 1; j < arg.size(); ++j) {
+        switch (arg[j]) {
+        case 'd': // Directories only
+          args.showDirsOnly = true;
+          break;
+        case 'a': // Show hidden files
+          args.showHidden = true;
+          break;
+        case 's': // Show file sizes
+          args.showSize = true;
+          break;
+        case 'p': // Show permissions
+          args.showPerms = true;
+          break;
+#ifndef _WIN32
+        case 'h': // Show sizes in powers of 1024 (KiB, MiB, ...)
+          args.sizeBase = 1024;
+          args.showSize = true;
+          break;
+        case 'U': // Print entries unsorted, as each directory yields them
+          args.unsorted = true;
+          break;
+#endif
+        case 'l': // Level (handled above, skip here)
+        case 'I': // Exclude pattern (handled above, skip here)
+        case 'o': // Output file (handled above, skip here)
+          break;
+        default:
+          // Unknown option character
+          foundUnknown = true;
+        }
+      }
+      continue;
+    }
+
+    // Positional argument: directory path
+    // Only accept one directory path; additional paths are errors
+    if (args.folder == ".")
+      args.folder = arg;
+    else
+      foundUnknown = true; // Multiple directory paths specified
+  }
+
+  // Compile all exclude patterns into one matcher for the whole walk
+  for (const std::string &pattern : args.excludePatterns)
+    args.exclude.add(pattern);
+  for (const std::string &pattern : args.includePatterns)
+    args.include.add(pattern);
+
+#ifndef _WIN32
+  // The -o file name picks the export format: Arrow IPC or TSV
+  auto endsWith = [&](const char *suffix) {
+    std::string ext(suffix);
+    if (args.csvOut.size() < ext.size())
+      return false;
+    std::string tail = args.csvOut.substr(args.csvOut.size() - ext.size());
+    std::transform(tail.begin(), tail.end(), tail.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return tail == ext;
+  };
+  args.arrowOut = endsWith(".arrow") || endsWith(".feather");
+
+  // --output takes the tree text, which -o replaces with the export
+  if (!args.outputFile.empty() && !args.csvOut.empty())
+    foundUnknown = true;
+
+  // Changes are printed as text; an export file is written only once
+  if (args.watch && !args.csvOut.empty())
+    foundUnknown = true;
+  if (!args.diffOld.empty() && (args.watch || !args.csvOut.empty()))
+    foundUnknown = true;
+
+  // Totals are printed on the tree lines, from a fresh walk
+  if (args.du && (args.watch || !args.csvOut.empty() ||
+                  !args.snapshotFile.empty()))
+    foundUnknown = true;
+
+  // Snapshots and exports keep tree order, which --diff and --refresh
+  // rely on
+  if ((args.sortBy != SORT_NAME || args.dirsFirst) &&
+      (!args.snapshotFile.empty() || !args.csvOut.empty()))
+    foundUnknown = true;
+
+  // -U prints every entry as soon as it is read: nothing may need a
+  // directory's other entries (-P, --gitignore), a whole listing or tree
+  // (--sort, --dirsfirst, --du, --top, -o, --snapshot) or a read-ahead
+  // pool (-j)
+  if (args.unsorted) {
+    if (!args.include.empty() || args.gitignore || args.dirsFirst ||
+        (args.sortBy != SORT_NAME && args.sortBy != SORT_NONE) || args.du ||
+        args.topCount > 0 || args.watch || !args.csvOut.empty() ||
+        !args.snapshotFile.empty() || args.jobs != 1)
+      foundUnknown = true;
+    args.sortBy = SORT_NONE;
+  }
+
+  // --mem-limit merges sorted runs of each huge folder while rendering:
+  // there must be an order to merge on, and a tree to render
+  if (args.memLimit > 0 &&
+      (args.sortBy == SORT_NONE || args.topCount > 0 || args.watch ||
+       !args.snapshotFile.empty()))
+    foundUnknown = true;
+
+  // The --top report replaces the tree and every other output
+  if (args.topCount > 0 && (args.watch || args.du || !args.csvOut.empty() ||
+                            !args.snapshotFile.empty()))
+    foundUnknown = true;
+#endif
+
+  // --by only ranks the --top report
+  if (rankGiven && args.topCount == 0)
+    foundUnknown = true;
+
+  // Return true only if no unknown arguments were found
+  return !foundUnknown;
+}
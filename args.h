@@ -1,59 +1,106 @@
-/**
- * @file args.h
- * @brief Command-line argument parsing declarations for eTree
- *
- * This header defines the Args structure which holds all command-line
- * arguments and options for the eTree directory tree viewer application.
- * It also declares the parseArgs function for processing command-line input.
- */
-
-#ifndef ARGS_H
-#define ARGS_H
-
-#include <string>
-
-/**
- * @struct Args
- * @brief Structure to hold all command-line arguments and options
- *
- * This structure contains all the configuration options that can be
- * specified via command-line arguments when running eTree.
- */
-struct Args {
-  std::string
-      folder; ///< Target directory to display (default: current directory)
-  std::string excludePattern; ///< Wildcard pattern for files/folders to exclude
-                              ///< (e.g., "*.tmp")
-  std::string
-      csvOut;   ///< Output CSV/TSV filename (empty if no CSV output requested)
-  int maxLevel; ///< Maximum depth to traverse (0 = unlimited)
-  bool showHidden;   ///< Whether to show hidden files and folders
-  bool showDirsOnly; ///< Whether to show only directories (no files)
-  bool showSize;     ///< Whether to display file sizes
-  bool showPerms;    ///< Whether to display file permissions
-  bool nocolors;     ///< Whether to disable colored output
-  bool showHelp;     ///< Whether to display help message
-  bool showVersion;  ///< Whether to display version information
-
-  /**
-   * @brief Default constructor - initializes all options to default values
-   */
-  Args();
-};
-
-/**
- * @brief Parse command-line arguments and populate Args structure
- *
- * This function processes the command-line arguments passed to main()
- * and fills the Args structure with the appropriate values. It handles
- * both short (-a) and long (--all) option formats.
- *
- * @param argc Number of command-line arguments
- * @param argv Array of command-line argument strings
- * @param args Reference to Args structure to populate
- * @return true if arguments were parsed successfully, false if there was an
- * error
- */
-bool parseArgs(int argc, char *argv[], Args &args);
-
-#endif
+/**
+ * @file args.h
+ * @brief Command-line argument parsing declarations for eTree
+ *
+ * This header defines the Args structure which holds all command-line
+ * arguments and options for the eTree directory tree viewer application.
+ * It also declares the parseArgs function for processing command-line input.
+ */
+
+#ifndef ARGS_H
+#define ARGS_H
+
+#include "glob.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// Ranking of the --top report (--by)
+enum TopOrder {
+  TOP_SIZE,  ///< Largest files
+  TOP_MTIME, ///< Most recently modified files and folders
+  TOP_COUNT, ///< Folders with the most entries
+};
+
+/// Order of the entries of each listed directory (--sort)
+enum SortOrder {
+  SORT_NAME,    ///< Bytewise by name (default)
+  SORT_NATURAL, ///< By name, ignoring ASCII case, numbers by value
+  SORT_SIZE,    ///< Largest first, then by name
+  SORT_MTIME,   ///< Most recently modified first, then by name
+  SORT_EXT,     ///< By extension, then by name
+  SORT_NONE,    ///< As the directory returns them
+};
+
+/**
+ * @struct Args
+ * @brief Structure to hold all command-line arguments and options
+ *
+ * This structure contains all the configuration options that can be
+ * specified via command-line arguments when running eTree.
+ */
+struct Args {
+  std::string
+      folder; ///< Target directory to display (default: current directory)
+  std::vector<std::string>
+      excludePatterns; ///< Wildcard patterns for files/folders to exclude
+                       ///< (-I, repeatable, and --exclude-from lines)
+  GlobSet exclude;     ///< excludePatterns compiled by parseArgs()
+  std::vector<std::string>
+      includePatterns; ///< Patterns of files to show (-P, repeatable;
+                       ///< names or root-relative paths with **)
+  IncludeSet include;  ///< includePatterns compiled by parseArgs()
+  std::string
+      csvOut;   ///< Output CSV/TSV filename (empty if no CSV output requested)
+  std::string outputFile; ///< Tree text output file (--output; empty: stdout)
+  std::string snapshotFile; ///< Tree index to save (--snapshot, --refresh)
+  std::string diffOld; ///< Earlier export to compare (--diff OLD NEW)
+  std::string diffNew; ///< Later export to compare (--diff OLD NEW)
+  int maxLevel; ///< Maximum depth to traverse (0 = unlimited)
+  int jobs;     ///< Directory enumeration threads (1 = serial walk)
+  uint64_t memLimit; ///< Memory for one folder's entries (--mem-limit;
+                     ///< 0 = unlimited)
+  unsigned sizeBase; ///< Size units: 1024 (-h), 1000 (--si), 0 (bytes)
+  size_t topCount;   ///< Entries in the --top report (0 = print the tree)
+  TopOrder topBy;    ///< Ranking of the --top report (--by)
+  SortOrder sortBy;  ///< Order of each folder's entries (--sort)
+  bool showHidden;   ///< Whether to show hidden files and folders
+  bool showDirsOnly; ///< Whether to show only directories (no files)
+  bool showSize;     ///< Whether to display file sizes
+  bool showPerms;    ///< Whether to display file permissions
+  bool nocolors;     ///< Whether to disable colored output
+  bool ioUring;      ///< Whether to batch metadata calls through io_uring
+  bool gitignore;    ///< Whether to skip entries matched by .gitignore files
+  bool arrowOut;     ///< Whether -o writes an Arrow IPC file (*.arrow,
+                     ///< *.feather) instead of TSV
+  bool refresh;      ///< Whether to reuse snapshotFile's unchanged dirs
+  bool watch;        ///< Whether to keep printing changes (--watch)
+  bool du;           ///< Whether folders show their subtree totals (--du)
+  bool dirsFirst;    ///< Whether folders precede files (--dirsfirst)
+  bool unsorted;     ///< Whether entries are printed as they are read (-U)
+  bool showHelp;     ///< Whether to display help message
+  bool showVersion;  ///< Whether to display version information
+
+  /**
+   * @brief Default constructor - initializes all options to default values
+   */
+  Args();
+};
+
+/**
+ * @brief Parse command-line arguments and populate Args structure
+ *
+ * This function processes the command-line arguments passed to main()
+ * and fills the Args structure with the appropriate values. It handles
+ * both short (-a) and long (--all) option formats.
+ *
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line argument strings
+ * @param args Reference to Args structure to populate
+ * @return true if arguments were parsed successfully, false if there was an
+ * error
+ */
+bool parseArgs(int argc, char *argv[], Args &args);
+
+#endif
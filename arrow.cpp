@@ -0,0 +1,546 @@
+/**
+ * @file arrow.cpp
+ * @brief Arrow IPC file writer implementation for eTree
+ *
+ * File layout (Arrow columnar format, IPC file):
+ *   "ARROW1\0\0", Schema message, DictionaryBatch message,
+ *   RecordBatch messages..., Footer, footer length, "ARROW1"
+ *
+ * Every message is a 0xFFFFFFFF continuation marker, the length of its
+ * flatbuffer metadata, the metadata (padded to 8 bytes) and a body of
+ * 8-byte aligned buffers. The metadata tables come from Arrow's
+ * Schema.fbs, Message.fbs and File.fbs; FlatBuilder below encodes exactly
+ * what they need. Values are written in the host byte order, which the
+ * schema declares as little-endian.
+ */
+
+#include "arrow.h"
+
+#ifndef _WIN32
+
+#include "output.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "The Arrow export writes little-endian data"
+#endif
+
+namespace {
+
+/// File magic, at the start (padded to 8 bytes) and at the very end
+const char kMagic[8] = {'A', 'R', 'R', 'O', 'W', '1', 0, 0};
+
+// Enumerations from the Arrow flatbuffer schemas
+constexpr int16_t kMetadataV5 = 4;     ///< MetadataVersion.V5
+constexpr uint8_t kHeaderSchema = 1;   ///< MessageHeader.Schema
+constexpr uint8_t kHeaderDict = 2;     ///< MessageHeader.DictionaryBatch
+constexpr uint8_t kHeaderBatch = 3;    ///< MessageHeader.RecordBatch
+constexpr uint8_t kTypeInt = 2;        ///< Type.Int
+constexpr uint8_t kTypeUtf8 = 5;       ///< Type.Utf8
+constexpr uint8_t kTypeTimestamp = 10; ///< Type.Timestamp
+constexpr int16_t kNanosecond = 3;     ///< TimeUnit.NANOSECOND
+
+/// Values of the "type" dictionary, in index order
+const char kTypeNames[] = "filefolder";
+const int32_t kTypeOffsets[] = {0, 4, 10};
+
+/**
+ * @class FlatBuilder
+ * @brief Minimal flatbuffer encoder, filled back to front
+ *
+ * As in the reference implementation, objects are prepended so that every
+ * offset points forward to an object finished earlier. A Ref is the
+ * position of an object counted from the end of the buffer.
+ */
+class FlatBuilder {
+public:
+  using Ref = uint32_t;
+
+  size_t size() const { return buf_.size() - head_; }
+  const uint8_t *data() const { return buf_.data() + head_; }
+
+  /// Pad so that n bytes from now the position is a multiple of align
+  void align(size_t align, size_t n = 0) {
+    minAlign_ = std::max(minAlign_, align);
+    size_t pad = (align - (size() + n) % align) % align;
+    reserve(pad);
+    head_ -= pad;
+    std::memset(buf_.data() + head_, 0, pad);
+  }
+
+  void prepend(const void *bytes, size_t n) {
+    reserve(n);
+    head_ -= n;
+    std::memcpy(buf_.data() + head_, bytes, n);
+  }
+
+  template <typename T> void push(T value) {
+    align(sizeof(T));
+    prepend(&value, sizeof(T));
+  }
+
+  void pushRef(Ref ref) {
+    align(4);
+    push<uint32_t>(static_cast<uint32_t>(size() + 4 - ref));
+  }
+
+  Ref string(std::string_view s) {
+    align(4, s.size() + 1);
+    push<uint8_t>(0);
+    prepend(s.data(), s.size());
+    push<uint32_t>(static_cast<uint32_t>(s.size()));
+    return static_cast<Ref>(size());
+  }
+
+  Ref refVector(const std::vector<Ref> &refs) {
+    align(4, refs.size() * 4);
+    for (auto it = refs.rbegin(); it != refs.rend(); ++it)
+      pushRef(*it);
+    push<uint32_t>(static_cast<uint32_t>(refs.size()));
+    return static_cast<Ref>(size());
+  }
+
+  /// Vector of structs whose largest member has 8 bytes
+  Ref structVector(const void *items, size_t count, size_t itemSize) {
+    align(8, count * itemSize);
+    prepend(items, count * itemSize);
+    push<uint32_t>(static_cast<uint32_t>(count));
+    return static_cast<Ref>(size());
+  }
+
+  void startTable() {
+    fields_.clear();
+    tableStart_ = size();
+  }
+
+  template <typename T> void add(uint16_t field, T value) {
+    push(value);
+    fields_.push_back({field, static_cast<uint32_t>(size())});
+  }
+
+  void addRef(uint16_t field, Ref ref) {
+    pushRef(ref);
+    fields_.push_back({field, static_cast<uint32_t>(size())});
+  }
+
+  /// Finish the table: its vtable is written just in front of it
+  Ref endTable() {
+    push<int32_t>(0); // Offset to the vtable, patched below
+    const Ref table = static_cast<Ref>(size());
+
+    uint16_t count = 0;
+    for (const auto &f : fields_)
+      count = std::max<uint16_t>(count, f.id + 1);
+    std::vector<uint16_t> slots(count, 0);
+    for (const auto &f : fields_)
+      slots[f.id] = static_cast<uint16_t>(table - f.pos);
+
+    for (auto it = slots.rbegin(); it != slots.rend(); ++it)
+      push<uint16_t>(*it);
+    push<uint16_t>(static_cast<uint16_t>(table - tableStart_));
+    push<uint16_t>(static_cast<uint16_t>(4 + 2 * count));
+
+    int32_t vtable = static_cast<int32_t>(size()) - static_cast<int32_t>(table);
+    std::memcpy(buf_.data() + buf_.size() - table, &vtable, sizeof(vtable));
+    return table;
+  }
+
+  /// Prepend the root offset; the buffer is then complete
+  void finish(Ref root) {
+    align(std::max<size_t>(minAlign_, 4), 4);
+    pushRef(root);
+  }
+
+  std::vector<uint8_t> release() const {
+    return std::vector<uint8_t>(data(), data() + size());
+  }
+
+private:
+  struct Field {
+    uint16_t id;
+    uint32_t pos;
+  };
+
+  void reserve(size_t n) {
+    if (head_ >= n)
+      return;
+    size_t used = size();
+    size_t capacity = std::max(buf_.size() * 2, used + n + 256);
+    std::vector<uint8_t> grown(capacity);
+    std::memcpy(grown.data() + capacity - used, data(), used);
+    buf_.swap(grown);
+    head_ = capacity - used;
+  }
+
+  std::vector<uint8_t> buf_;
+  size_t head_ = 0;
+  size_t minAlign_ = 1;
+  size_t tableStart_ = 0;
+  std::vector<Field> fields_;
+};
+
+using Ref = FlatBuilder::Ref;
+
+/// Arrow FieldNode struct: one per column of a batch
+struct FieldNode {
+  int64_t length;
+  int64_t nullCount;
+};
+
+/// Round up to the 8-byte alignment of IPC buffers and metadata
+size_t pad8(size_t n) { return (n + 7) & ~static_cast<size_t>(7); }
+
+/**
+ * @brief Encode an Int type table
+ */
+Ref intType(FlatBuilder &fb, int32_t bitWidth, bool isSigned) {
+  fb.startTable();
+  fb.add<int32_t>(0, bitWidth);
+  fb.add<uint8_t>(1, isSigned ? 1 : 0);
+  return fb.endTable();
+}
+
+/**
+ * @brief Encode one Field of the schema
+ *
+ * @param fb Builder
+ * @param name Column name
+ * @param nullable Whether the column may hold nulls
+ * @param typeType Type union tag
+ * @param type Type table
+ * @param dictionary DictionaryEncoding table, or 0 for none
+ */
+Ref field(FlatBuilder &fb, std::string_view name, bool nullable,
+          uint8_t typeType, Ref type, Ref dictionary = 0) {
+  Ref nameRef = fb.string(name);
+  Ref children = fb.refVector({});
+  fb.startTable();
+  fb.addRef(0, nameRef);
+  fb.add<uint8_t>(1, nullable ? 1 : 0);
+  fb.add<uint8_t>(2, typeType);
+  fb.addRef(3, type);
+  if (dictionary)
+    fb.addRef(4, dictionary);
+  fb.addRef(5, children);
+  return fb.endTable();
+}
+
+/**
+ * @brief Encode the Schema table of the export columns
+ */
+Ref schema(FlatBuilder &fb) {
+  auto utf8 = [&] {
+    fb.startTable();
+    return fb.endTable();
+  };
+  auto timestamp = [&] {
+    Ref tz = fb.string("UTC");
+    fb.startTable();
+    fb.add<int16_t>(0, kNanosecond);
+    fb.addRef(1, tz);
+    return fb.endTable();
+  };
+
+  std::vector<Ref> fields;
+  fields.push_back(field(fb, "relpath", false, kTypeUtf8, utf8()));
+  fields.push_back(field(fb, "name", false, kTypeUtf8, utf8()));
+
+  // "type" holds int8 indices into a dictionary of utf8 values
+  Ref indexType = intType(fb, 8, true);
+  fb.startTable();
+  fb.add<int64_t>(0, 0); // Dictionary id
+  fb.addRef(1, indexType);
+  Ref encoding = fb.endTable();
+  fields.push_back(field(fb, "type", false, kTypeUtf8, utf8(), encoding));
+
+  fields.push_back(
+      field(fb, "size", false, kTypeInt, intType(fb, 64, false)));
+  fields.push_back(field(fb, "created", true, kTypeTimestamp, timestamp()));
+  fields.push_back(field(fb, "modified", true, kTypeTimestamp, timestamp()));
+  fields.push_back(field(fb, "permissions", false, kTypeUtf8, utf8()));
+
+  Ref fieldsRef = fb.refVector(fields);
+  fb.startTable();
+  fb.add<int16_t>(0, 0); // Endianness.Little
+  fb.addRef(1, fieldsRef);
+  return fb.endTable();
+}
+
+/**
+ * @brief Encode a RecordBatch table
+ *
+ * @param fb Builder
+ * @param length Number of rows
+ * @param nodes One FieldNode per column
+ * @param buffers Position of every buffer in the body
+ */
+template <typename Spec>
+Ref recordBatch(FlatBuilder &fb, int64_t length,
+                const std::vector<FieldNode> &nodes,
+                const std::vector<Spec> &buffers) {
+  Ref nodesRef = fb.structVector(nodes.data(), nodes.size(), sizeof(FieldNode));
+  Ref buffersRef =
+      fb.structVector(buffers.data(), buffers.size(), sizeof(Spec));
+  fb.startTable();
+  fb.add<int64_t>(0, length);
+  fb.addRef(1, nodesRef);
+  fb.addRef(2, buffersRef);
+  return fb.endTable();
+}
+
+/**
+ * @brief Encode a Message table around a header and finish the buffer
+ */
+std::vector<uint8_t> message(FlatBuilder &fb, uint8_t headerType, Ref header,
+                             int64_t bodyLength) {
+  fb.startTable();
+  fb.add<int64_t>(3, bodyLength);
+  fb.addRef(2, header);
+  fb.add<int16_t>(0, kMetadataV5);
+  fb.add<uint8_t>(1, headerType);
+  fb.finish(fb.endTable());
+  return fb.release();
+}
+
+} // namespace
+
+/**
+ * @brief Append one timestamp, recording null for kNoTime
+ *
+ * @param value Nanoseconds since the epoch, or kNoTime
+ */
+void ArrowWriter::TimeColumn::add(int64_t value) {
+  size_t row = values.size();
+  if (row % 8 == 0)
+    validity.push_back(0);
+  if (value == kNoTime) {
+    nulls++;
+    value = 0;
+  } else {
+    validity.back() |= static_cast<uint8_t>(1u << (row % 8));
+  }
+  values.push_back(value);
+}
+
+/**
+ * @brief Start the file: magic, schema and the "type" dictionary
+ *
+ * @param out Writer opened on the export file (at offset 0)
+ */
+ArrowWriter::ArrowWriter(OutputWriter &out) : out_(out) {
+  writeBytes(kMagic, sizeof(kMagic));
+
+  FlatBuilder fb;
+  Ref header = schema(fb);
+  writeMessage(message(fb, kHeaderSchema, header, 0), {}, 0, nullptr);
+  writeDictionary();
+}
+
+/**
+ * @brief Append one row (written out when the batch is full)
+ *
+ * The batch is written first if the row's strings would take a utf8
+ * column past the 2 GiB its int32 offsets can address.
+ *
+ * @param relpath Path from the root directory
+ * @param name Filename or directory name
+ * @param isDir Whether the entry is a directory
+ * @param bytes File size in bytes (0 for directories)
+ * @param created Creation time in ns since the epoch, or kNoTime
+ * @param modified Modification time in ns since the epoch, or kNoTime
+ * @param perms Permission string
+ */
+void ArrowWriter::add(std::string_view relpath, std::string_view name,
+                      bool isDir, uint64_t bytes, int64_t created,
+                      int64_t modified, std::string_view perms) {
+  if (rows_ > 0 &&
+      !(relpath_.fits(relpath) && name_.fits(name) && perms_.fits(perms)))
+    writeBatch();
+  relpath_.add(relpath);
+  name_.add(name);
+  type_.push_back(isDir ? 1 : 0);
+  size_.push_back(bytes);
+  created_.add(created);
+  modified_.add(modified);
+  perms_.add(perms);
+  if (++rows_ == kBatchRows)
+    writeBatch();
+}
+
+/**
+ * @brief Write the last batch and the footer that completes the file
+ *
+ * The footer repeats the schema and lists where every dictionary and
+ * record batch starts, which is what lets readers memory-map the file and
+ * jump to any batch.
+ */
+void ArrowWriter::finish() {
+  if (finished_)
+    return;
+  finished_ = true;
+  if (rows_ > 0)
+    writeBatch();
+
+  FlatBuilder fb;
+  Ref schemaRef = schema(fb);
+  Ref dictRef =
+      fb.structVector(dictionaries_.data(), dictionaries_.size(), sizeof(Block));
+  Ref batchRef =
+      fb.structVector(batches_.data(), batches_.size(), sizeof(Block));
+  fb.startTable();
+  fb.addRef(1, schemaRef);
+  fb.addRef(2, dictRef);
+  fb.addRef(3, batchRef);
+  fb.add<int16_t>(0, kMetadataV5);
+  fb.finish(fb.endTable());
+
+  int32_t footerLength = static_cast<int32_t>(fb.size());
+  writeBytes(fb.data(), fb.size());
+  writeBytes(&footerLength, sizeof(footerLength));
+  writeBytes(kMagic, 6);
+}
+
+/**
+ * @brief Lay out body buffers back to back at 8-byte aligned offsets
+ *
+ * @param body Buffers of the body, in schema order
+ * @param specs Receives the position of each buffer
+ * @return Total body length
+ */
+int64_t ArrowWriter::layout(const std::vector<BodyBuffer> &body,
+                            std::vector<BufferSpec> &specs) {
+  size_t offset = 0;
+  specs.clear();
+  for (const auto &buffer : body) {
+    specs.push_back({static_cast<int64_t>(offset),
+                     static_cast<int64_t>(buffer.size)});
+    offset += pad8(buffer.size);
+  }
+  return static_cast<int64_t>(offset);
+}
+
+/**
+ * @brief Write the dictionary of the "type" column ("file", "folder")
+ */
+void ArrowWriter::writeDictionary() {
+  std::vector<BodyBuffer> body = {{nullptr, 0},
+                                  {kTypeOffsets, sizeof(kTypeOffsets)},
+                                  {kTypeNames, sizeof(kTypeNames) - 1}};
+  std::vector<BufferSpec> specs;
+  int64_t bodyLength = layout(body, specs);
+
+  FlatBuilder fb;
+  Ref data = recordBatch(fb, 2, {{2, 0}}, specs);
+  fb.startTable();
+  fb.add<int64_t>(0, 0); // Dictionary id
+  fb.addRef(1, data);
+  Ref header = fb.endTable();
+
+  Block block;
+  writeMessage(message(fb, kHeaderDict, header, bodyLength), body, bodyLength,
+               &block);
+  dictionaries_.push_back(block);
+}
+
+/**
+ * @brief Write the collected rows as one record batch and reset the columns
+ *
+ * Buffers per column follow the Arrow layout: validity bitmap (empty when
+ * there are no nulls), then offsets and data for utf8 or the values.
+ */
+void ArrowWriter::writeBatch() {
+  const int64_t rows = static_cast<int64_t>(rows_);
+  auto timeValidity = [](const TimeColumn &c) {
+    return c.nulls ? BodyBuffer{c.validity.data(), c.validity.size()}
+                   : BodyBuffer{nullptr, 0};
+  };
+  auto offsets = [](const StringColumn &c) {
+    return BodyBuffer{c.offsets.data(), c.offsets.size() * sizeof(int32_t)};
+  };
+  auto data = [](const StringColumn &c) {
+    return BodyBuffer{c.data.data(), c.data.size()};
+  };
+  const BodyBuffer none{nullptr, 0};
+
+  std::vector<BodyBuffer> body = {
+      none, offsets(relpath_), data(relpath_),
+      none, offsets(name_), data(name_),
+      none, {type_.data(), type_.size()},
+      none, {size_.data(), size_.size() * sizeof(uint64_t)},
+      timeValidity(created_),
+      {created_.values.data(), created_.values.size() * sizeof(int64_t)},
+      timeValidity(modified_),
+      {modified_.values.data(), modified_.values.size() * sizeof(int64_t)},
+      none, offsets(perms_), data(perms_)};
+  std::vector<FieldNode> nodes = {
+      {rows, 0},
+      {rows, 0},
+      {rows, 0},
+      {rows, 0},
+      {rows, static_cast<int64_t>(created_.nulls)},
+      {rows, static_cast<int64_t>(modified_.nulls)},
+      {rows, 0}};
+  std::vector<BufferSpec> specs;
+  int64_t bodyLength = layout(body, specs);
+
+  FlatBuilder fb;
+  Ref header = recordBatch(fb, rows, nodes, specs);
+  Block block;
+  writeMessage(message(fb, kHeaderBatch, header, bodyLength), body, bodyLength,
+               &block);
+  batches_.push_back(block);
+
+  // Start the next batch, keeping the column buffers' capacity
+  rows_ = 0;
+  for (StringColumn *c : {&relpath_, &name_, &perms_}) {
+    c->offsets.resize(1);
+    c->data.clear();
+  }
+  type_.clear();
+  size_.clear();
+  for (TimeColumn *c : {&created_, &modified_}) {
+    c->values.clear();
+    c->validity.clear();
+    c->nulls = 0;
+  }
+}
+
+/**
+ * @brief Write one encapsulated message: marker, metadata, padded body
+ *
+ * @param meta Finished Message flatbuffer
+ * @param body Body buffers, laid out by layout()
+ * @param bodyLength Total body length
+ * @param block Receives the message's position (may be null)
+ */
+void ArrowWriter::writeMessage(const std::vector<uint8_t> &meta,
+                               const std::vector<BodyBuffer> &body,
+                               int64_t bodyLength, Block *block) {
+  static const char zeros[8] = {};
+  const int32_t marker = -1; // 0xFFFFFFFF continuation
+  const int32_t metaLength = static_cast<int32_t>(pad8(meta.size()));
+
+  if (block)
+    *block = {static_cast<int64_t>(offset_), metaLength + 8, 0, bodyLength};
+  writeBytes(&marker, sizeof(marker));
+  writeBytes(&metaLength, sizeof(metaLength));
+  writeBytes(meta.data(), meta.size());
+  writeBytes(zeros, static_cast<size_t>(metaLength) - meta.size());
+  for (const auto &buffer : body) {
+    writeBytes(buffer.data, buffer.size);
+    writeBytes(zeros, pad8(buffer.size) - buffer.size);
+  }
+}
+
+/**
+ * @brief Write raw bytes to the file, keeping track of the offset
+ */
+void ArrowWriter::writeBytes(const void *data, size_t size) {
+  if (size == 0)
+    return;
+  out_.write(static_cast<const char *>(data), size);
+  offset_ += size;
+}
+
+#endif
@@ -0,0 +1,160 @@
+/**
+ * @file arrow.h
+ * @brief Columnar export to Apache Arrow IPC files for eTree (-o *.arrow)
+ *
+ * This header declares ArrowWriter, the alternative to the TSV export for
+ * analytics tools. When the -o file name ends in .arrow or .feather, the
+ * export rows are stored as typed columns in the Arrow IPC file format
+ * (also known as Feather V2), which pandas, Polars and DuckDB read
+ * directly and can memory-map without parsing any text.
+ *
+ * Columns (one row per file or folder, in tree order):
+ * - relpath     utf8                 Path from the root directory
+ * - name        utf8                 Filename or directory name
+ * - type        dictionary<int8>     "file" or "folder"
+ * - size        uint64               Size in bytes (0 for folders)
+ * - created     timestamp[ns, UTC]   Creation time (null if unknown)
+ * - modified    timestamp[ns, UTC]   Modification time (null if unknown)
+ * - permissions utf8                 Permission string ("rwxr-xr-x")
+ *
+ * Rows are buffered per column and written as one record batch every
+ * kBatchRows rows, so memory stays flat however large the tree is. A
+ * batch is written sooner if a utf8 column would outgrow its int32
+ * offsets (very deep trees, where paths are long). The
+ * file is written without the Arrow library: the few flatbuffer tables the
+ * format needs are encoded by hand in arrow.cpp.
+ */
+
+#ifndef ARROW_H
+#define ARROW_H
+
+#ifndef _WIN32
+
+#include "meta.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class OutputWriter;
+
+/**
+ * @class ArrowWriter
+ * @brief Streams export rows into an Arrow IPC file as record batches
+ *
+ * Not thread-safe: only the rendering thread adds rows.
+ */
+class ArrowWriter {
+public:
+  /// Timestamp value for "unknown" (stored as null)
+  static constexpr int64_t kNoTime = FileMeta::kNoTime;
+
+  /// Rows per record batch
+  static constexpr size_t kBatchRows = 64 * 1024;
+
+  /**
+   * @brief Start the file: magic, schema and the "type" dictionary
+   * @param out Writer opened on the export file (at offset 0)
+   */
+  explicit ArrowWriter(OutputWriter &out);
+
+  ArrowWriter(const ArrowWriter &) = delete;
+  ArrowWriter &operator=(const ArrowWriter &) = delete;
+
+  /**
+   * @brief Append one row (written out when the batch is full)
+   *
+   * @param relpath Path from the root directory
+   * @param name Filename or directory name
+   * @param isDir Whether the entry is a directory
+   * @param bytes File size in bytes (0 for directories)
+   * @param created Creation time in ns since the epoch, or kNoTime
+   * @param modified Modification time in ns since the epoch, or kNoTime
+   * @param perms Permission string
+   */
+  void add(std::string_view relpath, std::string_view name, bool isDir,
+           uint64_t bytes, int64_t created, int64_t modified,
+           std::string_view perms);
+
+  /**
+   * @brief Write the last batch and the footer that completes the file
+   */
+  void finish();
+
+private:
+  /// A utf8 column of the current batch
+  struct StringColumn {
+    std::vector<int32_t> offsets{0}; ///< Start of each value, plus the end
+    std::string data;                ///< Concatenated values
+
+    void add(std::string_view value) {
+      data.append(value);
+      offsets.push_back(static_cast<int32_t>(data.size()));
+    }
+
+    /// Whether value can be added without overflowing the offsets
+    bool fits(std::string_view value) const {
+      return value.size() <= static_cast<size_t>(INT32_MAX) - data.size();
+    }
+  };
+
+  /// A nullable timestamp column of the current batch
+  struct TimeColumn {
+    std::vector<int64_t> values;
+    std::vector<uint8_t> validity; ///< Bit per row, 1 = not null
+    size_t nulls = 0;
+
+    void add(int64_t value);
+  };
+
+  /// Location of one message in the file (Arrow's Block struct)
+  struct Block {
+    int64_t offset;
+    int32_t metaDataLength;
+    int32_t padding;
+    int64_t bodyLength;
+  };
+
+  /// One buffer of a message body
+  struct BodyBuffer {
+    const void *data;
+    size_t size;
+  };
+
+  /// Position of one buffer in a message body (Arrow's Buffer struct)
+  struct BufferSpec {
+    int64_t offset;
+    int64_t length;
+  };
+
+  static int64_t layout(const std::vector<BodyBuffer> &body,
+                        std::vector<BufferSpec> &specs);
+  void writeDictionary();
+  void writeBatch();
+  void writeMessage(const std::vector<uint8_t> &meta,
+                    const std::vector<BodyBuffer> &body, int64_t bodyLength,
+                    Block *block);
+  void writeBytes(const void *data, size_t size);
+
+  OutputWriter &out_;
+  uint64_t offset_ = 0;       ///< Bytes written to the file so far
+  bool finished_ = false;     ///< finish() has run
+
+  // Columns of the batch being collected
+  size_t rows_ = 0;
+  StringColumn relpath_;
+  StringColumn name_;
+  std::vector<int8_t> type_;  ///< Index into the "type" dictionary
+  std::vector<uint64_t> size_;
+  TimeColumn created_;
+  TimeColumn modified_;
+  StringColumn perms_;
+
+  std::vector<Block> dictionaries_; ///< Dictionary batches, for the footer
+  std::vector<Block> batches_;      ///< Record batches, for the footer
+};
+
+#endif
+
+#endif
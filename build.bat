@@ -1,6 +1,6 @@
-@echo off
-if exist etree.exe del etree.exe
-call "C:\Program Files\Microsoft Visual Studio\18\Insiders\VC\Auxiliary\Build\vcvars64.bat"
-cl /std:c++17 /EHsc /W3 /O2 /D_CRT_SECURE_NO_WARNINGS /Fe:etree.exe main.cpp etree.cpp args.cpp help.cpp csv.cpp
-if %errorlevel% neq 0 exit /b %errorlevel%
-echo Build Successful
+@echo off
+if exist etree.exe del etree.exe
+call "C:\Program Files\Microsoft Visual Studio\18\Insiders\VC\Auxiliary\Build\vcvars64.bat"
+cl /std:c++17 /EHsc /W3 /O2 /D_CRT_SECURE_NO_WARNINGS /Fe:etree.exe main.cpp etree.cpp args.cpp help.cpp csv.cpp walker.cpp dirstream.cpp meta.cpp uring.cpp glob.cpp ignore.cpp output.cpp arrow.cpp snapshot.cpp watch.cpp diff.cpp nodes.cpp format.cpp du.cpp top.cpp sort.cpp spill.cpp
+if %errorlevel% neq 0 exit /b %errorlevel%
+echo Build Successful
@@ -1,76 +1,248 @@
-/**
- * @file csv.cpp
- * @brief CSV/TSV export functionality implementation for eTree
- *
- * This file implements the TSV (Tab-Separated Values) export functionality,
- * which writes directory tree data to a file that can be opened in Excel
- * or other spreadsheet applications. The output uses UTF-8 encoding with
- * BOM for maximum compatibility.
- */
-
-#include "csv.h"
-#include <fstream>
-#include <iostream>
-
-/**
- * @brief Export tree statistics to a TSV (Tab-Separated Values) file
- *
- * This function creates a TSV file with the following structure:
- * - First line: UTF-8 BOM (\xEF\xBB\xBF) for proper encoding detection
- * - Second line: Header row with column names
- * - Remaining lines: One row per file/folder with tab-separated values
- *
- * Columns in the output:
- * 1. Relative Path - Path from root directory
- * 2. Name - Filename or directory name
- * 3. Type - "file" or "folder"
- * 4. Size (bytes) - File size in bytes (0 for folders)
- * 5. Created - Creation timestamp (YYYY-MM-DD HH:MM:SS)
- * 6. Modified - Last modification timestamp (YYYY-MM-DD HH:MM:SS)
- * 7. Permissions - Permission string (platform-specific format)
- *
- * The TSV format uses tabs (\t) as delimiters, making it compatible with
- * Excel and other spreadsheet applications. UTF-8 with BOM ensures that
- * Unicode characters (including RTL text) display correctly.
- *
- * @param filename Path to the output TSV file to create
- * @param stats TreeStats structure containing the collected directory data
- */
-void writeTsv(const std::string &filename, const TreeStats &stats) {
-  // Open file in binary mode to have full control over line endings and
-  // encoding
-  std::ofstream out(filename, std::ios::out | std::ios::binary);
-
-  // Check if file was opened successfully
-  if (!out.is_open()) {
-    std::cerr << "Error: Could not create file " << filename << std::endl;
-    return;
-  }
-
-  // Write UTF-8 BOM (Byte Order Mark) to signal UTF-8 encoding
-  // This helps Excel and other applications detect the encoding correctly
-  out << "\xEF\xBB\xBF";
-
-  // Write header row with column names (tab-separated)
-  out << "Relative Path\tName\tType\tSize "
-         "(bytes)\tCreated\tModified\tPermissions\n";
-
-  // Write data rows - one row per file/folder
-  for (const auto &row : stats.csvRows) {
-    out << row.relpath << '\t'  // Relative path from root
-        << row.name << '\t'     // Filename or directory name
-        << row.type << '\t'     // "file" or "folder"
-        << row.bytes << '\t'    // Size in bytes (0 for folders)
-        << row.created << '\t'  // Creation timestamp
-        << row.modified << '\t' // Modification timestamp
-        << row.perms << '\n';   // Permissions string
-  }
-
-  // Close the file
-  out.close();
-
-  // Check if any write errors occurred during the process
-  if (out.fail()) {
-    std::cerr << "Error: Could not write to file " << filename << std::endl;
-  }
-}
\ No newline at end of file
+/**
+ * @file csv.cpp
+ * @brief CSV/TSV export functionality implementation for eTree
+ *
+ * This file implements the TSV (Tab-Separated Values) export functionality,
+ * which writes directory tree data to a file that can be opened in Excel
+ * or other spreadsheet applications. The output uses UTF-8 encoding with
+ * BOM for maximum compatibility.
+ */
+
+#include "csv.h"
+#include <fstream>
+#include <iostream>
+
+#ifndef _WIN32
+#include "output.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <ctime>
+#endif
+
+namespace {
+
+/// UTF-8 BOM followed by the header row (tab-separated column names)
+const char kTsvHeader[] = "\xEF\xBB\xBF"
+                          "Relative Path\tName\tType\tSize "
+                          "(bytes)\tCreated\tModified\tPermissions\n";
+
+} // namespace
+
+/**
+ * @brief Export tree statistics to a TSV (Tab-Separated Values) file
+ *
+ * This function creates a TSV file with the following structure:
+ * - First line: UTF-8 BOM (\xEF\xBB\xBF) for proper encoding detection
+ * - Second line: Header row with column names
+ * - Remaining lines: One row per file/folder with tab-separated values
+ *
+ * Columns in the output:
+ * 1. Relative Path - Path from root directory
+ * 2. Name - Filename or directory name
+ * 3. Type - "file" or "folder"
+ * 4. Size (bytes) - File size in bytes (0 for folders)
+ * 5. Created - Creation timestamp (YYYY-MM-DD HH:MM:SS)
+ * 6. Modified - Last modification timestamp (YYYY-MM-DD HH:MM:SS)
+ * 7. Permissions - Permission string (platform-specific format)
+ *
+ * The TSV format uses tabs (\t) as delimiters, making it compatible with
+ * Excel and other spreadsheet applications. UTF-8 with BOM ensures that
+ * Unicode characters (including RTL text) display correctly.
+ *
+ * @param filename Path to the output TSV file to create
+ * @param stats TreeStats structure containing the collected directory data
+ */
+void writeTsv(const std::string &filename, const TreeStats &stats) {
+  // Open file in binary mode to have full control over line endings and
+  // encoding
+  std::ofstream out(filename, std::ios::out | std::ios::binary);
+
+  // Check if file was opened successfully
+  if (!out.is_open()) {
+    std::cerr << "Error: Could not create file " << filename << std::endl;
+    return;
+  }
+
+  // Write UTF-8 BOM (Byte Order Mark) to signal UTF-8 encoding, which
+  // helps Excel detect it, then the header row with column names
+  out << kTsvHeader;
+
+  // Write data rows - one row per file/folder
+  for (const auto &row : stats.csvRows) {
+    out << row.relpath << '\t'  // Relative path from root
+        << row.name << '\t'     // Filename or directory name
+        << row.type << '\t'     // "file" or "folder"
+        << row.bytes << '\t'    // Size in bytes (0 for folders)
+        << row.created << '\t'  // Creation timestamp
+        << row.modified << '\t' // Modification timestamp
+        << row.perms << '\n';   // Permissions string
+  }
+
+  // Close the file
+  out.close();
+
+  // Check if any write errors occurred during the process
+  if (out.fail()) {
+    std::cerr << "Error: Could not write to file " << filename << std::endl;
+  }
+}
+
+#ifndef _WIN32
+/**
+ * @brief Start a streamed TSV export: UTF-8 BOM and header row
+ *
+ * @param out Writer opened on the TSV file
+ */
+void writeTsvHeader(OutputWriter &out) {
+  out.write(kTsvHeader, sizeof(kTsvHeader) - 1);
+}
+
+/**
+ * @brief Append one data row to a streamed TSV export
+ *
+ * The columns are the same as writeTsv()'s. The row is assembled in a
+ * reused line buffer and passed to the writer in one call: the writer's
+ * buffer then always ends on a row boundary, and a file cut short by an
+ * interrupted run still parses.
+ *
+ * @param out Writer opened on the TSV file
+ * @param relpath Path from the root directory
+ * @param name Filename or directory name
+ * @param isDir Whether the entry is a directory
+ * @param bytes File size in bytes (0 for directories)
+ * @param created Creation timestamp (may be empty)
+ * @param modified Modification timestamp (may be empty)
+ * @param perms Permission string
+ */
+void writeTsvRow(OutputWriter &out, std::string_view relpath,
+                 std::string_view name, bool isDir, uintmax_t bytes,
+                 std::string_view created, std::string_view modified,
+                 std::string_view perms) {
+  static thread_local std::string line;
+
+  char digits[24];
+  auto size = std::to_chars(digits, digits + sizeof(digits), bytes);
+
+  line.clear();
+  line.append(relpath).append(1, '\t');
+  line.append(name).append(1, '\t');
+  line.append(isDir ? "folder\t" : "file\t");
+  line.append(digits, size.ptr).append(1, '\t');
+  line.append(created).append(1, '\t');
+  line.append(modified).append(1, '\t');
+  line.append(perms).append(1, '\n');
+  out.write(line);
+}
+
+/**
+ * @brief Format a time as local "YYYY-MM-DD HH:MM:SS"
+ *
+ * @param ns Nanoseconds since the epoch, or FileMeta::kNoTime
+ * @return The text (valid until the next call), "" for kNoTime
+ */
+std::string_view TimestampFormatter::format(int64_t ns) {
+  if (ns == FileMeta::kNoTime)
+    return {};
+
+  // Whole seconds and days, rounded down also before 1970
+  const int64_t second = ns / 1000000000 - (ns % 1000000000 < 0);
+  if (second == second_)
+    return std::string_view(text_, dateLength_ + 9);
+  second_ = second;
+
+  const int64_t day = second / 86400 - (second % 86400 < 0);
+  const Day &cached = lookup(day);
+  int64_t offset = cached.offset;
+  if (!cached.fixed) {
+    const time_t t = static_cast<time_t>(second);
+    struct tm local;
+    offset = localtime_r(&t, &local) ? local.tm_gmtoff : 0;
+  }
+
+  const int64_t local = second + offset;
+  const int64_t localDay = local / 86400 - (local % 86400 < 0);
+  if (localDay != localDay_)
+    setDate(localDay);
+
+  const int time = static_cast<int>(local - localDay * 86400);
+  char *p = text_ + dateLength_;
+  const int hour = time / 3600, minute = time / 60 % 60, sec = time % 60;
+  p[0] = ' ';
+  p[1] = static_cast<char>('0' + hour / 10);
+  p[2] = static_cast<char>('0' + hour % 10);
+  p[3] = ':';
+  p[4] = static_cast<char>('0' + minute / 10);
+  p[5] = static_cast<char>('0' + minute % 10);
+  p[6] = ':';
+  p[7] = static_cast<char>('0' + sec / 10);
+  p[8] = static_cast<char>('0' + sec % 10);
+  return std::string_view(text_, dateLength_ + 9);
+}
+
+/**
+ * @brief UTC offset of a UTC day, from the cache or from localtime_r()
+ *
+ * The offset counts as fixed for the day when it is the same at the day's
+ * first and last second.
+ *
+ * @param day Days since the epoch (UTC)
+ * @return Cache slot of the day
+ */
+const TimestampFormatter::Day &TimestampFormatter::lookup(int64_t day) {
+  if (days_.empty())
+    days_.resize(kDays);
+  Day &slot = days_[static_cast<uint64_t>(day) % kDays];
+  if (slot.day == day)
+    return slot;
+
+  const time_t first = static_cast<time_t>(day * 86400);
+  const time_t last = first + 86399;
+  struct tm a, b;
+  const bool known = localtime_r(&first, &a) && localtime_r(&last, &b);
+  slot.day = day;
+  slot.offset = known ? static_cast<int32_t>(a.tm_gmtoff) : 0;
+  slot.fixed = !known || a.tm_gmtoff == b.tm_gmtoff;
+  return slot;
+}
+
+/**
+ * @brief Write the date part of text_ for a local day
+ *
+ * Civil date from a day count (proleptic Gregorian calendar), as in
+ * Howard Hinnant's "chrono-Compatible Low-Level Date Algorithms".
+ *
+ * @param localDay Days since 1970-01-01 in local time
+ */
+void TimestampFormatter::setDate(int64_t localDay) {
+  localDay_ = localDay;
+  const int64_t z = localDay + 719468;
+  const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  const int64_t doe = z - era * 146097;
+  const int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const int64_t mp = (5 * doy + 2) / 153;
+  const int day = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+  const int month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+  const int64_t year = yoe + era * 400 + (month <= 2);
+
+  if (year < 0 || year > 9999) {
+    const int n = std::snprintf(text_, sizeof(text_) - 9, "%04lld-%02d-%02d",
+                                static_cast<long long>(year), month, day);
+    dateLength_ = static_cast<size_t>(std::min(n, int(sizeof(text_) - 10)));
+    return;
+  }
+  const int y = static_cast<int>(year);
+  text_[0] = static_cast<char>('0' + y / 1000);
+  text_[1] = static_cast<char>('0' + y / 100 % 10);
+  text_[2] = static_cast<char>('0' + y / 10 % 10);
+  text_[3] = static_cast<char>('0' + y % 10);
+  text_[4] = '-';
+  text_[5] = static_cast<char>('0' + month / 10);
+  text_[6] = static_cast<char>('0' + month % 10);
+  text_[7] = '-';
+  text_[8] = static_cast<char>('0' + day / 10);
+  text_[9] = static_cast<char>('0' + day % 10);
+  dateLength_ = 10;
+}
+#endif
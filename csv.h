@@ -1,32 +1,109 @@
-/**
- * @file csv.h
- * @brief CSV/TSV export functionality declarations for eTree
- *
- * This header declares the function for exporting directory tree
- * statistics to a tab-separated values (TSV) file format, which
- * can be opened in Excel or other spreadsheet applications.
- */
-
-#ifndef CSV_H
-#define CSV_H
-
-#include "etree.h"
-#include <string>
-
-
-/**
- * @brief Export tree statistics to a TSV (Tab-Separated Values) file
- *
- * This function writes the collected directory tree data to a TSV file
- * with UTF-8 encoding and BOM (Byte Order Mark). The file includes:
- * - Header row with column names
- * - One row per file/folder with: path, name, type, size, dates, permissions
- *
- * The TSV format is compatible with Excel and other spreadsheet applications.
- *
- * @param filename Path to the output TSV file to create
- * @param stats TreeStats structure containing the collected data to export
- */
-void writeTsv(const std::string &filename, const TreeStats &stats);
-
-#endif
+/**
+ * @file csv.h
+ * @brief CSV/TSV export functionality declarations for eTree
+ *
+ * This header declares the function for exporting directory tree
+ * statistics to a tab-separated values (TSV) file format, which
+ * can be opened in Excel or other spreadsheet applications.
+ */
+
+#ifndef CSV_H
+#define CSV_H
+
+#include "etree.h"
+#include <string>
+
+
+/**
+ * @brief Export tree statistics to a TSV (Tab-Separated Values) file
+ *
+ * This function writes the collected directory tree data to a TSV file
+ * with UTF-8 encoding and BOM (Byte Order Mark). The file includes:
+ * - Header row with column names
+ * - One row per file/folder with: path, name, type, size, dates, permissions
+ *
+ * The TSV format is compatible with Excel and other spreadsheet applications.
+ *
+ * @param filename Path to the output TSV file to create
+ * @param stats TreeStats structure containing the collected data to export
+ */
+void writeTsv(const std::string &filename, const TreeStats &stats);
+
+#ifndef _WIN32
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+class OutputWriter;
+
+/**
+ * @brief Start a streamed TSV export: UTF-8 BOM and header row
+ *
+ * On Unix/Linux, rows are not collected in TreeStats::csvRows but written
+ * by the renderer with writeTsvRow() as soon as they are produced.
+ *
+ * @param out Writer opened on the TSV file
+ */
+void writeTsvHeader(OutputWriter &out);
+
+/**
+ * @brief Append one data row to a streamed TSV export
+ *
+ * The row is handed to the writer as one piece, so the file only ever
+ * contains whole rows, even if the run is interrupted.
+ *
+ * @param out Writer opened on the TSV file
+ * @param relpath Path from the root directory
+ * @param name Filename or directory name
+ * @param isDir Whether the entry is a directory
+ * @param bytes File size in bytes (0 for directories)
+ * @param created Creation timestamp (may be empty)
+ * @param modified Modification timestamp (may be empty)
+ * @param perms Permission string
+ */
+void writeTsvRow(OutputWriter &out, std::string_view relpath,
+                 std::string_view name, bool isDir, uintmax_t bytes,
+                 std::string_view created, std::string_view modified,
+                 std::string_view perms);
+
+/**
+ * @class TimestampFormatter
+ * @brief Formats times as local "YYYY-MM-DD HH:MM:SS" for the TSV columns
+ *
+ * localtime_r() is not called per row. The UTC offset is looked up once per
+ * UTC day and kept in a small cache of days; the local date and time are
+ * then computed with integer arithmetic, and the date text is only
+ * rewritten when the local day changes. A day in which the offset changes
+ * (daylight saving) is not cached, so its times still get their exact
+ * offset from localtime_r().
+ */
+class TimestampFormatter {
+public:
+  /**
+   * @brief Format a time
+   * @param ns Nanoseconds since the epoch, or FileMeta::kNoTime
+   * @return The text (valid until the next call), "" for kNoTime
+   */
+  std::string_view format(int64_t ns);
+
+private:
+  /// UTC offset in effect for a whole UTC day
+  struct Day {
+    int64_t day = INT64_MIN; ///< Days since the epoch (UTC)
+    int32_t offset = 0;      ///< Seconds east of UTC
+    bool fixed = false;      ///< Offset is the same all day
+  };
+  static constexpr size_t kDays = 512; ///< Cached days (direct-mapped)
+
+  const Day &lookup(int64_t day);
+  void setDate(int64_t localDay);
+
+  std::vector<Day> days_;        ///< Allocated on first use
+  int64_t second_ = INT64_MIN;   ///< Second currently in text_
+  int64_t localDay_ = INT64_MIN; ///< Local day whose date is in text_
+  size_t dateLength_ = 0;        ///< Length of the date part of text_
+  char text_[40];                ///< "YYYY-MM-DD HH:MM:SS"
+};
+#endif
+
+#endif
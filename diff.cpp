@@ -0,0 +1,550 @@
+/**
+ * @file diff.cpp
+ * @brief Streaming comparison of two tree exports for eTree (--diff)
+ *
+ * The comparison is a sorted merge: rows of both inputs are compared by
+ * path in tree order, the smaller one is reported as removed or added and
+ * equal paths are compared field by field. Open directories are kept on a
+ * stack with their running size change; a directory's rollup is printed
+ * and added to its parent when the merge leaves it.
+ */
+
+#include "diff.h"
+
+#ifndef _WIN32
+
+#include "etree.h"
+#include "output.h"
+#include "snapshot.h"
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+/// Initial TSV read buffer (grows only for longer lines)
+constexpr size_t kReadBuffer = 1 << 20;
+
+/// Columns of an export row
+constexpr size_t kTsvColumns = 7;
+
+/**
+ * @brief Compare two relative paths in tree order
+ *
+ * A directory's contents follow it directly, so the separator sorts
+ * before every other byte ("a/b" < "a-b"); names compare bytewise like
+ * listDirectory() sorts them.
+ *
+ * @return Negative, zero or positive like strcmp()
+ */
+int comparePaths(std::string_view a, std::string_view b) {
+  const size_t n = std::min(a.size(), b.size());
+  for (size_t i = 0; i < n; ++i) {
+    if (a[i] == b[i])
+      continue;
+    if (a[i] == '/')
+      return -1;
+    if (b[i] == '/')
+      return 1;
+    return static_cast<unsigned char>(a[i]) < static_cast<unsigned char>(b[i])
+               ? -1
+               : 1;
+  }
+  return a.size() < b.size() ? -1 : a.size() > b.size() ? 1 : 0;
+}
+
+/**
+ * @brief Whether path lies below directory dir ("" is the root)
+ */
+bool isInside(std::string_view path, std::string_view dir) {
+  if (dir.empty())
+    return true;
+  return path.size() > dir.size() && path[dir.size()] == '/' &&
+         path.compare(0, dir.size(), dir) == 0;
+}
+
+/// One entry of an export, as far as the comparison needs it
+struct DiffRow {
+  std::string path;     ///< Path from the root directory
+  bool isDir = false;   ///< Whether the entry is a directory
+  uint64_t size = 0;    ///< Size in bytes (0 for directories)
+  std::string modified; ///< Modification time as stored ("" if unknown)
+  std::string perms;    ///< Permission string
+};
+
+/**
+ * @class ExportReader
+ * @brief Reads the rows of a TSV export or a snapshot in tree order
+ */
+class ExportReader {
+public:
+  ExportReader() = default;
+  ~ExportReader() {
+    if (fd_ >= 0)
+      close(fd_);
+  }
+  ExportReader(const ExportReader &) = delete;
+  ExportReader &operator=(const ExportReader &) = delete;
+
+  bool open(const std::string &file, std::string &why);
+  bool next(DiffRow &row);
+
+  /// Why next() stopped early ("" at the regular end)
+  const std::string &error() const { return error_; }
+
+  /// Whether the input is a snapshot (its times are not TSV text)
+  bool isSnapshot() const { return snapshot_ != nullptr; }
+
+private:
+  bool nextTsv(DiffRow &row);
+  bool nextSnapshot(DiffRow &row);
+  bool readLine(std::string_view &line);
+
+  std::string file_;
+  std::string error_;
+  std::string previous_; ///< Path of the last row (order check)
+  bool started_ = false; ///< previous_ is set
+
+  // TSV export
+  int fd_ = -1;
+  std::vector<char> buffer_;
+  size_t begin_ = 0; ///< Start of the unread bytes in buffer_
+  size_t end_ = 0;   ///< End of the bytes read into buffer_
+  bool eof_ = false;
+  uint64_t lineNumber_ = 0;
+
+  // Snapshot: one listing per open directory
+  struct Frame {
+    DirListing listing;
+    size_t next = 0;        ///< Next entry to return
+    size_t pathLength = 0;  ///< Length of the directory's path in path_
+  };
+  std::unique_ptr<SnapshotReader> snapshot_;
+  std::vector<Frame> stack_;
+  std::string path_; ///< Path of the current directory
+};
+
+/**
+ * @brief Open an input: a snapshot if it is one, else a TSV export
+ *
+ * @param file Input file
+ * @param why Receives the reason on failure
+ * @return false if the file cannot be read as either
+ */
+bool ExportReader::open(const std::string &file, std::string &why) {
+  file_ = file;
+
+  auto snapshot = std::make_unique<SnapshotReader>();
+  std::string ignored;
+  if (snapshot->open(file, ignored)) {
+    snapshot_ = std::move(snapshot);
+    if (snapshot_->root() != kSnapNone) {
+      stack_.emplace_back();
+      if (!snapshot_->read(snapshot_->root(), stack_.back().listing)) {
+        why = "Damaged snapshot: " + file;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  fd_ = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) {
+    why = "Could not open " + file + ": " + std::strerror(errno);
+    return false;
+  }
+  buffer_.resize(kReadBuffer);
+
+  // The header row (after the UTF-8 BOM) identifies an etree export
+  std::string_view header;
+  bool ok = readLine(header);
+  if (ok && header.rfind("\xEF\xBB\xBF", 0) == 0)
+    header.remove_prefix(3);
+  if (!ok || header.rfind("Relative Path\t", 0) != 0) {
+    why = file + " is neither an etree TSV export nor a snapshot";
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Read the next row and check that the rows are in tree order
+ *
+ * @param row Receives the row
+ * @return false at the end of the input or on error (see error())
+ */
+bool ExportReader::next(DiffRow &row) {
+  if (!(snapshot_ ? nextSnapshot(row) : nextTsv(row)))
+    return false;
+  if (started_ && comparePaths(previous_, row.path) >= 0) {
+    error_ = file_ + " is not in tree order at '" + row.path + "'";
+    return false;
+  }
+  previous_ = row.path;
+  started_ = true;
+  return true;
+}
+
+/**
+ * @brief Return the next line of the TSV file (without its line break)
+ *
+ * The view stays valid until the next call.
+ */
+bool ExportReader::readLine(std::string_view &line) {
+  for (;;) {
+    char *data = buffer_.data();
+    if (const void *nl = std::memchr(data + begin_, '\n', end_ - begin_)) {
+      const size_t stop = static_cast<const char *>(nl) - data;
+      line = std::string_view(data + begin_, stop - begin_);
+      begin_ = stop + 1;
+      break;
+    }
+    if (eof_) {
+      if (begin_ == end_)
+        return false;
+      line = std::string_view(data + begin_, end_ - begin_);
+      begin_ = end_;
+      break;
+    }
+
+    // Keep the partial line, then read more behind it
+    if (begin_ > 0) {
+      std::memmove(data, data + begin_, end_ - begin_);
+      end_ -= begin_;
+      begin_ = 0;
+    }
+    if (end_ == buffer_.size())
+      buffer_.resize(buffer_.size() * 2);
+    ssize_t n = read(fd_, buffer_.data() + end_, buffer_.size() - end_);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      error_ = "Could not read " + file_ + ": " + std::strerror(errno);
+      return false;
+    }
+    if (n == 0)
+      eof_ = true;
+    end_ += static_cast<size_t>(n);
+  }
+
+  ++lineNumber_;
+  if (!line.empty() && line.back() == '\r')
+    line.remove_suffix(1);
+  return true;
+}
+
+/**
+ * @brief Parse the next data row of a TSV export
+ */
+bool ExportReader::nextTsv(DiffRow &row) {
+  std::string_view line;
+  do {
+    if (!readLine(line))
+      return false;
+  } while (line.empty());
+
+  std::string_view fields[kTsvColumns];
+  size_t count = 0;
+  while (count < kTsvColumns) {
+    size_t tab = line.find('\t');
+    fields[count++] = line.substr(0, tab);
+    if (tab == std::string_view::npos)
+      break;
+    line.remove_prefix(tab + 1);
+  }
+  uint64_t size = 0;
+  const std::string_view &sizeText = fields[3];
+  if (count < kTsvColumns ||
+      std::from_chars(sizeText.data(), sizeText.data() + sizeText.size(), size)
+              .ec != std::errc()) {
+    error_ = file_ + ":" + std::to_string(lineNumber_) +
+             ": not an etree export row";
+    return false;
+  }
+
+  row.path.assign(fields[0]);
+  row.isDir = fields[2] == "folder";
+  row.size = size;
+  row.modified.assign(fields[5]);
+  row.perms.assign(fields[6]);
+  return true;
+}
+
+/**
+ * @brief Return the next entry of a snapshot, depth-first
+ */
+bool ExportReader::nextSnapshot(DiffRow &row) {
+  while (!stack_.empty()) {
+    Frame &top = stack_.back();
+    if (top.next == top.listing.entries.size()) {
+      stack_.pop_back();
+      if (!stack_.empty())
+        path_.resize(stack_.back().pathLength);
+      continue;
+    }
+    const WalkEntry &e = top.listing.entries[top.next++];
+
+    path_.resize(top.pathLength);
+    if (!path_.empty())
+      path_ += '/';
+    path_ += e.name;
+
+    row.path = path_;
+    row.isDir = e.isDir;
+    row.size = e.isDir ? 0 : e.meta.size;
+    row.modified.clear();
+    row.perms = "-";
+    if (e.meta.valid) {
+      char digits[24];
+      auto end = std::to_chars(digits, digits + sizeof(digits), e.meta.mtime);
+      row.modified.assign(digits, end.ptr);
+      row.perms = permissionsString(e.meta.mode);
+    }
+
+    // Descend: the subdirectory's entries come next
+    if (e.isDir && e.snapDir != kSnapNone) {
+      const uint32_t child = e.snapDir;
+      stack_.emplace_back();
+      stack_.back().pathLength = path_.size();
+      if (!snapshot_->read(child, stack_.back().listing)) {
+        error_ = "Damaged snapshot: " + file_;
+        return false;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @class DiffPrinter
+ * @brief Writes the change lines, rollups and summary of a comparison
+ */
+class DiffPrinter {
+public:
+  DiffPrinter(OutputWriter &out, bool colors) : out_(out), colors_(colors) {
+    open_.push_back({std::string(), 0});
+  }
+
+  /// Close the directories that path is not inside of
+  void enter(const std::string &path) {
+    while (open_.size() > 1 && !isInside(path, open_.back().path))
+      closeDir();
+  }
+
+  /// Open a directory row, so its contents roll up into it
+  void push(const std::string &path) { open_.push_back({path, 0}); }
+
+  void added(const DiffRow &row) {
+    ++added_;
+    line('+', row);
+    if (!row.isDir)
+      bracket(formatSizeBytes(row.size));
+    out_.endLine();
+    open_.back().delta += static_cast<int64_t>(row.size);
+  }
+
+  void removed(const DiffRow &row) {
+    ++removed_;
+    line('-', row);
+    if (!row.isDir)
+      bracket(formatSizeBytes(row.size));
+    out_.endLine();
+    open_.back().delta -= static_cast<int64_t>(row.size);
+  }
+
+  void resized(const DiffRow &before, const DiffRow &after) {
+    ++resized_;
+    line('~', after);
+    bracket(formatSizeBytes(before.size) + " -> " +
+            formatSizeBytes(after.size));
+    out_.endLine();
+    open_.back().delta += static_cast<int64_t>(after.size) -
+                          static_cast<int64_t>(before.size);
+  }
+
+  void modified(const DiffRow &row) {
+    ++modified_;
+    line('~', row);
+    out_.endLine();
+  }
+
+  /// Close every directory and print the summary
+  void finish() {
+    while (open_.size() > 1)
+      closeDir();
+    out_.write("\nThe diff counts ");
+    out_.writeNumber(added_);
+    out_.write(" added, ");
+    out_.writeNumber(removed_);
+    out_.write(" removed, ");
+    out_.writeNumber(resized_);
+    out_.write(" resized and ");
+    out_.writeNumber(modified_);
+    out_.write(" modified entries, size change ");
+    out_.write(signedSize(open_.back().delta));
+    out_.put('.');
+    out_.endLine();
+  }
+
+private:
+  /// A directory whose contents are being compared
+  struct OpenDir {
+    std::string path;
+    int64_t delta; ///< Net size change below it so far
+  };
+
+  static std::string signedSize(int64_t delta) {
+    const uint64_t magnitude =
+        delta < 0 ? 0 - static_cast<uint64_t>(delta) : delta;
+    return (delta < 0 ? "-" : "+") + formatSizeBytes(magnitude);
+  }
+
+  void closeDir() {
+    OpenDir dir = std::move(open_.back());
+    open_.pop_back();
+    open_.back().delta += dir.delta;
+    if (dir.delta == 0)
+      return;
+    out_.write("= ");
+    if (colors_)
+      out_.write(dircolor);
+    out_.write(dir.path);
+    out_.put('/');
+    if (colors_)
+      out_.write(resetcolor);
+    bracket(signedSize(dir.delta));
+    out_.endLine();
+  }
+
+  void line(char kind, const DiffRow &row) {
+    out_.put(kind);
+    out_.put(' ');
+    if (colors_)
+      out_.write(row.isDir ? dircolor : filecolor);
+    out_.write(row.path);
+    if (row.isDir)
+      out_.put('/');
+    if (colors_)
+      out_.write(resetcolor);
+  }
+
+  void bracket(const std::string &text) {
+    if (colors_)
+      out_.write(sizecolor);
+    out_.write(" [");
+    out_.write(text);
+    out_.put(']');
+    if (colors_)
+      out_.write(resetcolor);
+  }
+
+  OutputWriter &out_;
+  bool colors_;
+  std::vector<OpenDir> open_; ///< Root first, innermost directory last
+  uintmax_t added_ = 0;
+  uintmax_t removed_ = 0;
+  uintmax_t resized_ = 0;
+  uintmax_t modified_ = 0;
+};
+
+} // namespace
+
+/**
+ * @brief Compare two exports or snapshots and print the differences
+ *
+ * Both inputs are first read through to check that they are in tree
+ * order, so an unordered or damaged input is refused before any change
+ * is printed.
+ *
+ * Modification times are only compared between inputs of the same kind
+ * (TSV text and snapshot nanoseconds differ in form), and for files only:
+ * a directory's time changes with every entry added or removed in it.
+ *
+ * @param oldFile Earlier export (TSV or snapshot)
+ * @param newFile Later export (TSV or snapshot)
+ * @param out Output sink
+ * @param colors Whether colored output is enabled
+ * @return Process exit code
+ */
+int diffExports(const std::string &oldFile, const std::string &newFile,
+                OutputWriter &out, bool colors) {
+  // Read each input through once before printing anything: a row out of
+  // tree order would otherwise show up only after the merge had already
+  // reported changes it misread from the rows before it
+  std::string why;
+  for (const std::string *file : {&oldFile, &newFile}) {
+    ExportReader check;
+    if (!check.open(*file, why)) {
+      std::cerr << "Error: " << why << std::endl;
+      return 1;
+    }
+    DiffRow row;
+    while (check.next(row)) {
+    }
+    if (!check.error().empty()) {
+      std::cerr << "Error: " << check.error() << std::endl;
+      return 1;
+    }
+  }
+
+  ExportReader oldRows, newRows;
+  if (!oldRows.open(oldFile, why) || !newRows.open(newFile, why)) {
+    std::cerr << "Error: " << why << std::endl;
+    return 1;
+  }
+  const bool compareTimes = oldRows.isSnapshot() == newRows.isSnapshot();
+
+  DiffPrinter printer(out, colors);
+  DiffRow a, b;
+  bool haveOld = oldRows.next(a);
+  bool haveNew = newRows.next(b);
+  while (haveOld || haveNew) {
+    const int order = !haveOld   ? 1
+                      : !haveNew ? -1
+                                 : comparePaths(a.path, b.path);
+    const DiffRow &row = order <= 0 ? a : b;
+    printer.enter(row.path);
+
+    if (order < 0) {
+      printer.removed(a);
+    } else if (order > 0) {
+      printer.added(b);
+    } else if (a.isDir != b.isDir) {
+      printer.removed(a);
+      printer.added(b);
+    } else if (!a.isDir && a.size != b.size) {
+      printer.resized(a, b);
+    } else if (a.perms != b.perms ||
+               (compareTimes && !a.isDir && !a.modified.empty() &&
+                !b.modified.empty() && a.modified != b.modified)) {
+      printer.modified(b);
+    }
+
+    if (row.isDir || (order == 0 && b.isDir))
+      printer.push(row.path);
+
+    if (order <= 0)
+      haveOld = oldRows.next(a);
+    if (order >= 0)
+      haveNew = newRows.next(b);
+
+    // An input that changed since it was checked ends the comparison
+    for (const ExportReader *reader : {&oldRows, &newRows}) {
+      if (!reader->error().empty()) {
+        out.flush();
+        std::cerr << "Error: " << reader->error() << std::endl;
+        return 1;
+      }
+    }
+  }
+  printer.finish();
+  return 0;
+}
+
+#endif
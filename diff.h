@@ -0,0 +1,50 @@
+/**
+ * @file diff.h
+ * @brief Comparison of two tree exports for eTree (--diff OLD NEW)
+ *
+ * Both inputs are read as streams of rows in printTree order: depth-first,
+ * each directory's contents right after it, names in byte order. A TSV
+ * export (-o *.tsv) is read line by line and a snapshot (--snapshot) is
+ * walked through its mapping, so two inputs of any size are compared in
+ * one merge pass with memory bounded by the tree depth, not its size.
+ * Each input is read through once beforehand to check its order, so an
+ * input that is not in tree order (an export made with --sort) is
+ * refused before anything is printed. The two inputs may be of
+ * different kinds.
+ *
+ * Output (one line per changed entry, in tree order):
+ *   + path [size]         entry only in NEW
+ *   - path [size]         entry only in OLD
+ *   ~ path [old -> new]   file resized
+ *   ~ path                same size, but modified time or permissions
+ *                         differ
+ *   = dir/ [+delta]       net size change below a directory, printed
+ *                         after its contents when it is not zero
+ * followed by a summary with the counts and the total size change.
+ */
+
+#ifndef DIFF_H
+#define DIFF_H
+
+#ifndef _WIN32
+
+#include <string>
+
+class OutputWriter;
+
+/**
+ * @brief Compare two exports or snapshots and print the differences
+ *
+ * @param oldFile Earlier export (TSV or snapshot)
+ * @param newFile Later export (TSV or snapshot)
+ * @param out Output sink
+ * @param colors Whether colored output is enabled
+ * @return Process exit code (1 if an input cannot be read or is not in
+ *         tree order)
+ */
+int diffExports(const std::string &oldFile, const std::string &newFile,
+                OutputWriter &out, bool colors);
+
+#endif
+
+#endif
@@ -0,0 +1,236 @@
+/**
+ * @file dirstream.cpp
+ * @brief Raw getdents64 directory reader implementation for Linux
+ *
+ * The reader calls getdents64 through syscall() so that it does not depend
+ * on the glibc wrapper (only available since glibc 2.30), and walks the
+ * returned linux_dirent64 records in place.
+ */
+
+#include "dirstream.h"
+
+#ifdef __linux__
+
+#include <cstdint>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+/// Size of each getdents64 buffer (many entries per system call)
+constexpr size_t kBufferSize = 128 * 1024;
+
+/// Most idle buffers a thread keeps; a deep descent that frees many at
+/// once gives the rest back to the allocator
+constexpr size_t kPoolSize = 8;
+
+/**
+ * @struct LinuxDirent64
+ * @brief Record layout returned by the getdents64 system call
+ */
+struct LinuxDirent64 {
+  uint64_t d_ino;           ///< Inode number
+  int64_t d_off;            ///< Offset to the next record
+  unsigned short d_reclen;  ///< Length of this record
+  unsigned char d_type;     ///< File type
+  char d_name[1];           ///< NUL-terminated filename
+};
+
+/**
+ * @brief Per-thread free list of read buffers
+ *
+ * Directories are opened and closed at a high rate; recycling the buffers
+ * avoids a large allocation (often an mmap/munmap pair) per directory.
+ */
+std::vector<std::unique_ptr<char[]>> &bufferPool() {
+  static thread_local std::vector<std::unique_ptr<char[]>> pool;
+  return pool;
+}
+
+/**
+ * @brief Take a read buffer from the thread's pool, or allocate one
+ */
+std::unique_ptr<char[]> takeBuffer() {
+  auto &pool = bufferPool();
+  if (pool.empty())
+    return std::unique_ptr<char[]>(new char[kBufferSize]);
+  std::unique_ptr<char[]> buffer = std::move(pool.back());
+  pool.pop_back();
+  return buffer;
+}
+
+/**
+ * @brief Give a read buffer back to the thread's pool (freed if full)
+ */
+void giveBuffer(std::unique_ptr<char[]> buffer) {
+  auto &pool = bufferPool();
+  if (pool.size() < kPoolSize)
+    pool.push_back(std::move(buffer));
+}
+
+} // namespace
+
+/**
+ * @brief Open a directory for reading
+ *
+ * @param dir Directory path
+ */
+DirStream::DirStream(const std::filesystem::path &dir)
+    : DirStream(AT_FDCWD, dir.c_str()) {}
+
+/**
+ * @brief Open a directory relative to another one
+ *
+ * @param at Descriptor of the directory path starts from (or AT_FDCWD)
+ * @param path Directory path relative to at
+ */
+DirStream::DirStream(int at, const char *path) { open(at, path); }
+
+/**
+ * @brief Close the directory and recycle the read buffer
+ */
+DirStream::~DirStream() { suspend(); }
+
+/**
+ * @brief Open the directory and take a read buffer
+ *
+ * @param at Descriptor of the directory path starts from (or AT_FDCWD)
+ * @param path Directory path relative to at
+ */
+void DirStream::open(int at, const char *path) {
+  fd_ = openat(at, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd_ < 0) {
+    error_ = errno;
+    return;
+  }
+  buffer_ = takeBuffer();
+  used_ = pos_ = 0;
+}
+
+/**
+ * @brief Close the directory, remembering where to resume()
+ */
+void DirStream::suspend() {
+  if (fd_ >= 0)
+    close(fd_);
+  fd_ = -1;
+  if (buffer_)
+    giveBuffer(std::move(buffer_));
+}
+
+/**
+ * @brief Reopen a suspended directory after the last entry returned
+ *
+ * @param at Descriptor of the directory path starts from (or AT_FDCWD)
+ * @param path Directory path relative to at
+ * @return false (with error() set) if it cannot be reopened
+ */
+bool DirStream::resume(int at, const char *path) {
+  error_ = 0;
+  open(at, path);
+  if (fd_ >= 0 && lseek(fd_, static_cast<off_t>(offset_), SEEK_SET) < 0) {
+    error_ = errno;
+    suspend();
+  }
+  return fd_ >= 0;
+}
+
+/**
+ * @brief Advance to the next entry, refilling the buffer as needed
+ *
+ * @param entry Receives the next entry
+ * @return true if an entry was produced, false at end or on error
+ */
+bool DirStream::next(DirStreamEntry &entry) {
+  if (fd_ < 0)
+    return false;
+
+  for (;;) {
+    // Refill the buffer once all records have been consumed
+    if (pos_ >= used_) {
+      long n = syscall(SYS_getdents64, fd_, buffer_.get(), kBufferSize);
+      if (n < 0) {
+        error_ = errno;
+        return false;
+      }
+      if (n == 0)
+        return false; // End of directory
+      used_ = static_cast<size_t>(n);
+      pos_ = 0;
+    }
+
+    auto *d = reinterpret_cast<LinuxDirent64 *>(buffer_.get() + pos_);
+    pos_ += d->d_reclen;
+    offset_ = d->d_off;
+
+    // Skip the "." and ".." pseudo-entries
+    const char *name = d->d_name;
+    if (name[0] == '.' &&
+        (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+      continue;
+
+    entry.name = name;
+    entry.length = std::strlen(name);
+    entry.type = d->d_type;
+    return true;
+  }
+}
+
+/**
+ * @brief Check if an entry is a directory (following symlinks)
+ *
+ * @param entry Entry returned by next()
+ * @return true if the entry is or links to a directory
+ */
+bool DirStream::isDirectory(const DirStreamEntry &entry) const {
+  if (entry.type == DT_DIR)
+    return true;
+  if (entry.type != DT_UNKNOWN && entry.type != DT_LNK)
+    return false;
+
+  // d_type is not conclusive: ask the file system, following symlinks
+  struct stat st;
+  if (fstatat(fd_, entry.name, &st, 0) != 0)
+    return false; // Dangling symlink or vanished entry
+  return S_ISDIR(st.st_mode);
+}
+
+/**
+ * @brief Close the anchor's descriptor
+ */
+DirAnchor::~DirAnchor() {
+  if (fd >= 0)
+    close(fd);
+}
+
+/**
+ * @brief Descriptor a walk path is opened from (AT_FDCWD without anchor)
+ */
+int DirAnchor::at(const DirAnchor *anchor) {
+  return anchor ? anchor->fd : AT_FDCWD;
+}
+
+/**
+ * @brief Open a directory as an anchor for the paths below it
+ *
+ * @param from Anchor above the directory (may be null)
+ * @param path Walk path of the directory
+ * @return New anchor, or from if the directory cannot be opened
+ */
+DirAnchor::Ptr DirAnchor::open(const Ptr &from, const std::string &path) {
+  const int fd = openat(at(from.get()), relative(from.get(), path),
+                        O_PATH | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    return from;
+  auto anchor = std::make_shared<DirAnchor>();
+  anchor->fd = fd;
+  anchor->length = path.size() + (path.back() == '/' ? 0 : 1);
+  return anchor;
+}
+
+#endif
@@ -0,0 +1,181 @@
+/**
+ * @file dirstream.h
+ * @brief Raw getdents64 directory reader for Linux
+ *
+ * This header declares DirStream, a thin directory reader built directly on
+ * the getdents64 system call. Compared to std::filesystem::directory_iterator
+ * it does not build a directory_entry/path object per child, reads many
+ * entries per system call through a large reusable buffer, and classifies
+ * entries from d_type so that listing names needs no per-file stat.
+ *
+ * Paths longer than PATH_MAX cannot be opened whole, so deep directories
+ * are opened relative to a DirAnchor, an open ancestor a little above
+ * them.
+ *
+ * Only available on Linux; other platforms keep using
+ * std::filesystem::directory_iterator.
+ */
+
+#ifndef DIRSTREAM_H
+#define DIRSTREAM_H
+
+#ifdef __linux__
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+/**
+ * @struct DirStreamEntry
+ * @brief One raw directory entry, valid until the next DirStream::next()
+ */
+struct DirStreamEntry {
+  const char *name = nullptr; ///< NUL-terminated name inside the read buffer
+  size_t length = 0;          ///< Length of name in bytes
+  unsigned char type = 0;     ///< d_type (DT_DIR, DT_REG, DT_LNK, ...)
+};
+
+/**
+ * @class DirStream
+ * @brief Sequential reader over one open directory
+ *
+ * Read buffers are recycled per thread, so opening a directory costs no
+ * heap allocation once a thread has warmed up. "." and ".." are skipped.
+ * A stream can be suspended to give back its descriptor and buffer while
+ * deeper directories are read, and resumed after the last entry it
+ * returned.
+ */
+class DirStream {
+public:
+  /**
+   * @brief Open a directory for reading
+   * @param dir Directory path
+   */
+  explicit DirStream(const std::filesystem::path &dir);
+
+  /**
+   * @brief Open a directory relative to another one (openat())
+   * @param at Descriptor of the directory path starts from (or AT_FDCWD)
+   * @param path Directory path relative to at
+   */
+  DirStream(int at, const char *path);
+
+  /**
+   * @brief Close the directory and give the buffer back to the thread pool
+   */
+  ~DirStream();
+
+  DirStream(const DirStream &) = delete;
+  DirStream &operator=(const DirStream &) = delete;
+
+  /**
+   * @brief errno of the last failed operation (0 if none)
+   */
+  int error() const { return error_; }
+
+  /**
+   * @brief Directory file descriptor (-1 if the open failed)
+   */
+  int fd() const { return fd_; }
+
+  /**
+   * @brief Advance to the next entry
+   *
+   * @param entry Receives the next entry
+   * @return true if an entry was produced, false at end or on error
+   */
+  bool next(DirStreamEntry &entry);
+
+  /**
+   * @brief Check if an entry is a directory (following symlinks)
+   *
+   * Uses d_type when it is conclusive. Only DT_UNKNOWN entries (file
+   * systems that do not fill d_type) and symlinks, whose target type is
+   * unknown, cost an fstatat() relative to the open directory.
+   *
+   * @param entry Entry returned by next()
+   * @return true if the entry is or links to a directory
+   */
+  bool isDirectory(const DirStreamEntry &entry) const;
+
+  /**
+   * @brief Close the directory, remembering where to resume()
+   *
+   * Records read ahead but not yet returned are dropped; they are read
+   * again after resume().
+   */
+  void suspend();
+
+  /**
+   * @brief Reopen a suspended directory after the last entry returned
+   *
+   * @param at Descriptor of the directory path starts from (or AT_FDCWD)
+   * @param path Directory path relative to at
+   * @return false (with error() set) if it cannot be reopened
+   */
+  bool resume(int at, const char *path);
+
+private:
+  void open(int at, const char *path);
+
+  int fd_ = -1;
+  int error_ = 0;
+  std::unique_ptr<char[]> buffer_; ///< getdents64 buffer (thread recycled)
+  size_t used_ = 0;                ///< Bytes returned by the last read
+  size_t pos_ = 0;                 ///< Offset of the next record
+  int64_t offset_ = 0;             ///< d_off of the last record consumed
+};
+
+/**
+ * @struct DirAnchor
+ * @brief Open directory that deeper walk paths are opened relative to
+ *
+ * The walker opens a directory as an anchor once the part of its path
+ * below the previous anchor exceeds kSpan bytes, so the path a listing
+ * opens relative to its anchor always stays well below PATH_MAX. Jobs
+ * share the anchor above them; it is closed with the last of them.
+ */
+struct DirAnchor {
+  using Ptr = std::shared_ptr<const DirAnchor>;
+
+  /// Most bytes of path below an anchor before the next one is opened
+  static constexpr size_t kSpan = 2048;
+
+  int fd = -1;       ///< O_PATH descriptor of the directory
+  size_t length = 0; ///< Bytes of the walk path up to and including the
+                     ///< separator after the directory
+
+  DirAnchor() = default;
+  ~DirAnchor();
+  DirAnchor(const DirAnchor &) = delete;
+  DirAnchor &operator=(const DirAnchor &) = delete;
+
+  /**
+   * @brief Descriptor a walk path is opened from (AT_FDCWD without anchor)
+   */
+  static int at(const DirAnchor *anchor);
+
+  /**
+   * @brief Part of a walk path below an anchor (the whole path without)
+   */
+  static const char *relative(const DirAnchor *anchor,
+                              const std::string &path) {
+    return anchor ? path.c_str() + anchor->length : path.c_str();
+  }
+
+  /**
+   * @brief Open a directory as an anchor for the paths below it
+   *
+   * @param from Anchor above the directory (may be null)
+   * @param path Walk path of the directory
+   * @return New anchor, or from if the directory cannot be opened (paths
+   *         below it then fail to open as they would without anchors)
+   */
+  static Ptr open(const Ptr &from, const std::string &path);
+};
+
+#endif
+
+#endif
@@ -0,0 +1,163 @@
+/**
+ * @file du.cpp
+ * @brief Disk usage rollup implementation for eTree
+ *
+ * The listing threads do the per-file additions (tallyUsage()); the
+ * rendering thread only visits folders and hard-linked files, which keeps
+ * its pass and its (device, inode) set small even on large trees.
+ */
+
+#include "du.h"
+
+#ifndef _WIN32
+
+#include "args.h"
+#include "etree.h"
+#include "format.h"
+#include "output.h"
+#include "walker.h"
+#include <fcntl.h>
+
+/**
+ * @brief Add a listing's files to its own totals (listing thread)
+ *
+ * @param listing Listing whose entries have their metadata
+ * @param first First entry not tallied yet
+ */
+void tallyUsage(DirListing &listing, size_t first) {
+  for (size_t i = first; i < listing.entries.size(); ++i) {
+    const WalkEntry &e = listing.entries[i];
+    if (e.isDir)
+      continue;
+    if (e.meta.valid && e.meta.links > 1) {
+      // Counted once by DiskUsage::sum(), wherever it is seen first
+      listing.linked.push_back(
+          {{e.meta.dev, e.meta.ino}, e.meta.size, e.meta.allocated});
+      continue;
+    }
+    listing.usage.add(e.meta);
+    listing.usage.files++;
+  }
+}
+
+/**
+ * @brief Fill DirJob::usage of the root and of every folder below it
+ *
+ * The root folder itself is counted too, like du does.
+ *
+ * @param walker Listing producer
+ * @param root Job of the walk root
+ */
+void DiskUsage::sum(TreeWalker &walker, DirJob &root) {
+  FileMeta self;
+  fetchMeta(AT_FDCWD, root.path.c_str(), META_SIZE | META_USAGE, self);
+  first(self);
+  root.usage = DuTotals();
+  root.usage.add(self);
+  sumTree(walker, root);
+}
+
+/**
+ * @brief Whether an entry is seen for the first time (by device, inode)
+ *
+ * Entries whose metadata could not be read always count.
+ */
+bool DiskUsage::first(const FileMeta &meta) {
+  return !meta.valid || seen_.back().insert(FileId{meta.dev, meta.ino}).second;
+}
+
+/**
+ * @brief Add every folder's contents to its totals, subfolders first
+ *
+ * Each job's usage already holds the folder itself. A folder seen before
+ * (a bind mount or a symlink to a folder elsewhere in the tree) is summed
+ * with a set of its own, so its line shows everything it holds, but it
+ * adds nothing to its parent's totals.
+ *
+ * @param walker Listing producer
+ * @param root Folder to sum
+ */
+void DiskUsage::sumTree(TreeWalker &walker, DirJob &root) {
+  /// A folder being summed and where its listing is up to
+  struct Frame {
+    DirJob *job = nullptr;
+    size_t entry = 0;     ///< Next entry of the listing
+    size_t child = 0;     ///< Next subfolder job
+    bool counted = false; ///< Whether it adds to its parent's totals
+  };
+  std::vector<Frame> stack;
+
+  // Take a folder's own files and push it; one seen before gets a new set
+  auto open = [&](DirJob &job, bool counted) {
+    if (!counted)
+      seen_.emplace_back();
+    const DirListing &listing = walker.acquire(job);
+    DuTotals &total = job.usage;
+    total.add(listing.usage);
+    for (const LinkedFile &f : listing.linked) {
+      if (seen_.back().insert(f.id).second) {
+        total.apparent += f.apparent;
+        total.allocated += f.allocated;
+        total.files++;
+      }
+    }
+    stack.push_back({&job, 0, 0, counted});
+  };
+
+  open(root, true);
+  while (!stack.empty()) {
+    Frame &f = stack.back();
+    DirJob &job = *f.job;
+    const std::vector<WalkEntry> &entries = job.listing.entries;
+    DirJob *sub = nullptr;
+    bool counted = false;
+    while (!sub && f.entry < entries.size()) {
+      const WalkEntry &e = entries[f.entry++];
+      if (!e.isDir)
+        continue;
+      counted = first(e.meta);
+      DuTotals folder;
+      folder.add(e.meta);
+      if (f.child < job.children.size()) {
+        sub = job.children[f.child++].get();
+        sub->usage = folder;
+      } else if (counted) {
+        job.usage.add(folder);
+      }
+    }
+    if (sub) {
+      open(*sub, counted);
+      continue;
+    }
+
+    // Folder done: add it to its parent and leave its set
+    const bool done = f.counted;
+    stack.pop_back();
+    if (!done)
+      seen_.pop_back();
+    else if (!stack.empty())
+      stack.back().job->usage.add(job.usage);
+
+    // Below the depth limit nothing is printed: free the listing now
+    if (args_.maxLevel > 0 && job.level > args_.maxLevel)
+      walker.release(job);
+  }
+}
+
+/**
+ * @brief Write a folder's totals: "apparent, allocated on disk, N files"
+ *
+ * @param out Output sink
+ * @param usage Totals of the folder
+ */
+void writeUsage(OutputWriter &out, const DuTotals &usage) {
+  writeSize(out, usage.apparent);
+  out.write(", ");
+  writeSize(out, usage.allocated);
+  out.write(" on disk, ");
+  char *p = out.reserve(kMaxNumberText);
+  out.commit(formatInt(usage.files, p));
+  out.write(usage.files == 1 ? " file" : " files");
+}
+
+#endif
@@ -0,0 +1,160 @@
+/**
+ * @file du.h
+ * @brief Disk usage rollups for eTree (--du, Unix/Linux)
+ *
+ * With --du every folder line shows what its whole subtree holds: the
+ * apparent size (sum of st_size, like du --apparent-size), the space
+ * allocated on disk (st_blocks * 512, like du) and the number of files.
+ *
+ * The work is split along the walk:
+ * - The thread that lists a directory adds its files into the listing's
+ *   own DuTotals (tallyUsage()), so the bulk of the entries is summed on
+ *   the -j workers, each into its own listing, with no shared counter
+ * - Files with more than one hard link are only noted in the listing
+ * - One post-order pass on the rendering thread (DiskUsage::sum()) adds
+ *   every subdirectory's totals into its parent, and counts each noted
+ *   file and each directory once by (device, inode), where a depth-first
+ *   walk taking each folder's files before its subfolders meets it first,
+ *   so the totals do not depend on -j
+ *
+ * A folder's totals include the folder itself and everything the filters
+ * keep below it (-a, -I, -P, --gitignore); -l only limits the lines that
+ * are printed, not what is counted. Like du, a symlink is counted as the
+ * link itself and never followed, so links to folders are not descended.
+ */
+
+#ifndef DU_H
+#define DU_H
+
+#ifndef _WIN32
+
+#include "meta.h"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
+struct Args;
+struct DirJob;
+struct DirListing;
+class OutputWriter;
+class TreeWalker;
+
+/**
+ * @struct DuTotals
+ * @brief Sizes and file count of a set of entries
+ */
+struct DuTotals {
+  uint64_t apparent = 0;  ///< Sum of the sizes in bytes
+  uint64_t allocated = 0; ///< Sum of the bytes allocated on disk
+  uint64_t files = 0;     ///< Number of files (each inode once)
+
+  /**
+   * @brief Add the sizes of one entry (a file or a folder itself)
+   */
+  void add(const FileMeta &meta) {
+    if (meta.valid) {
+      apparent += meta.size;
+      allocated += meta.allocated;
+    }
+  }
+
+  /**
+   * @brief Add another set of totals
+   */
+  void add(const DuTotals &other) {
+    apparent += other.apparent;
+    allocated += other.allocated;
+    files += other.files;
+  }
+};
+
+/**
+ * @struct FileId
+ * @brief Identity of a file on the system: device and inode number
+ */
+struct FileId {
+  uint64_t dev = 0;
+  uint64_t ino = 0;
+
+  bool operator==(const FileId &o) const {
+    return dev == o.dev && ino == o.ino;
+  }
+};
+
+/**
+ * @struct LinkedFile
+ * @brief A file with several hard links, left for DiskUsage::sum()
+ */
+struct LinkedFile {
+  FileId id;              ///< Identity shared by all its links
+  uint64_t apparent = 0;  ///< Size in bytes
+  uint64_t allocated = 0; ///< Bytes allocated on disk
+};
+
+/**
+ * @brief Add a listing's files to its own totals (listing thread)
+ *
+ * Files with one link go into listing.usage, files with several into
+ * listing.linked; folders are left to DiskUsage::sum(). Called by
+ * listDirectory() before -d drops the files, and before --mem-limit moves
+ * them out of the listing.
+ *
+ * @param listing Listing whose entries have their metadata
+ * @param first First entry not tallied yet
+ */
+void tallyUsage(DirListing &listing, size_t first = 0);
+
+/**
+ * @class DiskUsage
+ * @brief Post-order rollup of the --du totals (rendering thread)
+ */
+class DiskUsage {
+public:
+  /**
+   * @brief Start with no file seen
+   * @param args Command-line arguments (depth limit)
+   */
+  explicit DiskUsage(const Args &args) : args_(args), seen_(1) {}
+
+  /**
+   * @brief Fill DirJob::usage of the root and of every folder below it
+   *
+   * Lists the whole subtree through the walker, keeping the folders being
+   * summed on a heap stack rather than recursing. Listings below the depth
+   * limit are released as soon as they are counted, since they are never
+   * printed; the others stay for the renderer.
+   *
+   * @param walker Listing producer
+   * @param root Job of the walk root
+   */
+  void sum(TreeWalker &walker, DirJob &root);
+
+private:
+  struct FileIdHash {
+    size_t operator()(const FileId &id) const {
+      return static_cast<size_t>(id.ino * 0x9E3779B97F4A7C15ull ^ id.dev);
+    }
+  };
+
+  using FileSet = std::unordered_set<FileId, FileIdHash>;
+
+  void sumTree(TreeWalker &walker, DirJob &root);
+  bool first(const FileMeta &meta);
+
+  const Args &args_;
+  /// Folders and linked files seen, one set per folder seen twice being
+  /// summed (the innermost last)
+  std::vector<FileSet> seen_;
+};
+
+/**
+ * @brief Write a folder's totals: "apparent, allocated on disk, N files"
+ * @param out Output sink
+ * @param usage Totals of the folder
+ */
+void writeUsage(OutputWriter &out, const DuTotals &usage);
+
+#endif
+
+#endif
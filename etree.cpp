@@ -1,851 +1,1928 @@
-﻿/**
- * @file etree.cpp
- * @brief Core directory tree traversal and display implementation for eTree
- *
- * This file implements the main tree traversal logic, including:
- * - Recursive directory traversal with depth limiting
- * - File filtering (hidden files, exclude patterns, directories-only)
- * - RTL (Right-to-Left) text handling for Arabic/Hebrew filenames
- * - Colored console output with ANSI escape codes
- * - File metadata retrieval (size, permissions, timestamps)
- * - CSV data collection for export
- * - Platform-specific implementations for Windows and Unix/Linux
- *
- * The implementation is split into Windows (_WIN32) and Unix/Linux sections
- * to handle platform-specific differences in:
- * - Character encoding (UTF-16 vs UTF-8)
- * - File permissions (Windows attributes vs Unix modes)
- * - Hidden file detection
- * - Console detection
- */
-
-#include "etree.h"
-#include "args.h"
-#include <algorithm>
-#include <chrono>
-#include <iostream>
-#include <locale>
-#include <regex>
-#include <sstream>
-
-
-#ifdef _WIN32
-#include <fcntl.h>
-#include <io.h>
-#include <windows.h>
-
-// Undefine Windows macros that conflict with std::max/min
-#undef max
-#undef min
-
-// ANSI color escape sequences for Windows console output
-const wchar_t *dircolor = L"\033[1;34m";  // Bold blue for directories
-const wchar_t *filecolor = L"\033[0;32m"; // Green for files
-const wchar_t *permcolor = L"\033[0;36m"; // Cyan for permissions
-const wchar_t *sizecolor = L"\033[0;33m"; // Yellow for file sizes
-const wchar_t *resetcolor = L"\033[0m";   // Reset to default color
-
-#else
-#include <unistd.h>
-
-// ANSI color escape sequences for Unix/Linux console output
-const char *dircolor = "\033[1;34m";  // Bold blue for directories
-const char *filecolor = "\033[0;32m"; // Green for files
-const char *permcolor = "\033[0;36m"; // Cyan for permissions
-const char *sizecolor = "\033[0;33m"; // Yellow for file sizes
-const char *resetcolor = "\033[0m";   // Reset to default color
-#endif
-
-// Filesystem namespace alias for convenience
-namespace fs = std::filesystem;
-
-//=============================================================================
-// Windows-specific helper functions
-//=============================================================================
-#ifdef _WIN32
-
-/**
- * @brief Detect if running in Windows Terminal
- *
- * Windows Terminal sets environment variables that we can check to determine
- * if we're running in a modern terminal that supports ANSI colors.
- *
- * @return true if Windows Terminal is detected, false otherwise
- */
-bool is_windows_terminal() {
-  char *wt = nullptr;
-  char *term = nullptr;
-
-  // Check for Windows Terminal environment variables
-  _dupenv_s(&wt, nullptr, "WT_SESSION");
-  _dupenv_s(&term, nullptr, "TERM_PROGRAM");
-
-  bool present = (wt && wt[0]) || (term && term[0]);
-
-  // Free allocated memory
-  if (wt)
-    free(wt);
-  if (term)
-    free(term);
-
-  return present;
-}
-
-/**
- * @brief Format an integer with locale-specific thousand separators
- *
- * Uses the system locale to insert commas (or other separators) for
- * readability. Example: 1234567 becomes "1,234,567"
- *
- * @param value The integer value to format
- * @return Formatted wide string with thousand separators
- */
-std::wstring formatIntWithCommas(uintmax_t value) {
-  std::wostringstream oss;
-  oss.imbue(std::locale("")); // Use system locale for formatting
-  oss << value;
-  return oss.str();
-}
-
-/**
- * @brief Format a byte count as a human-readable size string
- *
- * Appends " B" suffix to the formatted number.
- * Example: 1234567 becomes "1,234,567 B"
- *
- * @param bytes Number of bytes
- * @return Formatted wide string with " B" suffix
- */
-std::wstring formatSizeBytes(uintmax_t bytes) {
-  return formatIntWithCommas(bytes) + L" B";
-}
-
-/**
- * @brief Check if a wide character is an RTL (Right-to-Left) character
- *
- * Detects Arabic, Hebrew, and other RTL script characters by checking
- * Unicode code point ranges:
- * - 0x0590-0x08FF: Hebrew, Arabic, Syriac, Thaana, NKo, Samaritan
- * - 0xFB50-0xFDFF: Arabic Presentation Forms-A
- * - 0xFE70-0xFEFF: Arabic Presentation Forms-B
- *
- * @param c Wide character to check
- * @return true if character is RTL, false otherwise
- */
-bool is_arabic(wchar_t c) {
-  return (c >= 0x0590 && c <= 0x08FF) || (c >= 0xFB50 && c <= 0xFDFF) ||
-         (c >= 0xFE70 && c <= 0xFEFF);
-}
-
-/**
- * @brief Check if a wide string contains any RTL characters
- *
- * @param s Wide string to check
- * @return true if any RTL characters are found, false otherwise
- */
-bool contains_rtl(const std::wstring &s) {
-  for (wchar_t c : s) {
-    if (is_arabic(c))
-      return true;
-  }
-  return false;
-}
-
-/**
- * @brief Wrap RTL text for proper console display
- *
- * Windows console doesn't handle bidirectional text correctly, so we need
- * to manually reverse RTL character sequences. This function:
- * 1. Identifies RTL character sequences
- * 2. Reverses them while preserving LTR text
- * 3. Handles trailing spaces correctly
- *
- * Example: "Hello العالم World" becomes "Hello ملاعلا World"
- * (Arabic text is reversed, English text stays the same)
- *
- * Note: This is only needed for console output. File output should NOT
- * use this function, as text editors handle bidirectional text correctly.
- *
- * @param s Wide string potentially containing RTL text
- * @return Wrapped string with RTL sequences reversed
- */
-std::wstring wrap_rtl(std::wstring s) {
-  std::wstring res;         // Result string
-  std::wstring buf;         // Buffer for current sequence
-  bool buf_has_rtl = false; // Track if buffer contains RTL characters
-
-  // Process each character
-  for (wchar_t c : s) {
-    if (is_arabic(c)) {
-      // RTL character: add to buffer
-      buf += c;
-      buf_has_rtl = true;
-    } else if (c == L' ') {
-      // Space: add to buffer (could be part of RTL or LTR sequence)
-      buf += c;
-    } else {
-      // LTR or other neutral character: flush buffer
-      if (buf_has_rtl) {
-        // Buffer contains RTL text: extract trailing spaces, reverse, append
-        std::wstring trailing_spaces;
-        while (!buf.empty() && buf.back() == L' ') {
-          trailing_spaces += L' ';
-          buf.pop_back();
-        }
-        std::reverse(buf.begin(), buf.end()); // Reverse RTL sequence
-        res += buf;
-        res += trailing_spaces;
-      } else {
-        // Buffer contains only LTR text: append as-is
-        res += buf;
-      }
-
-      // Reset buffer and append current LTR character
-      buf.clear();
-      buf_has_rtl = false;
-      res += c;
-    }
-  }
-
-  // Flush remaining buffer at end of string
-  if (buf_has_rtl) {
-    std::wstring trailing_spaces;
-    while (!buf.empty() && buf.back() == L' ') {
-      trailing_spaces += L' ';
-      buf.pop_back();
-    }
-    std::reverse(buf.begin(), buf.end());
-    res += buf;
-    res += trailing_spaces;
-  } else {
-    res += buf;
-  }
-
-  return res;
-}
-
-/**
- * @brief Convert wide string (UTF-16) to UTF-8 string
- *
- * Uses Windows API WideCharToMultiByte to convert UTF-16 (used internally
- * by Windows) to UTF-8 (used for file output and cross-platform compatibility).
- *
- * @param w Wide string to convert
- * @return UTF-8 encoded narrow string
- */
-std::string wstring_to_utf8(const std::wstring &w) {
-  if (w.empty())
-    return std::string();
-
-  // Calculate required buffer size
-  int size_needed = WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(),
-                                        NULL, 0, NULL, NULL);
-
-  // Allocate buffer and perform conversion
-  std::string strTo(size_needed, 0);
-  WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(), &strTo[0],
-                      size_needed, NULL, NULL);
-
-  return strTo;
-}
-
-#else
-//=============================================================================
-// Unix/Linux-specific helper functions
-//=============================================================================
-
-/**
- * @brief Format an integer with locale-specific thousand separators (Unix
- * version)
- *
- * @param value The integer value to format
- * @return Formatted string with thousand separators
- */
-std::string formatIntWithCommas(uintmax_t value) {
-  std::ostringstream oss;
-  oss.imbue(std::locale(""));
-  oss << value;
-  return oss.str();
-}
-
-/**
- * @brief Format a byte count as a human-readable size string (Unix version)
- *
- * @param bytes Number of bytes
- * @return Formatted string with " B" suffix
- */
-std::string formatSizeBytes(uintmax_t bytes) {
-  return formatIntWithCommas(bytes) + " B";
-}
-
-#endif
-
-//=============================================================================
-// Cross-platform helper functions
-//=============================================================================
-
-/**
- * @brief Check if stdout is connected to a console
- *
- * Determines whether output is going to a console (terminal) or being
- * redirected to a file or piped to another program. This affects:
- * - Whether to use colored output
- * - Whether to use UTF-16 (console) or UTF-8 (file) on Windows
- * - Whether to apply RTL wrapping
- *
- * @return true if stdout is a console, false if redirected/piped
- */
-bool is_console() {
-#ifdef _WIN32
-  // Windows: Check if stdout is a character device and has console mode
-  DWORD mode;
-  HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
-  return GetFileType(hOut) == FILE_TYPE_CHAR && GetConsoleMode(hOut, &mode);
-#else
-  // Unix/Linux: Use isatty() to check if stdout is a terminal
-  return isatty(fileno(stdout));
-#endif
-}
-
-/**
- * @brief Determine if colored output should be enabled
- *
- * Colors are enabled only if:
- * 1. User hasn't disabled colors with --no-colors flag, AND
- * 2. Output is going to a console (not redirected to file)
- *
- * @param nocolors User's --no-colors flag
- * @return true if colors should be enabled, false otherwise
- */
-bool enable_colors(bool nocolors) { return !nocolors && is_console(); }
-
-/**
- * @brief Get permission string for a file or directory
- *
- * Platform-specific implementation:
- * - Windows: Returns attribute flags (R=ReadOnly, H=Hidden, S=System,
- * A=Archive)
- * - Unix/Linux: Returns Unix-style permissions (e.g., "rwxr-xr-x")
- *
- * @param entry Directory entry to get permissions for
- * @return Permission string
- */
-std::string getPermissions(const fs::directory_entry &entry) {
-  std::string perms;
-
-#ifdef _WIN32
-  // Windows: Get file attributes
-  DWORD attr = GetFileAttributesW(entry.path().c_str());
-  if (attr == INVALID_FILE_ATTRIBUTES)
-    return "-";
-
-  // Build permission string from attribute flags
-  if (attr & FILE_ATTRIBUTE_READONLY)
-    perms += 'R'; // Read-only
-  if (attr & FILE_ATTRIBUTE_HIDDEN)
-    perms += 'H'; // Hidden
-  if (attr & FILE_ATTRIBUTE_SYSTEM)
-    perms += 'S'; // System
-  if (attr & FILE_ATTRIBUTE_ARCHIVE)
-    perms += 'A'; // Archive
-
-#else
-  // Unix/Linux: Get file permissions
-  fs::perms p = entry.status().permissions();
-
-  // Build Unix-style permission string (rwxrwxrwx)
-  // Owner permissions
-  perms += ((p & fs::perms::owner_read) != fs::perms::none) ? 'r' : '-';
-  perms += ((p & fs::perms::owner_write) != fs::perms::none) ? 'w' : '-';
-  perms += ((p & fs::perms::owner_exec) != fs::perms::none) ? 'x' : '-';
-  // Group permissions
-  perms += ((p & fs::perms::group_read) != fs::perms::none) ? 'r' : '-';
-  perms += ((p & fs::perms::group_write) != fs::perms::none) ? 'w' : '-';
-  perms += ((p & fs::perms::group_exec) != fs::perms::none) ? 'x' : '-';
-  // Others permissions
-  perms += ((p & fs::perms::others_read) != fs::perms::none) ? 'r' : '-';
-  perms += ((p & fs::perms::others_write) != fs::perms::none) ? 'w' : '-';
-  perms += ((p & fs::perms::others_exec) != fs::perms::none) ? 'x' : '-';
-#endif
-
-  return perms.empty() ? "-" : perms;
-}
-
-//=============================================================================
-// Pattern matching for exclude functionality
-//=============================================================================
-
-#ifdef _WIN32
-/**
- * @brief Check if a filename matches a wildcard pattern (Windows version)
- *
- * Converts wildcard pattern to regex and performs case-insensitive matching.
- * Supports * (any characters) and ? (single character) wildcards.
- *
- * Example: "*.tmp" matches "file.tmp", "data.tmp", etc.
- *
- * @param name Wide string filename to check
- * @param pattern Wildcard pattern (narrow string)
- * @return true if filename matches pattern, false otherwise
- */
-bool matchesPatternW(const std::wstring &name, const std::string &pattern) {
-  if (pattern.empty())
-    return false;
-
-  // Convert wide string filename to UTF-8 for regex matching
-  std::string narrow = wstring_to_utf8(name);
-
-  // Convert wildcard pattern to regex pattern
-  std::string regexPattern =
-      std::regex_replace(pattern, std::regex("\\."), "\\."); // Escape dots
-  regexPattern =
-      std::regex_replace(regexPattern, std::regex("\\?"), "."); // ? -> .
-  regexPattern =
-      std::regex_replace(regexPattern, std::regex("\\*"), ".*"); // * -> .*
-
-  // Create regex with case-insensitive matching
-  std::regex re("^" + regexPattern + "$", std::regex_constants::icase);
-
-  return std::regex_match(narrow, re);
-}
-
-#else
-/**
- * @brief Check if a filename matches a wildcard pattern (Unix version)
- *
- * @param name Filename to check
- * @param pattern Wildcard pattern
- * @return true if filename matches pattern, false otherwise
- */
-bool matchesPattern(const std::string &name, const std::string &pattern) {
-  if (pattern.empty())
-    return false;
-
-  // Convert wildcard pattern to regex pattern
-  std::string regexPattern =
-      std::regex_replace(pattern, std::regex("\\."), "\\.");
-  regexPattern = std::regex_replace(regexPattern, std::regex("\\?"), ".");
-  regexPattern = std::regex_replace(regexPattern, std::regex("\\*"), ".*");
-
-  std::regex re("^" + regexPattern + "$", std::regex_constants::icase);
-
-  return std::regex_match(name, re);
-}
-#endif
-
-//=============================================================================
-// File timestamp retrieval
-//=============================================================================
-
-#ifdef _WIN32
-/**
- * @brief Get file creation and modification timestamps (Windows version)
- *
- * Uses Windows API to retrieve file times and convert them to local time
- * in YYYY-MM-DD HH:MM:SS format.
- *
- * @param path File path to get timestamps for
- * @return Pair of strings: (creation time, modification time)
- */
-std::pair<std::string, std::string> get_file_times(const fs::path &path) {
-  WIN32_FILE_ATTRIBUTE_DATA fileInfo;
-
-  // Get file attributes including timestamps
-  if (GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &fileInfo)) {
-    // Lambda to convert FILETIME to formatted string
-    auto fileTimeToString = [](const FILETIME &ft) -> std::string {
-      SYSTEMTIME stUTC, stLocal;
-
-      // Convert FILETIME to SYSTEMTIME (UTC)
-      FileTimeToSystemTime(&ft, &stUTC);
-
-      // Convert UTC to local time
-      SystemTimeToTzSpecificLocalTime(NULL, &stUTC, &stLocal);
-
-      // Format as YYYY-MM-DD HH:MM:SS
-      char buf[64];
-      sprintf_s(buf, "%04d-%02d-%02d %02d:%02d:%02d", stLocal.wYear,
-                stLocal.wMonth, stLocal.wDay, stLocal.wHour, stLocal.wMinute,
-                stLocal.wSecond);
-
-      return std::string(buf);
-    };
-
-    // Return creation and modification times
-    return {fileTimeToString(fileInfo.ftCreationTime),
-            fileTimeToString(fileInfo.ftLastWriteTime)};
-  }
-
-  // Return empty strings if file attributes couldn't be retrieved
-  return {"", ""};
-}
-
-#else
-/**
- * @brief Get file creation and modification timestamps (Unix version)
- *
- * Note: Unix doesn't reliably support creation time, so this returns empty
- * strings. Could be extended to use stat() for modification time if needed.
- *
- * @param path File path to get timestamps for
- * @return Pair of empty strings (creation time not available on Unix)
- */
-std::pair<std::string, std::string> get_file_times(const fs::path &path) {
-  return {"", ""}; // Unix doesn't have reliable creation time
-}
-#endif
-
-//=============================================================================
-// Main tree traversal and display function
-//=============================================================================
-
-#ifdef _WIN32
-/**
- * @brief Recursively print directory tree (Windows version)
- *
- * This is the main workhorse function that:
- * 1. Reads directory contents
- * 2. Filters entries based on user options (hidden, exclude pattern, dirs-only)
- * 3. Sorts entries alphabetically
- * 4. Displays each entry with tree characters, colors, and metadata
- * 5. Collects data for CSV export if requested
- * 6. Recursively processes subdirectories
- *
- * @param dir Current directory path to traverse
- * @param args Command-line arguments and options
- * @param level Current depth level (1 = root)
- * @param prefix Wide string prefix for tree drawing characters
- * @param isLast Whether this directory is the last entry in its parent
- * @param stats Reference to TreeStats for accumulating data
- * @param relpath Relative path from root directory (for CSV export)
- */
-void printTree(const fs::path &dir, const Args &args, int level,
-               std::wstring prefix, bool isLast, TreeStats &stats,
-               std::wstring relpath) {
-
-  // Check depth limit
-  if (args.maxLevel > 0 && level > args.maxLevel)
-    return;
-
-  // Collect directory entries
-  std::vector<fs::directory_entry> entries;
-  try {
-    // Iterate through directory, skipping entries we don't have permission to
-    // read
-    for (const auto &entry : fs::directory_iterator(
-             dir, fs::directory_options::skip_permission_denied)) {
-      std::wstring name = entry.path().filename().wstring();
-
-      // Filter hidden files if not showing hidden
-      if (!args.showHidden) {
-        DWORD attr = GetFileAttributesW(entry.path().c_str());
-        if (attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_HIDDEN))
-          continue; // Skip hidden files
-        if (!name.empty() && name[0] == L'.')
-          continue; // Skip dot files
-      }
-
-      // Filter by exclude pattern
-      if (!args.excludePattern.empty() &&
-          matchesPatternW(name, args.excludePattern))
-        continue;
-
-      // Filter to directories only if requested
-      if (args.showDirsOnly && !entry.is_directory())
-        continue;
-
-      entries.push_back(entry);
-    }
-  } catch (const std::exception &ex) {
-    // Handle permission denied or other errors
-    std::wcerr << L"[etree] Failed to enumerate directory '" << dir.wstring()
-               << L"': " << ex.what() << std::endl;
-    return;
-  }
-
-  // Sort entries alphabetically by filename
-  std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
-    return a.path().filename().wstring() < b.path().filename().wstring();
-  });
-
-  // Process each entry
-  for (size_t i = 0; i < entries.size(); ++i) {
-    const auto &entry = entries[i];
-    bool isDir = entry.is_directory();
-    bool entryIsLast = (i + 1 == entries.size());
-
-    // Choose tree branch character: `-- for last entry, |-- for others
-    std::wstring branch = entryIsLast ? L"`-- " : L"|-- ";
-
-    // Choose color based on entry type (directory or file)
-    const wchar_t *color =
-        (enable_colors(args.nocolors) ? (isDir ? dircolor : filecolor) : L"");
-    const wchar_t *reset = (enable_colors(args.nocolors) ? resetcolor : L"");
-
-    std::wstring displayname = entry.path().filename().wstring();
-
-    // Display entry name (unless doing CSV export)
-    if (args.csvOut.empty()) {
-      if (is_console()) {
-        // Console output: Use wide characters, apply RTL wrapping if needed
-        std::wstring consoleName = displayname;
-        if (contains_rtl(consoleName))
-          consoleName = wrap_rtl(consoleName);
-        std::wcout << prefix << color << branch << consoleName << reset;
-      } else {
-        // File output: Convert to UTF-8
-        std::cout << wstring_to_utf8(prefix)
-                  << wstring_to_utf8(std::wstring(color))
-                  << wstring_to_utf8(branch) << wstring_to_utf8(displayname)
-                  << wstring_to_utf8(std::wstring(reset));
-      }
-    }
-
-    // Collect CSV data if export requested
-    if (!args.csvOut.empty()) {
-      // Build relative path for this entry
-      fs::path relp = relpath.empty()
-                          ? entry.path().filename()
-                          : (fs::path(relpath) / entry.path().filename());
-
-      // Create CSV row
-      CsvRow row;
-      row.relpath = wstring_to_utf8(relp.wstring());
-      row.name = wstring_to_utf8(entry.path().filename().wstring());
-      row.type = isDir ? "folder" : "file";
-
-      // Get file size (0 for directories)
-      try {
-        row.bytes = isDir ? 0 : entry.file_size();
-      } catch (...) {
-        row.bytes = 0; // If we can't get size, use 0
-      }
-
-      // Get permissions and timestamps
-      row.perms = getPermissions(entry);
-      auto times = get_file_times(entry.path());
-      row.created = times.first;
-      row.modified = times.second;
-
-      stats.csvRows.push_back(row);
-    }
-
-    // Display additional metadata if requested (unless doing CSV export)
-    if (args.csvOut.empty()) {
-      // Show file size if requested
-      if (args.showSize) {
-        try {
-          uintmax_t size = isDir ? 0 : entry.file_size();
-          if (is_console()) {
-            std::wcout << (enable_colors(args.nocolors) ? sizecolor : L"")
-                       << L" [" << formatSizeBytes(size) << L"]"
-                       << (enable_colors(args.nocolors) ? resetcolor : L"");
-          } else {
-            std::cout << wstring_to_utf8(
-                             enable_colors(args.nocolors) ? sizecolor : L"")
-                      << " [" << wstring_to_utf8(formatSizeBytes(size)) << "]"
-                      << wstring_to_utf8(
-                             enable_colors(args.nocolors) ? resetcolor : L"");
-          }
-        } catch (...) {
-          // If we can't get size, show 0 B
-          if (is_console()) {
-            std::wcout << (enable_colors(args.nocolors) ? sizecolor : L"")
-                       << L" [0 B]"
-                       << (enable_colors(args.nocolors) ? resetcolor : L"");
-          } else {
-            std::cout << wstring_to_utf8(
-                             enable_colors(args.nocolors) ? sizecolor : L"")
-                      << " [0 B]"
-                      << wstring_to_utf8(
-                             enable_colors(args.nocolors) ? resetcolor : L"");
-          }
-        }
-      }
-
-      // Show permissions if requested
-      if (args.showPerms) {
-        std::string perms = getPermissions(entry);
-        std::wstring perms_w(perms.begin(), perms.end());
-        if (is_console()) {
-          std::wcout << (enable_colors(args.nocolors) ? permcolor : L"")
-                     << L" (" << perms_w << L")"
-                     << (enable_colors(args.nocolors) ? resetcolor : L"");
-        } else {
-          std::cout << wstring_to_utf8(enable_colors(args.nocolors) ? permcolor
-                                                                    : L"")
-                    << " (" << perms << ")"
-                    << wstring_to_utf8(enable_colors(args.nocolors) ? resetcolor
-                                                                    : L"");
-        }
-      }
-
-      // End line
-      if (is_console())
-        std::wcout << std::endl;
-      else
-        std::cout << std::endl;
-    }
-
-    // Recursively process subdirectories
-    if (isDir) {
-      stats.folders++;
-
-      // Build new prefix for child entries
-      // If this is the last entry, use spaces; otherwise use vertical bar
-      std::wstring newPrefix = prefix + (entryIsLast ? L"    " : L"|   ");
-
-      // Build new relative path for CSV export
-      std::wstring newRelpath =
-          relpath.empty()
-              ? std::wstring(entry.path().filename())
-              : (relpath + L"/" + entry.path().filename().wstring());
-
-      // Recursive call
-      printTree(entry.path(), args, level + 1, newPrefix, entryIsLast, stats,
-                newRelpath);
-    } else {
-      stats.files++;
-    }
-  }
-
-  // Update maximum depth reached
-  stats.maxDepth = std::max(stats.maxDepth, level);
-}
-
-#else
-//=============================================================================
-// Unix/Linux version of printTree (simpler, no RTL handling needed)
-//=============================================================================
-
-/**
- * @brief Recursively print directory tree (Unix/Linux version)
- *
- * Similar to Windows version but simpler:
- * - Uses narrow strings (UTF-8) throughout
- * - No RTL wrapping needed (terminals handle it correctly)
- * - Hidden file detection is simpler (just check for leading dot)
- *
- * @param dir Current directory path to traverse
- * @param args Command-line arguments and options
- * @param level Current depth level (1 = root)
- * @param prefix String prefix for tree drawing characters
- * @param isLast Whether this directory is the last entry in its parent
- * @param stats Reference to TreeStats for accumulating data
- * @param relpath Relative path from root directory (for CSV export)
- */
-void printTree(const fs::path &dir, const Args &args, int level,
-               std::string prefix, bool isLast, TreeStats &stats,
-               std::string relpath) {
-
-  // Check depth limit
-  if (args.maxLevel > 0 && level > args.maxLevel)
-    return;
-
-  // Collect directory entries
-  std::vector<fs::directory_entry> entries;
-  try {
-    for (const auto &entry : fs::directory_iterator(
-             dir, fs::directory_options::skip_permission_denied)) {
-      std::string name = entry.path().filename().string();
-
-      // Filter hidden files (files starting with dot)
-      if (!args.showHidden) {
-        if (!name.empty() && name[0] == '.')
-          continue;
-      }
-
-      // Filter by exclude pattern
-      if (!args.excludePattern.empty() &&
-          matchesPattern(name, args.excludePattern))
-        continue;
-
-      // Filter to directories only if requested
-      if (args.showDirsOnly && !entry.is_directory())
-        continue;
-
-      entries.push_back(entry);
-    }
-  } catch (const std::exception &ex) {
-    std::cerr << "[etree] Failed to enumerate directory '" << dir.string()
-              << "': " << ex.what() << std::endl;
-    return;
-  }
-
-  // Sort entries alphabetically
-  std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
-    return a.path().filename().string() < b.path().filename().string();
-  });
-
-  // Process each entry
-  for (size_t i = 0; i < entries.size(); ++i) {
-    const auto &entry = entries[i];
-    bool isDir = entry.is_directory();
-    bool entryIsLast = (i + 1 == entries.size());
-    std::string branch = entryIsLast ? "`-- " : "|-- ";
-    const char *color =
-        (enable_colors(args.nocolors) ? (isDir ? dircolor : filecolor) : "");
-    const char *reset = (enable_colors(args.nocolors) ? resetcolor : "");
-
-    // Display entry name (unless doing CSV export)
-    if (args.csvOut.empty())
-      std::cout << prefix << color << branch << entry.path().filename().string()
-                << reset;
-
-    // Collect CSV data if export requested
-    if (!args.csvOut.empty()) {
-      fs::path relp = relpath.empty()
-                          ? entry.path().filename()
-                          : (fs::path(relpath) / entry.path().filename());
-      CsvRow row;
-      row.relpath = relp.string();
-      row.name = entry.path().filename().string();
-      row.type = isDir ? "folder" : "file";
-      try {
-        row.bytes = isDir ? 0 : entry.file_size();
-      } catch (...) {
-        row.bytes = 0;
-      }
-      row.perms = getPermissions(entry);
-      auto times = get_file_times(entry.path());
-      row.created = times.first;
-      row.modified = times.second;
-      stats.csvRows.push_back(row);
-    }
-
-    // Display additional metadata if requested
-    if (args.csvOut.empty()) {
-      if (args.showSize) {
-        try {
-          std::cout << (enable_colors(args.nocolors) ? sizecolor : "") << " ["
-                    << formatSizeBytes(isDir ? 0 : entry.file_size()) << "]"
-                    << (enable_colors(args.nocolors) ? resetcolor : "");
-        } catch (...) {
-          std::cout << (enable_colors(args.nocolors) ? sizecolor : "")
-                    << " [0 B]"
-                    << (enable_colors(args.nocolors) ? resetcolor : "");
-        }
-      }
-      if (args.showPerms)
-        std::cout << (enable_colors(args.nocolors) ? permcolor : "") << " ("
-                  << getPermissions(entry) << ")"
-                  << (enable_colors(args.nocolors) ? resetcolor : "");
-      std::cout << std::endl;
-    }
-
-    // Recursively process subdirectories
-    if (isDir) {
-      stats.folders++;
-      printTree(entry.path(), args, level + 1,
-                prefix + (entryIsLast ? "    " : "|   "), entryIsLast, stats,
-                relpath.empty()
-                    ? entry.path().filename().string()
-                    : (relpath + "/" + entry.path().filename().string()));
-    } else {
-      stats.files++;
-    }
-  }
-
-  stats.maxDepth = std::max(stats.maxDepth, level);
-}
-#endif
\ No newline at end of file
+﻿/**
+ * @file etree.cpp
+ * @brief Core directory tree traversal and display implementation for eTree
+ *
+ * This file implements the main tree traversal logic, including:
+ * - Recursive directory traversal with depth limiting
+ * - File filtering (hidden files, exclude patterns, directories-only)
+ * - RTL (Right-to-Left) text handling for Arabic/Hebrew filenames
+ * - Colored console output with ANSI escape codes
+ * - File metadata retrieval (size, permissions, timestamps)
+ * - CSV data collection for export
+ * - Platform-specific implementations for Windows and Unix/Linux
+ *
+ * The implementation is split into Windows (_WIN32) and Unix/Linux sections
+ * to handle platform-specific differences in:
+ * - Character encoding (UTF-16 vs UTF-8)
+ * - File permissions (Windows attributes vs Unix modes)
+ * - Hidden file detection
+ * - Console detection
+ */
+
+#include "etree.h"
+#include "args.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <locale>
+#include <sstream>
+
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <windows.h>
+
+// Undefine Windows macros that conflict with std::max/min
+#undef max
+#undef min
+
+// ANSI color escape sequences for Windows console output
+const wchar_t *dircolor = L"\033[1;34m";  // Bold blue for directories
+const wchar_t *filecolor = L"\033[0;32m"; // Green for files
+const wchar_t *permcolor = L"\033[0;36m"; // Cyan for permissions
+const wchar_t *sizecolor = L"\033[0;33m"; // Yellow for file sizes
+const wchar_t *resetcolor = L"\033[0m";   // Reset to default color
+
+#else
+#include "arrow.h"
+#include "csv.h"
+#include "dirstream.h"
+#include "output.h"
+#include "snapshot.h"
+#include "sort.h"
+#include "uring.h"
+#include "walker.h"
+#include "watch.h"
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+// ANSI color escape sequences for Unix/Linux console output
+const char *dircolor = "\033[1;34m";  // Bold blue for directories
+const char *filecolor = "\033[0;32m"; // Green for files
+const char *permcolor = "\033[0;36m"; // Cyan for permissions
+const char *sizecolor = "\033[0;33m"; // Yellow for file sizes
+const char *resetcolor = "\033[0m";   // Reset to default color
+#endif
+
+// Filesystem namespace alias for convenience
+namespace fs = std::filesystem;
+
+//=============================================================================
+// Windows-specific helper functions
+//=============================================================================
+#ifdef _WIN32
+
+/**
+ * @brief Detect if running in Windows Terminal
+ *
+ * Windows Terminal sets environment variables that we can check to determine
+ * if we're running in a modern terminal that supports ANSI colors.
+ *
+ * @return true if Windows Terminal is detected, false otherwise
+ */
+bool is_windows_terminal() {
+  char *wt = nullptr;
+  char *term = nullptr;
+
+  // Check for Windows Terminal environment variables
+  _dupenv_s(&wt, nullptr, "WT_SESSION");
+  _dupenv_s(&term, nullptr, "TERM_PROGRAM");
+
+  bool present = (wt && wt[0]) || (term && term[0]);
+
+  // Free allocated memory
+  if (wt)
+    free(wt);
+  if (term)
+    free(term);
+
+  return present;
+}
+
+/**
+ * @brief Format an integer with locale-specific thousand separators
+ *
+ * Uses the system locale to insert commas (or other separators) for
+ * readability. Example: 1234567 becomes "1,234,567"
+ *
+ * @param value The integer value to format
+ * @return Formatted wide string with thousand separators
+ */
+std::wstring formatIntWithCommas(uintmax_t value) {
+  std::wostringstream oss;
+  oss.imbue(std::locale("")); // Use system locale for formatting
+  oss << value;
+  return oss.str();
+}
+
+/**
+ * @brief Format a byte count as a human-readable size string
+ *
+ * Appends " B" suffix to the formatted number.
+ * Example: 1234567 becomes "1,234,567 B"
+ *
+ * @param bytes Number of bytes
+ * @return Formatted wide string with " B" suffix
+ */
+std::wstring formatSizeBytes(uintmax_t bytes) {
+  return formatIntWithCommas(bytes) + L" B";
+}
+
+/**
+ * @brief Check if a wide character is an RTL (Right-to-Left) character
+ *
+ * Detects Arabic, Hebrew, and other RTL script characters by checking
+ * Unicode code point ranges:
+ * - 0x0590-0x08FF: Hebrew, Arabic, Syriac, Thaana, NKo, Samaritan
+ * - 0xFB50-0xFDFF: Arabic Presentation Forms-A
+ * - 0xFE70-0xFEFF: Arabic Presentation Forms-B
+ *
+ * @param c Wide character to check
+ * @return true if character is RTL, false otherwise
+ */
+bool is_arabic(wchar_t c) {
+  return (c >= 0x0590 && c <= 0x08FF) || (c >= 0xFB50 && c <= 0xFDFF) ||
+         (c >= 0xFE70 && c <= 0xFEFF);
+}
+
+/**
+ * @brief Check if a wide string contains any RTL characters
+ *
+ * @param s Wide string to check
+ * @return true if any RTL characters are found, false otherwise
+ */
+bool contains_rtl(const std::wstring &s) {
+  for (wchar_t c : s) {
+    if (is_arabic(c))
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Wrap RTL text for proper console display
+ *
+ * Windows console doesn't handle bidirectional text correctly, so we need
+ * to manually reverse RTL character sequences. This function:
+ * 1. Identifies RTL character sequences
+ * 2. Reverses them while preserving LTR text
+ * 3. Handles trailing spaces correctly
+ *
+ * Example: "Hello العالم World" becomes "Hello ملاعلا World"
+ * (Arabic text is reversed, English text stays the same)
+ *
+ * Note: This is only needed for console output. File output should NOT
+ * use this function, as text editors handle bidirectional text correctly.
+ *
+ * @param s Wide string potentially containing RTL text
+ * @return Wrapped string with RTL sequences reversed
+ */
+std::wstring wrap_rtl(std::wstring s) {
+  std::wstring res;         // Result string
+  std::wstring buf;         // Buffer for current sequence
+  bool buf_has_rtl = false; // Track if buffer contains RTL characters
+
+  // Process each character
+  for (wchar_t c : s) {
+    if (is_arabic(c)) {
+      // RTL character: add to buffer
+      buf += c;
+      buf_has_rtl = true;
+    } else if (c == L' ') {
+      // Space: add to buffer (could be part of RTL or LTR sequence)
+      buf += c;
+    } else {
+      // LTR or other neutral character: flush buffer
+      if (buf_has_rtl) {
+        // Buffer contains RTL text: extract trailing spaces, reverse, append
+        std::wstring trailing_spaces;
+        while (!buf.empty() && buf.back() == L' ') {
+          trailing_spaces += L' ';
+          buf.pop_back();
+        }
+        std::reverse(buf.begin(), buf.end()); // Reverse RTL sequence
+        res += buf;
+        res += trailing_spaces;
+      } else {
+        // Buffer contains only LTR text: append as-is
+        res += buf;
+      }
+
+      // Reset buffer and append current LTR character
+      buf.clear();
+      buf_has_rtl = false;
+      res += c;
+    }
+  }
+
+  // Flush remaining buffer at end of string
+  if (buf_has_rtl) {
+    std::wstring trailing_spaces;
+    while (!buf.empty() && buf.back() == L' ') {
+      trailing_spaces += L' ';
+      buf.pop_back();
+    }
+    std::reverse(buf.begin(), buf.end());
+    res += buf;
+    res += trailing_spaces;
+  } else {
+    res += buf;
+  }
+
+  return res;
+}
+
+/**
+ * @brief Convert wide string (UTF-16) to UTF-8 string
+ *
+ * Uses Windows API WideCharToMultiByte to convert UTF-16 (used internally
+ * by Windows) to UTF-8 (used for file output and cross-platform compatibility).
+ *
+ * @param w Wide string to convert
+ * @return UTF-8 encoded narrow string
+ */
+std::string wstring_to_utf8(const std::wstring &w) {
+  if (w.empty())
+    return std::string();
+
+  // Calculate required buffer size
+  int size_needed = WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(),
+                                        NULL, 0, NULL, NULL);
+
+  // Allocate buffer and perform conversion
+  std::string strTo(size_needed, 0);
+  WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(), &strTo[0],
+                      size_needed, NULL, NULL);
+
+  return strTo;
+}
+
+#else
+//=============================================================================
+// Unix/Linux-specific helper functions
+//=============================================================================
+
+/**
+ * @brief Write the Unix-style permission characters for mode bits
+ *
+ * Fills a caller-provided buffer so the renderer needs no allocation.
+ *
+ * @param mode st_mode value (only the permission bits are used)
+ * @param perms Receives 9 characters (e.g., "rwxr-xr-x"), not terminated
+ */
+void formatPermissions(unsigned mode, char *perms) {
+  // Owner, group and others, each read/write/execute
+  static const unsigned bits[9] = {S_IRUSR, S_IWUSR, S_IXUSR,
+                                   S_IRGRP, S_IWGRP, S_IXGRP,
+                                   S_IROTH, S_IWOTH, S_IXOTH};
+  static const char letters[] = "rwxrwxrwx";
+  for (int i = 0; i < 9; ++i)
+    perms[i] = (mode & bits[i]) ? letters[i] : '-';
+}
+
+/**
+ * @brief Build a Unix-style permission string from mode bits
+ *
+ * @param mode st_mode value (only the permission bits are used)
+ * @return Permission string (e.g., "rwxr-xr-x")
+ */
+std::string permissionsString(unsigned mode) {
+  std::string perms(9, '-');
+  formatPermissions(mode, &perms[0]);
+  return perms;
+}
+
+#endif
+
+//=============================================================================
+// Cross-platform helper functions
+//=============================================================================
+
+/**
+ * @brief Check if stdout is connected to a console
+ *
+ * Determines whether output is going to a console (terminal) or being
+ * redirected to a file or piped to another program. This affects:
+ * - Whether to use colored output
+ * - Whether to use UTF-16 (console) or UTF-8 (file) on Windows
+ * - Whether to apply RTL wrapping
+ *
+ * @return true if stdout is a console, false if redirected/piped
+ */
+bool is_console() {
+#ifdef _WIN32
+  // Windows: Check if stdout is a character device and has console mode
+  DWORD mode;
+  HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+  return GetFileType(hOut) == FILE_TYPE_CHAR && GetConsoleMode(hOut, &mode);
+#else
+  // Unix/Linux: Use isatty() to check if stdout is a terminal
+  return isatty(fileno(stdout));
+#endif
+}
+
+/**
+ * @brief Determine if colored output should be enabled
+ *
+ * Colors are enabled only if:
+ * 1. User hasn't disabled colors with --no-colors flag, AND
+ * 2. Output is going to a console (not redirected to file)
+ *
+ * @param nocolors User's --no-colors flag
+ * @return true if colors should be enabled, false otherwise
+ */
+bool enable_colors(bool nocolors) { return !nocolors && is_console(); }
+
+/**
+ * @brief Fold statistics collected by another traversal thread into these
+ *
+ * @param other Statistics gathered by a worker thread
+ */
+void TreeStats::merge(const TreeStats &other) {
+  maxDepth = std::max(maxDepth, other.maxDepth);
+  folders += other.folders;
+  files += other.files;
+  csvRows.insert(csvRows.end(), other.csvRows.begin(), other.csvRows.end());
+#ifndef _WIN32
+  top.merge(other.top);
+#endif
+}
+
+/**
+ * @brief Get permission string for a file or directory
+ *
+ * Platform-specific implementation:
+ * - Windows: Returns attribute flags (R=ReadOnly, H=Hidden, S=System,
+ * A=Archive)
+ * - Unix/Linux: Returns Unix-style permissions (e.g., "rwxr-xr-x")
+ *
+ * @param entry Directory entry to get permissions for
+ * @return Permission string
+ */
+std::string getPermissions(const fs::directory_entry &entry) {
+  std::string perms;
+
+#ifdef _WIN32
+  // Windows: Get file attributes
+  DWORD attr = GetFileAttributesW(entry.path().c_str());
+  if (attr == INVALID_FILE_ATTRIBUTES)
+    return "-";
+
+  // Build permission string from attribute flags
+  if (attr & FILE_ATTRIBUTE_READONLY)
+    perms += 'R'; // Read-only
+  if (attr & FILE_ATTRIBUTE_HIDDEN)
+    perms += 'H'; // Hidden
+  if (attr & FILE_ATTRIBUTE_SYSTEM)
+    perms += 'S'; // System
+  if (attr & FILE_ATTRIBUTE_ARCHIVE)
+    perms += 'A'; // Archive
+
+#else
+  // Unix/Linux: Get file permissions
+  perms = permissionsString(
+      static_cast<unsigned>(entry.status().permissions()));
+#endif
+
+  return perms.empty() ? "-" : perms;
+}
+
+//=============================================================================
+// File timestamp retrieval
+//=============================================================================
+
+#ifdef _WIN32
+/**
+ * @brief Get file creation and modification timestamps (Windows version)
+ *
+ * Uses Windows API to retrieve file times and convert them to local time
+ * in YYYY-MM-DD HH:MM:SS format.
+ *
+ * @param path File path to get timestamps for
+ * @return Pair of strings: (creation time, modification time)
+ */
+std::pair<std::string, std::string> get_file_times(const fs::path &path) {
+  WIN32_FILE_ATTRIBUTE_DATA fileInfo;
+
+  // Get file attributes including timestamps
+  if (GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &fileInfo)) {
+    // Lambda to convert FILETIME to formatted string
+    auto fileTimeToString = [](const FILETIME &ft) -> std::string {
+      SYSTEMTIME stUTC, stLocal;
+
+      // Convert FILETIME to SYSTEMTIME (UTC)
+      FileTimeToSystemTime(&ft, &stUTC);
+
+      // Convert UTC to local time
+      SystemTimeToTzSpecificLocalTime(NULL, &stUTC, &stLocal);
+
+      // Format as YYYY-MM-DD HH:MM:SS
+      char buf[64];
+      sprintf_s(buf, "%04d-%02d-%02d %02d:%02d:%02d", stLocal.wYear,
+                stLocal.wMonth, stLocal.wDay, stLocal.wHour, stLocal.wMinute,
+                stLocal.wSecond);
+
+      return std::string(buf);
+    };
+
+    // Return creation and modification times
+    return {fileTimeToString(fileInfo.ftCreationTime),
+            fileTimeToString(fileInfo.ftLastWriteTime)};
+  }
+
+  // Return empty strings if file attributes couldn't be retrieved
+  return {"", ""};
+}
+
+#endif
+
+//=============================================================================
+// Main tree traversal and display function
+//=============================================================================
+
+#ifdef _WIN32
+/**
+ * @brief Recursively print directory tree (Windows version)
+ *
+ * This is the main workhorse function that:
+ * 1. Reads directory contents
+ * 2. Filters entries based on user options (hidden, exclude pattern, dirs-only)
+ * 3. Sorts entries alphabetically
+ * 4. Displays each entry with tree characters, colors, and metadata
+ * 5. Collects data for CSV export if requested
+ * 6. Recursively processes subdirectories
+ *
+ * @param dir Current directory path to traverse
+ * @param args Command-line arguments and options
+ * @param level Current depth level (1 = root)
+ * @param prefix Wide string prefix for tree drawing characters
+ * @param isLast Whether this directory is the last entry in its parent
+ * @param stats Reference to TreeStats for accumulating data
+ * @param relpath Relative path from root directory (for CSV export)
+ */
+void printTree(const fs::path &dir, const Args &args, int level,
+               std::wstring prefix, bool isLast, TreeStats &stats,
+               std::wstring relpath) {
+
+  // Check depth limit
+  if (args.maxLevel > 0 && level > args.maxLevel)
+    return;
+
+  // Collect directory entries
+  std::vector<fs::directory_entry> entries;
+  try {
+    // Iterate through directory, skipping entries we don't have permission to
+    // read
+    for (const auto &entry : fs::directory_iterator(
+             dir, fs::directory_options::skip_permission_denied)) {
+      std::wstring name = entry.path().filename().wstring();
+
+      // Filter hidden files if not showing hidden
+      if (!args.showHidden) {
+        DWORD attr = GetFileAttributesW(entry.path().c_str());
+        if (attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_HIDDEN))
+          continue; // Skip hidden files
+        if (!name.empty() && name[0] == L'.')
+          continue; // Skip dot files
+      }
+
+      // Filter by exclude patterns (compiled once by parseArgs)
+      if (!args.exclude.empty() && args.exclude.match(wstring_to_utf8(name)))
+        continue;
+
+      // Filter to directories only if requested
+      if (args.showDirsOnly && !entry.is_directory())
+        continue;
+
+      entries.push_back(entry);
+    }
+  } catch (const std::exception &ex) {
+    // Handle permission denied or other errors
+    std::wcerr << L"[etree] Failed to enumerate directory '" << dir.wstring()
+               << L"': " << ex.what() << std::endl;
+    return;
+  }
+
+  // Sort entries alphabetically by filename; each name is extracted once
+  // and an index array is sorted on it
+  std::vector<std::pair<std::wstring, size_t>> order;
+  order.reserve(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i)
+    order.emplace_back(entries[i].path().filename().wstring(), i);
+  std::sort(order.begin(), order.end());
+  std::vector<fs::directory_entry> sorted;
+  sorted.reserve(entries.size());
+  for (const auto &o : order)
+    sorted.push_back(std::move(entries[o.second]));
+  entries.swap(sorted);
+
+  // Process each entry
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const auto &entry = entries[i];
+    bool isDir = entry.is_directory();
+    bool entryIsLast = (i + 1 == entries.size());
+
+    // Choose tree branch character: `-- for last entry, |-- for others
+    std::wstring branch = entryIsLast ? L"`-- " : L"|-- ";
+
+    // Choose color based on entry type (directory or file)
+    const wchar_t *color =
+        (enable_colors(args.nocolors) ? (isDir ? dircolor : filecolor) : L"");
+    const wchar_t *reset = (enable_colors(args.nocolors) ? resetcolor : L"");
+
+    std::wstring displayname = entry.path().filename().wstring();
+
+    // Display entry name (unless doing CSV export)
+    if (args.csvOut.empty()) {
+      if (is_console()) {
+        // Console output: Use wide characters, apply RTL wrapping if needed
+        std::wstring consoleName = displayname;
+        if (contains_rtl(consoleName))
+          consoleName = wrap_rtl(consoleName);
+        std::wcout << prefix << color << branch << consoleName << reset;
+      } else {
+        // File output: Convert to UTF-8
+        std::cout << wstring_to_utf8(prefix)
+                  << wstring_to_utf8(std::wstring(color))
+                  << wstring_to_utf8(branch) << wstring_to_utf8(displayname)
+                  << wstring_to_utf8(std::wstring(reset));
+      }
+    }
+
+    // Collect CSV data if export requested
+    if (!args.csvOut.empty()) {
+      // Build relative path for this entry
+      fs::path relp = relpath.empty()
+                          ? entry.path().filename()
+                          : (fs::path(relpath) / entry.path().filename());
+
+      // Create CSV row
+      CsvRow row;
+      row.relpath = wstring_to_utf8(relp.wstring());
+      row.name = wstring_to_utf8(entry.path().filename().wstring());
+      row.type = isDir ? "folder" : "file";
+
+      // Get file size (0 for directories)
+      try {
+        row.bytes = isDir ? 0 : entry.file_size();
+      } catch (...) {
+        row.bytes = 0; // If we can't get size, use 0
+      }
+
+      // Get permissions and timestamps
+      row.perms = getPermissions(entry);
+      auto times = get_file_times(entry.path());
+      row.created = times.first;
+      row.modified = times.second;
+
+      stats.csvRows.push_back(row);
+    }
+
+    // Display additional metadata if requested (unless doing CSV export)
+    if (args.csvOut.empty()) {
+      // Show file size if requested
+      if (args.showSize) {
+        try {
+          uintmax_t size = isDir ? 0 : entry.file_size();
+          if (is_console()) {
+            std::wcout << (enable_colors(args.nocolors) ? sizecolor : L"")
+                       << L" [" << formatSizeBytes(size) << L"]"
+                       << (enable_colors(args.nocolors) ? resetcolor : L"");
+          } else {
+            std::cout << wstring_to_utf8(
+                             enable_colors(args.nocolors) ? sizecolor : L"")
+                      << " [" << wstring_to_utf8(formatSizeBytes(size)) << "]"
+                      << wstring_to_utf8(
+                             enable_colors(args.nocolors) ? resetcolor : L"");
+          }
+        } catch (...) {
+          // If we can't get size, show 0 B
+          if (is_console()) {
+            std::wcout << (enable_colors(args.nocolors) ? sizecolor : L"")
+                       << L" [0 B]"
+                       << (enable_colors(args.nocolors) ? resetcolor : L"");
+          } else {
+            std::cout << wstring_to_utf8(
+                             enable_colors(args.nocolors) ? sizecolor : L"")
+                      << " [0 B]"
+                      << wstring_to_utf8(
+                             enable_colors(args.nocolors) ? resetcolor : L"");
+          }
+        }
+      }
+
+      // Show permissions if requested
+      if (args.showPerms) {
+        std::string perms = getPermissions(entry);
+        std::wstring perms_w(perms.begin(), perms.end());
+        if (is_console()) {
+          std::wcout << (enable_colors(args.nocolors) ? permcolor : L"")
+                     << L" (" << perms_w << L")"
+                     << (enable_colors(args.nocolors) ? resetcolor : L"");
+        } else {
+          std::cout << wstring_to_utf8(enable_colors(args.nocolors) ? permcolor
+                                                                    : L"")
+                    << " (" << perms << ")"
+                    << wstring_to_utf8(enable_colors(args.nocolors) ? resetcolor
+                                                                    : L"");
+        }
+      }
+
+      // End line
+      if (is_console())
+        std::wcout << std::endl;
+      else
+        std::cout << std::endl;
+    }
+
+    // Recursively process subdirectories
+    if (isDir) {
+      stats.folders++;
+
+      // Build new prefix for child entries
+      // If this is the last entry, use spaces; otherwise use vertical bar
+      std::wstring newPrefix = prefix + (entryIsLast ? L"    " : L"|   ");
+
+      // Build new relative path for CSV export
+      std::wstring newRelpath =
+          relpath.empty()
+              ? std::wstring(entry.path().filename())
+              : (relpath + L"/" + entry.path().filename().wstring());
+
+      // Recursive call
+      printTree(entry.path(), args, level + 1, newPrefix, entryIsLast, stats,
+                newRelpath);
+    } else {
+      stats.files++;
+    }
+  }
+
+  // Update maximum depth reached
+  stats.maxDepth = std::max(stats.maxDepth, level);
+}
+
+#else
+//=============================================================================
+// Unix/Linux version of printTree (simpler, no RTL handling needed)
+//=============================================================================
+
+/**
+ * @brief Apply the filters that need the entry type (--gitignore, -P)
+ *
+ * With -P, files (directories with -d) are kept only if they match, and
+ * other directories only if a match could lie below them.
+ *
+ * @param args Command-line arguments and options
+ * @param rules Ignore rules in effect (null without --gitignore)
+ * @param dir Directory being listed
+ * @param relDir dir relative to the walk root
+ * @param e Entry to test; e.matched is set for -P
+ * @param isDir Whether the entry is a directory
+ * @return true if the entry must be dropped
+ */
+static bool dropByType(const Args &args, const IgnoreFrame *rules,
+                       std::string_view dir, std::string_view relDir,
+                       WalkEntry &e, bool isDir) {
+  if (rules && rules->ignored(dir, e.name, isDir))
+    return true;
+
+  if (!args.include.empty()) {
+    e.matched = isDir == args.showDirsOnly && args.include.match(relDir, e.name);
+    if (!e.matched &&
+        (!isDir || !args.include.mayMatchBelow(relDir, e.name)))
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Enumerate, filter, sort and stat the entries of one directory
+ *
+ * This is the part of the walk that touches the filesystem, split out of
+ * printTree so that the -j worker threads can run it ahead of the renderer:
+ * 1. Reads directory contents
+ * 2. Filters entries (hidden, exclude/include patterns, --gitignore,
+ *    dirs-only)
+ * 3. Sorts entries (--sort, --dirsfirst; by name by default)
+ * 4. Fetches size, permissions and timestamps when the output needs them
+ * 5. Counts the directory and its entries in stats
+ *
+ * Entry names are stored in the listing's name arena, and the scratch
+ * vectors are kept per thread, so a recycled listing is filled without a
+ * heap allocation per entry.
+ *
+ * @param dir Directory to enumerate
+ * @param args Command-line arguments and options
+ * @param level Depth level of dir (1 = root)
+ * @param ignore Ignore rules inherited from the parent (--gitignore)
+ * @param stats Statistics of the calling thread
+ * @param listing Receives the listing (ok = false if it could not be
+ *        read); cleared first, its buffers are reused
+ * @param anchor Ancestor to open dir from (Linux; null: open dir whole)
+ */
+void listDirectory(const std::string &dir, const Args &args, int level,
+                   const IgnoreFrame::Ptr &ignore, TreeStats &stats,
+                   DirListing &listing, const DirAnchor *anchor) {
+  listing.clear();
+  listing.ignore = ignore;
+
+  // Path of dir relative to the walk root, for -P path patterns
+  std::string_view relDir(dir);
+  relDir.remove_prefix(std::min(relDir.size(), args.folder.size()));
+  while (!relDir.empty() && relDir.front() == '/')
+    relDir.remove_prefix(1);
+
+  // Metadata is only fetched when some output column needs it
+  unsigned fields = planMetadata(args);
+
+  // Collect directory entries; names are appended to the arena and the
+  // entries point into it once it has stopped growing
+  std::vector<WalkEntry> &entries = listing.entries;
+  std::vector<char> &names = listing.names;
+  static thread_local std::vector<std::pair<size_t, size_t>> spans;
+  spans.clear();
+  auto addName = [&](std::string_view name) {
+    spans.emplace_back(names.size(), name.size());
+    names.insert(names.end(), name.begin(), name.end());
+    names.push_back('\0');
+  };
+  auto pinNames = [&] {
+    for (size_t i = 0; i < entries.size(); ++i)
+      entries[i].name =
+          std::string_view(names.data() + spans[i].first, spans[i].second);
+  };
+#ifdef __linux__
+  // Linux: read raw getdents64 records; the type comes from d_type, so
+  // listing names costs no per-file stat. A deep directory is opened by
+  // the short part of its path below its anchor.
+  DirStream stream(DirAnchor::at(anchor), DirAnchor::relative(anchor, dir));
+  if (stream.fd() >= 0)
+    fetchDirStamp(stream.fd(), nullptr, listing.stamp);
+  if (stream.fd() < 0) {
+    // Unreadable directories are shown empty, like skip_permission_denied
+    if (stream.error() != EACCES) {
+      listing.error =
+          fs::filesystem_error("directory iterator cannot open directory", dir,
+                               std::error_code(stream.error(),
+                                               std::generic_category()))
+              .what();
+      return;
+    }
+  }
+
+  // d_type settles the type of most entries without a stat
+  auto typeKnown = [](unsigned char type) {
+    return type != DT_UNKNOWN && type != DT_LNK;
+  };
+
+  static thread_local std::vector<unsigned char> types; // d_type per entry
+  types.clear();
+
+  // Filter, stat and classify entries [first, end) once they are read.
+  // Push this directory's ignore rules first (parsed once, shared by every
+  // subdirectory), then drop what they or -P exclude; skipped directories
+  // are never opened. Entries of unknown type are decided once it is known.
+  auto settle = [&](size_t first) {
+    pinNames();
+    const IgnoreFrame *rules = listing.ignore.get();
+    const bool typeFilters = rules || !args.include.empty();
+    if (typeFilters) {
+      size_t kept = first;
+      for (size_t i = first; i < entries.size(); ++i) {
+        if (typeKnown(types[i]) && dropByType(args, rules, dir, relDir,
+                                              entries[i], types[i] == DT_DIR))
+          continue;
+        if (kept != i) {
+          entries[kept] = std::move(entries[i]);
+          types[kept] = types[i];
+        }
+        ++kept;
+      }
+      entries.resize(kept);
+      types.resize(kept);
+    }
+
+    if (fields) {
+      // One metadata call per entry, which also settles an unknown type.
+      // With --io-uring the whole batch is submitted at once.
+      static thread_local std::vector<MetaRequest> requests;
+      requests.resize(entries.size() - first);
+      for (size_t i = first; i < entries.size(); ++i) {
+        MetaRequest &req = requests[i - first];
+        req.name = entries[i].name.data();
+        req.fields = fields | (typeKnown(types[i]) ? 0u : META_TYPE);
+        req.meta = &entries[i].meta;
+      }
+      if (!args.ioUring ||
+          !fetchMetaBatch(stream.fd(), requests.data(), requests.size())) {
+        for (auto &req : requests)
+          fetchMeta(stream.fd(), req.name, req.fields, *req.meta);
+      }
+
+      for (size_t i = first; i < entries.size(); ++i) {
+        WalkEntry &e = entries[i];
+        e.isDir = typeKnown(types[i]) ? types[i] == DT_DIR
+                                      : (e.meta.valid && S_ISDIR(e.meta.mode));
+        e.isLink = types[i] == DT_LNK;
+      }
+    } else {
+      // Names only: stat just the entries d_type cannot classify
+      for (size_t i = first; i < entries.size(); ++i) {
+        DirStreamEntry de;
+        de.name = entries[i].name.data();
+        de.length = entries[i].name.size();
+        de.type = types[i];
+        entries[i].isDir = stream.isDirectory(de);
+        entries[i].isLink = types[i] == DT_LNK;
+      }
+    }
+
+    if (typeFilters) {
+      size_t kept = first;
+      for (size_t i = first; i < entries.size(); ++i) {
+        if (!typeKnown(types[i]) && dropByType(args, rules, dir, relDir,
+                                               entries[i], entries[i].isDir))
+          continue;
+        if (kept != i)
+          entries[kept] = std::move(entries[i]);
+        ++kept;
+      }
+      entries.resize(kept);
+    }
+  };
+
+  // --mem-limit: move the settled files of entries [first, end) to a
+  // sorted run on disk. The folders stay, and so do their names, moved to
+  // the front of the arena after the folders kept before them.
+  auto spill = [&](size_t first) {
+    if (args.du)
+      tallyUsage(listing, first);
+
+    static thread_local std::vector<WalkEntry> run;
+    run.clear();
+    size_t kept = first;
+    for (size_t i = first; i < entries.size(); ++i) {
+      if (entries[i].isDir)
+        entries[kept++] = entries[i];
+      else if (!args.showDirsOnly)
+        run.push_back(entries[i]);
+    }
+    if (!run.empty()) {
+      sortListing(run, args);
+      if (!listing.spill)
+        listing.spill = std::make_unique<SpillFile>();
+      if (!listing.spill->write(run)) {
+        listing.error =
+            fs::filesystem_error("cannot write a sorted run to $TMPDIR", dir,
+                                 std::error_code(listing.spill->error(),
+                                                 std::generic_category()))
+                .what();
+        entries.clear();
+        return false;
+      }
+    }
+
+    entries.resize(kept);
+    types.resize(kept);
+    spans.resize(kept);
+    size_t end = first > 0 ? spans[first - 1].first + spans[first - 1].second + 1
+                           : 0;
+    for (size_t i = first; i < kept; ++i) {
+      const std::string_view name = entries[i].name;
+      std::memmove(names.data() + end, name.data(), name.size() + 1);
+      spans[i] = {end, name.size()};
+      end += name.size() + 1;
+    }
+    names.resize(end);
+    pinNames();
+    return true;
+  };
+
+  const size_t runLimit = spillRunLimit(args);
+  size_t settled = 0;          // Entries [0, settled) are settled folders
+  bool rulesLoaded = false;    // listing.ignore holds this directory's rules
+  bool hasIgnoreFiles = false; // Saw a .gitignore or .ignore
+  DirStreamEntry raw;
+  while (stream.next(raw)) {
+    if (args.gitignore && raw.name[0] == '.') {
+      std::string_view name(raw.name, raw.length);
+      if (name == ".gitignore" || name == ".ignore")
+        hasIgnoreFiles = true;
+      else if (name == ".git")
+        continue; // Repository internals are never part of the listing
+    }
+
+    // Filter hidden files (files starting with dot)
+    if (!args.showHidden && raw.name[0] == '.')
+      continue;
+
+    // Filter by exclude patterns (compiled once by parseArgs)
+    if (args.exclude.match(std::string_view(raw.name, raw.length)))
+      continue;
+
+    // Files can be dropped for -d before any metadata call (--du still
+    // needs their sizes)
+    if (args.showDirsOnly && !args.du && typeKnown(raw.type) &&
+        raw.type != DT_DIR)
+      continue;
+
+    addName(std::string_view(raw.name, raw.length));
+    entries.emplace_back();
+    types.push_back(raw.type);
+
+    // Huge directory: the rules must be known before the first run, and
+    // its ignore files may not have been read yet
+    if (runLimit > 0 && entries.size() - settled >= runLimit) {
+      if (args.gitignore && !rulesLoaded) {
+        listing.ignore = IgnoreFrame::load(stream.fd(), dir, ignore);
+        rulesLoaded = true;
+      }
+      settle(settled);
+      if (!spill(settled))
+        return;
+      settled = entries.size();
+    }
+  }
+  if (stream.fd() >= 0 && stream.error() != 0) {
+    listing.error =
+        fs::filesystem_error(
+            "directory iterator cannot advance", dir,
+            std::error_code(stream.error(), std::generic_category()))
+            .what();
+    entries.clear();
+    return;
+  }
+
+  listing.hasIgnoreFiles = hasIgnoreFiles;
+  if (hasIgnoreFiles && !rulesLoaded)
+    listing.ignore = IgnoreFrame::load(stream.fd(), dir, ignore);
+  settle(settled);
+#else
+  (void)anchor; // Paths are opened whole
+  fetchDirStamp(-1, dir.c_str(), listing.stamp);
+  if (args.gitignore)
+    listing.ignore = IgnoreFrame::load(-1, dir, ignore);
+  listing.hasIgnoreFiles = listing.ignore != ignore;
+  const IgnoreFrame *rules = listing.ignore.get();
+
+  try {
+    for (const auto &entry : fs::directory_iterator(
+             dir, fs::directory_options::skip_permission_denied)) {
+      std::string name = entry.path().filename().string();
+
+      // Repository internals are never part of a --gitignore listing
+      if (args.gitignore && name == ".git")
+        continue;
+
+      // Filter hidden files (files starting with dot)
+      if (!args.showHidden) {
+        if (!name.empty() && name[0] == '.')
+          continue;
+      }
+
+      // Filter by exclude patterns (compiled once by parseArgs)
+      if (args.exclude.match(name))
+        continue;
+
+      // Filter to directories only if requested (--du still counts files)
+      if (args.showDirsOnly && !args.du && !entry.is_directory())
+        continue;
+
+      WalkEntry e;
+      e.name = name;
+      e.isLink = entry.is_symlink();
+      e.isDir = entry.is_directory() && !(args.du && e.isLink);
+
+      // Filter by the ignore rules in effect and the include patterns
+      if (dropByType(args, rules, dir, relDir, e, e.isDir))
+        continue;
+      if (fields)
+        fetchMeta(AT_FDCWD, entry.path().c_str(), fields, e.meta);
+      addName(name);
+      entries.push_back(e);
+    }
+  } catch (const std::exception &ex) {
+    listing.error = ex.what();
+    entries.clear();
+    return;
+  }
+  pinNames();
+#endif
+
+  // This thread's share of the --du totals
+  if (args.du)
+    tallyUsage(listing);
+
+  // Filter to directories only if requested
+  if (args.showDirsOnly)
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                 [](const WalkEntry &e) { return !e.isDir; }),
+                  entries.end());
+
+  // Sort entries (by name unless --sort/--dirsfirst say otherwise)
+  sortListing(entries, args);
+
+  countListing(listing, args, level, stats);
+  if (args.topCount > 0)
+    collectTop(dir, listing, args, stats.top);
+  listing.ok = true;
+}
+
+/**
+ * @brief Add a directory's entries to the walk statistics
+ *
+ * With -P the renderer counts instead: directories without matches are
+ * only hidden once their subtree has been listed. Listings below the depth
+ * limit (made for --du) are not counted, since they are not shown.
+ *
+ * @param listing Listing of the directory
+ * @param args Command-line arguments and options
+ * @param level Depth level of the directory (1 = root)
+ * @param stats Statistics of the calling thread
+ */
+void countListing(const DirListing &listing, const Args &args, int level,
+                  TreeStats &stats) {
+  if (!args.include.empty() || (args.maxLevel > 0 && level > args.maxLevel))
+    return;
+  for (const auto &e : listing.entries) {
+    if (e.isDir)
+      stats.folders++;
+    else
+      stats.files++;
+  }
+#ifdef __linux__
+  if (listing.spill)
+    stats.files += listing.spill->files();
+#endif
+  stats.maxDepth = std::max(stats.maxDepth, level);
+}
+
+/**
+ * @brief Check if a directory's subtree holds any -P match
+ *
+ * Lists the subtree as far as needed (stopping at the first match) and
+ * remembers the answer in every job it settles. Subtrees without a match
+ * are released right away, since they will never be rendered. The
+ * directories being searched are kept on a heap stack, so the depth of
+ * the subtree costs no native stack.
+ *
+ * @param walker Listing producer
+ * @param job Directory to check
+ * @param args Command-line arguments (depth limit)
+ * @return true if some entry below job matched an include pattern
+ */
+static bool hasMatches(TreeWalker &walker, DirJob &job, const Args &args) {
+  // Directories being searched, with their next child to check
+  std::vector<std::pair<DirJob *, size_t>> stack;
+
+  auto settle = [&](DirJob &dir, bool found) {
+    dir.matches = found ? 1 : 0;
+    if (!found)
+      walker.release(dir);
+    return found ? 1 : 0;
+  };
+  // Answer of a directory known from its own entries, or -1 once it has
+  // been pushed to search its children
+  auto open = [&](DirJob &dir) {
+    if (dir.matches >= 0)
+      return dir.matches;
+    const DirListing &listing = walker.acquire(dir);
+    if (!listing.ok)
+      return settle(dir, false);
+    for (const WalkEntry &e : listing.entries) {
+      if (e.matched)
+        return settle(dir, true);
+    }
+    stack.push_back({&dir, 0});
+    return -1;
+  };
+
+  int found = open(job);
+  while (!stack.empty()) {
+    DirJob &dir = *stack.back().first;
+    size_t &child = stack.back().second;
+    // Only within the depth limit (--du makes jobs below it)
+    const bool descend = args.maxLevel <= 0 || dir.level < args.maxLevel;
+    if (found != 1 && descend && child < dir.children.size()) {
+      found = open(*dir.children[child++]);
+      continue;
+    }
+    stack.pop_back();
+    found = settle(dir, found == 1);
+  }
+  return found == 1;
+}
+
+/**
+ * @brief List a subtree without printing it (--top)
+ *
+ * The listings feed the threads' --top lists as they are made; each one
+ * is released as soon as its subdirectories have been visited.
+ *
+ * @param walker Listing producer
+ * @param root Directory to visit
+ */
+static void visitTree(TreeWalker &walker, DirJob &root) {
+  // Directories being visited, with their next child
+  std::vector<std::pair<DirJob *, size_t>> stack;
+  walker.acquire(root);
+  stack.push_back({&root, 0});
+  while (!stack.empty()) {
+    DirJob &job = *stack.back().first;
+    size_t &child = stack.back().second;
+    if (child < job.children.size()) {
+      DirJob &sub = *job.children[child++];
+      walker.acquire(sub);
+      stack.push_back({&sub, 0});
+      continue;
+    }
+    walker.release(job);
+    stack.pop_back();
+  }
+}
+
+/**
+ * @brief Write one tree line: prefix, branch, name and selected columns
+ *
+ * @tparam Mode Bitmask of RenderFlag values (display flags only)
+ * @param out Output sink
+ * @param prefix Tree drawing characters of the entry's level
+ * @param name Entry name
+ * @param isDir Whether the entry is a folder (picks its color)
+ * @param last Whether it is the last entry shown in its folder
+ * @param size Size column (0 for folders)
+ * @param perms Permissions column ("-" if not known)
+ * @param usage --du totals shown instead of the size (folders only)
+ */
+template <unsigned Mode>
+static void writeTreeLine(OutputWriter &out, std::string_view prefix,
+                          std::string_view name, bool isDir, bool last,
+                          uintmax_t size, std::string_view perms,
+                          const DuTotals *usage) {
+  constexpr bool colors = Mode & RENDER_COLORS;
+  out.write(prefix);
+  if constexpr (colors)
+    out.write(isDir ? dircolor : filecolor);
+  out.write(last ? "`-- " : "|-- ");
+  out.write(name);
+  if constexpr (colors)
+    out.write(resetcolor);
+
+  if constexpr ((Mode & RENDER_SIZE) != 0) {
+    if constexpr (colors)
+      out.write(sizecolor);
+    out.write(" [");
+    if (usage)
+      writeUsage(out, *usage);
+    else
+      writeSize(out, size);
+    out.put(']');
+    if constexpr (colors)
+      out.write(resetcolor);
+  }
+  if constexpr ((Mode & RENDER_PERMS) != 0) {
+    if constexpr (colors)
+      out.write(permcolor);
+    out.write(" (");
+    out.write(perms);
+    out.put(')');
+    if constexpr (colors)
+      out.write(resetcolor);
+  }
+  out.endLine();
+}
+
+/**
+ * @struct RenderContext
+ * @brief Prefix and path buffers shared by the whole rendering descent
+ *
+ * Each level appends its part on the way down and truncates it again on
+ * the way back up, so building a line's prefix or an entry's relative
+ * path never allocates once the buffers have grown to the tree's depth.
+ */
+struct RenderContext {
+  std::string prefix; ///< Tree drawing characters of the current level
+  std::string path;   ///< Relative path of the current entry (CSV export)
+
+  /// Columnar export file (RENDER_ARROW only)
+  ArrowWriter *arrow = nullptr;
+
+  /// Snapshot being recorded (--snapshot, --refresh), and the entry record
+  /// of the directory about to be rendered
+  SnapshotWriter *snapshot = nullptr;
+  uint32_t snapEntry = kSnapNone;
+
+  /// Text of the Created and Modified columns (CSV export)
+  TimestampFormatter created{};
+  TimestampFormatter modified{};
+};
+
+/**
+ * @struct RenderFrame
+ * @brief One open directory of the rendering descent
+ *
+ * renderTree() keeps a frame per open level on a heap stack instead of
+ * recursing, so the depth of the tree costs no native stack. Frames are
+ * reused level by level: descending allocates nothing once the stack has
+ * grown to the tree's depth.
+ */
+struct RenderFrame {
+  DirJob *job = nullptr;    ///< Directory being rendered
+  uint32_t snapBase = 0;    ///< Snapshot record of its first entry
+  bool descend = false;     ///< Whether its subdirectories are rendered
+  size_t next = 0;          ///< Next entry to consider
+  size_t child = 0;         ///< Next subdirectory job
+  size_t lastShown = 0;     ///< Entry that gets the closing branch
+  std::vector<bool> hidden; ///< -P: entries without a match below them
+  size_t prefixLength = 0;  ///< ctx.prefix length to restore when done
+  size_t pathLength = 0;    ///< ctx.path length to restore when done
+
+#ifdef __linux__
+  /// --mem-limit: one merged entry, with its name and subdirectory job
+  struct Pending {
+    WalkEntry entry;
+    std::string name;
+    DirJob *sub = nullptr;
+  };
+  std::unique_ptr<SpillMerger> merge; ///< Merge of a spilled listing
+  Pending slots[2];                   ///< Entry to show and the one after
+  unsigned current = 0;               ///< Slot of the entry to show
+  bool more = false;                  ///< Whether slots[current] is loaded
+#endif
+};
+
+/**
+ * @brief Render one directory listing and, depth-first, its subdirectories
+ *
+ * Runs only on the calling thread, in the exact order of a serial walk, so
+ * output is identical whether listings come from the -j pool or not. The
+ * open directories are kept on a stack of RenderFrame, so trees of any
+ * depth are rendered in constant native stack space.
+ *
+ * Instantiated once per RenderFlag combination: the options are template
+ * constants, so the per-entry loop has no option tests and no isatty().
+ *
+ * @tparam Mode Bitmask of RenderFlag values
+ * @param walker Listing producer
+ * @param root Directory to render
+ * @param args Command-line arguments and options
+ * @param out Output sink for the tree text (the TSV file in export mode)
+ * @param ctx Prefix of this level and relative path of this directory
+ * @param stats Statistics of the rendering thread
+ */
+template <unsigned Mode>
+static void renderTree(TreeWalker &walker, DirJob &root, const Args &args,
+                       OutputWriter &out, RenderContext &ctx,
+                       TreeStats &stats) {
+  constexpr bool showPerms = Mode & RENDER_PERMS;
+  constexpr bool dirsOnly = Mode & RENDER_DIRS_ONLY;
+  constexpr bool csv = Mode & RENDER_CSV;
+  constexpr bool arrow = Mode & RENDER_ARROW;
+  constexpr bool du = Mode & RENDER_DU;
+
+  const bool include = !args.include.empty();
+  std::vector<std::unique_ptr<RenderFrame>> frames;
+  size_t depth = 0; // Open frames: frames[0, depth)
+
+#ifdef __linux__
+  // Next merged entry of a spilled listing to show, with its child job;
+  // with -P, folders without a match below them are skipped
+  auto pull = [&](RenderFrame &f, RenderFrame::Pending &p) {
+    while (f.merge->next(p.entry, p.name)) {
+      const bool isDir = dirsOnly || p.entry.isDir;
+      p.sub = isDir && f.child < f.job->children.size()
+                  ? f.job->children[f.child++].get()
+                  : nullptr;
+      if (include && p.entry.isDir && !p.entry.matched &&
+          !(f.descend && p.sub && hasMatches(walker, *p.sub, args)))
+        continue;
+      return true;
+    }
+    return false;
+  };
+#endif
+
+  // Open a directory on top of the stack; ctx is restored to the given
+  // lengths when it is done. false if it could not be listed (reported).
+  auto enter = [&](DirJob &job, size_t prefixLength, size_t pathLength) {
+    const DirListing &listing = walker.acquire(job);
+    if (!listing.ok) {
+      out.flush(); // Keep the message in place relative to the tree
+      std::cerr << "[etree] Failed to enumerate directory '" << job.path
+                << "': " << listing.error << std::endl;
+      walker.release(job);
+      return false;
+    }
+    if (depth == frames.size())
+      frames.push_back(std::make_unique<RenderFrame>());
+    RenderFrame &f = *frames[depth++];
+    f.job = &job;
+    f.next = 0;
+    f.child = 0;
+    f.prefixLength = prefixLength;
+    f.pathLength = pathLength;
+
+    // Record the listing; subdirectories link themselves to their entries
+    f.snapBase = 0;
+    if (ctx.snapshot)
+      f.snapBase = ctx.snapshot->addDirectory(listing, ctx.snapEntry);
+
+    // Subdirectories are rendered within the depth limit only (with --du
+    // there are jobs below it too, already summed)
+    f.descend = args.maxLevel <= 0 || job.level < args.maxLevel;
+
+    // With -P, directories without a match below them are hidden; decide
+    // that up front so the last visible entry gets the closing branch
+    const auto &entries = listing.entries;
+    f.lastShown = entries.size() - 1;
+    if (include) {
+      f.hidden.assign(entries.size(), false);
+      size_t c = 0;
+      for (size_t i = 0; i < entries.size(); ++i) {
+        if (!entries[i].isDir)
+          continue;
+        DirJob *sub =
+            c < job.children.size() ? job.children[c++].get() : nullptr;
+        f.hidden[i] = !entries[i].matched &&
+                      !(f.descend && sub && hasMatches(walker, *sub, args));
+      }
+      while (f.lastShown < entries.size() && f.hidden[f.lastShown])
+        --f.lastShown;
+
+      // The renderer counts in this mode (see listDirectory())
+      stats.maxDepth = std::max(stats.maxDepth, job.level);
+    }
+
+#ifdef __linux__
+    // --mem-limit: merge the sorted runs with the entries, one entry ahead
+    // so the last one shown gets the closing branch
+    f.merge.reset();
+    if (listing.spill) {
+      f.merge = std::make_unique<SpillMerger>(*listing.spill, entries, args);
+      f.current = 0;
+      f.more = pull(f, f.slots[0]);
+    }
+#endif
+    return true;
+  };
+
+  // Next entry of a frame to show: the entry, whether it gets the closing
+  // branch, its subdirectory job and its position in the listing
+  struct Shown {
+    const WalkEntry *entry = nullptr;
+    bool last = false;
+    DirJob *sub = nullptr;
+    size_t index = 0;
+  };
+  auto advance = [&](RenderFrame &f, Shown &shown) {
+#ifdef __linux__
+    if (f.merge) {
+      if (!f.more)
+        return false;
+      const RenderFrame::Pending &p = f.slots[f.current];
+      f.current ^= 1;
+      f.more = pull(f, f.slots[f.current]);
+      shown = {&p.entry, !f.more, p.sub, f.next++};
+      return true;
+    }
+#endif
+    const auto &entries = f.job->listing.entries;
+    while (f.next < entries.size()) {
+      const size_t i = f.next++;
+      DirJob *sub = nullptr;
+      if ((dirsOnly || entries[i].isDir) && f.child < f.job->children.size())
+        sub = f.job->children[f.child++].get();
+      if (include && f.hidden[i])
+        continue;
+      shown = {&entries[i], i == f.lastShown, sub, i};
+      return true;
+    }
+    return false;
+  };
+
+  if (!enter(root, ctx.prefix.size(), ctx.path.size()))
+    return;
+  while (depth > 0) {
+    RenderFrame &f = *frames[depth - 1];
+    Shown shown;
+    if (!advance(f, shown)) {
+      // Directory done: free its listing and go back up a level
+#ifdef __linux__
+      if (f.merge && f.merge->failed()) {
+        out.flush(); // Keep the message in place relative to the tree
+        std::cerr << "[etree] Failed to read back the sorted runs of '"
+                  << args.folder << (ctx.path.empty() ? "" : "/") << ctx.path
+                  << "'" << std::endl;
+      }
+      f.merge.reset();
+#endif
+      walker.release(*f.job);
+      ctx.prefix.resize(f.prefixLength);
+      ctx.path.resize(f.pathLength);
+      --depth;
+      continue;
+    }
+
+    const WalkEntry &entry = *shown.entry;
+    const bool isDir = dirsOnly || entry.isDir;
+    DirJob *sub = shown.sub;
+    if (include) {
+      if (isDir)
+        stats.folders++;
+      else
+        stats.files++;
+    }
+
+    // Size (0 for directories or if it couldn't be read) and permissions,
+    // both taken from the entry's single metadata record
+    uintmax_t size = isDir ? 0 : entry.meta.size;
+    char permBuf[9];
+    std::string_view perms = "-";
+    if constexpr (csv || showPerms) {
+      if (entry.meta.valid) {
+        formatPermissions(entry.meta.mode, permBuf);
+        perms = std::string_view(permBuf, sizeof(permBuf));
+      }
+    }
+
+    // Extend the relative path by this entry for CSV rows and descent
+    const size_t pathLength = ctx.path.size();
+    if (csv || (sub && f.descend)) {
+      if (pathLength > 0)
+        ctx.path += '/';
+      ctx.path += entry.name;
+    }
+
+    if constexpr (csv) {
+      // Creation and modification times (FileMeta::kNoTime if not known)
+      const int64_t btime =
+          entry.meta.valid ? entry.meta.btime : FileMeta::kNoTime;
+      const int64_t mtime =
+          entry.meta.valid ? entry.meta.mtime : FileMeta::kNoTime;
+      if constexpr (arrow) {
+        // Add the row to the current record batch
+        ctx.arrow->add(ctx.path, entry.name, isDir, size, btime, mtime, perms);
+      } else {
+        // Stream the TSV row (out is the export file in this mode)
+        writeTsvRow(out, ctx.path, entry.name, isDir, size,
+                    ctx.created.format(btime), ctx.modified.format(mtime),
+                    perms);
+      }
+    } else {
+      // Display entry name and the requested columns
+      writeTreeLine<Mode>(out, ctx.prefix, entry.name, isDir, shown.last,
+                          size, perms, du && sub ? &sub->usage : nullptr);
+    }
+
+    // Descend into subdirectories within the depth limit; the new frame
+    // restores the prefix and path when it is done
+    if (sub && f.descend) {
+      const size_t prefixLength = ctx.prefix.size();
+      ctx.prefix += shown.last ? "    " : "|   ";
+      ctx.snapEntry = f.snapBase + static_cast<uint32_t>(shown.index);
+      if (enter(*sub, prefixLength, pathLength))
+        continue;
+      ctx.prefix.resize(prefixLength);
+    }
+    ctx.path.resize(pathLength);
+  }
+}
+
+/// Entry point of one renderTree() instantiation
+using RenderFn = void (*)(TreeWalker &, DirJob &, const Args &, OutputWriter &,
+                          RenderContext &, TreeStats &);
+
+/**
+ * @brief Build the table of display renderers, indexed by RenderFlag bits
+ */
+template <size_t... Modes>
+static constexpr std::array<RenderFn, sizeof...(Modes)>
+renderTable(std::index_sequence<Modes...>) {
+  return {{&renderTree<static_cast<unsigned>(Modes)>...}};
+}
+
+/// Display renderers for every combination of the flags below RENDER_CSV
+static constexpr auto kRenderers =
+    renderTable(std::make_index_sequence<RENDER_CSV>());
+
+#ifdef __linux__
+/**
+ * @struct StreamEntry
+ * @brief An entry read by streamTree() whose line is not printed yet
+ */
+struct StreamEntry {
+  std::string name;   ///< Copy of the name (the stream's buffer moves on)
+  bool isDir = false;  ///< Whether the entry is (or links to) a directory
+  bool isLink = false; ///< Whether the entry is a symbolic link
+  FileMeta meta;       ///< Metadata fetched for the selected options
+};
+
+/**
+ * @brief Read a stream's next entry that passes the -a/-I/-d filters
+ *
+ * @param stream Open directory
+ * @param args Command-line arguments and options
+ * @param fields Metadata to fetch (see planMetadata())
+ * @param entry Receives the entry (its name buffer is reused)
+ * @return false at the end of the directory or on error
+ */
+static bool nextStreamEntry(DirStream &stream, const Args &args,
+                            unsigned fields, StreamEntry &entry) {
+  DirStreamEntry raw;
+  while (stream.next(raw)) {
+    if (!args.showHidden && raw.name[0] == '.')
+      continue;
+    if (args.exclude.match(std::string_view(raw.name, raw.length)))
+      continue;
+
+    // d_type settles most types; links and DT_UNKNOWN need a stat
+    const bool known = raw.type != DT_UNKNOWN && raw.type != DT_LNK;
+    if (args.showDirsOnly && known && raw.type != DT_DIR)
+      continue;
+    entry.meta = FileMeta();
+    if (fields) {
+      fetchMeta(stream.fd(), raw.name, fields | (known ? 0u : META_TYPE),
+                entry.meta);
+      entry.isDir = known ? raw.type == DT_DIR
+                          : entry.meta.valid && S_ISDIR(entry.meta.mode);
+    } else {
+      entry.isDir = stream.isDirectory(raw);
+    }
+    if (args.showDirsOnly && !entry.isDir)
+      continue;
+
+    entry.name.assign(raw.name, raw.length);
+    entry.isLink = raw.type == DT_LNK;
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @struct StreamFrame
+ * @brief One open directory of a -U descent
+ */
+struct StreamFrame {
+  std::unique_ptr<DirStream> stream; ///< Directory being read
+  StreamEntry entries[2];            ///< Entry to print and the one after
+  unsigned current = 0;              ///< Slot of the entry to print
+  bool more = false;                 ///< Whether entries[current] is loaded
+  int level = 0;                     ///< Depth level (1 = root)
+  size_t prefixLength = 0;           ///< Prefix length to restore when done
+  size_t pathLength = 0;             ///< Path length to restore when done
+  DirAnchor::Ptr anchor;             ///< Anchor the directory reopens from
+  DirAnchor::Ptr below;              ///< Anchor its subdirectories reopen from
+};
+
+/// Most directories a -U descent keeps open; shallower levels are
+/// suspended and reopened when the walk comes back to them
+constexpr size_t kStreamLevels = 64;
+
+/**
+ * @brief Print a directory's entries as the directory yields them (-U)
+ *
+ * Nothing is collected or sorted: each entry is printed as soon as the
+ * entry after it has been read, which settles whether it gets the closing
+ * branch, and subdirectories are printed depth-first in between. Memory
+ * is two entries per level and one read buffer per open level, so the
+ * first line of a directory with millions of entries appears right away.
+ *
+ * The open levels are kept on a heap stack of StreamFrame, and each
+ * subdirectory is opened relative to its parent, so neither the native
+ * stack nor PATH_MAX limits the depth. A directory whose last entry is
+ * the subdirectory being entered is closed first, so a chain of single
+ * folders holds two descriptors whatever its depth. Past kStreamLevels
+ * open levels the shallowest one is suspended, and reopened where it left
+ * off once the walk is back (through ".." of the level below, or from its
+ * DirAnchor), so the descriptor limit does not bound the depth either. A
+ * subdirectory reached through a symbolic link is checked against the
+ * levels above it, as the walker does, and a loop fails with ELOOP
+ * instead of being entered.
+ *
+ * @tparam Mode Bitmask of RenderFlag values (display flags only)
+ * @param dir Directory to print
+ * @param level Depth level of dir (1 = root)
+ * @param args Command-line arguments and options
+ * @param out Output sink
+ * @param prefix Tree drawing characters of this level (restored on return)
+ * @param stats Statistics of the walk
+ */
+template <unsigned Mode>
+static void streamTree(const fs::path &dir, int level, const Args &args,
+                       OutputWriter &out, std::string &prefix,
+                       TreeStats &stats) {
+  std::string path = dir.native(); // Directory being opened or read
+  auto fail = [&](const char *what, int error) {
+    out.flush(); // Keep the message in place relative to the tree
+    std::cerr << "[etree] Failed to enumerate directory '" << path << "': "
+              << fs::filesystem_error(
+                     what, fs::path(path),
+                     std::error_code(error, std::generic_category()))
+                     .what()
+              << std::endl;
+  };
+  // Whether a directory was opened; unreadable ones are shown empty, like
+  // a listed walk does
+  auto opened = [&](const DirStream &stream, int at) {
+    if (stream.fd() < 0 && stream.error() != EACCES) {
+      fail("directory iterator cannot open directory", stream.error());
+      return false;
+    }
+    stats.maxDepth = std::max(stats.maxDepth, at);
+    return stream.fd() >= 0;
+  };
+  // Directories being listed, indexed by level - level of dir: entering
+  // one of them again closes a loop (see DirAncestry)
+  std::vector<FileId> ancestry;
+  auto identify = [](const DirStream &stream) {
+    FileId id;
+    struct stat st;
+    if (fstat(stream.fd(), &st) == 0) {
+      id.dev = static_cast<uint64_t>(st.st_dev);
+      id.ino = static_cast<uint64_t>(st.st_ino);
+    }
+    return id;
+  };
+
+  const unsigned fields = planMetadata(args);
+  std::vector<std::unique_ptr<StreamFrame>> frames;
+  size_t depth = 0;     // Live frames: frames[0, depth)
+  size_t suspended = 0; // Suspended frames: frames[0, suspended)
+  auto push = [&](std::unique_ptr<DirStream> stream, int at,
+                  size_t prefixLength, size_t pathLength,
+                  DirAnchor::Ptr anchor) {
+    if (depth == frames.size())
+      frames.push_back(std::make_unique<StreamFrame>());
+    StreamFrame &f = *frames[depth++];
+    f.stream = std::move(stream);
+    f.level = at;
+    f.prefixLength = prefixLength;
+    f.pathLength = pathLength;
+    f.current = 0;
+    f.more = nextStreamEntry(*f.stream, args, fields, f.entries[0]);
+    // Deep below the anchor: this directory anchors its subdirectories
+    f.anchor = std::move(anchor);
+    f.below = f.anchor;
+    if (path.size() - (f.anchor ? f.anchor->length : 0) > DirAnchor::kSpan)
+      f.below = DirAnchor::open(f.anchor, path);
+    if (depth - suspended > kStreamLevels)
+      frames[suspended++]->stream->suspend();
+  };
+
+  auto root = std::make_unique<DirStream>(AT_FDCWD, path.c_str());
+  if (!opened(*root, level))
+    return;
+  ancestry.push_back(identify(*root));
+  // Reopen a suspended directory where it left off once its subdirectory
+  // is done: through ".." of the subdirectory when that is the directory,
+  // else (links, levels left for a last subdirectory) from its anchor
+  auto resume = [&](StreamFrame &f, const DirStream &done, int doneLevel) {
+    if (!f.more)
+      return;
+    if (doneLevel == f.level + 1 && done.fd() >= 0 &&
+        f.stream->resume(done.fd(), "..") &&
+        identify(*f.stream) == ancestry[static_cast<size_t>(f.level - level)])
+      return;
+    f.stream->suspend();
+    if (!f.stream->resume(DirAnchor::at(f.anchor.get()),
+                          DirAnchor::relative(f.anchor.get(), path)))
+      f.more = false;
+  };
+
+  push(std::move(root), level, prefix.size(), path.size(), nullptr);
+  while (depth > 0) {
+    StreamFrame &f = *frames[depth - 1];
+    if (!f.more) {
+      // Directory done: close it and go back up a level
+      if (f.stream->error() != 0)
+        fail("directory iterator cannot advance", f.stream->error());
+      std::unique_ptr<DirStream> done = std::move(f.stream);
+      f.anchor.reset();
+      f.below.reset();
+      prefix.resize(f.prefixLength);
+      path.resize(f.pathLength);
+      if (--depth > 0 && depth == suspended)
+        resume(*frames[--suspended], *done, f.level);
+      continue;
+    }
+
+    const StreamEntry &current = f.entries[f.current];
+    f.current ^= 1;
+    f.more = nextStreamEntry(*f.stream, args, fields, f.entries[f.current]);
+    const bool last = !f.more;
+    if (current.isDir)
+      stats.folders++;
+    else
+      stats.files++;
+
+    char permBuf[9];
+    std::string_view perms = "-";
+    if constexpr ((Mode & RENDER_PERMS) != 0) {
+      if (current.meta.valid) {
+        formatPermissions(current.meta.mode, permBuf);
+        perms = std::string_view(permBuf, sizeof(permBuf));
+      }
+    }
+    writeTreeLine<Mode>(out, prefix, current.name, current.isDir, last,
+                        current.isDir ? 0 : current.meta.size, perms,
+                        nullptr);
+
+    if (!current.isDir || (args.maxLevel > 0 && f.level >= args.maxLevel))
+      continue;
+    size_t prefixLength = prefix.size();
+    size_t pathLength = path.size();
+    prefix += last ? "    " : "|   ";
+    if (!path.empty() && path.back() != '/')
+      path += '/';
+    path += current.name;
+    auto stream =
+        std::make_unique<DirStream>(f.stream->fd(), current.name.c_str());
+    const int at = f.level + 1;
+    FileId id;
+    bool loop = false;
+    if (stream->fd() >= 0) {
+      id = identify(*stream);
+      ancestry.resize(static_cast<size_t>(at - level));
+      loop = (current.isLink || at % DirAncestry::kLoopCheck == 0) &&
+             std::find(ancestry.begin(), ancestry.end(), id) !=
+                 ancestry.end();
+      if (loop)
+        fail("directory iterator cannot open directory", ELOOP);
+    }
+    if (loop || !opened(*stream, at)) {
+      prefix.resize(prefixLength);
+      path.resize(pathLength);
+      continue;
+    }
+    ancestry.push_back(id);
+    DirAnchor::Ptr anchor = f.below;
+    if (last && f.stream->error() == 0) {
+      // Nothing follows in this directory: let the subdirectory take its
+      // place on the stack
+      prefixLength = f.prefixLength;
+      pathLength = f.pathLength;
+      f.stream.reset();
+      f.anchor.reset();
+      f.below.reset();
+      --depth;
+    }
+    push(std::move(stream), at, prefixLength, pathLength, std::move(anchor));
+  }
+}
+
+/// Entry point of one streamTree() instantiation
+using StreamFn = void (*)(const fs::path &, int, const Args &, OutputWriter &,
+                          std::string &, TreeStats &);
+
+/**
+ * @brief Build the table of -U printers, indexed by RenderFlag bits
+ */
+template <size_t... Modes>
+static constexpr std::array<StreamFn, sizeof...(Modes)>
+streamTable(std::index_sequence<Modes...>) {
+  return {{&streamTree<static_cast<unsigned>(Modes)>...}};
+}
+
+/// -U printers for every combination of the flags below RENDER_DU
+static constexpr auto kStreamers =
+    streamTable(std::make_index_sequence<RENDER_DU>());
+#endif
+
+/**
+ * @brief Work out the renderer specialisation for the selected options
+ *
+ * @param args Command-line arguments and options
+ * @param colors Whether colored output is enabled
+ * @return Bitmask of RenderFlag values
+ */
+unsigned renderMode(const Args &args, bool colors) {
+  // Export mode prints nothing, so the display flags do not matter
+  if (!args.csvOut.empty())
+    return args.arrowOut ? RENDER_CSV | RENDER_ARROW : RENDER_CSV;
+
+  unsigned mode = 0;
+  if (colors)
+    mode |= RENDER_COLORS;
+  if (args.showSize)
+    mode |= RENDER_SIZE;
+  if (args.showPerms)
+    mode |= RENDER_PERMS;
+  if (args.showDirsOnly)
+    mode |= RENDER_DIRS_ONLY;
+  if (args.du)
+    mode |= RENDER_DU;
+  return mode;
+}
+
+/**
+ * @brief Print directory tree (Unix/Linux version)
+ *
+ * Similar to Windows version but simpler:
+ * - Uses narrow strings (UTF-8) throughout
+ * - No RTL wrapping needed (terminals handle it correctly)
+ * - Hidden file detection is simpler (just check for leading dot)
+ *
+ * Directories are enumerated by a TreeWalker: inline for a serial walk, or
+ * ahead of time by a pool of worker threads with -j N. Rendering always
+ * happens here, in serial order. With -U (Linux) entries are printed by
+ * streamTree() as they are read instead.
+ *
+ * @param dir Current directory path to traverse
+ * @param args Command-line arguments and options
+ * @param level Current depth level (1 = root)
+ * @param prefix String prefix for tree drawing characters
+ * @param isLast Whether this directory is the last entry in its parent
+ * @param stats Reference to TreeStats for accumulating data
+ * @param out Output sink for the tree text (the TSV file in export mode)
+ * @param mode Renderer specialisation (see renderMode())
+ * @param relpath Relative path from root directory (for CSV export)
+ * @param watcher Watcher that stores the walked tree (--watch)
+ */
+void printTree(const fs::path &dir, const Args &args, int level,
+               std::string prefix, bool isLast, TreeStats &stats,
+               OutputWriter &out, unsigned mode, std::string relpath,
+               TreeWatcher *watcher) {
+
+  // Check depth limit
+  if (args.maxLevel > 0 && level > args.maxLevel)
+    return;
+
+#ifdef __linux__
+  // -U prints entries as they are read, without listing anything ahead
+  if (args.unsorted) {
+    kStreamers[mode % RENDER_DU](dir, level, args, out, prefix, stats);
+    return;
+  }
+#endif
+
+  // --refresh reuses the previous snapshot; both options save a new one
+  std::unique_ptr<SnapshotReader> previous;
+  std::unique_ptr<SnapshotWriter> snapshot;
+  uint32_t snapRoot = kSnapNone;
+  if (!args.snapshotFile.empty()) {
+    const uint64_t options = snapshotOptions(args);
+    if (args.refresh) {
+      previous = std::make_unique<SnapshotReader>();
+      std::string why;
+      if (previous->open(args.snapshotFile, dir, options, why)) {
+        snapRoot = previous->root();
+      } else {
+        std::cerr << "[etree] " << why << "; listing every directory"
+                  << std::endl;
+        previous.reset();
+      }
+    }
+    snapshot = std::make_unique<SnapshotWriter>(dir, options);
+  }
+
+  TreeWalker walker(args, stats, previous.get(), watcher);
+  std::shared_ptr<DirJob> root = walker.start(
+      dir, level, args.gitignore ? IgnoreFrame::loadParents(dir) : nullptr,
+      snapRoot);
+
+  // --du adds up every subtree before the first line is printed
+  if (args.du) {
+    DiskUsage usage(args);
+    usage.sum(walker, *root);
+    stats.usage = root->usage;
+  }
+
+  // --top prints a report from the listings instead of the tree
+  if (args.topCount > 0) {
+    visitTree(walker, *root);
+    walker.finish();
+    return;
+  }
+
+  RenderFn render = kRenderers[mode % RENDER_CSV];
+  if (mode & RENDER_ARROW)
+    render = &renderTree<RENDER_CSV | RENDER_ARROW>;
+  else if (mode & RENDER_CSV)
+    render = &renderTree<RENDER_CSV>;
+
+  // The Arrow export writes its schema now and its footer at the end
+  std::unique_ptr<ArrowWriter> arrow;
+  if (mode & RENDER_ARROW)
+    arrow = std::make_unique<ArrowWriter>(out);
+
+  RenderContext ctx{std::move(prefix), std::move(relpath), arrow.get(),
+                    snapshot.get()};
+  render(walker, *root, args, out, ctx, stats);
+  walker.finish();
+  if (arrow)
+    arrow->finish();
+
+  if (snapshot && !snapshot->save(args.snapshotFile)) {
+    std::cerr << "[etree] Could not write snapshot " << args.snapshotFile
+              << ": " << std::strerror(errno) << std::endl;
+  }
+}
+#endif
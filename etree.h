@@ -1,218 +1,384 @@
-/**
- * @file etree.h
- * @brief Core directory tree traversal and display functionality for eTree
- *
- * This header defines the main data structures and functions for traversing
- * directory trees and displaying them in a tree format. It includes support
- * for:
- * - Cross-platform file system operations
- * - RTL (Right-to-Left) text handling for Arabic/Hebrew filenames
- * - Colored console output with ANSI escape codes
- * - CSV/TSV export functionality
- * - File metadata (size, permissions, timestamps)
- */
-
-#ifndef ETREE_H
-#define ETREE_H
-
-#include <filesystem>
-#include <string>
-#include <vector>
-
-#ifdef _WIN32
-#include <windows.h>
-#endif
-
-// Forward declaration of Args structure
-struct Args;
-
-/**
- * @struct CsvRow
- * @brief Represents a single row in the CSV/TSV export
- *
- * Each row corresponds to one file or directory in the tree,
- * containing all relevant metadata for export to spreadsheet applications.
- */
-struct CsvRow {
-  std::string relpath;  ///< Relative path from the root directory
-  std::string name;     ///< Filename or directory name
-  std::string type;     ///< "file" or "folder"
-  std::string perms;    ///< Permission string (e.g., "RHSA" on Windows,
-                        ///< "rwxr-xr-x" on Unix)
-  uintmax_t bytes = 0;  ///< File size in bytes (0 for directories)
-  std::string created;  ///< Creation timestamp (YYYY-MM-DD HH:MM:SS)
-  std::string modified; ///< Last modification timestamp (YYYY-MM-DD HH:MM:SS)
-
-  /**
-   * @brief Default constructor - initializes bytes to 0
-   */
-  CsvRow() : bytes(0) {}
-};
-
-/**
- * @struct TreeStats
- * @brief Accumulates statistics during directory tree traversal
- *
- * This structure collects information about the directory tree as it's
- * being traversed, including depth, counts, and CSV export data.
- */
-struct TreeStats {
-  int maxDepth = 0;            ///< Maximum depth reached during traversal
-  int folders = 0;             ///< Total number of directories encountered
-  int files = 0;               ///< Total number of files encountered
-  std::vector<CsvRow> csvRows; ///< Collection of rows for CSV export
-};
-
-// Platform-specific declarations
-#ifdef _WIN32
-// Windows-specific: Wide character (UTF-16) support for Unicode filenames
-
-// ANSI color escape sequences for console output
-extern const wchar_t *dircolor;   ///< Color for directory names (blue)
-extern const wchar_t *filecolor;  ///< Color for file names (green)
-extern const wchar_t *permcolor;  ///< Color for permissions (cyan)
-extern const wchar_t *sizecolor;  ///< Color for file sizes (yellow)
-extern const wchar_t *resetcolor; ///< Reset to default color
-
-/**
- * @brief Check if running in Windows Terminal (supports ANSI colors)
- * @return true if Windows Terminal is detected, false otherwise
- */
-bool is_windows_terminal();
-
-/**
- * @brief Format an integer with locale-specific thousand separators
- * @param value The integer value to format
- * @return Formatted wide string with commas (e.g., "1,234,567")
- */
-std::wstring formatIntWithCommas(uintmax_t value);
-
-/**
- * @brief Format a byte count as a human-readable size string
- * @param bytes Number of bytes
- * @return Formatted string with " B" suffix (e.g., "1,234 B")
- */
-std::wstring formatSizeBytes(uintmax_t bytes);
-
-/**
- * @brief Check if a wide string contains RTL (Right-to-Left) characters
- *
- * Detects Arabic, Hebrew, and other RTL script characters that require
- * special handling for proper console display.
- *
- * @param s Wide string to check
- * @return true if RTL characters are found, false otherwise
- */
-bool contains_rtl(const std::wstring &s);
-
-/**
- * @brief Wrap RTL text for proper console display
- *
- * Windows console doesn't handle bidirectional text correctly, so this
- * function reverses RTL character sequences while preserving LTR text
- * and spacing. This is only needed for console output, not file output.
- *
- * @param s Wide string potentially containing RTL text
- * @return Wrapped string with RTL sequences reversed
- */
-std::wstring wrap_rtl(std::wstring s);
-
-/**
- * @brief Convert wide string (UTF-16) to UTF-8 string
- *
- * Used for file output where UTF-8 encoding is required instead of
- * the UTF-16 used for console output on Windows.
- *
- * @param w Wide string to convert
- * @return UTF-8 encoded string
- */
-std::string wstring_to_utf8(const std::wstring &w);
-
-/**
- * @brief Recursively print directory tree (Windows version)
- *
- * @param path Current directory path to traverse
- * @param args Command-line arguments and options
- * @param level Current depth level (starts at 1)
- * @param prefix Wide string prefix for tree drawing characters
- * @param isLast Whether this is the last entry in current directory
- * @param stats Reference to TreeStats for accumulating data
- * @param relpath Relative path from root (for CSV export)
- */
-void printTree(const std::filesystem::path &, const Args &, int, std::wstring,
-               bool, TreeStats &, std::wstring relpath = L"");
-
-#else
-// Unix/Linux-specific: Narrow character (UTF-8) support
-
-// ANSI color escape sequences for console output
-extern const char *dircolor;   ///< Color for directory names (blue)
-extern const char *filecolor;  ///< Color for file names (green)
-extern const char *permcolor;  ///< Color for permissions (cyan)
-extern const char *sizecolor;  ///< Color for file sizes (yellow)
-extern const char *resetcolor; ///< Reset to default color
-
-/**
- * @brief Format an integer with locale-specific thousand separators
- * @param value The integer value to format
- * @return Formatted string with commas (e.g., "1,234,567")
- */
-std::string formatIntWithCommas(uintmax_t value);
-
-/**
- * @brief Format a byte count as a human-readable size string
- * @param bytes Number of bytes
- * @return Formatted string with " B" suffix (e.g., "1,234 B")
- */
-std::string formatSizeBytes(uintmax_t bytes);
-
-/**
- * @brief Recursively print directory tree (Unix/Linux version)
- *
- * @param path Current directory path to traverse
- * @param args Command-line arguments and options
- * @param level Current depth level (starts at 1)
- * @param prefix String prefix for tree drawing characters
- * @param isLast Whether this is the last entry in current directory
- * @param stats Reference to TreeStats for accumulating data
- * @param relpath Relative path from root (for CSV export)
- */
-void printTree(const std::filesystem::path &, const Args &, int, std::string,
-               bool, TreeStats &, std::string relpath = "");
-#endif
-
-/**
- * @brief Get permission string for a file or directory
- *
- * On Windows: Returns attribute flags (R=ReadOnly, H=Hidden, S=System,
- * A=Archive) On Unix/Linux: Returns Unix-style permissions (e.g., "rwxr-xr-x")
- *
- * @param entry Directory entry to get permissions for
- * @return Permission string
- */
-std::string getPermissions(const std::filesystem::directory_entry &);
-
-/**
- * @brief Determine if colored output should be enabled
- *
- * Colors are enabled if:
- * - nocolors flag is not set, AND
- * - Output is going to a console (not redirected to file)
- *
- * @param nocolors User's --no-colors flag
- * @return true if colors should be enabled, false otherwise
- */
-bool enable_colors(bool nocolors);
-
-/**
- * @brief Check if stdout is connected to a console
- *
- * Returns false if output is redirected to a file or piped to another program.
- * This is used to determine whether to use console-specific features like
- * colors and wide character output.
- *
- * @return true if stdout is a console, false if redirected/piped
- */
-bool is_console();
-
-#endif
+/**
+ * @file etree.h
+ * @brief Core directory tree traversal and display functionality for eTree
+ *
+ * This header defines the main data structures and functions for traversing
+ * directory trees and displaying them in a tree format. It includes support
+ * for:
+ * - Cross-platform file system operations
+ * - RTL (Right-to-Left) text handling for Arabic/Hebrew filenames
+ * - Colored console output with ANSI escape codes
+ * - CSV/TSV export functionality
+ * - File metadata (size, permissions, timestamps)
+ */
+
+#ifndef ETREE_H
+#define ETREE_H
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "du.h"
+#include "format.h"
+#include "ignore.h"
+#include "meta.h"
+#include "spill.h"
+#include "top.h"
+#endif
+
+// Forward declaration of Args structure
+struct Args;
+
+/**
+ * @struct CsvRow
+ * @brief Represents a single row in the CSV/TSV export
+ *
+ * Each row corresponds to one file or directory in the tree,
+ * containing all relevant metadata for export to spreadsheet applications.
+ */
+struct CsvRow {
+  std::string relpath;  ///< Relative path from the root directory
+  std::string name;     ///< Filename or directory name
+  std::string type;     ///< "file" or "folder"
+  std::string perms;    ///< Permission string (e.g., "RHSA" on Windows,
+                        ///< "rwxr-xr-x" on Unix)
+  uintmax_t bytes = 0;  ///< File size in bytes (0 for directories)
+  std::string created;  ///< Creation timestamp (YYYY-MM-DD HH:MM:SS)
+  std::string modified; ///< Last modification timestamp (YYYY-MM-DD HH:MM:SS)
+
+  /**
+   * @brief Default constructor - initializes bytes to 0
+   */
+  CsvRow() : bytes(0) {}
+};
+
+/**
+ * @struct TreeStats
+ * @brief Accumulates statistics during directory tree traversal
+ *
+ * This structure collects information about the directory tree as it's
+ * being traversed, including depth, counts, and CSV export data.
+ */
+struct TreeStats {
+  int maxDepth = 0;            ///< Maximum depth reached during traversal
+  int folders = 0;             ///< Total number of directories encountered
+  int files = 0;               ///< Total number of files encountered
+  std::vector<CsvRow> csvRows; ///< Rows for CSV export (Windows; Unix
+                               ///< streams them, see writeTsvRow())
+#ifndef _WIN32
+  DuTotals usage; ///< Totals of the whole tree (--du; not merged)
+  TopList top;    ///< Best entries this thread listed (--top)
+#endif
+
+  /**
+   * @brief Fold statistics collected by another traversal thread into these
+   *
+   * Counters are summed, depth takes the maximum, CSV rows are appended
+   * and the --top lists are merged.
+   *
+   * @param other Statistics gathered by a worker thread
+   */
+  void merge(const TreeStats &other);
+};
+
+// Platform-specific declarations
+#ifdef _WIN32
+// Windows-specific: Wide character (UTF-16) support for Unicode filenames
+
+// ANSI color escape sequences for console output
+extern const wchar_t *dircolor;   ///< Color for directory names (blue)
+extern const wchar_t *filecolor;  ///< Color for file names (green)
+extern const wchar_t *permcolor;  ///< Color for permissions (cyan)
+extern const wchar_t *sizecolor;  ///< Color for file sizes (yellow)
+extern const wchar_t *resetcolor; ///< Reset to default color
+
+/**
+ * @brief Check if running in Windows Terminal (supports ANSI colors)
+ * @return true if Windows Terminal is detected, false otherwise
+ */
+bool is_windows_terminal();
+
+/**
+ * @brief Format an integer with locale-specific thousand separators
+ * @param value The integer value to format
+ * @return Formatted wide string with commas (e.g., "1,234,567")
+ */
+std::wstring formatIntWithCommas(uintmax_t value);
+
+/**
+ * @brief Format a byte count as a human-readable size string
+ * @param bytes Number of bytes
+ * @return Formatted string with " B" suffix (e.g., "1,234 B")
+ */
+std::wstring formatSizeBytes(uintmax_t bytes);
+
+/**
+ * @brief Check if a wide string contains RTL (Right-to-Left) characters
+ *
+ * Detects Arabic, Hebrew, and other RTL script characters that require
+ * special handling for proper console display.
+ *
+ * @param s Wide string to check
+ * @return true if RTL characters are found, false otherwise
+ */
+bool contains_rtl(const std::wstring &s);
+
+/**
+ * @brief Wrap RTL text for proper console display
+ *
+ * Windows console doesn't handle bidirectional text correctly, so this
+ * function reverses RTL character sequences while preserving LTR text
+ * and spacing. This is only needed for console output, not file output.
+ *
+ * @param s Wide string potentially containing RTL text
+ * @return Wrapped string with RTL sequences reversed
+ */
+std::wstring wrap_rtl(std::wstring s);
+
+/**
+ * @brief Convert wide string (UTF-16) to UTF-8 string
+ *
+ * Used for file output where UTF-8 encoding is required instead of
+ * the UTF-16 used for console output on Windows.
+ *
+ * @param w Wide string to convert
+ * @return UTF-8 encoded string
+ */
+std::string wstring_to_utf8(const std::wstring &w);
+
+/**
+ * @brief Recursively print directory tree (Windows version)
+ *
+ * @param path Current directory path to traverse
+ * @param args Command-line arguments and options
+ * @param level Current depth level (starts at 1)
+ * @param prefix Wide string prefix for tree drawing characters
+ * @param isLast Whether this is the last entry in current directory
+ * @param stats Reference to TreeStats for accumulating data
+ * @param relpath Relative path from root (for CSV export)
+ */
+void printTree(const std::filesystem::path &, const Args &, int, std::wstring,
+               bool, TreeStats &, std::wstring relpath = L"");
+
+#else
+// Unix/Linux-specific: Narrow character (UTF-8) support
+
+class OutputWriter;
+class TreeWatcher;
+struct DirAnchor;
+
+// ANSI color escape sequences for console output
+extern const char *dircolor;   ///< Color for directory names (blue)
+extern const char *filecolor;  ///< Color for file names (green)
+extern const char *permcolor;  ///< Color for permissions (cyan)
+extern const char *sizecolor;  ///< Color for file sizes (yellow)
+extern const char *resetcolor; ///< Reset to default color
+
+/**
+ * @brief Write the Unix-style permission characters for mode bits
+ * @param mode st_mode value (only the permission bits are used)
+ * @param perms Receives 9 characters (e.g., "rwxr-xr-x"), not terminated
+ */
+void formatPermissions(unsigned mode, char *perms);
+
+/**
+ * @brief Build a Unix-style permission string from mode bits
+ * @param mode st_mode value (only the permission bits are used)
+ * @return Permission string (e.g., "rwxr-xr-x")
+ */
+std::string permissionsString(unsigned mode);
+
+/**
+ * @struct WalkEntry
+ * @brief One filtered directory entry with the metadata needed for output
+ *
+ * Produced by listDirectory() so that every filesystem call for an entry is
+ * made by the thread that enumerates its directory, and the renderer only
+ * formats values that were already fetched. All output (tree columns, TSV
+ * rows) reads the entry's metadata from the single FileMeta record.
+ */
+struct WalkEntry {
+  std::string_view name; ///< Name (NUL-terminated, in the listing's arena
+                         ///< or the --refresh snapshot)
+  bool isDir = false;   ///< Whether the entry is (or links to) a directory
+  bool matched = false; ///< Entry itself matched an include pattern (-P)
+  bool isLink = false;  ///< Entry is a symbolic link (followed if isDir)
+  uint32_t snapDir = UINT32_MAX; ///< Record of the subdirectory in the
+                                 ///< --refresh snapshot (none: UINT32_MAX)
+  FileMeta meta;        ///< Metadata fetched for the selected options
+};
+
+/**
+ * @struct DirListing
+ * @brief Result of enumerating a single directory
+ *
+ * Entry names live in the names arena, so a listing may be moved (the
+ * arena's storage moves with it) but not copied. Listings are recycled by
+ * the walker: clear() keeps the capacity of both buffers.
+ */
+struct DirListing {
+  bool ok = false;                ///< false if the directory could not be read
+  std::string error;              ///< Error message when ok is false
+  std::vector<WalkEntry> entries; ///< Filtered entries in display order
+  std::vector<char> names;        ///< Arena with every entry name
+  IgnoreFrame::Ptr ignore;        ///< Rules for subdirectories (--gitignore)
+  DirStamp stamp;                 ///< Taken before listing (loop checks and
+                                  ///< --snapshot)
+  bool hasIgnoreFiles = false;    ///< Has a .gitignore or .ignore file
+  DuTotals usage;                 ///< Files with one link (--du only)
+  std::vector<LinkedFile> linked; ///< Files with several links (--du only)
+#ifdef __linux__
+  std::unique_ptr<SpillFile> spill; ///< Sorted runs of files moved out of
+                                    ///< entries (--mem-limit; null if none)
+#endif
+
+  DirListing() = default;
+  DirListing(DirListing &&) = default;
+  DirListing &operator=(DirListing &&) = default;
+  DirListing(const DirListing &) = delete;
+  DirListing &operator=(const DirListing &) = delete;
+
+  /**
+   * @brief Empty the listing for reuse, keeping the buffers' capacity
+   */
+  void clear() {
+    ok = false;
+    error.clear();
+    entries.clear();
+    names.clear();
+    ignore.reset();
+    stamp = DirStamp();
+    hasIgnoreFiles = false;
+    usage = DuTotals();
+    linked.clear();
+#ifdef __linux__
+    spill.reset();
+#endif
+  }
+};
+
+/**
+ * @brief Enumerate, filter, sort and stat the entries of one directory
+ *
+ * Applies the hidden/exclude/ignore/dirs-only filters, sorts the entries
+ * (sortListing()) and fetches the metadata the selected output options
+ * need (see planMetadata()). With --du the files are tallied
+ * (tallyUsage()) before -d drops them; with --top the entries are offered
+ * to stats.top. With --mem-limit the files of a huge directory are moved
+ * to sorted runs in listing.spill as they are read (see spill.h). The
+ * directory and its entries are counted in stats (depth, folders, files).
+ * Safe to call from several threads at once with distinct stats objects.
+ *
+ * @param dir Directory to enumerate
+ * @param args Command-line arguments and options
+ * @param level Depth level of dir (1 = root)
+ * @param ignore Ignore rules inherited from the parent (--gitignore)
+ * @param stats Statistics of the calling thread
+ * @param listing Receives the listing; cleared first, its buffers are reused
+ * @param anchor Ancestor to open dir from (Linux, see DirAnchor; null:
+ *        open dir by its whole path)
+ */
+void listDirectory(const std::string &dir, const Args &args, int level,
+                   const IgnoreFrame::Ptr &ignore, TreeStats &stats,
+                   DirListing &listing, const DirAnchor *anchor = nullptr);
+
+/**
+ * @brief Add a directory's entries to the walk statistics (unless -P)
+ *
+ * @param listing Listing of the directory
+ * @param args Command-line arguments and options
+ * @param level Depth level of the directory (1 = root)
+ * @param stats Statistics of the calling thread
+ */
+void countListing(const DirListing &listing, const Args &args, int level,
+                  TreeStats &stats);
+
+/**
+ * @brief Output features the tree renderer is specialised for
+ *
+ * main() works out the combination once (see renderMode()) and printTree()
+ * runs the renderer instantiated for it, so the per-entry loop tests no
+ * options.
+ */
+enum RenderFlag : unsigned {
+  RENDER_COLORS = 1u << 0,    ///< ANSI colors
+  RENDER_SIZE = 1u << 1,      ///< Size column (-s)
+  RENDER_PERMS = 1u << 2,     ///< Permissions column (-p)
+  RENDER_DIRS_ONLY = 1u << 3, ///< Only directories are listed (-d)
+  RENDER_DU = 1u << 4,        ///< Folders show subtree totals (--du)
+  RENDER_CSV = 1u << 5,       ///< Stream TSV rows instead of printing (-o)
+  RENDER_ARROW = 1u << 6,     ///< Export rows go to an Arrow file (with CSV)
+};
+
+/**
+ * @brief Work out the renderer specialisation for the selected options
+ * @param args Command-line arguments and options
+ * @param colors Whether colored output is enabled
+ * @return Bitmask of RenderFlag values
+ */
+unsigned renderMode(const Args &args, bool colors);
+
+/**
+ * @brief Print directory tree (Unix/Linux version)
+ *
+ * The tree is walked with explicit stacks of open directories, so its
+ * depth is limited neither by the native stack nor by PATH_MAX.
+ *
+ * @param path Current directory path to traverse
+ * @param args Command-line arguments and options
+ * @param level Current depth level (starts at 1)
+ * @param prefix String prefix for tree drawing characters
+ * @param isLast Whether this is the last entry in current directory
+ * @param stats Reference to TreeStats for accumulating data
+ * @param out Output sink for the tree text (the TSV file in export mode)
+ * @param mode Renderer specialisation (see renderMode())
+ * @param relpath Relative path from root (for CSV export)
+ * @param watcher Watcher that stores the walked tree (--watch; may be
+ *        null)
+ */
+void printTree(const std::filesystem::path &, const Args &, int, std::string,
+               bool, TreeStats &, OutputWriter &out, unsigned mode,
+               std::string relpath = "", TreeWatcher *watcher = nullptr);
+#endif
+
+/**
+ * @brief Get permission string for a file or directory
+ *
+ * On Windows: Returns attribute flags (R=ReadOnly, H=Hidden, S=System,
+ * A=Archive) On Unix/Linux: Returns Unix-style permissions (e.g., "rwxr-xr-x")
+ *
+ * @param entry Directory entry to get permissions for
+ * @return Permission string
+ */
+std::string getPermissions(const std::filesystem::directory_entry &);
+
+/**
+ * @brief Determine if colored output should be enabled
+ *
+ * Colors are enabled if:
+ * - nocolors flag is not set, AND
+ * - Output is going to a console (not redirected to file)
+ *
+ * @param nocolors User's --no-colors flag
+ * @return true if colors should be enabled, false otherwise
+ */
+bool enable_colors(bool nocolors);
+
+/**
+ * @brief Check if stdout is connected to a console
+ *
+ * Returns false if output is redirected to a file or piped to another program.
+ * This is used to determine whether to use console-specific features like
+ * colors and wide character output.
+ *
+ * @return true if stdout is a console, false if redirected/piped
+ */
+bool is_console();
+
+#endif
@@ -0,0 +1,211 @@
+/**
+ * @file format.cpp
+ * @brief Number and size formatting implementation for eTree
+ *
+ * Numbers are written backwards from their last digit, two digits per
+ * division, and a separator is inserted whenever the current group of the
+ * locale's grouping pattern is full. The result matches what an ostream
+ * imbued with the same locale prints.
+ */
+
+#include "format.h"
+
+#ifndef _WIN32
+
+#include "args.h"
+#include "output.h"
+#include <charconv>
+#include <climits>
+#include <cstring>
+#include <locale>
+#include <stdexcept>
+
+namespace {
+
+/// "00" to "99": the two digits of every value below 100
+constexpr char kDigitPairs[] = "00010203040506070809"
+                               "10111213141516171819"
+                               "20212223242526272829"
+                               "30313233343536373839"
+                               "40414243444546474849"
+                               "50515253545556575859"
+                               "60616263646566676869"
+                               "70717273747576777879"
+                               "80818283848586878889"
+                               "90919293949596979899";
+
+/// Unit names of the scaled size styles, from bytes up to exbibytes
+const char *const kIecUnits[] = {"B", "KiB", "MiB", "GiB", "TiB", "PiB", "EiB"};
+const char *const kSiUnits[] = {"B", "kB", "MB", "GB", "TB", "PB", "EB"};
+constexpr int kLargestUnit = 6;
+
+/// Number punctuation read from the locale by initFormat()
+struct NumberStyle {
+  std::string grouping;  ///< numpunct::grouping() ("" = no separators)
+  char separator = ',';  ///< numpunct::thousands_sep()
+  char point = '.';      ///< numpunct::decimal_point()
+  unsigned sizeBase = 0; ///< 1024 (-h), 1000 (--si) or 0 (exact bytes)
+};
+
+NumberStyle style;
+
+/**
+ * @brief Append a short string
+ */
+char *append(char *p, const char *text) {
+  const size_t n = std::strlen(text);
+  std::memcpy(p, text, n);
+  return p + n;
+}
+
+} // namespace
+
+/**
+ * @brief Read the locale's number punctuation and pick the size style
+ *
+ * @param args Command-line arguments (-h, --si)
+ */
+void initFormat(const Args &args) {
+  style = NumberStyle();
+  style.sizeBase = args.sizeBase;
+  try {
+    const std::locale locale("");
+    const auto &punct = std::use_facet<std::numpunct<char>>(locale);
+    style.grouping = punct.grouping();
+    style.separator = punct.thousands_sep();
+    style.point = punct.decimal_point();
+  } catch (const std::runtime_error &) {
+    // Unknown locale name: keep the "C" locale's plain digits
+  }
+}
+
+/**
+ * @brief Write an integer with the locale's thousands separators
+ *
+ * Grouping follows numpunct: grouping[i] is the size of the i-th group
+ * from the right, the last size repeats, and a size of 0 or CHAR_MAX ends
+ * the grouping.
+ *
+ * @param value Number to format
+ * @param buffer Receives at most kMaxNumberText characters
+ * @return End of the text written
+ */
+char *formatInt(uintmax_t value, char *buffer) {
+  const std::string &grouping = style.grouping;
+  if (grouping.empty())
+    return std::to_chars(buffer, buffer + kMaxNumberText, value).ptr;
+
+  char text[kMaxNumberText];
+  char *p = text + sizeof(text);
+  size_t group = 0;                   // Index into grouping
+  int left = grouping[0];             // Digits until the next separator
+  auto emit = [&](char digit) {
+    if (left == 0) {
+      *--p = style.separator;
+      if (group + 1 < grouping.size())
+        ++group;
+      const int size = grouping[group];
+      left = size > 0 && size != CHAR_MAX ? size : -1;
+    }
+    *--p = digit;
+    if (left > 0)
+      --left;
+  };
+  if (left <= 0 || left == CHAR_MAX)
+    left = -1;
+
+  while (value >= 100) {
+    const unsigned pair = static_cast<unsigned>(value % 100) * 2;
+    value /= 100;
+    emit(kDigitPairs[pair + 1]);
+    emit(kDigitPairs[pair]);
+  }
+  if (value >= 10) {
+    const unsigned pair = static_cast<unsigned>(value) * 2;
+    emit(kDigitPairs[pair + 1]);
+    emit(kDigitPairs[pair]);
+  } else {
+    emit(static_cast<char>('0' + value));
+  }
+
+  const size_t length = static_cast<size_t>(text + sizeof(text) - p);
+  std::memcpy(buffer, p, length);
+  return buffer + length;
+}
+
+/**
+ * @brief Write a byte count in the selected size style
+ *
+ * @param bytes Number of bytes
+ * @param buffer Receives at most kMaxNumberText characters
+ * @return End of the text written
+ */
+char *formatSize(uintmax_t bytes, char *buffer) {
+  const unsigned base = style.sizeBase;
+  if (base == 0 || bytes < base) {
+    char *p = formatInt(bytes, buffer);
+    return append(p, " B");
+  }
+
+  double value = static_cast<double>(bytes);
+  int unit = 0;
+  while (value >= base && unit < kLargestUnit) {
+    value /= base;
+    ++unit;
+  }
+
+  // One decimal below 10, none above; rounding up may reach the next unit
+  uint64_t tenths = static_cast<uint64_t>(value * 10 + 0.5);
+  if (tenths >= 100)
+    tenths = static_cast<uint64_t>(value + 0.5) * 10;
+  if (tenths >= uint64_t(base) * 10 && unit < kLargestUnit) {
+    ++unit;
+    tenths = 10;
+  }
+
+  char *p = buffer;
+  if (tenths < 100) {
+    *p++ = static_cast<char>('0' + tenths / 10);
+    *p++ = style.point;
+    *p++ = static_cast<char>('0' + tenths % 10);
+  } else {
+    p = std::to_chars(p, buffer + kMaxNumberText, tenths / 10).ptr;
+  }
+  *p++ = ' ';
+  return append(p, (base == 1024 ? kIecUnits : kSiUnits)[unit]);
+}
+
+/**
+ * @brief Append a byte count in the selected size style to the output
+ *
+ * @param out Output sink
+ * @param bytes Number of bytes
+ */
+void writeSize(OutputWriter &out, uintmax_t bytes) {
+  char *p = out.reserve(kMaxNumberText);
+  out.commit(formatSize(bytes, p));
+}
+
+/**
+ * @brief Format an integer with locale-specific thousand separators
+ *
+ * @param value The integer value to format
+ * @return Formatted string with thousand separators
+ */
+std::string formatIntWithCommas(uintmax_t value) {
+  char text[kMaxNumberText];
+  return std::string(text, formatInt(value, text));
+}
+
+/**
+ * @brief Format a byte count in the selected size style
+ *
+ * @param bytes Number of bytes
+ * @return Formatted string with its unit
+ */
+std::string formatSizeBytes(uintmax_t bytes) {
+  char text[kMaxNumberText];
+  return std::string(text, formatSize(bytes, text));
+}
+
+#endif
@@ -0,0 +1,85 @@
+/**
+ * @file format.h
+ * @brief Number and size formatting for eTree (Unix/Linux)
+ *
+ * This header declares the formatting used for the size column (-s), the
+ * --watch change lines and the --diff report. The system locale's digit
+ * grouping, thousands separator and decimal point are read once by
+ * initFormat(); after that a number is formatted with no locale or stream
+ * object at all: digits are produced two at a time from a digit-pair
+ * table (or by std::to_chars when the locale does not group) straight
+ * into the caller's buffer, which can be the output buffer itself.
+ *
+ * Size styles:
+ *   default   exact bytes with thousands separators   "1,234,567 B"
+ *   -h        IEC units (powers of 1024)              "1.2 MiB"
+ *   --si      SI units (powers of 1000)               "1.2 MB"
+ * Scaled sizes show one decimal below 10 and none above, rounded to the
+ * nearest value.
+ */
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#ifndef _WIN32
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct Args;
+class OutputWriter;
+
+/// Longest text formatInt() or formatSize() writes
+constexpr size_t kMaxNumberText = 64;
+
+/**
+ * @brief Read the locale's number punctuation and pick the size style
+ *
+ * Call once at startup, before any thread formats a number. An invalid
+ * locale setting (LANG, LC_ALL, LC_NUMERIC) falls back to plain digits.
+ *
+ * @param args Command-line arguments (-h, --si)
+ */
+void initFormat(const Args &args);
+
+/**
+ * @brief Write an integer with the locale's thousands separators
+ * @param value Number to format
+ * @param buffer Receives at most kMaxNumberText characters
+ * @return End of the text written
+ */
+char *formatInt(uintmax_t value, char *buffer);
+
+/**
+ * @brief Write a byte count in the selected size style
+ * @param bytes Number of bytes
+ * @param buffer Receives at most kMaxNumberText characters
+ * @return End of the text written
+ */
+char *formatSize(uintmax_t bytes, char *buffer);
+
+/**
+ * @brief Append a byte count in the selected size style to the output
+ * @param out Output sink (the text is formatted in its buffer)
+ * @param bytes Number of bytes
+ */
+void writeSize(OutputWriter &out, uintmax_t bytes);
+
+/**
+ * @brief Format an integer with locale-specific thousand separators
+ * @param value The integer value to format
+ * @return Formatted string with commas (e.g., "1,234,567")
+ */
+std::string formatIntWithCommas(uintmax_t value);
+
+/**
+ * @brief Format a byte count in the selected size style
+ * @param bytes Number of bytes
+ * @return Formatted string (e.g., "1,234 B", or "1.2 KiB" with -h)
+ */
+std::string formatSizeBytes(uintmax_t bytes);
+
+#endif
+
+#endif
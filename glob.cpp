@@ -0,0 +1,740 @@
+/**
+ * @file glob.cpp
+ * @brief Compiled wildcard (glob) pattern implementation for eTree
+ *
+ * Matching uses the classic single-backtrack wildcard algorithm: on a
+ * mismatch the most recent * absorbs one more character and matching
+ * resumes after it. It works in place on the name, so the hot loop of the
+ * tree walk tests each entry without allocating.
+ *
+ * GlobSet runs its general patterns as one shift-and automaton: every
+ * pattern position is a bit, a step shifts the active bits one position
+ * forward and masks them with the positions that accept the character,
+ * and star positions keep their bit set. All patterns advance together
+ * with a few word operations per character.
+ */
+
+#include "glob.h"
+
+#include <algorithm>
+
+namespace {
+
+/**
+ * @brief Decode one UTF-8 character
+ *
+ * Invalid or truncated sequences yield their first byte mapped into a
+ * private range (0x110000 + byte), so a raw byte in a name still matches
+ * the same raw byte in a pattern and nothing else.
+ *
+ * @param s String to decode from
+ * @param i Offset of the character; advanced past it
+ * @return Code point
+ */
+uint32_t decodeUtf8(std::string_view s, size_t &i) {
+  unsigned char b = static_cast<unsigned char>(s[i]);
+  if (b < 0x80) {
+    ++i;
+    return b;
+  }
+
+  size_t len = (b >= 0xF0 && b < 0xF8) ? 4
+               : (b >= 0xE0)           ? 3
+               : (b >= 0xC2)           ? 2
+                                       : 0;
+  if (len == 0 || len > 4 || i + len > s.size()) {
+    ++i;
+    return 0x110000 + b;
+  }
+
+  uint32_t cp = b & (0xFF >> (len + 1));
+  for (size_t k = 1; k < len; ++k) {
+    unsigned char c = static_cast<unsigned char>(s[i + k]);
+    if ((c & 0xC0) != 0x80) {
+      ++i;
+      return 0x110000 + b;
+    }
+    cp = (cp << 6) | (c & 0x3F);
+  }
+  i += len;
+  return cp;
+}
+
+/**
+ * @brief Fold a code point to lower case
+ *
+ * Covers ASCII plus the common alphabets whose case mapping is a fixed
+ * offset or an even/odd pair: Latin-1, Latin Extended-A, Greek, Cyrillic.
+ *
+ * @param c Code point
+ * @return Lower-case code point (c itself if it has no simple mapping)
+ */
+uint32_t foldCase(uint32_t c) {
+  if (c < 0x80)
+    return (c >= 'A' && c <= 'Z') ? c + 32 : c;
+  if (c >= 0xC0 && c <= 0xDE && c != 0xD7) // Latin-1 Supplement
+    return c + 0x20;
+  if (c >= 0x100 && c <= 0x137 && !(c & 1)) // Latin Extended-A (pairs)
+    return c + 1;
+  if (c >= 0x139 && c <= 0x148 && (c & 1))
+    return c + 1;
+  if (c >= 0x14A && c <= 0x177 && !(c & 1))
+    return c + 1;
+  if (c >= 0x391 && c <= 0x3AB && c != 0x3A2) // Greek
+    return c + 0x20;
+  if (c >= 0x400 && c <= 0x40F) // Cyrillic
+    return c + 0x50;
+  if (c >= 0x410 && c <= 0x42F)
+    return c + 0x20;
+  return c;
+}
+
+/**
+ * @brief Case-insensitive FNV-1a hash of a string
+ *
+ * @param s String (UTF-8)
+ * @return Hash of the case-folded code points
+ */
+uint64_t foldedHash(std::string_view s) {
+  uint64_t h = 14695981039346656037ull;
+  size_t i = 0;
+  while (i < s.size()) {
+    h ^= foldCase(decodeUtf8(s, i));
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+/**
+ * @brief Case-insensitive string comparison
+ *
+ * @param a First string (UTF-8)
+ * @param b Second string (UTF-8)
+ * @return true if both strings fold to the same code points
+ */
+bool foldedEqual(std::string_view a, std::string_view b) {
+  size_t i = 0, j = 0;
+  while (i < a.size() && j < b.size()) {
+    if (foldCase(decodeUtf8(a, i)) != foldCase(decodeUtf8(b, j)))
+      return false;
+  }
+  return i == a.size() && j == b.size();
+}
+
+/**
+ * @brief Look up a string in a folded-hash table
+ *
+ * @param table Table keyed by foldedHash()
+ * @param s String to find
+ * @return true if a case-insensitively equal string is present
+ */
+bool foldedContains(const std::unordered_multimap<uint64_t, std::string> &table,
+                    std::string_view s) {
+  auto range = table.equal_range(foldedHash(s));
+  for (auto it = range.first; it != range.second; ++it)
+    if (foldedEqual(it->second, s))
+      return true;
+  return false;
+}
+
+/**
+ * @brief Check if a string contains any wildcard character
+ */
+bool hasWildcard(std::string_view s) {
+  return s.find_first_of("*?[") != std::string_view::npos;
+}
+
+/// Set bit i of a multi-word bit vector
+inline void setBit(std::vector<uint64_t> &v, size_t i) {
+  v[i / 64] |= uint64_t(1) << (i % 64);
+}
+
+} // namespace
+
+/**
+ * @brief Compile a wildcard pattern into a token program
+ *
+ * Consecutive stars are merged, literals are stored case-folded (unless
+ * CaseSensitive) and an unterminated [ is taken literally.
+ *
+ * @param pattern Pattern text (UTF-8)
+ * @param flags Bitmask of Flags values
+ */
+GlobPattern::GlobPattern(const std::string &pattern, unsigned flags)
+    : caseSensitive_(flags & CaseSensitive) {
+  std::string_view p(pattern);
+  auto fold = [this](uint32_t c) { return caseSensitive_ ? c : foldCase(c); };
+
+  for (unsigned char ch : pattern)
+    if (ch >= 0x80)
+      ascii_ = false;
+
+  size_t i = 0;
+  while (i < p.size()) {
+    char ch = p[i];
+
+    if (ch == '\\' && (flags & Escapes) && i + 1 < p.size()) {
+      ++i;
+      tokens_.push_back({Kind::Literal, fold(decodeUtf8(p, i))});
+      continue;
+    }
+
+    if (ch == '*') {
+      ++i;
+      if (tokens_.empty() || tokens_.back().kind != Kind::Star)
+        tokens_.push_back({Kind::Star, 0});
+      continue;
+    }
+
+    if (ch == '?') {
+      ++i;
+      tokens_.push_back({Kind::AnyOne, 0});
+      continue;
+    }
+
+    if (ch == '[') {
+      // Find the closing bracket; a ] right after [ or [! is a member
+      size_t j = i + 1;
+      if (j < p.size() && (p[j] == '!' || p[j] == '^'))
+        ++j;
+      if (j < p.size() && p[j] == ']')
+        ++j;
+      while (j < p.size() && p[j] != ']')
+        ++j;
+
+      if (j < p.size()) {
+        CharClass cls;
+        size_t k = i + 1;
+        if (p[k] == '!' || p[k] == '^') {
+          cls.negate = true;
+          ++k;
+        }
+        while (k < j) {
+          uint32_t lo = decodeUtf8(p, k);
+          uint32_t hi = lo;
+          if (k + 1 < j && p[k] == '-') {
+            ++k;
+            hi = decodeUtf8(p, k);
+          }
+          cls.ranges.push_back({lo, hi, fold(lo), fold(hi)});
+        }
+        tokens_.push_back(
+            {Kind::Class, static_cast<uint32_t>(classes_.size())});
+        classes_.push_back(std::move(cls));
+        i = j + 1;
+        continue;
+      }
+      // No closing bracket: fall through and match [ literally
+    }
+
+    tokens_.push_back({Kind::Literal, fold(decodeUtf8(p, i))});
+  }
+}
+
+/**
+ * @brief Test one character against one non-star token
+ *
+ * @param tok Literal, AnyOne or Class token
+ * @param c Code point from the name (not folded)
+ * @return true if the character matches
+ */
+bool GlobPattern::matchOne(const Token &tok, uint32_t c) const {
+  switch (tok.kind) {
+  case Kind::AnyOne:
+    return true;
+  case Kind::Literal:
+    return (caseSensitive_ ? c : foldCase(c)) == tok.value;
+  case Kind::Class: {
+    const CharClass &cls = classes_[tok.value];
+    uint32_t fc = caseSensitive_ ? c : foldCase(c);
+    bool in = false;
+    for (const Range &r : cls.ranges) {
+      if ((c >= r.lo && c <= r.hi) || (fc >= r.flo && fc <= r.fhi)) {
+        in = true;
+        break;
+      }
+    }
+    return in != cls.negate;
+  }
+  default:
+    return false;
+  }
+}
+
+/**
+ * @brief Wildcard matching with single-star backtracking
+ *
+ * @tparam Utf8 Decode the name as UTF-8 (false: one byte per character)
+ * @param name Filename to test
+ * @return true if the whole name matches
+ */
+template <bool Utf8>
+bool GlobPattern::matchImpl(std::string_view name) const {
+  const size_t ntok = tokens_.size();
+  const size_t none = static_cast<size_t>(-1);
+  size_t t = 0;           // Current token
+  size_t n = 0;           // Current offset in name
+  size_t starTok = none;  // Token after the last * seen
+  size_t starName = 0;    // Name offset that * has absorbed up to
+
+  while (n < name.size()) {
+    if (t < ntok) {
+      if (tokens_[t].kind == Kind::Star) {
+        starTok = ++t;
+        starName = n;
+        continue;
+      }
+
+      size_t next = n;
+      uint32_t c = Utf8 ? decodeUtf8(name, next)
+                        : static_cast<unsigned char>(name[next++]);
+      if (matchOne(tokens_[t], c)) {
+        ++t;
+        n = next;
+        continue;
+      }
+    }
+
+    // Mismatch: let the last * absorb one more character
+    if (starTok == none)
+      return false;
+    if (Utf8)
+      decodeUtf8(name, starName);
+    else
+      ++starName;
+    n = starName;
+    t = starTok;
+  }
+
+  // Name consumed: only trailing stars may remain
+  while (t < ntok && tokens_[t].kind == Kind::Star)
+    ++t;
+  return t == ntok;
+}
+
+/**
+ * @brief Check if a whole filename matches the pattern
+ *
+ * @param name Filename (UTF-8)
+ * @return true if name matches
+ */
+bool GlobPattern::match(std::string_view name) const {
+  if (tokens_.empty())
+    return false;
+
+  // ASCII fast path unless the name or the pattern has multi-byte characters
+  if (ascii_) {
+    bool asciiName = true;
+    for (char ch : name) {
+      if (static_cast<unsigned char>(ch) >= 0x80) {
+        asciiName = false;
+        break;
+      }
+    }
+    if (asciiName)
+      return matchImpl<false>(name);
+  }
+  return matchImpl<true>(name);
+}
+
+/**
+ * @brief Compile a path pattern into per-segment patterns
+ *
+ * Consecutive ** segments are merged, and a trailing ** becomes "*" plus
+ * ** so that it needs at least one more segment.
+ *
+ * @param pattern Pattern text (UTF-8)
+ * @param flags Bitmask of GlobPattern::Flags values for every segment
+ */
+PathGlob::PathGlob(const std::string &pattern, unsigned flags) {
+  size_t i = 0;
+  while (i <= pattern.size()) {
+    size_t end = pattern.find('/', i);
+    if (end == std::string::npos)
+      end = pattern.size();
+    std::string segment = pattern.substr(i, end - i);
+    i = end + 1;
+    if (segment.empty())
+      continue;
+
+    Segment seg;
+    if (segment == "**") {
+      if (!segments_.empty() && segments_.back().globstar)
+        continue;
+      seg.globstar = true;
+    } else {
+      seg.glob = GlobPattern(segment, flags);
+    }
+    segments_.push_back(std::move(seg));
+  }
+
+  if (!segments_.empty() && segments_.back().globstar) {
+    Segment any;
+    any.glob = GlobPattern("*");
+    segments_.insert(segments_.end() - 1, std::move(any));
+  }
+}
+
+/**
+ * @brief Split a relative path into its non-empty segments
+ *
+ * @param path Relative path with '/' separators
+ * @param parts Receives the segments (cleared first)
+ */
+void PathGlob::split(std::string_view path,
+                     std::vector<std::string_view> &parts) {
+  parts.clear();
+  size_t i = 0;
+  while (i < path.size()) {
+    size_t end = path.find('/', i);
+    if (end == std::string_view::npos)
+      end = path.size();
+    if (end > i)
+      parts.push_back(path.substr(i, end - i));
+    i = end + 1;
+  }
+}
+
+/**
+ * @brief Match a relative path segment by segment
+ *
+ * The same single-backtrack scheme as GlobPattern, one level up: ** plays
+ * the role of * and each path segment the role of one character.
+ *
+ * @param path Relative path with '/' separators (UTF-8)
+ * @return true if the whole path matches
+ */
+bool PathGlob::match(std::string_view path) const {
+  if (segments_.empty())
+    return false;
+
+  // Split the path into segments (scratch reused by every call)
+  static thread_local std::vector<std::string_view> parts;
+  split(path, parts);
+
+  const size_t nseg = segments_.size();
+  const size_t none = static_cast<size_t>(-1);
+  size_t t = 0;          // Current pattern segment
+  size_t n = 0;          // Current path segment
+  size_t starSeg = none; // Pattern segment after the last ** seen
+  size_t starPart = 0;   // Path segment that ** has absorbed up to
+
+  while (n < parts.size()) {
+    if (t < nseg) {
+      if (segments_[t].globstar) {
+        starSeg = ++t;
+        starPart = n;
+        continue;
+      }
+      if (segments_[t].glob.match(parts[n])) {
+        ++t;
+        ++n;
+        continue;
+      }
+    }
+
+    // Mismatch: let the last ** absorb one more directory
+    if (starSeg == none)
+      return false;
+    n = ++starPart;
+    t = starSeg;
+  }
+
+  while (t < nseg && segments_[t].globstar)
+    ++t;
+  return t == nseg;
+}
+
+/**
+ * @brief Check if a path below a directory could match the pattern
+ *
+ * Only the segments before the first ** are fixed; once the directory
+ * reaches a **, anything below it may still match.
+ *
+ * @param dir Relative directory path with '/' separators (UTF-8)
+ * @return false if no path inside dir can match
+ */
+bool PathGlob::matchPrefix(std::string_view dir) const {
+  static thread_local std::vector<std::string_view> parts;
+  split(dir, parts);
+
+  const size_t nseg = segments_.size();
+  size_t fixed = 0; // Segments before the first **
+  while (fixed < nseg && !segments_[fixed].globstar)
+    ++fixed;
+
+  for (size_t i = 0; i < parts.size() && i < fixed; ++i)
+    if (!segments_[i].glob.match(parts[i]))
+      return false;
+
+  // Without a ** the path below must still fit in the remaining segments
+  return fixed < nseg || parts.size() < nseg;
+}
+
+/**
+ * @brief Add a pattern to the set, choosing its tier
+ *
+ * @param pattern Pattern text (UTF-8); empty patterns are ignored
+ */
+void GlobSet::add(const std::string &pattern) {
+  if (pattern.empty())
+    return;
+  ++count_;
+
+  std::string_view p(pattern);
+  if (!hasWildcard(p)) {
+    exact_.emplace(foldedHash(p), pattern);
+    return;
+  }
+
+  // "*" followed by plain text: a suffix test, no automaton needed
+  std::string_view tail = p.substr(1);
+  if (p[0] == '*' && !tail.empty() && !hasWildcard(tail)) {
+    suffixes_.emplace(foldedHash(tail), std::string(tail));
+    if (std::find(suffixLengths_.begin(), suffixLengths_.end(), tail.size()) ==
+        suffixLengths_.end())
+      suffixLengths_.push_back(tail.size());
+    return;
+  }
+
+  GlobPattern glob(pattern);
+  if (glob.empty())
+    return;
+  addToAutomaton(glob);
+  globs_.push_back(std::move(glob));
+}
+
+/**
+ * @brief Append a compiled pattern's positions to the merged automaton
+ *
+ * Each pattern gets one start position followed by one position per token.
+ * The per-byte masks for ASCII input are filled in here; non-ASCII input
+ * tests the class and non-ASCII literal positions (slow_) per character.
+ *
+ * @param glob Compiled pattern (about to be stored at globs_.size())
+ */
+void GlobSet::addToAutomaton(const GlobPattern &glob) {
+  using Kind = GlobPattern::Kind;
+
+  size_t base = bits_;
+  bits_ += 1 + glob.tokens_.size();
+  size_t words = (bits_ + 63) / 64;
+  if (start_.size() < words) {
+    // Widen every bit vector; the 128 per-byte masks are stored word-major
+    std::vector<uint64_t> ascii(128 * words, 0);
+    size_t oldWords = start_.size();
+    for (size_t c = 0; c < 128; ++c)
+      for (size_t w = 0; w < oldWords; ++w)
+        ascii[c * words + w] = ascii_[c * oldWords + w];
+    ascii_.swap(ascii);
+    start_.resize(words, 0);
+    star_.resize(words, 0);
+    accept_.resize(words, 0);
+    anyChar_.resize(words, 0);
+  }
+
+  if (!glob.ascii_)
+    asciiPatterns_ = false;
+
+  setBit(start_, base);
+  setBit(accept_, bits_ - 1);
+
+  for (size_t t = 0; t < glob.tokens_.size(); ++t) {
+    const GlobPattern::Token &tok = glob.tokens_[t];
+    size_t bit = base + 1 + t;
+
+    if (tok.kind == Kind::Star || tok.kind == Kind::AnyOne) {
+      if (tok.kind == Kind::Star)
+        setBit(star_, bit);
+      setBit(anyChar_, bit);
+      for (size_t c = 0; c < 128; ++c)
+        ascii_[c * words + bit / 64] |= uint64_t(1) << (bit % 64);
+      continue;
+    }
+
+    for (uint32_t c = 0; c < 128; ++c)
+      if (glob.matchOne(tok, c))
+        ascii_[c * words + bit / 64] |= uint64_t(1) << (bit % 64);
+    if (tok.kind == Kind::Class || tok.value >= 0x80)
+      slow_.push_back({bit, globs_.size(), t});
+  }
+}
+
+/**
+ * @brief Run the merged automaton over a name
+ *
+ * @tparam Utf8 Decode the name as UTF-8 (false: ASCII, one byte per char)
+ * @param name Filename to test
+ * @return true if any general pattern matches the whole name
+ */
+template <bool Utf8>
+bool GlobSet::matchAutomaton(std::string_view name) const {
+  const size_t words = start_.size();
+
+  // Scratch state, reused by every call on this thread
+  static thread_local std::vector<uint64_t> scratch;
+  if (scratch.size() < 2 * words)
+    scratch.resize(2 * words);
+  uint64_t *state = scratch.data();
+  uint64_t *mask = state + words;
+
+  // Initial state: every start position, plus the stars right after them
+  for (size_t w = 0; w < words; ++w)
+    state[w] = start_[w];
+  uint64_t carry = 0;
+  for (size_t w = 0; w < words; ++w) {
+    uint64_t cur = state[w];
+    state[w] |= ((cur << 1) | carry) & star_[w];
+    carry = cur >> 63;
+  }
+
+  size_t i = 0;
+  while (i < name.size()) {
+    const uint64_t *m;
+    if (!Utf8 || static_cast<unsigned char>(name[i]) < 0x80) {
+      m = &ascii_[static_cast<unsigned char>(name[i]) * words];
+      ++i;
+    } else {
+      uint32_t c = decodeUtf8(name, i);
+      for (size_t w = 0; w < words; ++w)
+        mask[w] = anyChar_[w];
+      for (const SlowToken &slow : slow_)
+        if (globs_[slow.glob].matchOne(globs_[slow.glob].tokens_[slow.token],
+                                       c))
+          mask[slow.bit / 64] |= uint64_t(1) << (slow.bit % 64);
+      m = mask;
+    }
+
+    // Advance every position by one character, then let stars match empty
+    uint64_t any = 0;
+    carry = 0;
+    for (size_t w = 0; w < words; ++w) {
+      uint64_t cur = state[w];
+      uint64_t shifted = (cur << 1) | carry;
+      carry = cur >> 63;
+      state[w] = ((shifted & ~start_[w]) | (cur & star_[w])) & m[w];
+    }
+    carry = 0;
+    for (size_t w = 0; w < words; ++w) {
+      uint64_t cur = state[w];
+      state[w] |= ((cur << 1) | carry) & star_[w];
+      carry = cur >> 63;
+      any |= state[w];
+    }
+    if (!any)
+      return false;
+  }
+
+  for (size_t w = 0; w < words; ++w)
+    if (state[w] & accept_[w])
+      return true;
+  return false;
+}
+
+/**
+ * @brief Check if a filename matches any pattern of the set
+ *
+ * @param name Filename (UTF-8)
+ * @return true if name matches at least one pattern
+ */
+bool GlobSet::match(std::string_view name) const {
+  if (!exact_.empty() && foldedContains(exact_, name))
+    return true;
+
+  for (size_t len : suffixLengths_)
+    if (len <= name.size() &&
+        foldedContains(suffixes_, name.substr(name.size() - len)))
+      return true;
+
+  if (globs_.empty())
+    return false;
+
+  if (asciiPatterns_) {
+    bool asciiName = true;
+    for (char ch : name) {
+      if (static_cast<unsigned char>(ch) >= 0x80) {
+        asciiName = false;
+        break;
+      }
+    }
+    if (asciiName)
+      return matchAutomaton<false>(name);
+  }
+  return matchAutomaton<true>(name);
+}
+
+/**
+ * @brief Add an include pattern, as a name or a path pattern
+ *
+ * Leading "**" segments are dropped first: "**" followed by a name matches
+ * that name at any depth, which is exactly what a name pattern does.
+ *
+ * @param pattern Name or path pattern (UTF-8); empty patterns are ignored
+ */
+void IncludeSet::add(const std::string &pattern) {
+  std::string_view p(pattern);
+  while (p.substr(0, 3) == "**/")
+    p.remove_prefix(3);
+  if (p.empty())
+    return;
+
+  if (p.find('/') == std::string_view::npos && p != "**")
+    names_.add(std::string(p));
+  else
+    paths_.emplace_back(pattern);
+}
+
+namespace {
+
+/**
+ * @brief Join a relative directory and a name (scratch reused per thread)
+ */
+std::string_view joinPath(std::string_view dir, std::string_view name) {
+  static thread_local std::string path;
+  path.assign(dir.data(), dir.size());
+  if (!path.empty())
+    path += '/';
+  path.append(name.data(), name.size());
+  return path;
+}
+
+} // namespace
+
+/**
+ * @brief Check if an entry matches any pattern
+ *
+ * @param dir Relative path of the entry's directory ("" for the root)
+ * @param name Entry name
+ * @return true if the entry is included
+ */
+bool IncludeSet::match(std::string_view dir, std::string_view name) const {
+  if (names_.match(name))
+    return true;
+  if (paths_.empty())
+    return false;
+
+  std::string_view path = joinPath(dir, name);
+  for (const PathGlob &glob : paths_)
+    if (glob.match(path))
+      return true;
+  return false;
+}
+
+/**
+ * @brief Check if anything below a directory could match
+ *
+ * @param dir Relative path of the directory's parent ("" for the root)
+ * @param name Directory name
+ * @return false if the subtree can be skipped without listing it
+ */
+bool IncludeSet::mayMatchBelow(std::string_view dir,
+                               std::string_view name) const {
+  if (!names_.empty())
+    return true;
+
+  std::string_view path = joinPath(dir, name);
+  for (const PathGlob &glob : paths_)
+    if (glob.matchPrefix(path))
+      return true;
+  return false;
+}
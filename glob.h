@@ -0,0 +1,283 @@
+/**
+ * @file glob.h
+ * @brief Compiled wildcard (glob) patterns for eTree
+ *
+ * This header declares GlobPattern, the matcher behind the -I exclude
+ * option. A pattern is compiled once, when the arguments are parsed, into a
+ * small token program; matching a filename against it then needs no heap
+ * allocation and no regular expression engine.
+ *
+ * Supported syntax (always case-insensitive, like before):
+ * - *      any run of characters (including none)
+ * - ?      exactly one character
+ * - [abc]  one character from a set; ranges like [a-z]; [!x] or [^x] negate
+ * - anything else matches itself
+ *
+ * Pure-ASCII names and patterns are matched byte by byte with ASCII case
+ * folding. Otherwise matching switches to UTF-8 code points, so ? and
+ * classes match whole characters and common non-ASCII letters (Latin-1,
+ * Latin Extended-A, Greek, Cyrillic) compare case-insensitively.
+ *
+ * PathGlob matches '/'-separated relative paths segment by segment, with
+ * ** standing for any number of directories. IncludeSet combines name and
+ * path patterns for the -P include filter.
+ *
+ * GlobSet combines any number of patterns into one matcher whose cost per
+ * name does not grow with the number of patterns: exact names go into a
+ * hash table, "*.ext" style patterns into a suffix table, and every other
+ * pattern into one merged bit-parallel automaton.
+ */
+
+#ifndef GLOB_H
+#define GLOB_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class GlobPattern
+ * @brief One wildcard pattern compiled for repeated allocation-free matching
+ */
+class GlobPattern {
+public:
+  /// Compile options (bitmask)
+  enum Flags : unsigned {
+    CaseSensitive = 1u << 0, ///< Compare exactly (default: ignore case)
+    Escapes = 1u << 1,       ///< A backslash makes the next character literal
+  };
+
+  /**
+   * @brief Create an empty pattern (matches nothing)
+   */
+  GlobPattern() = default;
+
+  /**
+   * @brief Compile a wildcard pattern
+   * @param pattern Pattern text (UTF-8)
+   * @param flags Bitmask of Flags values
+   */
+  explicit GlobPattern(const std::string &pattern, unsigned flags = 0);
+
+  /**
+   * @brief Check if the pattern is empty (and so never matches)
+   */
+  bool empty() const { return tokens_.empty(); }
+
+  /**
+   * @brief Check if a whole filename matches the pattern
+   * @param name Filename (UTF-8)
+   * @return true if name matches
+   */
+  bool match(std::string_view name) const;
+
+private:
+  /// Kind of one compiled pattern element
+  enum class Kind : uint8_t { Literal, AnyOne, Star, Class };
+
+  /// One compiled pattern element
+  struct Token {
+    Kind kind;
+    uint32_t value; ///< Folded code point (Literal) or class index (Class)
+  };
+
+  /// One range of a character class, as written and case-folded
+  struct Range {
+    uint32_t lo, hi;   ///< Range as written
+    uint32_t flo, fhi; ///< Range with both ends case-folded
+  };
+
+  /// A [...] character class
+  struct CharClass {
+    bool negate = false;
+    std::vector<Range> ranges;
+  };
+
+  template <bool Utf8> bool matchImpl(std::string_view name) const;
+  bool matchOne(const Token &tok, uint32_t c) const;
+
+  friend class GlobSet;
+
+  std::vector<Token> tokens_;
+  std::vector<CharClass> classes_;
+  bool ascii_ = true;          ///< Whether the pattern is pure ASCII
+  bool caseSensitive_ = false; ///< Compiled with CaseSensitive
+};
+
+/**
+ * @class PathGlob
+ * @brief A wildcard pattern over '/'-separated relative paths
+ *
+ * Each path segment is a GlobPattern, so * and ? never cross a '/'. A
+ * segment that is exactly ** matches any number of directories (including
+ * none): a leading ** segment finds the rest of the pattern at any depth, a
+ * middle one allows anything in between, and a trailing one matches
+ * everything below (but not the directory itself).
+ */
+class PathGlob {
+public:
+  /**
+   * @brief Create an empty pattern (matches nothing)
+   */
+  PathGlob() = default;
+
+  /**
+   * @brief Compile a path pattern (leading and doubled slashes are ignored)
+   * @param pattern Pattern text (UTF-8)
+   * @param flags Bitmask of GlobPattern::Flags values for every segment
+   */
+  explicit PathGlob(const std::string &pattern, unsigned flags = 0);
+
+  /**
+   * @brief Check if the pattern is empty (and so never matches)
+   */
+  bool empty() const { return segments_.empty(); }
+
+  /**
+   * @brief Check if a whole relative path matches the pattern
+   * @param path Relative path with '/' separators (UTF-8)
+   * @return true if path matches
+   */
+  bool match(std::string_view path) const;
+
+  /**
+   * @brief Check if a path below a directory could match the pattern
+   *
+   * Compares the directory against the pattern's leading segments (up to
+   * the first **), so a walk can skip subtrees that cannot contain a match.
+   *
+   * @param dir Relative directory path with '/' separators (UTF-8)
+   * @return false if no path inside dir can match
+   */
+  bool matchPrefix(std::string_view dir) const;
+
+private:
+  static void split(std::string_view path,
+                    std::vector<std::string_view> &parts);
+
+  /// One path segment of the pattern
+  struct Segment {
+    bool globstar = false; ///< Segment is ** (any number of directories)
+    GlobPattern glob;      ///< Pattern for one name (unless globstar)
+  };
+
+  std::vector<Segment> segments_;
+};
+
+/**
+ * @class GlobSet
+ * @brief Many wildcard patterns combined into one matcher
+ *
+ * A name matches the set if it matches any of its patterns. Patterns are
+ * sorted into three tiers when added:
+ * - Exact names ("node_modules"): hash lookup of the case-folded name
+ * - Suffix patterns ("*.o", "*.tar.gz"): one hash lookup per distinct
+ *   suffix length
+ * - Everything else: a shift-and automaton over all patterns at once,
+ *   one bit per pattern position, advanced a machine word at a time
+ *
+ * Matching does not allocate (the automaton reuses per-thread scratch
+ * space), so it is safe and cheap to call from several threads.
+ */
+class GlobSet {
+public:
+  /**
+   * @brief Add a pattern to the set
+   * @param pattern Pattern text (UTF-8); empty patterns are ignored
+   */
+  void add(const std::string &pattern);
+
+  /**
+   * @brief Check if the set has no patterns (and so never matches)
+   */
+  bool empty() const { return count_ == 0; }
+
+  /**
+   * @brief Number of patterns added
+   */
+  size_t size() const { return count_; }
+
+  /**
+   * @brief Check if a filename matches any pattern of the set
+   * @param name Filename (UTF-8)
+   * @return true if name matches at least one pattern
+   */
+  bool match(std::string_view name) const;
+
+private:
+  void addToAutomaton(const GlobPattern &glob);
+  template <bool Utf8> bool matchAutomaton(std::string_view name) const;
+
+  size_t count_ = 0; ///< Number of patterns added
+
+  /// Exact names and suffixes, keyed by case-folded hash
+  std::unordered_multimap<uint64_t, std::string> exact_;
+  std::unordered_multimap<uint64_t, std::string> suffixes_;
+  std::vector<size_t> suffixLengths_; ///< Distinct suffix lengths in bytes
+
+  // Merged automaton: bit i of a state vector is one pattern position
+  std::vector<GlobPattern> globs_; ///< General patterns (own their classes)
+  size_t bits_ = 0;                ///< Number of positions in use
+  std::vector<uint64_t> start_;    ///< Start position of each pattern
+  std::vector<uint64_t> star_;     ///< Positions holding a *
+  std::vector<uint64_t> accept_;   ///< Last position of each pattern
+  std::vector<uint64_t> anyChar_;  ///< Positions accepting any character
+  std::vector<uint64_t> ascii_;    ///< Per-byte masks, 128 x words
+  bool asciiPatterns_ = true;      ///< All general patterns are ASCII
+
+  /// Position that needs a per-character test on non-ASCII input
+  struct SlowToken {
+    size_t bit;
+    size_t glob;
+    size_t token;
+  };
+  std::vector<SlowToken> slow_;
+};
+
+/**
+ * @class IncludeSet
+ * @brief Include patterns (-P): which entries to show, which dirs to enter
+ *
+ * Patterns without a '/' (also after stripping leading "**" segments)
+ * match the entry name at any depth and are combined in a GlobSet. The
+ * others are PathGlobs over the path relative to the walk root, whose
+ * leading segments tell which subtrees can hold a match at all. Matching
+ * is case-insensitive, like -I.
+ */
+class IncludeSet {
+public:
+  /**
+   * @brief Add a pattern to the set
+   * @param pattern Name or path pattern (UTF-8); empty patterns are ignored
+   */
+  void add(const std::string &pattern);
+
+  /**
+   * @brief Check if the set has no patterns (everything is included)
+   */
+  bool empty() const { return names_.empty() && paths_.empty(); }
+
+  /**
+   * @brief Check if an entry matches any pattern
+   * @param dir Relative path of the entry's directory ("" for the root)
+   * @param name Entry name
+   * @return true if the entry is included
+   */
+  bool match(std::string_view dir, std::string_view name) const;
+
+  /**
+   * @brief Check if anything below a directory could match
+   * @param dir Relative path of the directory's parent ("" for the root)
+   * @param name Directory name
+   * @return false if the subtree can be skipped without listing it
+   */
+  bool mayMatchBelow(std::string_view dir, std::string_view name) const;
+
+private:
+  GlobSet names_;                ///< Patterns for names at any depth
+  std::vector<PathGlob> paths_;  ///< Patterns for paths from the root
+};
+
+#endif
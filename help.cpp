@@ -1,112 +1,173 @@
-/**
- * @file help.cpp
- * @brief Help message display implementation for eTree
- *
- * This file implements the printUsage() function which displays comprehensive
- * usage information and help text to the user. The output is platform-specific
- * to account for differences in console output between Windows and Unix/Linux.
- */
-
-#include "help.h"
-#include <iostream>
-
-/**
- * @brief Display usage information and help text
- *
- * This function prints a comprehensive help message including:
- * - Program name and version
- * - Command-line syntax
- * - Detailed list of all available options with descriptions
- * - Usage notes about encoding, colors, and file formats
- * - Practical usage examples
- *
- * The output is platform-specific:
- * - Windows: Uses std::wcout for wide character support
- * - Unix/Linux: Uses std::cout for standard output
- *
- * The help text explains all command-line options, their short and long forms,
- * and provides context about Unicode support, RTL text handling, and TSV
- * export.
- */
-void printUsage() {
-#ifdef _WIN32
-  // Windows version: Use wide character output for Unicode support
-  std::wcout
-      << L"eTree - Directory Tree Viewer v1.0.0\n"
-         L"Usage:\n"
-         L"  etree [options] [directory]\n"
-         L"\nOptions (-, /, or -- for each option):\n"
-         L"  -d /d         Only show directories (no files)\n"
-         L"  -a /a         Show hidden files and folders\n"
-         L"  -I /I pat     Exclude files/folders matching pattern (wildcards "
-         L"*, ?)\n"
-         L"  -s /s         Show file sizes in bytes (with thousands "
-         L"separators)\n"
-         L"  -p /p         Show file permissions (RHSA on Windows, rwx on "
-         L"UNIX)\n"
-         L"  -l /l N       Limit depth to N levels (default: unlimited)\n"
-         L"  -nc /nc       Disable color output (ASCII only, auto for file "
-         L"output)\n"
-         L"  -o file       Output to file as TSV (tab-separated, UTF-8 for "
-         L"Excel import)\n"
-         L"  -v /v         Show program version\n"
-         L"  -? /?         Show this help message\n"
-         L"  --help        Show this help message\n"
-         L"\nNotes:\n"
-         L"  - Output file (-o): Exports all fields as tab-separated UTF-8 "
-         L"(TSV, not CSV) to avoid field misparsing.\n"
-         L"  - Hidden/system files included only with -a.\n"
-         L"  - Control tree depth/output columns with -l, -p, -s etc.\n"
-         L"  - Unicode: All filenames (including RTL/Arabic/Chinese) are "
-         L"supported for output/import in Excel.\n"
-         L"  - Coloring is auto-enabled in Windows Terminal, auto-disabled in "
-         L"classic console (cmd.exe).\n"
-         L"  - For file redirection with proper UTF-8 encoding, use: cmd /c "
-         L"\"etree folder > output.txt\"\n"
-         L"    or PowerShell: etree folder | Out-File -Encoding UTF8 "
-         L"output.txt\n"
-         L"\nExamples:\n"
-         L"  etree -a -l2              # All visible/hiddens, 2 levels deep\n"
-         L"  etree -o files.tsv        # TSV export for Excel import\n"
-         L"  etree -a -o all.tsv       # All files, including hidden, to TSV\n"
-         L"  etree -I*.tmp -s -p       # Exclude .tmp files, show sizes and "
-         L"permissions\n";
-#else
-  // Unix/Linux version: Use standard character output
-  std::cout
-      << "eTree - Directory Tree Viewer v1.0.0\n"
-         "Usage:\n"
-         "  etree [options] [directory]\n"
-         "\nOptions (-, /, or -- for each option):\n"
-         "  -d /d         Only show directories (no files)\n"
-         "  -a /a         Show hidden files and folders\n"
-         "  -I /I pat     Exclude files/folders matching pattern (wildcards *, "
-         "?)\n"
-         "  -s /s         Show file sizes in bytes (with thousands "
-         "separators)\n"
-         "  -p /p         Show file permissions (RHSA on Windows, rwx on "
-         "UNIX)\n"
-         "  -l /l N       Limit depth to N levels (default: unlimited)\n"
-         "  -nc /nc       Disable color output (ASCII only, auto for file "
-         "output)\n"
-         "  -o file       Output to file as TSV (tab-separated, UTF-8 for "
-         "Excel import)\n"
-         "  -v /v         Show program version\n"
-         "  -? /?         Show this help message\n"
-         "  --help        Show this help message\n"
-         "\nNotes:\n"
-         "  - Output file (-o): Exports all fields as tab-separated UTF-8 "
-         "(TSV, not CSV) to avoid field misparsing.\n"
-         "  - Hidden/system files included only with -a.\n"
-         "  - Control tree depth/output columns with -l, -p, -s etc.\n"
-         "  - Unicode: All filenames (including RTL/Arabic/Chinese) are "
-         "supported for output/import in Excel.\n"
-         "  - Coloring is auto-detected from tty and shell environment.\n"
-         "\nExamples:\n"
-         "  etree -a -l2              # All visible/hiddens, 2 levels deep\n"
-         "  etree -o files.tsv        # TSV export for Excel import\n"
-         "  etree -a -o all.tsv       # All files, including hidden, to TSV\n"
-         "  etree -I*.tmp -s -p       # Exclude .tmp files, show sizes and "
-         "permissions\n";
-#endif
-}
+/**
+ * @file help.cpp
+ * @brief Help message display implementation for eTree
+ *
+ * This file implements the printUsage() function which displays comprehensive
+ * usage information and help text to the user. The output is platform-specific
+ * to account for differences in console output between Windows and Unix/Linux.
+ */
+
+#include "help.h"
+#include <iostream>
+
+/**
+ * @brief Display usage information and help text
+ *
+ * This function prints a comprehensive help message including:
+ * - Program name and version
+ * - Command-line syntax
+ * - Detailed list of all available options with descriptions
+ * - Usage notes about encoding, colors, and file formats
+ * - Practical usage examples
+ *
+ * The output is platform-specific:
+ * - Windows: Uses std::wcout for wide character support
+ * - Unix/Linux: Uses std::cout for standard output
+ *
+ * The help text explains all command-line options, their short and long forms,
+ * and provides context about Unicode support, RTL text handling, and TSV
+ * export.
+ */
+void printUsage() {
+#ifdef _WIN32
+  // Windows version: Use wide character output for Unicode support
+  std::wcout
+      << L"eTree - Directory Tree Viewer v1.0.0\n"
+         L"Usage:\n"
+         L"  etree [options] [directory]\n"
+         L"\nOptions (-, /, or -- for each option):\n"
+         L"  -d /d         Only show directories (no files)\n"
+         L"  -a /a         Show hidden files and folders\n"
+         L"  -I /I pat     Exclude files/folders matching pattern (wildcards "
+         L"*, ?, [a-z]; repeatable)\n"
+         L"  --exclude-from file  Exclude patterns listed in file (one per "
+         L"line, # comments)\n"
+         L"  -s /s         Show file sizes in bytes (with thousands "
+         L"separators)\n"
+         L"  -p /p         Show file permissions (RHSA on Windows, rwx on "
+         L"UNIX)\n"
+         L"  -l /l N       Limit depth to N levels (default: unlimited)\n"
+         L"  -nc /nc       Disable color output (ASCII only, auto for file "
+         L"output)\n"
+         L"  -o file       Output to file as TSV (tab-separated, UTF-8 for "
+         L"Excel import)\n"
+         L"  -v /v         Show program version\n"
+         L"  -? /?         Show this help message\n"
+         L"  --help        Show this help message\n"
+         L"\nNotes:\n"
+         L"  - Output file (-o): Exports all fields as tab-separated UTF-8 "
+         L"(TSV, not CSV) to avoid field misparsing.\n"
+         L"  - Hidden/system files included only with -a.\n"
+         L"  - Control tree depth/output columns with -l, -p, -s etc.\n"
+         L"  - Unicode: All filenames (including RTL/Arabic/Chinese) are "
+         L"supported for output/import in Excel.\n"
+         L"  - Coloring is auto-enabled in Windows Terminal, auto-disabled in "
+         L"classic console (cmd.exe).\n"
+         L"  - For file redirection with proper UTF-8 encoding, use: cmd /c "
+         L"\"etree folder > output.txt\"\n"
+         L"    or PowerShell: etree folder | Out-File -Encoding UTF8 "
+         L"output.txt\n"
+         L"\nExamples:\n"
+         L"  etree -a -l2              # All visible/hiddens, 2 levels deep\n"
+         L"  etree -o files.tsv        # TSV export for Excel import\n"
+         L"  etree -a -o all.tsv       # All files, including hidden, to TSV\n"
+         L"  etree -I*.tmp -s -p       # Exclude .tmp files, show sizes and "
+         L"permissions\n";
+#else
+  // Unix/Linux version: Use standard character output
+  std::cout
+      << "eTree - Directory Tree Viewer v1.0.0\n"
+         "Usage:\n"
+         "  etree [options] [directory]\n"
+         "\nOptions (-, /, or -- for each option):\n"
+         "  -d /d         Only show directories (no files)\n"
+         "  -a /a         Show hidden files and folders\n"
+         "  -I /I pat     Exclude files/folders matching pattern (wildcards *, "
+         "?, [a-z]; repeatable)\n"
+         "  --exclude-from file  Exclude patterns listed in file (one per "
+         "line, # comments)\n"
+         "  -P pat        Show only files matching pattern (name, or path "
+         "like src/**/*.proto; repeatable)\n"
+         "  --gitignore   Skip entries excluded by .gitignore/.ignore files "
+         "(and .git)\n"
+         "  -s /s         Show file sizes in bytes (with thousands "
+         "separators)\n"
+         "  -h            Show file sizes in KiB, MiB, GiB (powers of 1024)\n"
+         "  --si          Show file sizes in kB, MB, GB (powers of 1000)\n"
+         "  --du          Show each folder's total size, size on disk and "
+         "file count (hard links once)\n"
+         "  --top N       Print only the N largest files instead of the "
+         "tree (see --by)\n"
+         "  --by KEY      Rank --top by size (default), mtime (newest "
+         "files/folders) or count (fullest folders)\n"
+         "  --sort KEY    Order entries by name (default), natural, size, "
+         "mtime, ext or none\n"
+         "  --dirsfirst   List folders before files\n"
+         "  -U            Print entries unsorted, as soon as they are read "
+         "(first lines at once, constant memory)\n"
+         "  --mem-limit SIZE  Sort huge folders in runs spilled to $TMPDIR "
+         "to stay near SIZE (e.g. 256M; Linux)\n"
+         "  -p /p         Show file permissions (RHSA on Windows, rwx on "
+         "UNIX)\n"
+         "  -l /l N       Limit depth to N levels (default: unlimited)\n"
+         "  -j /j N       Enumerate directories with N threads (default: 1, "
+         "-j alone: all cores)\n"
+         "  --io-uring    Batch -s/-p/-o metadata calls per directory via "
+         "io_uring (Linux)\n"
+         "  -nc /nc       Disable color output (ASCII only, auto for file "
+         "output)\n"
+         "  -o file       Output to file as TSV (tab-separated, UTF-8 for "
+         "Excel import)\n"
+         "  -o file.arrow Export typed columns as an Arrow IPC file (also "
+         ".feather)\n"
+         "  --output file Write the tree to file instead of the terminal "
+         "(no colors)\n"
+         "  --watch       Keep running and print entries as they are added, "
+         "removed or modified (Linux)\n"
+         "  --snapshot F  Save an index of the walk to F for later "
+         "--refresh runs\n"
+         "  --refresh F   Reuse unchanged directories from snapshot F, "
+         "then update F\n"
+         "  --diff OLD NEW  Compare two TSV exports or snapshots (added, "
+         "removed, resized, per-folder size change)\n"
+         "  -v /v         Show program version\n"
+         "  -? /?         Show this help message\n"
+         "  --help        Show this help message\n"
+         "\nNotes:\n"
+         "  - Output file (-o): Exports all fields as tab-separated UTF-8 "
+         "(TSV, not CSV) to avoid field misparsing.\n"
+         "  - Hidden/system files included only with -a.\n"
+         "  - Control tree depth/output columns with -l, -p, -s etc.\n"
+         "  - Unicode: All filenames (including RTL/Arabic/Chinese) are "
+         "supported for output/import in Excel.\n"
+         "  - Coloring is auto-detected from tty and shell environment.\n"
+         "\nExamples:\n"
+         "  etree -a -l2              # All visible/hiddens, 2 levels deep\n"
+         "  etree -o files.tsv        # TSV export for Excel import\n"
+         "  etree -a -o all.tsv       # All files, including hidden, to TSV\n"
+         "  etree -I*.tmp -s -p       # Exclude .tmp files, show sizes and "
+         "permissions\n"
+         "  etree -j8 -o all.tsv      # Export using 8 threads, same row "
+         "order\n"
+         "  etree -h -l2              # Two levels with readable sizes\n"
+         "  etree --du -h -d -l1      # Where the disk space went, by "
+         "top folder\n"
+         "  etree --top 100 -h -j8    # The 100 largest files\n"
+         "  etree --top 20 --by mtime # The 20 most recently modified "
+         "entries\n"
+         "  etree --sort size -h -l1  # Largest entries at the top of "
+         "each folder\n"
+         "  etree -U -d spool         # Start printing a huge folder right "
+         "away\n"
+         "  etree --mem-limit 64M mail # Sort a huge folder in bounded "
+         "memory\n"
+         "  etree -a -o all.arrow     # Columnar export for pandas/DuckDB\n"
+         "  etree -P '**/*.proto'     # Only .proto files and their "
+         "folders\n"
+         "  etree -s --refresh t.snap # Re-list only directories changed "
+         "since t.snap\n"
+         "  etree --watch -s incoming # Follow a staging directory live\n"
+         "  etree --diff mon.tsv tue.tsv  # What changed between two "
+         "exports\n";
+#endif
+}
@@ -0,0 +1,266 @@
+/**
+ * @file ignore.cpp
+ * @brief .gitignore / .ignore rule stack implementation for eTree
+ *
+ * Ignore files are read with one open/read per file, relative to the
+ * directory descriptor the walk already holds, and compiled into
+ * GlobPattern / PathGlob rules (case-sensitive, with backslash escapes).
+ */
+
+#include "ignore.h"
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <fcntl.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+/// Ignore files read in every directory, lowest precedence first
+const char *const kIgnoreFiles[] = {".gitignore", ".ignore"};
+
+/**
+ * @brief Read a whole file into a string
+ *
+ * @param dirfd Directory descriptor name is relative to (or AT_FDCWD)
+ * @param name File name (or full path with AT_FDCWD)
+ * @param text Receives the file contents
+ * @return true if the file could be opened and read
+ */
+bool readFile(int dirfd, const char *name, std::string &text) {
+  int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  char buf[16384];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+    text.append(buf, static_cast<size_t>(n));
+  close(fd);
+  return n == 0;
+}
+
+/**
+ * @brief Read the ignore files of one directory
+ *
+ * @param dirfd Open descriptor of dir (or -1 to open files by path)
+ * @param dir Directory path
+ * @param text Receives the concatenated rules of all ignore files
+ * @return true if at least one ignore file was read
+ */
+bool readIgnoreFiles(int dirfd, const fs::path &dir, std::string &text) {
+  bool found = false;
+  for (const char *file : kIgnoreFiles) {
+    std::string content;
+    bool ok = dirfd >= 0 ? readFile(dirfd, file, content)
+                         : readFile(AT_FDCWD, (dir / file).c_str(), content);
+    if (ok) {
+      found = true;
+      text += content;
+      text += '\n';
+    }
+  }
+  return found;
+}
+
+/**
+ * @brief Extend a stack digest by one frame's rule text (64-bit FNV-1a)
+ *
+ * @param parent Digest of the inherited stack
+ * @param text Contents of the frame's ignore files
+ * @return Digest of the new stack
+ */
+uint64_t chainDigest(uint64_t parent, const std::string &text) {
+  uint64_t hash = 14695981039346656037ull ^ parent;
+  for (unsigned char c : text) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash == 0 ? 1 : hash;
+}
+
+} // namespace
+
+/**
+ * @brief Parse ignore file text into rules, in file order
+ *
+ * Follows gitignore(5): blank lines and # comments are skipped, unescaped
+ * trailing spaces are trimmed, "!" negates, a trailing "/" restricts the
+ * rule to directories, and any other "/" anchors it to this directory.
+ *
+ * @param text Contents of the directory's ignore files
+ */
+void IgnoreFrame::parse(const std::string &text) {
+  const unsigned flags = GlobPattern::CaseSensitive | GlobPattern::Escapes;
+
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t end = text.find('\n', pos);
+    if (end == std::string::npos)
+      end = text.size();
+    std::string line = text.substr(pos, end - pos);
+    pos = end + 1;
+
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    while (!line.empty() && line.back() == ' ' &&
+           !(line.size() >= 2 && line[line.size() - 2] == '\\'))
+      line.pop_back();
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    Rule rule;
+    if (line[0] == '!') {
+      rule.negate = true;
+      line.erase(0, 1);
+    }
+    if (!line.empty() && line.back() == '/') {
+      rule.dirOnly = true;
+      line.pop_back();
+    }
+    if (line.empty())
+      continue;
+
+    rule.anchored = line.find('/') != std::string::npos;
+    if (rule.anchored) {
+      rule.path = PathGlob(line, flags);
+      if (rule.path.empty())
+        continue;
+    } else {
+      rule.name = GlobPattern(line, flags);
+    }
+    rules_.push_back(std::move(rule));
+  }
+}
+
+/**
+ * @brief Read a directory's ignore files and push them onto a stack
+ *
+ * @param dirfd Open descriptor of dir (or -1 to open files by path)
+ * @param dir Directory path as seen by the walk
+ * @param parent Stack inherited from the parent directory (may be null)
+ * @return New top of stack, or parent if dir has no rules
+ */
+IgnoreFrame::Ptr IgnoreFrame::load(int dirfd, const fs::path &dir,
+                                   Ptr parent) {
+  std::string text;
+  if (!readIgnoreFiles(dirfd, dir, text))
+    return parent;
+
+  auto frame = std::make_shared<IgnoreFrame>();
+  frame->parse(text);
+  if (frame->rules_.empty())
+    return parent;
+  frame->digest_ = chainDigest(digest(parent), text);
+  frame->parent_ = std::move(parent);
+  frame->skip_ = dir.native().size();
+  return frame;
+}
+
+/**
+ * @brief Build the stack for the walk root from the directories above it
+ *
+ * Looks for the .git entry that marks the top of the work tree, starting
+ * at the root's parent, and loads every directory from there down.
+ *
+ * @param root Walk root, as passed to printTree()
+ * @return Stack to start the walk with (may be null)
+ */
+IgnoreFrame::Ptr IgnoreFrame::loadParents(const fs::path &root) {
+  std::error_code ec;
+  fs::path abs = fs::absolute(root, ec).lexically_normal();
+  if (ec)
+    return nullptr;
+  if (!abs.has_filename())
+    abs = abs.parent_path();
+
+  // The root itself is the top of the work tree: nothing above applies
+  if (fs::exists(abs / ".git", ec))
+    return nullptr;
+
+  std::vector<fs::path> chain;
+  for (fs::path dir = abs.parent_path();; dir = dir.parent_path()) {
+    chain.push_back(dir);
+    if (fs::exists(dir / ".git", ec))
+      break;
+    if (dir == dir.parent_path())
+      return nullptr; // Not inside a work tree
+  }
+
+  Ptr stack;
+  for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+    std::string text;
+    if (!readIgnoreFiles(-1, *it, text))
+      continue;
+
+    auto frame = std::make_shared<IgnoreFrame>();
+    frame->parse(text);
+    if (frame->rules_.empty())
+      continue;
+    frame->digest_ = chainDigest(digest(stack), text);
+    frame->parent_ = std::move(stack);
+    frame->prefix_ = abs.lexically_relative(*it).generic_string();
+    frame->skip_ = root.native().size();
+    stack = std::move(frame);
+  }
+  return stack;
+}
+
+/**
+ * @brief Check if an entry is ignored by this stack
+ *
+ * Frames are searched from the top (deepest directory) down and each
+ * frame's rules from last to first; the first rule that matches decides.
+ *
+ * @param dir Path of the entry's directory as seen by the walk
+ * @param name Entry name
+ * @param isDir Whether the entry is a directory
+ * @return true if the deciding rule ignores the entry
+ */
+bool IgnoreFrame::ignored(std::string_view dir, std::string_view name,
+                          bool isDir) const {
+  static thread_local std::string rel; // Relative path, reused per call
+
+  for (const IgnoreFrame *frame = this; frame; frame = frame->parent_.get()) {
+    bool relBuilt = false;
+    for (auto it = frame->rules_.rbegin(); it != frame->rules_.rend(); ++it) {
+      const Rule &rule = *it;
+      if (rule.dirOnly && !isDir)
+        continue;
+
+      bool hit;
+      if (rule.anchored) {
+        if (!relBuilt) {
+          // prefix_ + directories below this frame's directory + name
+          std::string_view below =
+              dir.substr(std::min(frame->skip_, dir.size()));
+          while (!below.empty() && below.front() == '/')
+            below.remove_prefix(1);
+          rel = frame->prefix_;
+          if (!below.empty()) {
+            if (!rel.empty())
+              rel += '/';
+            rel += below;
+          }
+          if (!rel.empty())
+            rel += '/';
+          rel += name;
+          relBuilt = true;
+        }
+        hit = rule.path.match(rel);
+      } else {
+        hit = rule.name.match(name);
+      }
+
+      if (hit)
+        return !rule.negate;
+    }
+  }
+  return false;
+}
+
+#endif
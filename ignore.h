@@ -0,0 +1,113 @@
+/**
+ * @file ignore.h
+ * @brief .gitignore / .ignore rule stacks for eTree (--gitignore)
+ *
+ * With --gitignore, every directory's .gitignore and .ignore files are
+ * parsed once, when the directory is listed, into an IgnoreFrame. Frames
+ * form a stack through their parent pointers: a directory's frame is
+ * pushed on top of the one it inherited, and all of its subdirectories
+ * share it, so rules are never re-read or copied on the way down. Entries
+ * matched by the stack are dropped from the listing before anything else
+ * happens to them; an ignored directory is therefore never opened.
+ *
+ * Matching follows git: the last matching rule of the deepest file wins,
+ * "!" re-includes, a trailing "/" matches directories only, patterns with
+ * a "/" are anchored to the directory of their file, and case matters.
+ */
+
+#ifndef IGNORE_H
+#define IGNORE_H
+
+#ifndef _WIN32
+
+#include "glob.h"
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class IgnoreFrame
+ * @brief The ignore rules of one directory, linked to the inherited ones
+ *
+ * Frames are immutable once built and shared between threads through
+ * std::shared_ptr, so -j workers can list sibling directories with the
+ * same inherited stack.
+ */
+class IgnoreFrame {
+public:
+  /// Shared, immutable handle to the top of a rule stack
+  using Ptr = std::shared_ptr<const IgnoreFrame>;
+
+  /**
+   * @brief Read a directory's ignore files and push them onto a stack
+   *
+   * @param dirfd Open descriptor of dir (or -1 to open files by path)
+   * @param dir Directory path as seen by the walk
+   * @param parent Stack inherited from the parent directory (may be null)
+   * @return New top of stack, or parent if dir has no rules
+   */
+  static Ptr load(int dirfd, const std::filesystem::path &dir, Ptr parent);
+
+  /**
+   * @brief Build the stack for the walk root from the directories above it
+   *
+   * When the root is inside a git work tree, the ignore files between the
+   * top of the work tree and the root's parent apply too, as they would
+   * for git itself. Outside a work tree this returns null.
+   *
+   * @param root Walk root, as passed to printTree()
+   * @return Stack to start the walk with (may be null)
+   */
+  static Ptr loadParents(const std::filesystem::path &root);
+
+  /**
+   * @brief Check if an entry is ignored by this stack
+   *
+   * @param dir Path of the entry's directory as seen by the walk
+   * @param name Entry name
+   * @param isDir Whether the entry is a directory
+   * @return true if the deciding rule ignores the entry
+   */
+  bool ignored(std::string_view dir, std::string_view name, bool isDir) const;
+
+  /**
+   * @brief Digest of the rule text of this frame and all frames below it
+   *
+   * Two stacks with the same digest filter alike, so a --refresh snapshot
+   * can tell whether a directory's cached listing is still filtered by
+   * the rules in effect now.
+   *
+   * @param stack Top of a stack (may be null: no rules, digest 0)
+   */
+  static uint64_t digest(const Ptr &stack) {
+    return stack ? stack->digest_ : 0;
+  }
+
+private:
+  /// One line of an ignore file
+  struct Rule {
+    GlobPattern name;      ///< Pattern for the entry name (not anchored)
+    PathGlob path;         ///< Pattern for the relative path (anchored)
+    bool anchored = false; ///< Pattern contained a '/'
+    bool negate = false;   ///< Rule started with '!'
+    bool dirOnly = false;  ///< Rule ended with '/'
+  };
+
+  void parse(const std::string &text);
+
+  std::vector<Rule> rules_;
+  Ptr parent_;
+
+  // Relative path of an entry from this frame's directory:
+  // prefix_ + (entry's directory path after skip_ bytes) + name
+  std::string prefix_; ///< Path from this directory to the walk root
+  size_t skip_ = 0;    ///< Length of this directory's path in the walk
+  uint64_t digest_ = 0; ///< Hash of the rule texts of the whole stack
+};
+
+#endif
+
+#endif
@@ -0,0 +1,237 @@
+/**
+ * @file meta.cpp
+ * @brief File metadata planning and retrieval implementation for eTree
+ *
+ * On Linux the metadata is fetched with statx(), asking only for the fields
+ * the output needs. Where statx is not available (non-Linux systems, old
+ * kernels or libcs) a plain fstatat() is used instead.
+ */
+
+#include "meta.h"
+
+#ifndef _WIN32
+
+#include "args.h"
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+
+/**
+ * @brief Work out which metadata fields the selected options need
+ *
+ * - Size: shown with -s, exported with -o
+ * - Permissions: shown with -p, exported with -o
+ * - Creation and modification time: exported with -o
+ * - Size or modification time: ranked by --top (--by size, --by mtime)
+ * - Size, allocated size, link count and identity: summed by --du, which
+ *   counts symlinks as links (like du) instead of following them
+ * - Everything a snapshot stores with --snapshot / --refresh (including
+ *   the times, so a refreshed export has them for reused entries too)
+ *
+ * @param args Command-line arguments and options
+ * @return Bitmask of MetaField values
+ */
+unsigned planMetadata(const Args &args) {
+  bool csv = !args.csvOut.empty();
+  unsigned fields = 0;
+
+  if (csv || args.showSize)
+    fields |= META_SIZE;
+  if (csv || args.showPerms)
+    fields |= META_PERMS;
+  if (csv)
+    fields |= META_MTIME | META_BTIME;
+  if (!args.snapshotFile.empty())
+    fields |= META_SIZE | META_PERMS | META_MTIME | META_BTIME;
+  if (args.du)
+    fields |= META_SIZE | META_USAGE | META_LINK;
+  if (args.topCount > 0 && args.topBy == TOP_SIZE)
+    fields |= META_SIZE;
+  if (args.topCount > 0 && args.topBy == TOP_MTIME)
+    fields |= META_MTIME;
+  if (args.sortBy == SORT_SIZE)
+    fields |= META_SIZE;
+  if (args.sortBy == SORT_MTIME)
+    fields |= META_MTIME;
+
+  return fields;
+}
+
+/**
+ * @brief Modification time of a stat result in ns since the epoch
+ */
+static int64_t statMtime(const struct stat &st) {
+#if defined(__APPLE__)
+  const struct timespec &ts = st.st_mtimespec;
+#else
+  const struct timespec &ts = st.st_mtim;
+#endif
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief Creation time of a stat result in ns since the epoch
+ *
+ * Only macOS has it in struct stat; elsewhere it needs statx().
+ */
+static int64_t statBtime(const struct stat &st) {
+#if defined(__APPLE__)
+  const struct timespec &ts = st.st_birthtimespec;
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#else
+  (void)st;
+  return FileMeta::kNoTime;
+#endif
+}
+
+/**
+ * @brief Fetch metadata with fstatat() (portable fallback)
+ *
+ * @param dirfd Directory file descriptor (or AT_FDCWD)
+ * @param name Entry name relative to dirfd
+ * @param fields Bitmask of MetaField values (only META_LINK matters)
+ * @param meta Receives the metadata
+ * @return true on success
+ */
+static bool fetchMetaStat(int dirfd, const char *name, unsigned fields,
+                          FileMeta &meta) {
+  struct stat st;
+  if (fstatat(dirfd, name, &st,
+              (fields & META_LINK) ? AT_SYMLINK_NOFOLLOW : 0) != 0)
+    return false;
+
+  meta.mode = st.st_mode;
+  meta.size = static_cast<uint64_t>(st.st_size);
+  meta.mtime = statMtime(st);
+  meta.btime = statBtime(st);
+  meta.allocated = static_cast<uint64_t>(st.st_blocks) * 512;
+  meta.links = static_cast<uint32_t>(st.st_nlink);
+  meta.dev = static_cast<uint64_t>(st.st_dev);
+  meta.ino = static_cast<uint64_t>(st.st_ino);
+  meta.valid = true;
+  return true;
+}
+
+#if defined(__linux__) && defined(STATX_TYPE)
+/**
+ * @brief Translate MetaField bits into the smallest statx() mask
+ *
+ * @param fields Bitmask of MetaField values
+ * @return STATX_* mask
+ */
+unsigned statxMask(unsigned fields) {
+  unsigned mask = 0;
+  if (fields & META_TYPE)
+    mask |= STATX_TYPE;
+  if (fields & META_SIZE)
+    mask |= STATX_SIZE;
+  if (fields & META_PERMS)
+    mask |= STATX_MODE;
+  if (fields & META_MTIME)
+    mask |= STATX_MTIME;
+  if (fields & META_BTIME)
+    mask |= STATX_BTIME;
+  if (fields & META_USAGE)
+    mask |= STATX_BLOCKS | STATX_NLINK | STATX_INO;
+  return mask;
+}
+
+/**
+ * @brief statx() flags for MetaField bits
+ *
+ * @param fields Bitmask of MetaField values
+ * @return AT_* flags
+ */
+int statxFlags(unsigned fields) {
+  return AT_STATX_DONT_SYNC |
+         ((fields & META_LINK) ? AT_SYMLINK_NOFOLLOW : 0);
+}
+
+/**
+ * @brief Copy a successful statx() result into a FileMeta record
+ *
+ * stx_mask tells whether the file system filled stx_btime (ext4, XFS,
+ * Btrfs and tmpfs do; many network file systems do not). The device
+ * number is always filled, and is encoded like st_dev.
+ *
+ * @param stx statx() result
+ * @param meta Receives the metadata
+ */
+void metaFromStatx(const struct statx &stx, FileMeta &meta) {
+  meta.mode = stx.stx_mode;
+  meta.size = stx.stx_size;
+  meta.mtime = static_cast<int64_t>(stx.stx_mtime.tv_sec) * 1000000000 +
+               stx.stx_mtime.tv_nsec;
+  meta.btime = (stx.stx_mask & STATX_BTIME)
+                   ? static_cast<int64_t>(stx.stx_btime.tv_sec) * 1000000000 +
+                         stx.stx_btime.tv_nsec
+                   : FileMeta::kNoTime;
+  meta.allocated = stx.stx_blocks * 512;
+  meta.links = stx.stx_nlink;
+  meta.dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+  meta.ino = stx.stx_ino;
+  meta.valid = true;
+}
+#endif
+
+/**
+ * @brief Fetch the requested fields of one entry with a single system call
+ *
+ * @param dirfd Directory file descriptor name is relative to (or AT_FDCWD)
+ * @param name Entry name (or full path with AT_FDCWD)
+ * @param fields Bitmask of MetaField values to fetch
+ * @param meta Receives the metadata
+ * @return true on success, false on failure
+ */
+bool fetchMeta(int dirfd, const char *name, unsigned fields, FileMeta &meta) {
+  meta = FileMeta();
+
+#if defined(__linux__) && defined(STATX_TYPE)
+  // Set once the kernel or libc reports that statx is not implemented
+  static std::atomic<bool> noStatx{false};
+
+  if (!noStatx.load(std::memory_order_relaxed)) {
+    // Ask only for what the output needs
+    struct statx stx;
+    if (statx(dirfd, name, statxFlags(fields), statxMask(fields), &stx) ==
+        0) {
+      metaFromStatx(stx, meta);
+      return true;
+    }
+    if (errno != ENOSYS)
+      return false;
+    noStatx.store(true, std::memory_order_relaxed);
+  }
+#endif
+
+  // stat() always returns every field
+  return fetchMetaStat(dirfd, name, fields, meta);
+}
+
+/**
+ * @brief Read the stamp of a directory
+ *
+ * @param fd Open descriptor of the directory, or -1 to stat path
+ * @param path Directory path (used when fd is -1)
+ * @param stamp Receives the stamp (stamp.valid = false on failure)
+ * @return true on success
+ */
+bool fetchDirStamp(int fd, const char *path, DirStamp &stamp) {
+  stamp = DirStamp();
+  struct stat st;
+  if ((fd >= 0 ? fstat(fd, &st) : stat(path, &st)) != 0)
+    return false;
+
+  stamp.dev = static_cast<uint64_t>(st.st_dev);
+  stamp.ino = static_cast<uint64_t>(st.st_ino);
+  stamp.mtime = statMtime(st);
+  stamp.valid = true;
+  return true;
+}
+
+#endif
@@ -0,0 +1,138 @@
+/**
+ * @file meta.h
+ * @brief File metadata planning and retrieval for eTree (Unix/Linux)
+ *
+ * This header declares the metadata "demand planner": from the command-line
+ * options it works out which file attributes the output actually needs, and
+ * fetches exactly those with a single call per entry (statx on Linux with
+ * the smallest mask and AT_STATX_DONT_SYNC, fstatat elsewhere). The
+ * creation time comes from the same call: statx reports stx_btime where
+ * the file system records it, plain stat() has none outside macOS. The result is
+ * cached in a FileMeta record that every consumer reads from, so no entry is
+ * ever stat'ed twice.
+ */
+
+#ifndef META_H
+#define META_H
+
+#ifndef _WIN32
+
+#include <cstdint>
+
+// Forward declaration of Args structure
+struct Args;
+
+/// Metadata fields that an output option can ask for
+enum MetaField : unsigned {
+  META_TYPE = 1u << 0,  ///< File type (only when d_type is not conclusive)
+  META_SIZE = 1u << 1,  ///< Size in bytes (-s, -o)
+  META_PERMS = 1u << 2, ///< Permission bits (-p, -o)
+  META_MTIME = 1u << 3, ///< Modification time (-o, --snapshot)
+  META_BTIME = 1u << 4, ///< Creation time, where the file system has it
+  META_USAGE = 1u << 5, ///< Allocated size, link count and identity (--du)
+  META_LINK = 1u << 6,  ///< Describe a symlink itself, not its target (--du)
+};
+
+/**
+ * @struct FileMeta
+ * @brief Cached result of the one metadata call made for an entry
+ */
+struct FileMeta {
+  /// btime of a file whose creation time is not known
+  static constexpr int64_t kNoTime = INT64_MIN;
+
+  bool valid = false;     ///< Whether the metadata call succeeded
+  uint32_t mode = 0;      ///< st_mode (file type and permission bits)
+  uint32_t links = 0;     ///< Number of hard links (META_USAGE)
+  uint64_t size = 0;      ///< Size in bytes
+  int64_t mtime = 0;      ///< Modification time in ns since the epoch
+  int64_t btime = kNoTime; ///< Creation time in ns since the epoch
+  uint64_t allocated = 0; ///< Bytes allocated on disk (META_USAGE)
+  uint64_t dev = 0;       ///< Device number (META_USAGE)
+  uint64_t ino = 0;       ///< Inode number (META_USAGE)
+};
+
+/**
+ * @struct DirStamp
+ * @brief Identity and modification time of a directory
+ *
+ * A directory's mtime changes whenever an entry is added, removed or
+ * renamed in it, so an unchanged stamp means an unchanged name list.
+ */
+struct DirStamp {
+  bool valid = false; ///< Whether the stat call succeeded
+  uint64_t dev = 0;   ///< Device number
+  uint64_t ino = 0;   ///< Inode number
+  int64_t mtime = 0;  ///< Modification time in ns since the epoch
+
+  bool operator==(const DirStamp &o) const {
+    return valid && o.valid && dev == o.dev && ino == o.ino &&
+           mtime == o.mtime;
+  }
+};
+
+/**
+ * @brief Work out which metadata fields the selected options need
+ *
+ * @param args Command-line arguments and options
+ * @return Bitmask of MetaField values (0 = names only, no stat at all)
+ */
+unsigned planMetadata(const Args &args);
+
+/**
+ * @brief Fetch the requested fields of one entry with a single system call
+ *
+ * Symlinks are followed, like std::filesystem::status(), unless fields has
+ * META_LINK (then they are described like lstat()). On Linux this is a
+ * statx() with only the requested fields in the mask and AT_STATX_DONT_SYNC,
+ * so network file systems may answer from their attribute cache; kernels or
+ * libcs without statx fall back to fstatat().
+ *
+ * @param dirfd Directory file descriptor name is relative to (or AT_FDCWD)
+ * @param name Entry name (or full path with AT_FDCWD)
+ * @param fields Bitmask of MetaField values to fetch
+ * @param meta Receives the metadata (meta.valid = false on failure)
+ * @return true on success, false on failure
+ */
+bool fetchMeta(int dirfd, const char *name, unsigned fields, FileMeta &meta);
+
+/**
+ * @brief Read the stamp of a directory
+ *
+ * @param fd Open descriptor of the directory, or -1 to stat path
+ * @param path Directory path (used when fd is -1)
+ * @param stamp Receives the stamp (stamp.valid = false on failure)
+ * @return true on success
+ */
+bool fetchDirStamp(int fd, const char *path, DirStamp &stamp);
+
+#if defined(__linux__)
+#include <sys/stat.h>
+
+#ifdef STATX_TYPE
+/**
+ * @brief Translate MetaField bits into the smallest statx() mask
+ * @param fields Bitmask of MetaField values
+ * @return STATX_* mask
+ */
+unsigned statxMask(unsigned fields);
+
+/**
+ * @brief statx() flags for MetaField bits (symlinks followed or not)
+ * @param fields Bitmask of MetaField values
+ * @return AT_* flags
+ */
+int statxFlags(unsigned fields);
+
+/**
+ * @brief Copy a successful statx() result into a FileMeta record
+ * @param stx statx() result
+ * @param meta Receives the metadata
+ */
+void metaFromStatx(const struct statx &stx, FileMeta &meta);
+#endif
+#endif
+
+#endif
+
+#endif
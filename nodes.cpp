@@ -0,0 +1,254 @@
+/**
+ * @file nodes.cpp
+ * @brief Compact in-memory tree store implementation for eTree
+ */
+
+#include "nodes.h"
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+/**
+ * @brief 64-bit FNV-1a hash of a name
+ */
+uint64_t hashName(std::string_view name) {
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : name) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+} // namespace
+
+/**
+ * @brief Create an empty arena
+ */
+NameArena::NameArena() : table_(1024, kEmpty) {}
+
+/**
+ * @brief Store a name once and return its offset
+ *
+ * Linear probing over a power-of-two table kept at most half full.
+ *
+ * @param name Name to intern
+ * @return Offset of the stored copy
+ */
+uint32_t NameArena::intern(std::string_view name) {
+  const size_t mask = table_.size() - 1;
+  size_t slot = hashName(name) & mask;
+  for (;; slot = (slot + 1) & mask) {
+    const uint32_t offset = table_[slot];
+    if (offset == kEmpty)
+      break;
+    if (get(offset) == name)
+      return offset;
+  }
+
+  // New name: copy it (NUL-terminated) into the current chunk
+  if (used_ + name.size() + 1 > kChunk) {
+    chunks_.push_back(std::make_unique<char[]>(kChunk));
+    used_ = 0;
+  }
+  const uint32_t offset =
+      static_cast<uint32_t>((chunks_.size() - 1) << kChunkBits) + used_;
+  char *p = chunks_.back().get() + used_;
+  std::memcpy(p, name.data(), name.size());
+  p[name.size()] = '\0';
+  used_ += static_cast<uint32_t>(name.size() + 1);
+
+  table_[slot] = offset;
+  if (++count_ * 2 > table_.size())
+    grow();
+  return offset;
+}
+
+/**
+ * @brief Double the intern table and re-insert every offset
+ */
+void NameArena::grow() {
+  std::vector<uint32_t> old(table_.size() * 2, kEmpty);
+  old.swap(table_);
+  const size_t mask = table_.size() - 1;
+  for (uint32_t offset : old) {
+    if (offset == kEmpty)
+      continue;
+    size_t slot = hashName(get(offset)) & mask;
+    while (table_[slot] != kEmpty)
+      slot = (slot + 1) & mask;
+    table_[slot] = offset;
+  }
+}
+
+/**
+ * @brief Bytes allocated for names and the intern table
+ */
+size_t NameArena::memoryUsage() const {
+  return chunks_.size() * kChunk + table_.size() * sizeof(uint32_t);
+}
+
+/**
+ * @brief Append one node (not yet linked into its parent's range)
+ */
+uint32_t NodeStore::append(uint32_t parent, uint32_t name) {
+  if ((count_ & kChunkMask) == 0)
+    chunks_.push_back(std::make_unique<Node[]>(kChunk));
+  const uint32_t i = static_cast<uint32_t>(count_++);
+  Node &n = (*this)[i];
+  n = Node();
+  n.parent = parent;
+  n.name = name;
+  return i;
+}
+
+/**
+ * @brief Add the root directory (the first node)
+ * @param name Name shown for the root
+ * @return Index of the root
+ */
+uint32_t NodeStore::addRoot(std::string_view name) {
+  const uint32_t root = append(kNoNode, names_.intern(name));
+  (*this)[root].flags = Node::Dir;
+  return root;
+}
+
+/**
+ * @brief Store a directory's listing as its children
+ *
+ * @param dir Index of the directory
+ * @param listing Its listing
+ * @return Index of the first child
+ */
+uint32_t NodeStore::setChildren(uint32_t dir, const DirListing &listing) {
+  const uint32_t first = static_cast<uint32_t>(count_);
+  for (const WalkEntry &e : listing.entries) {
+    Node &n = (*this)[append(dir, names_.intern(e.name))];
+    n.flags = (e.isDir ? Node::Dir : 0) | (e.matched ? Node::Matched : 0) |
+              (e.meta.valid ? Node::MetaValid : 0);
+    n.mode = static_cast<uint16_t>(e.meta.mode);
+    n.size = e.isDir ? 0 : e.meta.size;
+    n.mtime = e.meta.mtime;
+  }
+
+  Node &d = (*this)[dir];
+  garbage_ += d.isDir() ? d.size : 0;
+  d.children = first;
+  d.size = listing.entries.size();
+  return first;
+}
+
+/**
+ * @brief Hand a directory's children over to another node
+ *
+ * @param from Node that owns the children
+ * @param to Node that takes them over
+ */
+void NodeStore::moveChildren(uint32_t from, uint32_t to) {
+  Node &src = (*this)[from];
+  Node &dst = (*this)[to];
+  dst.children = src.children;
+  dst.size = src.size;
+  for (uint32_t c = 0; c < dst.size; ++c)
+    (*this)[dst.children + c].parent = to;
+  src.size = 0;
+}
+
+/**
+ * @brief Rebuild the store from the root without unreachable nodes
+ *
+ * Copies the tree breadth-first into fresh chunks, so every directory's
+ * children are contiguous again and the names keep their offsets.
+ *
+ * @return New index of every old node (kNoNode if it was dropped)
+ */
+std::vector<uint32_t> NodeStore::compact() {
+  std::vector<uint32_t> remap(count_, kNoNode);
+  if (count_ == 0)
+    return remap;
+
+  std::vector<std::unique_ptr<Node[]>> old;
+  old.swap(chunks_);
+  auto oldNode = [&](uint32_t i) -> const Node & {
+    return old[i >> kChunkBits][i & kChunkMask];
+  };
+  count_ = 0;
+  garbage_ = 0;
+
+  // The new root, then each directory's children in breadth-first order;
+  // `next` walks the new array, which doubles as the queue
+  remap[0] = append(kNoNode, oldNode(0).name);
+  (*this)[0] = oldNode(0);
+  for (uint32_t next = 0; next < count_; ++next) {
+    Node &n = (*this)[next];
+    if (!n.isDir() || n.size == 0)
+      continue;
+    const uint32_t from = n.children;
+    const uint32_t count = static_cast<uint32_t>(n.size);
+    n.children = static_cast<uint32_t>(count_);
+    for (uint32_t c = 0; c < count; ++c) {
+      const uint32_t i = append(next, 0);
+      (*this)[i] = oldNode(from + c);
+      (*this)[i].parent = next;
+      remap[from + c] = i;
+    }
+    // append() may have added a chunk; n is still valid (chunks never move)
+  }
+  (*this)[0].parent = kNoNode;
+  return remap;
+}
+
+/**
+ * @brief Metadata of a node
+ */
+FileMeta NodeStore::meta(uint32_t i) const {
+  const Node &n = (*this)[i];
+  FileMeta m;
+  m.valid = n.flags & Node::MetaValid;
+  m.mode = n.mode;
+  m.size = n.isDir() ? 0 : n.size;
+  m.mtime = n.mtime;
+  return m;
+}
+
+/**
+ * @brief Depth level of a node (1 = root)
+ */
+int NodeStore::level(uint32_t i) const {
+  int level = 1;
+  for (uint32_t p = (*this)[i].parent; p != kNoNode; p = (*this)[p].parent)
+    ++level;
+  return level;
+}
+
+/**
+ * @brief Path of a node relative to the root
+ *
+ * @param i Node
+ * @param path Receives the path ("" for the root)
+ */
+void NodeStore::path(uint32_t i, std::string &path) const {
+  path.clear();
+  static thread_local std::vector<uint32_t> chain;
+  chain.clear();
+  for (; (*this)[i].parent != kNoNode; i = (*this)[i].parent)
+    chain.push_back(i);
+  for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+    if (!path.empty())
+      path += '/';
+    path += name(*it);
+  }
+}
+
+/**
+ * @brief Bytes allocated for nodes and names
+ */
+size_t NodeStore::memoryUsage() const {
+  return chunks_.size() * kChunk * sizeof(Node) + names_.memoryUsage();
+}
+
+#endif
@@ -0,0 +1,223 @@
+/**
+ * @file nodes.h
+ * @brief Compact in-memory tree store for eTree
+ *
+ * This header declares NodeStore, the representation for modes that keep
+ * a whole tree in memory after it has been walked (--watch). Instead of
+ * listings, paths and per-entry strings, every file or directory is one
+ * fixed 32-byte Node:
+ *
+ *   parent    32-bit index of the parent directory
+ *   name      32-bit offset of the name in an interned NameArena
+ *   children  index of the first child (directories)
+ *   mode      st_mode (type and permission bits), plus flags
+ *   size      size in bytes (files) or number of children (directories)
+ *   mtime     modification time in ns
+ *
+ * A directory's children are stored contiguously, in listing order, so a
+ * directory is a range of the node array and a path is found by following
+ * parent indices. Names are interned: a name that occurs many times in a
+ * tree ("Makefile", "index.js", "__init__.py") is stored once. Nodes and
+ * names live in fixed-size chunks, so growing the store never copies it
+ * and its memory is close to 32 bytes per node plus the distinct names.
+ *
+ * When a directory's contents change, its children are written as a new
+ * block and the old one becomes garbage; compact() rebuilds the store
+ * without garbage once enough of it has accumulated.
+ */
+
+#ifndef NODES_H
+#define NODES_H
+
+#ifndef _WIN32
+
+#include "etree.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class NameArena
+ * @brief Interned, NUL-terminated names addressed by 32-bit offsets
+ */
+class NameArena {
+public:
+  NameArena();
+
+  /**
+   * @brief Store a name once and return its offset
+   * @param name Name (no NUL bytes, at most kChunk - 1 bytes)
+   * @return Offset of the stored copy
+   */
+  uint32_t intern(std::string_view name);
+
+  /**
+   * @brief Name stored at an offset
+   */
+  std::string_view get(uint32_t offset) const {
+    const char *p = chunks_[offset >> kChunkBits].get() + (offset & kChunkMask);
+    return std::string_view(p);
+  }
+
+  /**
+   * @brief Bytes allocated for names and the intern table
+   */
+  size_t memoryUsage() const;
+
+private:
+  static constexpr unsigned kChunkBits = 20; ///< 1 MiB chunks
+  static constexpr uint32_t kChunk = 1u << kChunkBits;
+  static constexpr uint32_t kChunkMask = kChunk - 1;
+  static constexpr uint32_t kEmpty = UINT32_MAX;
+
+  void grow();
+
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  uint32_t used_ = kChunk; ///< Bytes used in the last chunk (full: none)
+  std::vector<uint32_t> table_; ///< Open-addressing table of offsets
+  size_t count_ = 0;            ///< Distinct names
+};
+
+/**
+ * @struct Node
+ * @brief One file or directory of a NodeStore (32 bytes)
+ */
+struct Node {
+  uint32_t parent;   ///< Parent directory (kNoNode for the root)
+  uint32_t name;     ///< Offset of the name in the NameArena
+  uint32_t children; ///< Directories: index of the first child
+  uint16_t mode;     ///< st_mode (type and permission bits)
+  uint16_t flags;    ///< Node::Flags
+  uint64_t size;     ///< Files: size in bytes; directories: child count
+  int64_t mtime;     ///< Modification time in ns since the epoch
+
+  enum Flags : uint16_t {
+    Dir = 1u << 0,       ///< Node is a directory
+    Matched = 1u << 1,   ///< Matched a -P pattern itself
+    MetaValid = 1u << 2, ///< mode/size/mtime are known
+  };
+
+  bool isDir() const { return flags & Dir; }
+};
+
+static_assert(sizeof(Node) == 32, "Node must stay 32 bytes");
+
+/// "No node" (parent of the root)
+constexpr uint32_t kNoNode = UINT32_MAX;
+
+/**
+ * @class NodeStore
+ * @brief A tree of Nodes with contiguous children and interned names
+ *
+ * Not thread-safe: the store is filled and read by the rendering thread.
+ */
+class NodeStore {
+public:
+  /**
+   * @brief Add the root directory (the first node)
+   * @param name Name shown for the root (its path)
+   * @return Index of the root
+   */
+  uint32_t addRoot(std::string_view name);
+
+  /**
+   * @brief Store a directory's listing as its children
+   *
+   * The entries become one new contiguous block; if the directory had
+   * children before, that block is left behind as garbage. The new
+   * children have no children of their own yet.
+   *
+   * @param dir Index of the directory
+   * @param listing Its listing (entries in display order)
+   * @return Index of the first child
+   */
+  uint32_t setChildren(uint32_t dir, const DirListing &listing);
+
+  /**
+   * @brief Hand a directory's children over to another node
+   *
+   * Used when a directory's own node moved to a new block: its children
+   * stay where they are and only their parent index changes.
+   *
+   * @param from Node that owns the children
+   * @param to Node that takes them over
+   */
+  void moveChildren(uint32_t from, uint32_t to);
+
+  /**
+   * @brief Count nodes that are no longer reachable
+   * @param count Number of nodes dropped from the tree
+   */
+  void retire(size_t count) { garbage_ += count; }
+
+  /**
+   * @brief Whether enough garbage has accumulated for compact()
+   */
+  bool wantsCompaction() const {
+    return garbage_ > kMinGarbage && garbage_ > count_ / 2;
+  }
+
+  /**
+   * @brief Rebuild the store from the root without unreachable nodes
+   * @return New index of every old node (kNoNode if it was dropped)
+   */
+  std::vector<uint32_t> compact();
+
+  Node &operator[](uint32_t i) {
+    return chunks_[i >> kChunkBits][i & kChunkMask];
+  }
+  const Node &operator[](uint32_t i) const {
+    return chunks_[i >> kChunkBits][i & kChunkMask];
+  }
+
+  /// Number of nodes stored (reachable or not)
+  size_t size() const { return count_; }
+
+  /// Name of a node
+  std::string_view name(uint32_t i) const { return names_.get((*this)[i].name); }
+
+  /// Number of children of a directory
+  uint32_t childCount(uint32_t i) const {
+    const Node &n = (*this)[i];
+    return n.isDir() ? static_cast<uint32_t>(n.size) : 0;
+  }
+
+  /// Metadata of a node, as listDirectory() fetched it
+  FileMeta meta(uint32_t i) const;
+
+  /**
+   * @brief Depth level of a node (1 = root)
+   */
+  int level(uint32_t i) const;
+
+  /**
+   * @brief Path of a node relative to the root ("" for the root)
+   * @param i Node
+   * @param path Receives the path
+   */
+  void path(uint32_t i, std::string &path) const;
+
+  /**
+   * @brief Bytes allocated for nodes and names
+   */
+  size_t memoryUsage() const;
+
+private:
+  static constexpr unsigned kChunkBits = 16; ///< 64Ki nodes (2 MiB)
+  static constexpr uint32_t kChunk = 1u << kChunkBits;
+  static constexpr uint32_t kChunkMask = kChunk - 1;
+  static constexpr size_t kMinGarbage = 1u << 16;
+
+  uint32_t append(uint32_t parent, uint32_t name);
+
+  std::vector<std::unique_ptr<Node[]>> chunks_;
+  size_t count_ = 0;
+  size_t garbage_ = 0; ///< Unreachable nodes
+  NameArena names_;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,157 @@
+/**
+ * @file output.cpp
+ * @brief Buffered output sink implementation for eTree
+ *
+ * Writes go straight to the descriptor with write(2); when a large chunk
+ * does not fit behind the pending bytes, both are handed to one writev(2)
+ * call instead of being copied through the buffer.
+ */
+
+#include "output.h"
+
+#ifndef _WIN32
+
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+/// Buffer size: large enough that a tree is written in few system calls
+constexpr size_t kBufferSize = 256 * 1024;
+
+} // namespace
+
+/**
+ * @brief Create a writer on an already open descriptor (not closed)
+ *
+ * @param fd File descriptor to write to
+ */
+OutputWriter::OutputWriter(int fd)
+    : fd_(fd), terminal_(isatty(fd)), buffer_(new char[kBufferSize]),
+      capacity_(kBufferSize) {}
+
+/**
+ * @brief Flush pending output and close the descriptor if owned
+ */
+OutputWriter::~OutputWriter() {
+  flush();
+  if (ownsFd_)
+    close(fd_);
+}
+
+/**
+ * @brief Redirect the writer to a new file (created or truncated)
+ *
+ * Pending output for the previous descriptor is flushed first.
+ *
+ * @param filename File to write to
+ * @return true on success, false if the file could not be opened
+ */
+bool OutputWriter::open(const std::string &filename) {
+  int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0666);
+  if (fd < 0)
+    return false;
+
+  flush();
+  if (ownsFd_)
+    close(fd_);
+  fd_ = fd;
+  ownsFd_ = true;
+  terminal_ = false;
+  failed_ = false;
+  return true;
+}
+
+/**
+ * @brief Append bytes to the output
+ *
+ * Small writes are copied into the buffer; a write that would overflow it
+ * is sent together with the pending bytes in one writev().
+ *
+ * @param data Bytes to append
+ * @param size Number of bytes
+ */
+void OutputWriter::write(const char *data, size_t size) {
+  if (size <= capacity_ - used_) {
+    std::memcpy(buffer_.get() + used_, data, size);
+    used_ += size;
+    return;
+  }
+
+  if (!failed_ && !writeTwo(buffer_.get(), used_, data, size))
+    failed_ = true;
+  used_ = 0;
+}
+
+/**
+ * @brief Append an unsigned integer in decimal (std::to_chars)
+ *
+ * @param value Number to append
+ */
+void OutputWriter::writeNumber(uintmax_t value) {
+  char digits[24];
+  auto result = std::to_chars(digits, digits + sizeof(digits), value);
+  write(digits, static_cast<size_t>(result.ptr - digits));
+}
+
+/**
+ * @brief Write out everything buffered so far
+ *
+ * @return false if the output has failed
+ */
+bool OutputWriter::flush() {
+  if (used_ > 0 && !failed_ && !writeAll(buffer_.get(), used_))
+    failed_ = true;
+  used_ = 0;
+  return !failed_;
+}
+
+/**
+ * @brief write() until all bytes are out, retrying after EINTR
+ *
+ * @return false on a write error
+ */
+bool OutputWriter::writeAll(const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = ::write(fd_, data, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+/**
+ * @brief Write two byte ranges back to back with writev()
+ *
+ * Partial writes are finished with plain write() calls.
+ *
+ * @return false on a write error
+ */
+bool OutputWriter::writeTwo(const char *a, size_t na, const char *b,
+                            size_t nb) {
+  iovec iov[2] = {{const_cast<char *>(a), na}, {const_cast<char *>(b), nb}};
+  ssize_t n;
+  do {
+    n = ::writev(fd_, iov, 2);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0)
+    return false;
+
+  size_t done = static_cast<size_t>(n);
+  if (done < na)
+    return writeAll(a + done, na - done) && writeAll(b, nb);
+  done -= na;
+  return writeAll(b + done, nb - done);
+}
+
+#endif
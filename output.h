@@ -0,0 +1,147 @@
+/**
+ * @file output.h
+ * @brief Buffered output sink for the tree renderer (Unix/Linux)
+ *
+ * This header declares OutputWriter, which replaces std::cout/std::endl on
+ * the rendering path. Lines are assembled in one large reusable buffer
+ * with memcpy and std::to_chars and reach the file descriptor through
+ * write()/writev() only when the buffer fills up or the writer is flushed,
+ * instead of one flushing write per line. A terminal is flushed once per
+ * line so that interactive output still appears as the walk progresses.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#ifndef _WIN32
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/**
+ * @class OutputWriter
+ * @brief Large-buffer writer on a file descriptor
+ *
+ * Not thread-safe: only the rendering thread writes. A write error (for
+ * example a closed pipe or a full disk) is remembered and further output
+ * is discarded.
+ */
+class OutputWriter {
+public:
+  /**
+   * @brief Create a writer on an already open descriptor (not closed)
+   * @param fd File descriptor to write to (default: standard output)
+   */
+  explicit OutputWriter(int fd = 1);
+
+  /**
+   * @brief Flush pending output and close the descriptor if owned
+   */
+  ~OutputWriter();
+
+  OutputWriter(const OutputWriter &) = delete;
+  OutputWriter &operator=(const OutputWriter &) = delete;
+
+  /**
+   * @brief Redirect the writer to a new file (created or truncated)
+   * @param filename File to write to
+   * @return true on success, false if the file could not be opened
+   */
+  bool open(const std::string &filename);
+
+  /**
+   * @brief Whether the descriptor is a terminal (line-flushed, colorable)
+   */
+  bool isTerminal() const { return terminal_; }
+
+  /**
+   * @brief Append bytes to the output
+   * @param data Bytes to append
+   * @param size Number of bytes
+   */
+  void write(const char *data, size_t size);
+
+  /**
+   * @brief Append a string to the output
+   * @param text Text to append
+   */
+  void write(std::string_view text) { write(text.data(), text.size()); }
+
+  /**
+   * @brief Append one character to the output
+   * @param c Character to append
+   */
+  void put(char c) {
+    if (used_ == capacity_)
+      flush();
+    buffer_[used_++] = c;
+  }
+
+  /**
+   * @brief Room to format up to size bytes in place
+   *
+   * Flushes first if the buffer has less room left; pass the end of what
+   * was written to commit().
+   *
+   * @param size Most bytes that will be written (at most a few KiB)
+   * @return Where to write
+   */
+  char *reserve(size_t size) {
+    if (capacity_ - used_ < size)
+      flush();
+    return buffer_.get() + used_;
+  }
+
+  /**
+   * @brief Keep the bytes written after reserve()
+   * @param end End of the bytes written
+   */
+  void commit(const char *end) {
+    used_ = static_cast<size_t>(end - buffer_.get());
+  }
+
+  /**
+   * @brief Append an unsigned integer in decimal (std::to_chars)
+   * @param value Number to append
+   */
+  void writeNumber(uintmax_t value);
+
+  /**
+   * @brief End the current line (flushes when writing to a terminal)
+   */
+  void endLine() {
+    put('\n');
+    if (terminal_)
+      flush();
+  }
+
+  /**
+   * @brief Write out everything buffered so far
+   * @return false if the output has failed
+   */
+  bool flush();
+
+  /**
+   * @brief Whether a write error has occurred
+   */
+  bool failed() const { return failed_; }
+
+private:
+  bool writeAll(const char *data, size_t size);
+  bool writeTwo(const char *a, size_t na, const char *b, size_t nb);
+
+  int fd_;                         ///< Destination descriptor
+  bool ownsFd_ = false;            ///< Close fd_ on destruction
+  bool terminal_ = false;          ///< fd_ is a terminal
+  bool failed_ = false;            ///< A write has failed
+  std::unique_ptr<char[]> buffer_; ///< Pending output
+  size_t capacity_;                ///< Size of buffer_
+  size_t used_ = 0;                ///< Bytes pending in buffer_
+};
+
+#endif
+
+#endif
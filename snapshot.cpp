@@ -0,0 +1,461 @@
+/**
+ * @file snapshot.cpp
+ * @brief Persistent tree snapshot implementation for eTree
+ *
+ * Snapshots are written in one pass from memory (header, directory and
+ * entry records, names) to a temporary file that is then renamed over the
+ * old one, so a refresh can keep reading the previous snapshot through its
+ * mapping while the new one is saved, and an interrupted save never leaves
+ * a truncated snapshot behind.
+ */
+
+#include "snapshot.h"
+
+#ifndef _WIN32
+
+#include "args.h"
+#include "output.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char kMagic[8] = {'E', 'T', 'S', 'N', 'A', 'P', 0, 0};
+constexpr uint32_t kVersion = 2;
+
+// The records are written and mapped as they are laid out in memory
+static_assert(sizeof(SnapshotHeader) % 8 == 0, "header keeps alignment");
+static_assert(sizeof(SnapshotDir) == 48, "unexpected SnapshotDir padding");
+static_assert(sizeof(SnapshotEntry) == 40, "unexpected SnapshotEntry padding");
+
+/// How much older than the walk a directory's stamp must be to be trusted
+/// (covers coarse mtime ticks, and 2 s ones on FAT)
+constexpr int64_t kRacyNs = 2000000000;
+
+/**
+ * @brief Key under which a walk root is stored (absolute, normalized)
+ */
+std::string rootKey(const fs::path &root) {
+  std::error_code ec;
+  fs::path abs = fs::absolute(root, ec);
+  std::string key = (ec ? root : abs).lexically_normal().string();
+  while (key.size() > 1 && key.back() == '/')
+    key.pop_back();
+  return key;
+}
+
+/**
+ * @brief 64-bit FNV-1a hash, extended by each call
+ */
+void hashBytes(uint64_t &hash, std::string_view bytes) {
+  for (unsigned char c : bytes) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+}
+
+} // namespace
+
+/**
+ * @brief Fingerprint of the options that decide what a listing contains
+ *
+ * The depth limit is not part of it: directories below the old limit
+ * simply have no record and are listed fresh.
+ *
+ * @param args Command-line arguments and options
+ * @return Hash of -a, -d, -I, -P and --gitignore
+ */
+uint64_t snapshotOptions(const Args &args) {
+  uint64_t hash = 14695981039346656037ull;
+  hashBytes(hash, args.showHidden ? "a1" : "a0");
+  hashBytes(hash, args.showDirsOnly ? "d1" : "d0");
+  hashBytes(hash, args.gitignore ? "g1" : "g0");
+  for (const std::string &pattern : args.excludePatterns) {
+    hashBytes(hash, "\nI");
+    hashBytes(hash, pattern);
+  }
+  for (const std::string &pattern : args.includePatterns) {
+    hashBytes(hash, "\nP");
+    hashBytes(hash, pattern);
+  }
+  return hash;
+}
+
+/**
+ * @brief Unmap the snapshot
+ */
+SnapshotReader::~SnapshotReader() {
+  if (map_)
+    munmap(map_, mapSize_);
+}
+
+/**
+ * @brief Map a snapshot and check its structure
+ *
+ * Every section must lie inside the file; records are checked again when
+ * they are used, so a damaged snapshot is never read out of bounds.
+ *
+ * @param file Snapshot file
+ * @param why Receives the reason when the file is not a snapshot
+ * @return true if the snapshot can be read
+ */
+bool SnapshotReader::open(const std::string &file, std::string &why) {
+  int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    why = "Could not open snapshot " + file + ": " + std::strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 &&
+      static_cast<uint64_t>(st.st_size) >= sizeof(SnapshotHeader)) {
+    mapSize_ = static_cast<size_t>(st.st_size);
+    map_ = mmap(nullptr, mapSize_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map_ == MAP_FAILED)
+      map_ = nullptr;
+  }
+  close(fd);
+  if (!map_) {
+    why = "Not a snapshot: " + file;
+    return false;
+  }
+
+  const char *base = static_cast<const char *>(map_);
+  const auto &h = *reinterpret_cast<const SnapshotHeader *>(base);
+  auto fits = [&](uint64_t offset, uint64_t count, size_t size) {
+    return offset % 8 == 0 && offset <= mapSize_ &&
+           count <= (mapSize_ - offset) / size;
+  };
+  if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) == 0 &&
+      h.version != kVersion) {
+    why = "Snapshot " + file + " was written by another etree version";
+    return false;
+  }
+  if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 ||
+      !fits(h.dirsOffset, h.dirCount, sizeof(SnapshotDir)) ||
+      !fits(h.entriesOffset, h.entryCount, sizeof(SnapshotEntry)) ||
+      !fits(h.namesOffset, h.namesSize, 1) || h.rootLength >= h.namesSize ||
+      h.dirCount >= kSnapNone || h.entryCount >= kSnapNone) {
+    why = "Not a snapshot: " + file;
+    return false;
+  }
+  dirs_ = reinterpret_cast<const SnapshotDir *>(base + h.dirsOffset);
+  entries_ = reinterpret_cast<const SnapshotEntry *>(base + h.entriesOffset);
+  names_ = base + h.namesOffset;
+  dirCount_ = h.dirCount;
+  entryCount_ = h.entryCount;
+  namesSize_ = h.namesSize;
+  options_ = h.options;
+  rootLength_ = h.rootLength;
+  return true;
+}
+
+/**
+ * @brief Map a snapshot and check that it fits this walk
+ *
+ * @param file Snapshot file
+ * @param root Walk root
+ * @param options snapshotOptions() of this run
+ * @param why Receives the reason when the snapshot is not usable
+ * @return true if the snapshot can be used
+ */
+bool SnapshotReader::open(const std::string &file, const fs::path &root,
+                          uint64_t options, std::string &why) {
+  if (!open(file, why))
+    return false;
+  if (options_ != options) {
+    why = "Snapshot " + file + " was saved with other filter options";
+    return false;
+  }
+  if (names_[rootLength_] != '\0' ||
+      std::string_view(names_, rootLength_) != rootKey(root)) {
+    why = "Snapshot " + file + " is of another directory";
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Check that a directory's entry records lie inside the snapshot
+ */
+bool SnapshotReader::validEntries(const SnapshotDir &d) const {
+  if (d.firstEntry > entryCount_ || d.entryCount > entryCount_ - d.firstEntry)
+    return false;
+  for (uint64_t i = 0; i < d.entryCount; ++i) {
+    const SnapshotEntry &s = entries_[d.firstEntry + i];
+    if (s.name >= namesSize_ || s.nameLength >= namesSize_ - s.name ||
+        names_[s.name + s.nameLength] != '\0' ||
+        (s.child != kSnapNone && s.child >= dirCount_))
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Fill a listing from a directory record if it is still current
+ *
+ * One stat of the directory decides; the entries, their metadata and the
+ * records of their subdirectories then come from the snapshot. With
+ * --gitignore the directory's own ignore files are read again: the
+ * listing is only reused if the resulting rule stack has the digest it
+ * was filtered with, and its subdirectories inherit that stack.
+ *
+ * @param dir Directory record
+ * @param path Directory path
+ * @param args Command-line arguments and options
+ * @param level Depth level of the directory (for the statistics)
+ * @param ignore Ignore rules inherited from the parent (--gitignore)
+ * @param stats Statistics of the calling thread
+ * @param listing Receives the listing when the stamp matches
+ * @return false if the directory changed (listing left untouched)
+ */
+bool SnapshotReader::reuse(uint32_t dir, const fs::path &path,
+                           const Args &args, int level,
+                           const IgnoreFrame::Ptr &ignore, TreeStats &stats,
+                           DirListing &listing) const {
+  if (dir >= dirCount_)
+    return false;
+  const SnapshotDir &d = dirs_[dir];
+  if ((d.flags & SnapshotDir::Stale) || !validEntries(d))
+    return false;
+
+  DirStamp now;
+  if (!fetchDirStamp(-1, path.c_str(), now) || now.dev != d.dev ||
+      now.ino != d.ino || now.mtime != d.mtime)
+    return false;
+
+  IgnoreFrame::Ptr rules = ignore;
+  if (args.gitignore) {
+    if (d.flags & SnapshotDir::IgnoreFiles)
+      rules = IgnoreFrame::load(-1, path, ignore);
+    if (IgnoreFrame::digest(rules) != d.rules)
+      return false;
+  }
+
+  fill(d, listing);
+  listing.stamp = now;
+  listing.ignore = std::move(rules);
+  countListing(listing, args, level, stats);
+  listing.ok = true;
+  return true;
+}
+
+/**
+ * @brief Fill a listing from a directory record, whatever its stamp
+ *
+ * @param dir Directory record
+ * @param listing Receives the entries
+ * @return false if the record is damaged (listing left untouched)
+ */
+bool SnapshotReader::read(uint32_t dir, DirListing &listing) const {
+  if (dir >= dirCount_ || !validEntries(dirs_[dir]))
+    return false;
+  fill(dirs_[dir], listing);
+  listing.ok = true;
+  return true;
+}
+
+/**
+ * @brief Copy a checked directory record into a listing
+ *
+ * Entry names point into the mapping; the listing is not marked ok.
+ */
+void SnapshotReader::fill(const SnapshotDir &d, DirListing &listing) const {
+  listing.clear();
+  listing.hasIgnoreFiles = d.flags & SnapshotDir::IgnoreFiles;
+
+  listing.entries.resize(d.entryCount);
+  for (uint32_t i = 0; i < d.entryCount; ++i) {
+    const SnapshotEntry &s = entries_[d.firstEntry + i];
+    WalkEntry &e = listing.entries[i];
+    e = WalkEntry();
+    e.name = std::string_view(names_ + s.name, s.nameLength);
+    e.isDir = s.flags & SnapshotEntry::Dir;
+    e.matched = s.flags & SnapshotEntry::Matched;
+    e.isLink = s.flags & SnapshotEntry::Link;
+    e.snapDir = s.child;
+    e.meta.valid = s.flags & SnapshotEntry::MetaValid;
+    e.meta.mode = s.mode;
+    e.meta.size = s.size;
+    e.meta.mtime = s.mtime;
+    e.meta.btime = s.btime;
+  }
+}
+
+/**
+ * @brief Find the records of a freshly listed directory's subdirectories
+ *
+ * @param dir Old record of the directory
+ * @param listing Fresh listing of the directory
+ */
+void SnapshotReader::link(uint32_t dir, DirListing &listing) const {
+  if (dir >= dirCount_ || !validEntries(dirs_[dir]))
+    return;
+  const SnapshotDir &d = dirs_[dir];
+
+  // Old subdirectories by name
+  static thread_local std::vector<std::pair<std::string_view, uint32_t>> old;
+  old.clear();
+  for (uint32_t i = 0; i < d.entryCount; ++i) {
+    const SnapshotEntry &s = entries_[d.firstEntry + i];
+    if (s.child != kSnapNone)
+      old.emplace_back(std::string_view(names_ + s.name, s.nameLength),
+                       s.child);
+  }
+  if (old.empty())
+    return;
+  std::sort(old.begin(), old.end());
+
+  for (WalkEntry &e : listing.entries) {
+    if (!e.isDir)
+      continue;
+    auto it = std::lower_bound(
+        old.begin(), old.end(), e.name,
+        [](const auto &o, std::string_view name) { return o.first < name; });
+    if (it != old.end() && it->first == e.name)
+      e.snapDir = it->second;
+  }
+}
+
+/**
+ * @brief Start an empty snapshot (the walk starts now)
+ *
+ * @param root Walk root
+ * @param options snapshotOptions() of this run
+ */
+SnapshotWriter::SnapshotWriter(const fs::path &root, uint64_t options)
+    : options_(options) {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  started_ = static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+
+  std::string key = rootKey(root);
+  names_.assign(key.begin(), key.end());
+  names_.push_back('\0');
+  rootLength_ = key.size();
+}
+
+/**
+ * @brief Append a directory listing
+ *
+ * @param listing Listing of the directory (ok)
+ * @param parentEntry Entry record of the directory in its parent, or
+ *        kSnapNone for the root
+ * @return Index of the directory's first entry record
+ */
+uint32_t SnapshotWriter::addDirectory(const DirListing &listing,
+                                      uint32_t parentEntry) {
+  const uint32_t index = static_cast<uint32_t>(dirs_.size());
+  const uint32_t first = static_cast<uint32_t>(entries_.size());
+  if (parentEntry < entries_.size())
+    entries_[parentEntry].child = index;
+
+  SnapshotDir d{};
+  d.dev = listing.stamp.dev;
+  d.ino = listing.stamp.ino;
+  d.mtime = listing.stamp.mtime;
+  d.rules = IgnoreFrame::digest(listing.ignore);
+  d.firstEntry = first;
+  d.entryCount = static_cast<uint32_t>(listing.entries.size());
+  d.flags = 0;
+  // A stamp from the walk's last ticks may not show an entry added in the
+  // same tick after the listing: list such a directory again next time
+  if (!listing.stamp.valid || listing.stamp.mtime > started_ - kRacyNs)
+    d.flags |= SnapshotDir::Stale;
+  if (listing.hasIgnoreFiles)
+    d.flags |= SnapshotDir::IgnoreFiles;
+  dirs_.push_back(d);
+
+  for (const WalkEntry &e : listing.entries) {
+    SnapshotEntry s{};
+    s.name = static_cast<uint32_t>(names_.size());
+    s.nameLength = static_cast<uint16_t>(e.name.size());
+    s.child = kSnapNone;
+    s.flags = 0;
+    if (e.isDir)
+      s.flags |= SnapshotEntry::Dir;
+    if (e.matched)
+      s.flags |= SnapshotEntry::Matched;
+    if (e.meta.valid)
+      s.flags |= SnapshotEntry::MetaValid;
+    if (e.isLink)
+      s.flags |= SnapshotEntry::Link;
+    s.mode = e.meta.mode;
+    s.size = e.meta.size;
+    s.mtime = e.meta.mtime;
+    s.btime = e.meta.btime;
+    if (names_.size() + e.name.size() >= kSnapNone || e.name.size() > 0xffff)
+      overflow_ = true;
+    names_.insert(names_.end(), e.name.begin(), e.name.end());
+    names_.push_back('\0');
+    entries_.push_back(s);
+  }
+  if (entries_.size() >= kSnapNone || dirs_.size() >= kSnapNone)
+    overflow_ = true;
+  return first;
+}
+
+/**
+ * @brief Write the snapshot (to a temporary file, then renamed over file)
+ *
+ * @param file Snapshot file
+ * @return false on error (errno is set)
+ */
+bool SnapshotWriter::save(const std::string &file) {
+  if (overflow_) {
+    errno = EOVERFLOW;
+    return false;
+  }
+
+  SnapshotHeader h{};
+  std::memcpy(h.magic, kMagic, sizeof(kMagic));
+  h.version = kVersion;
+  h.options = options_;
+  h.dirCount = dirs_.size();
+  h.entryCount = entries_.size();
+  h.namesSize = names_.size();
+  h.dirsOffset = sizeof(SnapshotHeader);
+  h.entriesOffset = h.dirsOffset + dirs_.size() * sizeof(SnapshotDir);
+  h.namesOffset = h.entriesOffset + entries_.size() * sizeof(SnapshotEntry);
+  h.rootLength = rootLength_;
+
+  // A unique temporary next to file, so concurrent refreshes of the same
+  // snapshot do not write into each other's; it gets the mode a new file
+  // would get
+  std::string temp = file + ".XXXXXX";
+  const int fd = mkostemp(temp.data(), O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  const mode_t mask = umask(0);
+  umask(mask);
+  fchmod(fd, 0666 & ~mask);
+
+  bool ok;
+  {
+    OutputWriter out(fd);
+    out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    out.write(reinterpret_cast<const char *>(dirs_.data()),
+              dirs_.size() * sizeof(SnapshotDir));
+    out.write(reinterpret_cast<const char *>(entries_.data()),
+              entries_.size() * sizeof(SnapshotEntry));
+    out.write(names_.data(), names_.size());
+    ok = out.flush();
+  }
+  ok = close(fd) == 0 && ok;
+  if (ok && std::rename(temp.c_str(), file.c_str()) == 0)
+    return true;
+  const int err = errno;
+  unlink(temp.c_str());
+  errno = err;
+  return false;
+}
+
+#endif
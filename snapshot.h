@@ -0,0 +1,255 @@
+/**
+ * @file snapshot.h
+ * @brief Persistent tree snapshots for eTree (--snapshot, --refresh)
+ *
+ * A snapshot is a flat, memory-mappable index of one walk: every listed
+ * directory with its stamp (device, inode, mtime) and its filtered entries
+ * with their type, size, permissions, mtime and creation time.
+ *
+ * --snapshot FILE saves the index of the current walk. --refresh FILE maps
+ * the previous index first: a directory whose stamp has not changed is
+ * served from it with one stat and no enumeration or per-file metadata
+ * calls; only directories whose stamp changed are listed again. The
+ * refreshed tree is then saved back to FILE.
+ *
+ * The stamp tracks the directory's name list, not the files' contents: a
+ * file rewritten in place keeps its snapshot size and times until an entry
+ * of its directory is added, removed or renamed (likewise the mtime shown
+ * for a subdirectory, although the subdirectory itself is listed again as
+ * soon as its own stamp changes). Snapshots are only reused
+ * with the same listing filters (-a, -d, -I, -P, --gitignore) and root;
+ * with --gitignore a directory is also listed again whenever the ignore
+ * rules in effect inside it changed (its own files or any parent's).
+ *
+ * Directory mtimes advance in coarse ticks, so an entry added right after
+ * a listing may leave the stamp unchanged. Like git's racy-index check, a
+ * directory whose stamp is not at least two seconds older than the start
+ * of the walk is saved as Stale and listed again by the next refresh.
+ *
+ * File layout (native byte order, all sections 8-byte aligned):
+ *   SnapshotHeader, SnapshotDir[dirCount], SnapshotEntry[entryCount],
+ *   names (NUL-terminated, the root path first)
+ * Directories are stored in render (depth-first) order; entries of one
+ * directory are contiguous and in listing order.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#ifndef _WIN32
+
+#include "etree.h"
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/// "No directory record" (entry not listed, or not a directory)
+constexpr uint32_t kSnapNone = UINT32_MAX;
+
+/**
+ * @struct SnapshotHeader
+ * @brief First bytes of a snapshot file
+ */
+struct SnapshotHeader {
+  char magic[8];         ///< "ETSNAP\0\0"
+  uint32_t version;      ///< Format version (also detects byte order)
+  uint32_t reserved;
+  uint64_t options;      ///< Fingerprint of the listing filters
+  uint64_t dirCount;     ///< Number of SnapshotDir records
+  uint64_t entryCount;   ///< Number of SnapshotEntry records
+  uint64_t namesSize;    ///< Bytes in the names section
+  uint64_t dirsOffset;   ///< File offset of the directory records
+  uint64_t entriesOffset;///< File offset of the entry records
+  uint64_t namesOffset;  ///< File offset of the names section
+  uint64_t rootLength;   ///< Length of the root path at names offset 0
+};
+
+/**
+ * @struct SnapshotDir
+ * @brief One listed directory
+ */
+struct SnapshotDir {
+  uint64_t dev;        ///< Stamp: device number
+  uint64_t ino;        ///< Stamp: inode number
+  int64_t mtime;       ///< Stamp: mtime in ns (taken before listing)
+  uint64_t rules;      ///< IgnoreFrame::digest() of the rules in effect
+                       ///< inside the directory (--gitignore)
+  uint64_t firstEntry; ///< Index of the first entry record
+  uint32_t entryCount; ///< Number of entries
+  uint32_t flags;      ///< SnapshotDir::Flags
+  enum Flags : uint32_t {
+    Stale = 1u << 0,       ///< Stamp unknown or too recent: never reused
+    IgnoreFiles = 1u << 1, ///< Has a .gitignore or .ignore
+  };
+};
+
+/**
+ * @struct SnapshotEntry
+ * @brief One entry of a listed directory (40 bytes)
+ */
+struct SnapshotEntry {
+  uint64_t size;       ///< Size in bytes
+  int64_t mtime;       ///< Modification time in ns since the epoch
+  int64_t btime;       ///< Creation time in ns, or FileMeta::kNoTime
+  uint32_t name;       ///< Offset of the name in the names section
+  uint32_t child;      ///< Directory record of a subdirectory, or kSnapNone
+  uint32_t mode;       ///< st_mode
+  uint16_t nameLength; ///< Name length in bytes
+  uint8_t flags;       ///< SnapshotEntry::Flags
+  uint8_t reserved;
+  enum Flags : uint8_t {
+    Dir = 1u << 0,       ///< Entry is a directory
+    Matched = 1u << 1,   ///< Entry matched a -P pattern itself
+    MetaValid = 1u << 2, ///< mode/size/mtime/btime are known
+    Link = 1u << 3,      ///< Entry is a symbolic link
+  };
+};
+
+/**
+ * @brief Fingerprint of the options that decide what a listing contains
+ * @param args Command-line arguments and options
+ * @return Hash of -a, -d, -I, -P and --gitignore
+ */
+uint64_t snapshotOptions(const Args &args);
+
+/**
+ * @class SnapshotReader
+ * @brief The previous snapshot, mapped read-only for --refresh
+ *
+ * All lookups are const and may run on any walker thread. Listings served
+ * from the snapshot point into the mapping, so the reader must outlive
+ * the walk and the rendering.
+ */
+class SnapshotReader {
+public:
+  SnapshotReader() = default;
+  ~SnapshotReader();
+  SnapshotReader(const SnapshotReader &) = delete;
+  SnapshotReader &operator=(const SnapshotReader &) = delete;
+
+  /**
+   * @brief Map a snapshot and check its structure (--diff)
+   *
+   * @param file Snapshot file
+   * @param why Receives the reason when the file is not a snapshot
+   * @return true if the snapshot can be read
+   */
+  bool open(const std::string &file, std::string &why);
+
+  /**
+   * @brief Map a snapshot and check that it fits this walk
+   *
+   * @param file Snapshot file
+   * @param root Walk root
+   * @param options snapshotOptions() of this run
+   * @param why Receives the reason when the snapshot is not usable
+   * @return true if the snapshot can be used
+   */
+  bool open(const std::string &file, const std::filesystem::path &root,
+            uint64_t options, std::string &why);
+
+  /**
+   * @brief Record of the walk root (kSnapNone if the snapshot is empty)
+   */
+  uint32_t root() const { return dirCount_ > 0 ? 0 : kSnapNone; }
+
+  /**
+   * @brief Fill a listing from a directory record if it is still current
+   *
+   * @param dir Directory record
+   * @param path Directory path
+   * @param args Command-line arguments and options
+   * @param level Depth level of the directory (for the statistics)
+   * @param ignore Ignore rules inherited from the parent (--gitignore)
+   * @param stats Statistics of the calling thread
+   * @param listing Receives the listing when the stamp matches
+   * @return false if the directory changed (listing left untouched)
+   */
+  bool reuse(uint32_t dir, const std::filesystem::path &path,
+             const Args &args, int level, const IgnoreFrame::Ptr &ignore,
+             TreeStats &stats, DirListing &listing) const;
+
+  /**
+   * @brief Find the records of a freshly listed directory's subdirectories
+   *
+   * Sets WalkEntry::snapDir of every subdirectory that the old record of
+   * the directory also had, so unchanged subtrees are still reused below
+   * a changed directory.
+   *
+   * @param dir Old record of the directory
+   * @param listing Fresh listing of the directory
+   */
+  void link(uint32_t dir, DirListing &listing) const;
+
+  /**
+   * @brief Fill a listing from a directory record, without checking that
+   *        the directory is unchanged (--diff)
+   *
+   * @param dir Directory record
+   * @param listing Receives the entries (names point into the mapping)
+   * @return false if the record is damaged
+   */
+  bool read(uint32_t dir, DirListing &listing) const;
+
+private:
+  bool validEntries(const SnapshotDir &d) const;
+  void fill(const SnapshotDir &d, DirListing &listing) const;
+
+  void *map_ = nullptr;
+  size_t mapSize_ = 0;
+  const SnapshotDir *dirs_ = nullptr;
+  const SnapshotEntry *entries_ = nullptr;
+  const char *names_ = nullptr;
+  uint64_t dirCount_ = 0;
+  uint64_t entryCount_ = 0;
+  uint64_t namesSize_ = 0;
+  uint64_t options_ = 0;    ///< Filter fingerprint of the snapshot
+  uint64_t rootLength_ = 0; ///< Length of the root path in names_
+};
+
+/**
+ * @class SnapshotWriter
+ * @brief Collects the listings of a walk and saves them as a snapshot
+ *
+ * Fed by the renderer in depth-first order (single thread).
+ */
+class SnapshotWriter {
+public:
+  /**
+   * @brief Start an empty snapshot (the walk starts now)
+   * @param root Walk root
+   * @param options snapshotOptions() of this run
+   */
+  SnapshotWriter(const std::filesystem::path &root, uint64_t options);
+
+  /**
+   * @brief Append a directory listing
+   *
+   * @param listing Listing of the directory (ok)
+   * @param parentEntry Entry record of the directory in its parent, or
+   *        kSnapNone for the root
+   * @return Index of the directory's first entry record
+   */
+  uint32_t addDirectory(const DirListing &listing, uint32_t parentEntry);
+
+  /**
+   * @brief Write the snapshot (to a temporary file, then renamed over file)
+   * @param file Snapshot file
+   * @return false on error (errno is set)
+   */
+  bool save(const std::string &file);
+
+private:
+  uint64_t options_;
+  int64_t started_;       ///< Start of the walk in ns since the epoch
+  bool overflow_ = false; ///< Too large for 32-bit record indices
+  std::vector<SnapshotDir> dirs_;
+  std::vector<SnapshotEntry> entries_;
+  std::vector<char> names_;
+  uint64_t rootLength_;
+};
+
+#endif
+
+#endif
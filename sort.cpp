@@ -0,0 +1,350 @@
+/**
+ * @file sort.cpp
+ * @brief Entry order implementation for eTree
+ */
+
+#include "sort.h"
+
+#ifndef _WIN32
+
+#include "args.h"
+#include "etree.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace {
+
+/// Leading bytes of a key text kept in SortKey::prefix
+constexpr size_t kPrefixBytes = 16;
+
+/**
+ * @struct SortKey
+ * @brief What an entry is sorted on, extracted once per entry
+ */
+struct SortKey {
+  uint64_t rank = 0;          ///< Size or mtime order (0 sorts first)
+  uint64_t prefix[2] = {};    ///< First 16 bytes of text, big-endian
+  const char *text = nullptr; ///< Key text (name, or built in the arena)
+  uint32_t length = 0;        ///< Length of text
+  uint32_t index = 0;         ///< Position of the entry in the listing
+  uint8_t group = 0;          ///< 0 for folders with --dirsfirst, else 1
+};
+
+/**
+ * @brief Whether key a sorts before key b
+ *
+ * The zero padding of short prefixes only makes keys look equal where
+ * one text is a prefix of the other, and the length then decides.
+ */
+bool before(const SortKey &a, const SortKey &b) {
+  if (a.group != b.group)
+    return a.group < b.group;
+  if (a.rank != b.rank)
+    return a.rank < b.rank;
+  if (a.prefix[0] != b.prefix[0])
+    return a.prefix[0] < b.prefix[0];
+  if (a.prefix[1] != b.prefix[1])
+    return a.prefix[1] < b.prefix[1];
+  const uint32_t common = std::min(a.length, b.length);
+  if (common > kPrefixBytes) {
+    const int c = std::memcmp(a.text + kPrefixBytes, b.text + kPrefixBytes,
+                              common - kPrefixBytes);
+    if (c != 0)
+      return c < 0;
+  }
+  if (a.length != b.length)
+    return a.length < b.length;
+  return a.index < b.index;
+}
+
+/**
+ * @brief Load up to 8 bytes of a text as a big-endian integer
+ *
+ * Missing bytes are zero, below every byte a key text can hold but NUL.
+ */
+uint64_t loadPrefix(const char *text, size_t length) {
+  uint64_t prefix = 0;
+  const size_t n = std::min<size_t>(length, 8);
+  for (size_t i = 0; i < n; ++i)
+    prefix |= uint64_t(static_cast<unsigned char>(text[i])) << (56 - 8 * i);
+  return prefix;
+}
+
+/**
+ * @brief Extension of a name: what follows its last dot ("" if none)
+ *
+ * A leading dot does not start an extension (".profile" has none).
+ */
+std::string_view extension(std::string_view name) {
+  const size_t dot = name.rfind('.');
+  if (dot == std::string_view::npos || dot == 0)
+    return {};
+  return name.substr(dot + 1);
+}
+
+/**
+ * @brief Append the natural-order spelling of a name
+ *
+ * ASCII letters are folded to lower case. A run of digits becomes '0',
+ * its number of significant digits and those digits, so runs compare by
+ * value ("file9" < "file10") and still sort among other bytes where a
+ * digit would. Names spelled the same ("a01", "a1") are ordered by the
+ * raw name that follows the spelling.
+ *
+ * @param out Arena to append to (at most 3 bytes per name byte)
+ * @param name Entry name
+ */
+void appendNatural(std::string &out, std::string_view name) {
+  auto isDigit = [](char c) { return c >= '0' && c <= '9'; };
+  size_t i = 0;
+  while (i < name.size()) {
+    const char c = name[i];
+    if (!isDigit(c)) {
+      out += c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+      ++i;
+      continue;
+    }
+    size_t end = i;
+    while (end < name.size() && isDigit(name[end]))
+      ++end;
+    while (i + 1 < end && name[i] == '0')
+      ++i; // Leading zeros do not change the value
+    const size_t digits = std::min<size_t>(end - i, 255);
+    out += '0';
+    out += static_cast<char>(digits);
+    out.append(name.data() + i, digits);
+    i = end;
+  }
+}
+
+/**
+ * @brief Rank of an entry: size or mtime order, 0 for the other keys
+ *
+ * Entries whose metadata could not be read sort last.
+ */
+uint64_t rankOf(const WalkEntry &e, SortOrder order) {
+  switch (order) {
+  case SORT_SIZE:
+    return e.meta.valid ? ~e.meta.size : UINT64_MAX;
+  case SORT_MTIME:
+    // Signed to unsigned order, then inverted: newest first
+    return e.meta.valid ? ~(static_cast<uint64_t>(e.meta.mtime) ^ (1ull << 63))
+                        : UINT64_MAX;
+  default:
+    return 0;
+  }
+}
+
+/**
+ * @brief Whether the key text is built rather than the name itself
+ */
+bool builtText(SortOrder order) {
+  return order == SORT_EXT || order == SORT_NATURAL;
+}
+
+/**
+ * @brief Append the built key text of a name (ext and natural)
+ *
+ * The raw name follows a NUL, which no name contains, as tie-break.
+ *
+ * @param out Arena to append to (at most 4 bytes per name byte, plus 1)
+ * @param name Entry name
+ * @param order SORT_EXT or SORT_NATURAL
+ */
+void appendText(std::string &out, std::string_view name, SortOrder order) {
+  if (order == SORT_EXT)
+    out.append(extension(name));
+  else
+    appendNatural(out, name);
+  out += '\0';
+  out.append(name);
+}
+
+/// Ranges shorter than this are left to std::sort
+constexpr size_t kRadixCutoff = 64;
+
+/// Bytes of the sort string keyByte() spells
+constexpr unsigned kKeyBytes = 25;
+
+/// Most keys whose buffer is kept for the thread's next listing
+constexpr size_t kKeepKeys = 64 * 1024;
+
+/**
+ * @brief Byte d of a key's sort string: group, rank, then prefix
+ *
+ * The 25 bytes order keys like before() does up to the end of the prefix.
+ */
+unsigned keyByte(const SortKey &key, unsigned d) {
+  if (d == 0)
+    return key.group;
+  if (d < 9)
+    return static_cast<unsigned>(key.rank >> (8 * (8 - d))) & 0xff;
+  if (d < 17)
+    return static_cast<unsigned>(key.prefix[0] >> (8 * (16 - d))) & 0xff;
+  return static_cast<unsigned>(key.prefix[1] >> (8 * (24 - d))) & 0xff;
+}
+
+/**
+ * @brief Sort keys[0, n) on byte d of their sort strings and up
+ *
+ * Most significant byte first, in place: one counting pass sizes 256
+ * buckets, the keys are swapped into their buckets, and each bucket is
+ * sorted on the next byte. A byte every key shares is skipped; small
+ * ranges, and keys whose sort strings are equal, are finished by
+ * std::sort with before().
+ *
+ * @param keys Keys to sort
+ * @param n Number of keys
+ * @param d First byte that may differ
+ */
+void radixSort(SortKey *keys, size_t n, unsigned d) {
+  for (; n >= kRadixCutoff && d < kKeyBytes; ++d) {
+    size_t end[256] = {};
+    for (size_t i = 0; i < n; ++i)
+      end[keyByte(keys[i], d)]++;
+    if (end[keyByte(keys[0], d)] == n)
+      continue; // This byte decides nothing
+
+    // Bucket b is [start[b], end[b]); next[b] is its first misplaced key
+    size_t start[256];
+    size_t next[256];
+    size_t sum = 0;
+    for (unsigned b = 0; b < 256; ++b) {
+      start[b] = next[b] = sum;
+      sum += end[b];
+      end[b] = sum;
+    }
+    for (unsigned b = 0; b < 256; ++b) {
+      while (next[b] < end[b]) {
+        const unsigned to = keyByte(keys[next[b]], d);
+        if (to == b)
+          ++next[b];
+        else
+          std::swap(keys[next[b]], keys[next[to]++]);
+      }
+    }
+
+    for (unsigned b = 0; b < 256; ++b) {
+      if (end[b] - start[b] > 1)
+        radixSort(keys + start[b], end[b] - start[b], d + 1);
+    }
+    return;
+  }
+  std::sort(keys, keys + n, before);
+}
+
+} // namespace
+
+/**
+ * @brief Put a listing's entries in display order
+ *
+ * @param entries Filtered entries of one directory (names in its arena)
+ * @param args Command-line arguments (--sort, --dirsfirst)
+ */
+void sortListing(std::vector<WalkEntry> &entries, const Args &args) {
+  if (entries.size() < 2)
+    return;
+  if (args.sortBy == SORT_NONE) {
+    if (args.dirsFirst)
+      std::stable_partition(entries.begin(), entries.end(),
+                            [](const WalkEntry &e) { return e.isDir; });
+    return;
+  }
+
+  // Texts built for ext and natural live in one arena, reserved up front
+  // so the keys can point into it while it is filled
+  static thread_local std::string texts;
+  texts.clear();
+  if (builtText(args.sortBy)) {
+    size_t bytes = 0;
+    for (const WalkEntry &e : entries)
+      bytes += (args.sortBy == SORT_EXT ? 2 : 4) * e.name.size() + 1;
+    texts.reserve(bytes);
+  }
+
+  static thread_local std::vector<SortKey> keys;
+  keys.resize(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const WalkEntry &e = entries[i];
+    SortKey &key = keys[i];
+    key = SortKey();
+    key.index = static_cast<uint32_t>(i);
+    key.group = args.dirsFirst && e.isDir ? 0 : 1;
+    key.rank = rankOf(e, args.sortBy);
+    if (builtText(args.sortBy)) {
+      const size_t start = texts.size();
+      appendText(texts, e.name, args.sortBy);
+      key.text = texts.data() + start;
+      key.length = static_cast<uint32_t>(texts.size() - start);
+    } else {
+      key.text = e.name.data();
+      key.length = static_cast<uint32_t>(e.name.size());
+    }
+    key.prefix[0] = loadPrefix(key.text, key.length);
+    if (key.length > 8)
+      key.prefix[1] = loadPrefix(key.text + 8, key.length - 8);
+  }
+
+  // The group and rank bytes only matter when they are used
+  unsigned first = 9;
+  if (args.sortBy == SORT_SIZE || args.sortBy == SORT_MTIME)
+    first = 1;
+  if (args.dirsFirst)
+    first = 0;
+  radixSort(keys.data(), keys.size(), first);
+
+  // Move the entries into key order in place, one cycle of the
+  // permutation at a time; a placed key's index is set to its position
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (keys[i].index == i)
+      continue;
+    WalkEntry held = std::move(entries[i]);
+    size_t to = i;
+    for (;;) {
+      const size_t from = keys[to].index;
+      keys[to].index = static_cast<uint32_t>(to);
+      if (from == i) {
+        entries[to] = std::move(held);
+        break;
+      }
+      entries[to] = std::move(entries[from]);
+      to = from;
+    }
+  }
+
+  // Keep the scratch of ordinary folders, not of a huge one
+  if (keys.capacity() > kKeepKeys)
+    std::vector<SortKey>().swap(keys);
+}
+
+/**
+ * @brief Take the sort key of an entry
+ *
+ * @param entry Entry (its name is copied)
+ * @param args Command-line arguments (--sort, --dirsfirst)
+ */
+void EntryKey::assign(const WalkEntry &entry, const Args &args) {
+  group_ = args.dirsFirst && entry.isDir ? 0 : 1;
+  rank_ = rankOf(entry, args.sortBy);
+  text_.clear();
+  if (builtText(args.sortBy))
+    appendText(text_, entry.name, args.sortBy);
+  else
+    text_.assign(entry.name);
+}
+
+/**
+ * @brief Whether this key sorts before another one
+ */
+bool EntryKey::operator<(const EntryKey &other) const {
+  if (group_ != other.group_)
+    return group_ < other.group_;
+  if (rank_ != other.rank_)
+    return rank_ < other.rank_;
+  return text_ < other.text_;
+}
+
+#endif
@@ -0,0 +1,71 @@
+/**
+ * @file sort.h
+ * @brief Entry order of eTree listings (--sort, --dirsfirst, Unix/Linux)
+ *
+ * Every listing is ordered by one engine, whatever the --sort key:
+ * - Each entry gets a small SortKey once: its group (folders first with
+ *   --dirsfirst), a 64-bit rank (size or mtime, largest or newest first),
+ *   and a key text whose first 16 bytes are loaded as big-endian integers
+ * - The array of keys is radix sorted on those bytes, most significant
+ *   first; buckets of a few dozen keys are finished by std::sort, where
+ *   only texts sharing their first 16 bytes reach a memcmp. No string is
+ *   built while sorting
+ * - The entries are moved into the sorted order once
+ *
+ * The key text is the name itself for name, size and mtime (ties go by
+ * name), the extension followed by the name for ext, and for natural a
+ * spelling in which every run of digits sorts by its value. --sort none
+ * keeps the order the directory returned.
+ */
+
+#ifndef SORT_H
+#define SORT_H
+
+#ifndef _WIN32
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Args;
+struct WalkEntry;
+
+/**
+ * @brief Put a listing's entries in display order
+ *
+ * Called by listDirectory() on the thread that listed the directory.
+ *
+ * @param entries Filtered entries of one directory (names in its arena)
+ * @param args Command-line arguments (--sort, --dirsfirst)
+ */
+void sortListing(std::vector<WalkEntry> &entries, const Args &args);
+
+/**
+ * @class EntryKey
+ * @brief Sort key of a single entry, to merge sorted runs (--mem-limit)
+ *
+ * Orders entries exactly like sortListing() does (any key but none).
+ */
+class EntryKey {
+public:
+  /**
+   * @brief Take the sort key of an entry
+   * @param entry Entry (its name is copied)
+   * @param args Command-line arguments (--sort, --dirsfirst)
+   */
+  void assign(const WalkEntry &entry, const Args &args);
+
+  /**
+   * @brief Whether this key sorts before another one
+   */
+  bool operator<(const EntryKey &other) const;
+
+private:
+  uint8_t group_ = 1; ///< 0 for folders with --dirsfirst, else 1
+  uint64_t rank_ = 0; ///< Size or mtime order
+  std::string text_;  ///< Name, or the text built for ext and natural
+};
+
+#endif
+
+#endif
@@ -0,0 +1,324 @@
+/**
+ * @file spill.cpp
+ * @brief Spilled sorted runs and their merge for eTree (--mem-limit)
+ *
+ * A run is a sequence of records, each a SpillRecord followed by the
+ * entry's name. Runs are written through one buffer and read back with
+ * pread(), so every run of the file can be read at its own position.
+ */
+
+#include "spill.h"
+
+#ifdef __linux__
+
+#include "args.h"
+#include "etree.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+/// Bytes one held entry is counted at against --mem-limit
+constexpr size_t kEntryBytes = 320;
+
+/// Fewest entries per run, so a tiny limit does not make a run per read
+constexpr size_t kMinRunEntries = 1024;
+
+/// Size of the write buffer and most a run is read ahead by
+constexpr size_t kBufferBytes = 64 * 1024;
+
+/// Least a run is read ahead by (holds the largest record)
+constexpr size_t kMinReadBytes = 4 * 1024;
+
+/**
+ * @struct SpillRecord
+ * @brief Fixed part of one spilled entry; the name's bytes follow it
+ */
+struct SpillRecord {
+  FileMeta meta;           ///< Metadata fetched for the entry
+  uint32_t nameLength = 0; ///< Bytes of the name that follow
+  uint8_t matched = 0;     ///< WalkEntry::matched (-P)
+};
+
+/**
+ * @brief Write a whole buffer at an offset, retrying short writes
+ * @return false on failure (errno is set)
+ */
+bool writeAt(int fd, const char *data, size_t bytes, uint64_t offset) {
+  while (bytes > 0) {
+    const ssize_t n = pwrite(fd, data, bytes, static_cast<off_t>(offset));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += n;
+    bytes -= static_cast<size_t>(n);
+    offset += static_cast<uint64_t>(n);
+  }
+  return true;
+}
+
+/**
+ * @brief Open an anonymous temporary file in $TMPDIR (default /tmp)
+ *
+ * O_TMPFILE where the filesystem supports it, else a named file that is
+ * unlinked at once.
+ *
+ * @return Descriptor, or -1 (errno is set)
+ */
+int openTemporary() {
+  const char *env = std::getenv("TMPDIR");
+  const std::string dir = env && *env ? env : "/tmp";
+  int fd = open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+  if (fd >= 0)
+    return fd;
+
+  std::string name = dir + "/etree-XXXXXX";
+  fd = mkostemp(name.data(), O_CLOEXEC);
+  if (fd >= 0)
+    unlink(name.c_str());
+  return fd;
+}
+
+} // namespace
+
+/**
+ * @brief Most entries of one directory a listing thread holds at a time
+ *
+ * @param args Command-line arguments (--mem-limit, -j)
+ * @return Entries per run, or 0 without --mem-limit
+ */
+size_t spillRunLimit(const Args &args) {
+  if (args.memLimit == 0)
+    return 0;
+  const uint64_t perThread =
+      args.memLimit / static_cast<uint64_t>(std::max(args.jobs, 1));
+  return static_cast<size_t>(
+      std::max<uint64_t>(perThread / kEntryBytes, kMinRunEntries));
+}
+
+/**
+ * @brief Close the file (its space is freed)
+ */
+SpillFile::~SpillFile() {
+  if (fd_ >= 0)
+    close(fd_);
+}
+
+/**
+ * @brief Append one sorted run of files, opening the file on first use
+ *
+ * @param run Entries in display order (none of them a folder)
+ * @return false if the file could not be created or written (see error())
+ */
+bool SpillFile::write(const std::vector<WalkEntry> &run) {
+  if (run.empty())
+    return true;
+  if (fd_ < 0) {
+    fd_ = openTemporary();
+    if (fd_ < 0) {
+      error_ = errno;
+      return false;
+    }
+  }
+
+  static thread_local std::vector<char> buffer;
+  buffer.clear();
+  const uint64_t start = size_;
+  auto flush = [&] {
+    if (!writeAt(fd_, buffer.data(), buffer.size(), size_)) {
+      error_ = errno;
+      return false;
+    }
+    size_ += buffer.size();
+    buffer.clear();
+    return true;
+  };
+  for (const WalkEntry &e : run) {
+    SpillRecord record;
+    record.meta = e.meta;
+    record.nameLength = static_cast<uint32_t>(e.name.size());
+    record.matched = e.matched ? 1 : 0;
+    if (buffer.size() + sizeof(record) + e.name.size() > kBufferBytes &&
+        !flush())
+      return false;
+    const char *bytes = reinterpret_cast<const char *>(&record);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(record));
+    buffer.insert(buffer.end(), e.name.begin(), e.name.end());
+  }
+  if (!flush())
+    return false;
+
+  runs_.push_back({start, size_ - start});
+  files_ += run.size();
+  return true;
+}
+
+/**
+ * @struct SpillMerger::Source
+ * @brief One merged input (a run or the listing) and its current entry
+ */
+struct SpillMerger::Source {
+  const SpillFile::Run *run = nullptr; ///< Run read (null: the listing)
+  uint64_t read = 0;                   ///< Bytes of the run read so far
+  std::vector<char> buffer;            ///< Bytes read ahead
+  size_t pos = 0;                      ///< First unused byte of buffer
+  size_t next = 0;                     ///< Next listing entry
+
+  WalkEntry entry;  ///< Current entry (name points into name)
+  std::string name; ///< Name of the current entry
+  EntryKey key;     ///< Sort key of the current entry
+};
+
+/**
+ * @brief Start merging the runs with the listing's own sorted entries
+ *
+ * Each run is read ahead by an even share of a quarter of the limit,
+ * between 4 and 64 KiB.
+ *
+ * @param spill Runs of the listing
+ * @param entries Entries that stayed in the listing (sorted)
+ * @param args Command-line arguments (--sort, --dirsfirst, --mem-limit)
+ */
+SpillMerger::SpillMerger(const SpillFile &spill,
+                         const std::vector<WalkEntry> &entries,
+                         const Args &args)
+    : spill_(spill), entries_(entries), args_(args) {
+  const size_t runs = spill.runs_.size();
+  const size_t share = static_cast<size_t>(
+      args.memLimit / 4 / std::max<size_t>(runs, 1));
+  const size_t readBytes = std::clamp(share, kMinReadBytes, kBufferBytes);
+
+  for (size_t i = 0; i <= runs; ++i) {
+    auto source = std::make_unique<Source>();
+    if (i < runs) {
+      source->run = &spill.runs_[i];
+      source->buffer.reserve(readBytes);
+    }
+    sources_.push_back(std::move(source));
+  }
+  for (size_t i = 0; i < sources_.size(); ++i) {
+    if (advance(*sources_[i]))
+      heap_.push_back(i);
+  }
+  auto after = [this](size_t a, size_t b) { return before(b, a); };
+  std::make_heap(heap_.begin(), heap_.end(), after);
+}
+
+SpillMerger::~SpillMerger() = default;
+
+/**
+ * @brief Whether source a's entry comes before source b's
+ *
+ * Keys of one listing are distinct (the name decides last); the source
+ * index only keeps the order total.
+ */
+bool SpillMerger::before(size_t a, size_t b) const {
+  if (sources_[a]->key < sources_[b]->key)
+    return true;
+  if (sources_[b]->key < sources_[a]->key)
+    return false;
+  return a < b;
+}
+
+/**
+ * @brief Load a source's next entry
+ *
+ * @return false if the source is exhausted, or on a read error (then
+ *         failed_ is set)
+ */
+bool SpillMerger::advance(Source &source) {
+  if (!source.run) {
+    if (source.next >= entries_.size())
+      return false;
+    source.entry = entries_[source.next++];
+    source.name.assign(source.entry.name);
+  } else {
+    // Keep a whole record in the buffer: move the unused tail to the front
+    // and read ahead when the header or the name would cross its end
+    auto available = [&] { return source.buffer.size() - source.pos; };
+    auto fill = [&]() -> bool {
+      source.buffer.erase(source.buffer.begin(),
+                          source.buffer.begin() + source.pos);
+      source.pos = 0;
+      const size_t used = source.buffer.size();
+      const size_t want = static_cast<size_t>(std::min<uint64_t>(
+          source.buffer.capacity() - used, source.run->bytes - source.read));
+      source.buffer.resize(used + want);
+      size_t got = 0;
+      while (got < want) {
+        const ssize_t n =
+            pread(spill_.fd_, source.buffer.data() + used + got, want - got,
+                  static_cast<off_t>(source.run->offset + source.read));
+        if (n < 0 && errno == EINTR)
+          continue;
+        if (n <= 0) {
+          failed_ = true;
+          return false;
+        }
+        got += static_cast<size_t>(n);
+        source.read += static_cast<uint64_t>(n);
+      }
+      return true;
+    };
+
+    if (available() == 0 && source.read == source.run->bytes)
+      return false;
+    SpillRecord record;
+    if (available() < sizeof(record) && !fill())
+      return false;
+    if (available() < sizeof(record)) {
+      failed_ = true; // Truncated run
+      return false;
+    }
+    std::memcpy(&record, source.buffer.data() + source.pos, sizeof(record));
+    source.pos += sizeof(record);
+    if (available() < record.nameLength &&
+        (!fill() || available() < record.nameLength)) {
+      failed_ = true;
+      return false;
+    }
+    source.name.assign(source.buffer.data() + source.pos, record.nameLength);
+    source.pos += record.nameLength;
+
+    source.entry = WalkEntry();
+    source.entry.meta = record.meta;
+    source.entry.matched = record.matched != 0;
+  }
+  source.entry.name = source.name;
+  source.key.assign(source.entry, args_);
+  return true;
+}
+
+/**
+ * @brief Produce the next entry
+ *
+ * @param entry Receives the entry; its name points into name
+ * @param name Receives a copy of the name
+ * @return false once every entry has been produced, or on a read error
+ */
+bool SpillMerger::next(WalkEntry &entry, std::string &name) {
+  if (heap_.empty() || failed_)
+    return false;
+  auto after = [this](size_t a, size_t b) { return before(b, a); };
+  std::pop_heap(heap_.begin(), heap_.end(), after);
+  const size_t top = heap_.back();
+  Source &source = *sources_[top];
+
+  name.swap(source.name);
+  entry = source.entry;
+  entry.name = name;
+
+  if (advance(source))
+    std::push_heap(heap_.begin(), heap_.end(), after);
+  else
+    heap_.pop_back();
+  return true;
+}
+
+#endif
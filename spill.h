@@ -0,0 +1,148 @@
+/**
+ * @file spill.h
+ * @brief Sorted runs of a huge directory's files on disk (--mem-limit, Linux)
+ *
+ * With --mem-limit a listing thread holds at most spillRunLimit() entries
+ * of one directory at a time. Whenever that many have been read, they are
+ * filtered and stat'ed as usual, their files are sorted and appended to
+ * the listing's SpillFile as one run, and only the folders stay in the
+ * listing (each of them becomes a walk job anyway). The entries read last
+ * stay in the listing as well, so a directory below the limit is listed
+ * exactly as before and nothing is written.
+ *
+ * The renderer reads a spilled listing through a SpillMerger: a k-way
+ * merge of the runs and the listing's own entries, ordered by EntryKey
+ * exactly like sortListing() orders a single listing, so the tree and the
+ * exports do not change. Each run is read back through a 64 KiB buffer.
+ *
+ * The file is opened with O_TMPFILE in $TMPDIR (default /tmp): it has no
+ * name and its space is freed when the listing is released.
+ */
+
+#ifndef SPILL_H
+#define SPILL_H
+
+#ifdef __linux__
+
+#include "sort.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct Args;
+struct WalkEntry;
+
+/**
+ * @brief Most entries of one directory a listing thread holds at a time
+ *
+ * The --mem-limit budget is shared by the -j threads; each held entry is
+ * counted at about 320 bytes (entry, name, sort key and scratch).
+ *
+ * @param args Command-line arguments (--mem-limit, -j)
+ * @return Entries per run, or 0 without --mem-limit
+ */
+size_t spillRunLimit(const Args &args);
+
+/**
+ * @class SpillFile
+ * @brief Anonymous temporary file holding the sorted runs of one listing
+ */
+class SpillFile {
+public:
+  SpillFile() = default;
+
+  /**
+   * @brief Close the file (its space is freed)
+   */
+  ~SpillFile();
+
+  SpillFile(const SpillFile &) = delete;
+  SpillFile &operator=(const SpillFile &) = delete;
+
+  /**
+   * @brief Append one sorted run of files, opening the file on first use
+   *
+   * @param run Entries in display order (none of them a folder)
+   * @return false if the file could not be created or written (see error())
+   */
+  bool write(const std::vector<WalkEntry> &run);
+
+  /**
+   * @brief Number of entries in all runs
+   */
+  uint64_t files() const { return files_; }
+
+  /**
+   * @brief errno of the last failure
+   */
+  int error() const { return error_; }
+
+private:
+  friend class SpillMerger;
+
+  /// Byte range of one run in the file
+  struct Run {
+    uint64_t offset = 0;
+    uint64_t bytes = 0;
+  };
+
+  int fd_ = -1;
+  uint64_t size_ = 0;      ///< Bytes written so far
+  uint64_t files_ = 0;     ///< Entries written so far
+  std::vector<Run> runs_;  ///< Runs in the order they were written
+  int error_ = 0;
+};
+
+/**
+ * @class SpillMerger
+ * @brief Entries of a spilled listing in display order
+ */
+class SpillMerger {
+public:
+  /**
+   * @brief Start merging the runs with the listing's own sorted entries
+   *
+   * @param spill Runs of the listing
+   * @param entries Entries that stayed in the listing (sorted)
+   * @param args Command-line arguments (--sort, --dirsfirst)
+   */
+  SpillMerger(const SpillFile &spill, const std::vector<WalkEntry> &entries,
+              const Args &args);
+  ~SpillMerger();
+
+  SpillMerger(const SpillMerger &) = delete;
+  SpillMerger &operator=(const SpillMerger &) = delete;
+
+  /**
+   * @brief Produce the next entry
+   *
+   * @param entry Receives the entry; its name points into name
+   * @param name Receives a copy of the name
+   * @return false once every entry has been produced, or on a read error
+   */
+  bool next(WalkEntry &entry, std::string &name);
+
+  /**
+   * @brief Whether reading a run failed (the merge stopped early)
+   */
+  bool failed() const { return failed_; }
+
+private:
+  struct Source;
+
+  bool advance(Source &source);
+  bool before(size_t a, size_t b) const;
+
+  const SpillFile &spill_;
+  const std::vector<WalkEntry> &entries_;
+  const Args &args_;
+  std::vector<std::unique_ptr<Source>> sources_; ///< Runs, then the listing
+  std::vector<size_t> heap_;                     ///< Sources with an entry
+  bool failed_ = false;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,176 @@
+/**
+ * @file top.cpp
+ * @brief Top-N report implementation for eTree
+ */
+
+#include "top.h"
+
+#ifndef _WIN32
+
+#include "args.h"
+#include "csv.h"
+#include "etree.h"
+#include "format.h"
+#include "output.h"
+#include <algorithm>
+
+namespace {
+
+/**
+ * @brief Whether a ranks before b: larger key, then smaller path
+ */
+bool better(const TopEntry &a, const TopEntry &b) {
+  if (a.key != b.key)
+    return a.key > b.key;
+  return a.path < b.path;
+}
+
+} // namespace
+
+/**
+ * @brief Offer an entry, dropping the worst one if the list is full
+ *
+ * @param entry Candidate
+ */
+void TopList::add(TopEntry entry) {
+  if (heap_.size() < limit_) {
+    heap_.push_back(std::move(entry));
+    std::push_heap(heap_.begin(), heap_.end(), better);
+  } else if (limit_ > 0 && better(entry, heap_.front())) {
+    std::pop_heap(heap_.begin(), heap_.end(), better);
+    heap_.back() = std::move(entry);
+    std::push_heap(heap_.begin(), heap_.end(), better);
+  }
+}
+
+/**
+ * @brief Offer every entry of another thread's list
+ *
+ * @param other List gathered by a worker thread
+ */
+void TopList::merge(const TopList &other) {
+  limit_ = std::max(limit_, other.limit_);
+  for (const TopEntry &entry : other.heap_) {
+    if (wants(entry.key))
+      add(entry);
+  }
+}
+
+/**
+ * @brief The entries, best first
+ */
+std::vector<TopEntry> TopList::sorted() const {
+  std::vector<TopEntry> entries = heap_;
+  std::sort(entries.begin(), entries.end(), better);
+  return entries;
+}
+
+/**
+ * @brief Offer the entries of one listing to a thread's list
+ *
+ * With -P only entries that matched a pattern themselves are offered
+ * (folders for --by count are always offered).
+ *
+ * @param dir Directory that was listed
+ * @param listing Its filtered entries with their metadata
+ * @param args Command-line arguments (--top, --by, -P)
+ * @param top List of the calling thread
+ */
+void collectTop(const std::string &dir, const DirListing &listing,
+                const Args &args, TopList &top) {
+  top.setLimit(args.topCount);
+  const std::string &base = dir;
+  auto offer = [&](int64_t key, std::string_view name, bool isDir) {
+    if (!top.wants(key))
+      return;
+    TopEntry entry;
+    entry.key = key;
+    entry.isDir = isDir;
+    entry.path.reserve(base.size() + 1 + name.size());
+    entry.path = base;
+    if (!name.empty()) {
+      if (!base.empty() && base.back() != '/')
+        entry.path += '/';
+      entry.path += name;
+    }
+    top.add(std::move(entry));
+  };
+
+  const bool include = !args.include.empty();
+  switch (args.topBy) {
+  case TOP_SIZE:
+    for (const WalkEntry &e : listing.entries) {
+      if (!e.isDir && e.meta.valid && (!include || e.matched))
+        offer(static_cast<int64_t>(e.meta.size), e.name, false);
+    }
+    break;
+  case TOP_MTIME:
+    for (const WalkEntry &e : listing.entries) {
+      if (e.meta.valid && (!include || e.matched))
+        offer(e.meta.mtime, e.name, e.isDir);
+    }
+    break;
+  case TOP_COUNT:
+    offer(static_cast<int64_t>(listing.entries.size()), {}, true);
+    break;
+  }
+}
+
+/**
+ * @brief Print the report, one "value  path" line per entry
+ *
+ * The values are right-aligned in one column: sizes in the -s/-h/--si
+ * style, times as local "YYYY-MM-DD HH:MM:SS", counts with separators.
+ *
+ * @param out Output sink
+ * @param top Merged list of the whole walk
+ * @param args Command-line arguments (--by, size style)
+ * @param colors Whether colored output is enabled
+ */
+void writeTop(OutputWriter &out, const TopList &top, const Args &args,
+              bool colors) {
+  const std::vector<TopEntry> entries = top.sorted();
+
+  // Format every value first to find the column width
+  std::vector<std::string> values;
+  values.reserve(entries.size());
+  TimestampFormatter times;
+  size_t width = 0;
+  for (const TopEntry &entry : entries) {
+    char text[kMaxNumberText];
+    std::string value;
+    switch (args.topBy) {
+    case TOP_SIZE:
+      value.assign(text, formatSize(static_cast<uint64_t>(entry.key), text));
+      break;
+    case TOP_MTIME:
+      value = times.format(entry.key);
+      break;
+    case TOP_COUNT:
+      value.assign(text, formatInt(static_cast<uint64_t>(entry.key), text));
+      value += entry.key == 1 ? " entry" : " entries";
+      break;
+    }
+    width = std::max(width, value.size());
+    values.push_back(std::move(value));
+  }
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    for (size_t pad = values[i].size(); pad < width; ++pad)
+      out.put(' ');
+    if (colors)
+      out.write(sizecolor);
+    out.write(values[i]);
+    if (colors)
+      out.write(resetcolor);
+    out.write("  ");
+    if (colors)
+      out.write(entries[i].isDir ? dircolor : filecolor);
+    out.write(entries[i].path);
+    if (colors)
+      out.write(resetcolor);
+    out.endLine();
+  }
+}
+
+#endif
@@ -0,0 +1,112 @@
+/**
+ * @file top.h
+ * @brief Top-N report for eTree (--top N --by size|mtime|count, Unix/Linux)
+ *
+ * With --top the tree is walked but not printed. Every listing thread
+ * offers the entries it lists to a bounded heap of its own (kept in its
+ * TreeStats), so a candidate costs one comparison with the current N-th
+ * best and no lock; only entries that enter the heap get their path
+ * built. TreeWalker::finish() merges the workers' heaps into the renderer
+ * thread's, and writeTop() prints the winners, best first:
+ *
+ *   --by size    files, largest first (the default)
+ *   --by mtime   files and folders, most recently modified first
+ *   --by count   folders, most entries first
+ *
+ * Listings are released as soon as their subtree is walked, so memory
+ * stays at N paths plus the walk's usual look-ahead. Ties are broken by
+ * path, so the report does not depend on -j.
+ */
+
+#ifndef TOP_H
+#define TOP_H
+
+#ifndef _WIN32
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Args;
+struct DirListing;
+class OutputWriter;
+
+/**
+ * @struct TopEntry
+ * @brief One candidate of the report
+ */
+struct TopEntry {
+  int64_t key = 0;    ///< Size, mtime in ns, or number of entries
+  std::string path;   ///< Path as walked (starting with the root argument)
+  bool isDir = false; ///< Whether the entry is a folder
+};
+
+/**
+ * @class TopList
+ * @brief The N best entries seen by one thread (a min-heap on the key)
+ */
+class TopList {
+public:
+  /**
+   * @brief Set how many entries are kept
+   * @param limit N of --top
+   */
+  void setLimit(size_t limit) { limit_ = limit; }
+
+  /**
+   * @brief Whether an entry with this key could enter the list
+   *
+   * Cheap test made before the entry's path is built.
+   */
+  bool wants(int64_t key) const {
+    return heap_.size() < limit_ || (limit_ > 0 && key >= heap_.front().key);
+  }
+
+  /**
+   * @brief Offer an entry, dropping the worst one if the list is full
+   * @param entry Candidate
+   */
+  void add(TopEntry entry);
+
+  /**
+   * @brief Offer every entry of another thread's list
+   * @param other List gathered by a worker thread
+   */
+  void merge(const TopList &other);
+
+  /**
+   * @brief The entries, best first
+   */
+  std::vector<TopEntry> sorted() const;
+
+private:
+  size_t limit_ = 0;
+  std::vector<TopEntry> heap_; ///< Worst entry at the front
+};
+
+/**
+ * @brief Offer the entries of one listing to a thread's list
+ *
+ * @param dir Directory that was listed
+ * @param listing Its filtered entries with their metadata
+ * @param args Command-line arguments (--top, --by, -P)
+ * @param top List of the calling thread
+ */
+void collectTop(const std::string &dir, const DirListing &listing,
+                const Args &args, TopList &top);
+
+/**
+ * @brief Print the report, one "value  path" line per entry
+ *
+ * @param out Output sink
+ * @param top Merged list of the whole walk
+ * @param args Command-line arguments (--by, size style)
+ * @param colors Whether colored output is enabled
+ */
+void writeTop(OutputWriter &out, const TopList &top, const Args &args,
+              bool colors);
+
+#endif
+
+#endif
@@ -0,0 +1,271 @@
+/**
+ * @file uring.cpp
+ * @brief io_uring batched statx backend implementation for eTree
+ *
+ * A minimal io_uring client: each thread lazily sets up one ring, maps the
+ * submission/completion queues, and keeps it filled with IORING_OP_STATX
+ * requests until every entry of the directory has completed.
+ */
+
+#include "uring.h"
+
+#ifndef _WIN32
+
+#if defined(__linux__) && defined(STATX_TYPE) &&                               \
+    __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+// IO_URING_OP_SUPPORTED arrived with the probe API and IORING_OP_STATX (5.6)
+#if defined(IO_URING_OP_SUPPORTED)
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+/// Submission queue size; larger directories are streamed through it
+constexpr unsigned kRingEntries = 256;
+
+/// Set once io_uring turned out to be unusable on this system
+std::atomic<bool> uringUnavailable{false};
+
+/**
+ * @class StatxRing
+ * @brief One thread's io_uring instance with its mapped queues
+ */
+class StatxRing {
+public:
+  StatxRing() = default;
+  ~StatxRing();
+
+  StatxRing(const StatxRing &) = delete;
+  StatxRing &operator=(const StatxRing &) = delete;
+
+  /**
+   * @brief Create the ring and check that IORING_OP_STATX is supported
+   * @return true if the ring is usable
+   */
+  bool setup();
+
+  /**
+   * @brief Run all requests through the ring
+   * @return false if the kernel rejected the submission
+   */
+  bool run(int dirfd, MetaRequest *requests, size_t count);
+
+private:
+  int fd_ = -1;
+  io_uring_params params_{};
+
+  void *sqRing_ = MAP_FAILED;
+  void *cqRing_ = MAP_FAILED;
+  size_t sqRingSize_ = 0;
+  size_t cqRingSize_ = 0;
+  io_uring_sqe *sqes_ = static_cast<io_uring_sqe *>(MAP_FAILED);
+
+  // Pointers into the mapped rings
+  unsigned *sqHead_ = nullptr;
+  unsigned *sqTail_ = nullptr;
+  unsigned *sqMask_ = nullptr;
+  unsigned *sqArray_ = nullptr;
+  unsigned *cqHead_ = nullptr;
+  unsigned *cqTail_ = nullptr;
+  unsigned *cqMask_ = nullptr;
+  io_uring_cqe *cqes_ = nullptr;
+
+  std::vector<struct statx> results_; ///< statx buffers, reused per batch
+};
+
+/**
+ * @brief Unmap the queues and close the ring
+ */
+StatxRing::~StatxRing() {
+  if (sqes_ != MAP_FAILED)
+    munmap(sqes_, params_.sq_entries * sizeof(io_uring_sqe));
+  if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_)
+    munmap(cqRing_, cqRingSize_);
+  if (sqRing_ != MAP_FAILED)
+    munmap(sqRing_, sqRingSize_);
+  if (fd_ >= 0)
+    close(fd_);
+}
+
+/**
+ * @brief Create the ring, map its queues and probe for IORING_OP_STATX
+ *
+ * @return true if the ring is usable
+ */
+bool StatxRing::setup() {
+  fd_ = static_cast<int>(
+      syscall(__NR_io_uring_setup, kRingEntries, &params_));
+  if (fd_ < 0)
+    return false;
+
+  // Make sure the kernel knows the statx opcode (5.6+)
+  size_t probeSize = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+  std::unique_ptr<char[]> probeBuf(new char[probeSize]());
+  auto *probe = reinterpret_cast<io_uring_probe *>(probeBuf.get());
+  if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, 256) <
+          0 ||
+      probe->last_op < IORING_OP_STATX ||
+      !(probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED))
+    return false;
+
+  // Map the submission and completion rings (one mapping on 5.4+)
+  sqRingSize_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned);
+  cqRingSize_ = params_.cq_off.cqes + params_.cq_entries * sizeof(io_uring_cqe);
+  bool single = params_.features & IORING_FEAT_SINGLE_MMAP;
+  if (single)
+    sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+
+  sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+  if (sqRing_ == MAP_FAILED)
+    return false;
+  cqRing_ = single ? sqRing_
+                   : mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+  if (cqRing_ == MAP_FAILED)
+    return false;
+  sqes_ = static_cast<io_uring_sqe *>(
+      mmap(nullptr, params_.sq_entries * sizeof(io_uring_sqe),
+           PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+           IORING_OFF_SQES));
+  if (sqes_ == MAP_FAILED)
+    return false;
+
+  char *sq = static_cast<char *>(sqRing_);
+  sqHead_ = reinterpret_cast<unsigned *>(sq + params_.sq_off.head);
+  sqTail_ = reinterpret_cast<unsigned *>(sq + params_.sq_off.tail);
+  sqMask_ = reinterpret_cast<unsigned *>(sq + params_.sq_off.ring_mask);
+  sqArray_ = reinterpret_cast<unsigned *>(sq + params_.sq_off.array);
+
+  char *cq = static_cast<char *>(cqRing_);
+  cqHead_ = reinterpret_cast<unsigned *>(cq + params_.cq_off.head);
+  cqTail_ = reinterpret_cast<unsigned *>(cq + params_.cq_off.tail);
+  cqMask_ = reinterpret_cast<unsigned *>(cq + params_.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params_.cq_off.cqes);
+
+  return true;
+}
+
+/**
+ * @brief Keep the ring full of statx requests until all have completed
+ *
+ * @param dirfd Directory file descriptor the names are relative to
+ * @param requests Requests to complete
+ * @param count Number of requests
+ * @return false if the kernel rejected the submission
+ */
+bool StatxRing::run(int dirfd, MetaRequest *requests, size_t count) {
+  if (results_.size() < count)
+    results_.resize(count);
+
+  size_t next = 0;     // Next request to queue
+  size_t queued = 0;   // Queued in the ring but not yet taken by the kernel
+  size_t inflight = 0; // Taken by the kernel but not yet completed
+
+  while (next < count || queued > 0 || inflight > 0) {
+    // Queue as many requests as the ring has room for; keeping inflight
+    // below sq_entries also guarantees the completion queue never overflows
+    unsigned tail = *sqTail_;
+    while (next < count && inflight + queued < params_.sq_entries) {
+      unsigned index = tail & *sqMask_;
+      io_uring_sqe &sqe = sqes_[index];
+      std::memset(&sqe, 0, sizeof(sqe));
+      sqe.opcode = IORING_OP_STATX;
+      sqe.fd = dirfd;
+      sqe.addr = reinterpret_cast<uint64_t>(requests[next].name);
+      sqe.len = statxMask(requests[next].fields);
+      sqe.off = reinterpret_cast<uint64_t>(&results_[next]);
+      sqe.statx_flags = statxFlags(requests[next].fields);
+      sqe.user_data = next;
+      sqArray_[index] = index;
+      ++tail;
+      ++next;
+      ++queued;
+    }
+    __atomic_store_n(sqTail_, tail, __ATOMIC_RELEASE);
+
+    // Submit and wait for at least one completion
+    long ret = syscall(__NR_io_uring_enter, fd_, static_cast<unsigned>(queued),
+                       1, IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      return false;
+    if (ret > 0) {
+      queued -= static_cast<size_t>(ret);
+      inflight += static_cast<size_t>(ret);
+    }
+
+    // Reap every completion that is ready
+    unsigned cqHead = *cqHead_;
+    unsigned cqTail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    while (cqHead != cqTail) {
+      const io_uring_cqe &cqe = cqes_[cqHead & *cqMask_];
+      MetaRequest &req = requests[cqe.user_data];
+      *req.meta = FileMeta();
+      if (cqe.res == 0)
+        metaFromStatx(results_[cqe.user_data], *req.meta);
+      ++cqHead;
+      --inflight;
+    }
+    __atomic_store_n(cqHead_, cqHead, __ATOMIC_RELEASE);
+  }
+
+  return true;
+}
+
+} // namespace
+
+/**
+ * @brief Fetch the metadata of many entries with batched io_uring statx
+ *
+ * @param dirfd Directory file descriptor the names are relative to
+ * @param requests Requests to complete
+ * @param count Number of requests
+ * @return false if io_uring cannot be used (nothing was fetched)
+ */
+bool fetchMetaBatch(int dirfd, MetaRequest *requests, size_t count) {
+  if (uringUnavailable.load(std::memory_order_relaxed))
+    return false;
+
+  // One ring per thread, created on first use
+  static thread_local std::unique_ptr<StatxRing> ring;
+  if (!ring) {
+    auto fresh = std::make_unique<StatxRing>();
+    if (!fresh->setup()) {
+      uringUnavailable.store(true, std::memory_order_relaxed);
+      return false;
+    }
+    ring = std::move(fresh);
+  }
+
+  if (!ring->run(dirfd, requests, count)) {
+    // Submission failed: the ring is in an unknown state, drop it
+    ring.reset();
+    uringUnavailable.store(true, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+#else
+
+/**
+ * @brief io_uring is not available in this build: always fall back
+ */
+bool fetchMetaBatch(int, MetaRequest *, size_t) { return false; }
+
+#endif
+
+#endif
@@ -0,0 +1,411 @@
+/**
+ * @file walker.cpp
+ * @brief Work-stealing directory enumeration pool implementation for eTree
+ *
+ * This file implements TreeWalker, the scheduler behind the -j option.
+ * Directory enumeration itself is done by listDirectory() in etree.cpp;
+ * this file only decides which thread enumerates which directory and hands
+ * the results back to the rendering thread in the order it asks for them.
+ */
+
+#include "walker.h"
+
+#ifndef _WIN32
+
+#include "args.h"
+#include "watch.h"
+#include <algorithm>
+#include <cerrno>
+#include <string>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+/// Released listings kept for reuse (about one per directory level in flight)
+constexpr size_t kSpareListings = 64;
+
+/// Listings with more entry capacity than this are freed, not kept
+constexpr size_t kSpareEntries = 4096;
+
+} // namespace
+
+/**
+ * @brief Drop the chain above without recursing once per level
+ *
+ * Nodes only this one holds are unlinked one by one, so releasing the
+ * last job below a very deep chain does not nest a destructor call per
+ * level.
+ */
+DirAncestry::~DirAncestry() {
+  Ptr above = std::move(parent);
+  while (above && above.use_count() == 1)
+    above = std::move(above->parent);
+}
+
+/**
+ * @brief Whether a directory is on a chain
+ *
+ * @param chain Innermost directory of the chain (may be null)
+ * @param id Identity to look for
+ */
+bool DirAncestry::contains(const DirAncestry *chain, const FileId &id) {
+  for (; chain; chain = chain->parent.get()) {
+    if (chain->id == id)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Create the walker and start the worker threads (if any)
+ *
+ * Queue 0 belongs to the rendering thread (it only pushes, workers steal
+ * from it); queues 1..N belong to the N worker threads.
+ *
+ * @param args Command-line arguments (filters, depth limit, -j count)
+ * @param stats Statistics of the rendering thread
+ * @param snapshot Previous snapshot for --refresh (may be null)
+ * @param watcher Watcher for --watch (may be null)
+ */
+TreeWalker::TreeWalker(const Args &args, TreeStats &stats,
+                       const SnapshotReader *snapshot, TreeWatcher *watcher)
+    : args_(args), snapshot_(snapshot), watcher_(watcher), stats_(stats) {
+  size_t workers = args.jobs > 1 ? static_cast<size_t>(args.jobs) : 0;
+
+  // Keep the workers at most a few thousand directories ahead of the
+  // renderer so memory stays bounded on huge trees
+  bufferLimit_ = 4096 * std::max<size_t>(workers, 1);
+
+  // --du sums the whole tree before printing, keeping what it will print
+  if (args.du)
+    bufferLimit_ = SIZE_MAX;
+
+  workerStats_.resize(workers);
+  queues_.resize(workers + 1);
+  for (auto &q : queues_)
+    q = std::make_unique<JobQueue>();
+
+  for (size_t i = 0; i < workers; ++i)
+    threads_.emplace_back(&TreeWalker::workerLoop, this, i + 1);
+}
+
+/**
+ * @brief Stop and join the workers
+ */
+TreeWalker::~TreeWalker() { finish(); }
+
+/**
+ * @brief Create the root job and queue it for the workers
+ *
+ * @param dir Root directory path
+ * @param level Depth level of the root directory
+ * @param ignore Ignore rules that apply to the root (--gitignore)
+ * @param snap Record of the root in the --refresh snapshot
+ * @return Root job
+ */
+std::shared_ptr<DirJob> TreeWalker::start(const fs::path &dir, int level,
+                                          IgnoreFrame::Ptr ignore,
+                                          uint32_t snap) {
+  rootLevel_ = level;
+  auto job =
+      std::make_shared<DirJob>(dir.native(), level, std::move(ignore), snap);
+  if (!threads_.empty())
+    push(0, job);
+  return job;
+}
+
+/**
+ * @brief Enumerate one directory and create jobs for its subdirectories
+ *
+ * Subdirectory jobs are pushed in reverse so that the owner pops the first
+ * child next, which keeps workers close to the renderer's depth-first order.
+ * They inherit the ignore rules in effect inside this directory.
+ *
+ * With --refresh, a directory whose stamp matches its snapshot record is
+ * served from the snapshot instead of being listed; the records of its
+ * subdirectories are passed on to their jobs either way.
+ *
+ * With --watch the directory is watched before it is listed, so a change
+ * made while it is being listed is still delivered as an event.
+ *
+ * @param job Job claimed by the calling thread
+ * @param stats Statistics of the calling thread
+ * @param queue Deque owned by the calling thread
+ */
+void TreeWalker::run(DirJob &job, TreeStats &stats, size_t queue) {
+  // Fill a recycled listing so its entry and name buffers are reused
+  {
+    std::lock_guard<std::mutex> lock(spareMutex_);
+    if (!spare_.empty()) {
+      job.listing = std::move(spare_.back());
+      spare_.pop_back();
+    }
+  }
+  if (watcher_)
+    watcher_->watch(job);
+
+  // A directory that is one of its own ancestors is not listed: the loop
+  // would never end (relative opens keep its paths short of the limits
+  // that used to stop it)
+  const bool loop = (job.viaLink || job.level % DirAncestry::kLoopCheck == 0) &&
+                    closesLoop(job);
+  if (loop) {
+    job.listing.clear();
+    job.listing.error =
+        fs::filesystem_error("directory iterator cannot open directory",
+                             job.path,
+                             std::error_code(ELOOP, std::generic_category()))
+            .what();
+  }
+
+  const bool reused =
+      !loop && snapshot_ &&
+      snapshot_->reuse(job.snap, job.path, args_, job.level, job.ignore, stats,
+                       job.listing);
+  if (!loop && !reused) {
+#ifdef __linux__
+    listDirectory(job.path, args_, job.level, job.ignore, stats, job.listing,
+                  job.anchor.get());
+#else
+    listDirectory(job.path, args_, job.level, job.ignore, stats, job.listing);
+#endif
+    if (snapshot_ && job.snap != kSnapNone && job.listing.ok)
+      snapshot_->link(job.snap, job.listing);
+  }
+
+  // Create child jobs unless the next level is beyond the depth limit
+  // (--du counts below it)
+  bool descend = args_.maxLevel <= 0 || job.level + 1 <= args_.maxLevel ||
+                 args_.du;
+  if (job.listing.ok && descend) {
+#ifdef __linux__
+    // Deep below the anchor: this directory anchors its subdirectories
+    DirAnchor::Ptr anchor = job.anchor;
+    if (job.path.size() - (anchor ? anchor->length : 0) > DirAnchor::kSpan)
+      anchor = DirAnchor::open(job.anchor, job.path);
+#endif
+    // The children's ancestors are this directory and the ones above it
+    DirAncestry::Ptr ancestors = job.ancestors;
+    if (job.listing.stamp.valid)
+      ancestors = std::make_shared<DirAncestry>(
+          FileId{job.listing.stamp.dev, job.listing.stamp.ino}, ancestors);
+
+    const bool separator = !job.path.empty() && job.path.back() != '/';
+    for (const auto &entry : job.listing.entries) {
+      if (!entry.isDir)
+        continue;
+      std::string path;
+      path.reserve(job.path.size() + 1 + entry.name.size());
+      path += job.path;
+      if (separator)
+        path += '/';
+      path += entry.name;
+      job.children.push_back(std::make_shared<DirJob>(
+          std::move(path), job.level + 1, job.listing.ignore, entry.snapDir));
+      job.children.back()->ancestors = ancestors;
+      job.children.back()->viaLink = entry.isLink;
+#ifdef __linux__
+      job.children.back()->anchor = anchor;
+#endif
+    }
+  }
+
+  // The children carry the path on; the root keeps it for --du and --watch
+  if (job.listing.ok && job.level > rootLevel_)
+    std::string().swap(job.path);
+
+  if (!threads_.empty()) {
+    for (auto it = job.children.rbegin(); it != job.children.rend(); ++it)
+      push(queue, *it);
+  }
+
+  buffered_++;
+
+  // Publish completion to the renderer
+  {
+    std::lock_guard<std::mutex> lock(doneMutex_);
+    job.state.store(2);
+  }
+  doneCv_.notify_all();
+}
+
+/**
+ * @brief Whether a job's directory is one of its own ancestors
+ *
+ * @param job Job about to be listed
+ * @return false if it is not, or if it cannot be found (the listing then
+ *         reports why)
+ */
+bool TreeWalker::closesLoop(const DirJob &job) const {
+  if (!job.ancestors)
+    return false;
+  struct stat st;
+#ifdef __linux__
+  const DirAnchor *anchor = job.anchor.get();
+  if (fstatat(DirAnchor::at(anchor), DirAnchor::relative(anchor, job.path),
+              &st, 0) != 0)
+    return false;
+#else
+  if (stat(job.path.c_str(), &st) != 0)
+    return false;
+#endif
+  return DirAncestry::contains(
+      job.ancestors.get(), FileId{static_cast<uint64_t>(st.st_dev),
+                                  static_cast<uint64_t>(st.st_ino)});
+}
+
+/**
+ * @brief Add a job to the back of a deque and wake an idle worker
+ *
+ * @param queue Index of the deque
+ * @param job Job to add
+ */
+void TreeWalker::push(size_t queue, const std::shared_ptr<DirJob> &job) {
+  {
+    std::lock_guard<std::mutex> lock(queues_[queue]->mutex);
+    queues_[queue]->jobs.push_back(job);
+  }
+  {
+    std::lock_guard<std::mutex> lock(workMutex_);
+    queued_++;
+  }
+  workCv_.notify_one();
+}
+
+/**
+ * @brief Take a job: newest from our own deque, else oldest from another
+ *
+ * @param queue Deque owned by the calling worker
+ * @return Job, or nullptr if every deque is empty
+ */
+std::shared_ptr<DirJob> TreeWalker::pop(size_t queue) {
+  std::shared_ptr<DirJob> job;
+
+  // Own deque: LIFO, so we keep descending the subtree we just opened
+  {
+    std::lock_guard<std::mutex> lock(queues_[queue]->mutex);
+    if (!queues_[queue]->jobs.empty()) {
+      job = std::move(queues_[queue]->jobs.back());
+      queues_[queue]->jobs.pop_back();
+    }
+  }
+
+  // Steal: FIFO from the victims, starting after ourselves
+  for (size_t k = 1; !job && k < queues_.size(); ++k) {
+    JobQueue &victim = *queues_[(queue + k) % queues_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.jobs.empty()) {
+      job = std::move(victim.jobs.front());
+      victim.jobs.pop_front();
+    }
+  }
+
+  if (job)
+    queued_--;
+  return job;
+}
+
+/**
+ * @brief Worker thread main loop
+ *
+ * Waits until there is work and the renderer is not too far behind, then
+ * claims a job. Jobs already claimed by the renderer are simply dropped.
+ *
+ * @param index Deque owned by this worker (1..N)
+ */
+void TreeWalker::workerLoop(size_t index) {
+  TreeStats &stats = workerStats_[index - 1];
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(workMutex_);
+      workCv_.wait(lock, [&] {
+        return stop_ || (queued_ > 0 && buffered_ < bufferLimit_);
+      });
+      if (stop_)
+        return;
+    }
+
+    std::shared_ptr<DirJob> job = pop(index);
+    if (!job)
+      continue;
+
+    int expected = 0;
+    if (job->state.compare_exchange_strong(expected, 1))
+      run(*job, stats, index);
+  }
+}
+
+/**
+ * @brief Get the listing of a job, enumerating it inline if still queued
+ *
+ * With --watch, the first acquire() of a job also stores its listing in
+ * the watcher's tree.
+ *
+ * @param job Job whose listing is needed
+ * @return Reference to the finished listing
+ */
+const DirListing &TreeWalker::acquire(DirJob &job) {
+  int expected = 0;
+  if (job.state.compare_exchange_strong(expected, 1)) {
+    // Nobody started it yet: do it ourselves rather than wait
+    run(job, stats_, 0);
+  } else {
+    std::unique_lock<std::mutex> lock(doneMutex_);
+    doneCv_.wait(lock, [&] { return job.state.load() == 2; });
+  }
+  if (watcher_ && !job.stored) {
+    job.stored = true;
+    watcher_->add(job, job.listing);
+  }
+  return job.listing;
+}
+
+/**
+ * @brief Free a job's listing once its whole subtree has been rendered
+ *
+ * The listing's buffers go back to a small pool for the next directory;
+ * listings of unusually large directories are freed instead so that one
+ * huge directory does not pin its memory for the rest of the walk.
+ *
+ * @param job Job previously returned by acquire()
+ */
+void TreeWalker::release(DirJob &job) {
+  DirListing listing = std::move(job.listing);
+  job.listing = DirListing();
+  job.children.clear();
+  if (listing.entries.capacity() <= kSpareEntries) {
+    listing.clear();
+    std::lock_guard<std::mutex> lock(spareMutex_);
+    if (spare_.size() < kSpareListings)
+      spare_.push_back(std::move(listing));
+  }
+  {
+    std::lock_guard<std::mutex> lock(workMutex_);
+    buffered_--;
+  }
+  workCv_.notify_one();
+}
+
+/**
+ * @brief Stop the workers and merge their statistics into the caller's
+ */
+void TreeWalker::finish() {
+  {
+    std::lock_guard<std::mutex> lock(workMutex_);
+    stop_ = true;
+  }
+  workCv_.notify_all();
+
+  for (auto &t : threads_)
+    t.join();
+  threads_.clear();
+
+  for (auto &ws : workerStats_)
+    stats_.merge(ws);
+  workerStats_.clear();
+}
+
+#endif
@@ -0,0 +1,222 @@
+/**
+ * @file walker.h
+ * @brief Work-stealing directory enumeration pool for eTree
+ *
+ * This header defines the scheduler used by printTree() to enumerate
+ * directories on several threads at once (-j N). The pool only produces
+ * directory listings; rendering stays on the calling thread, which consumes
+ * the listings in depth-first order so that the tree and the TSV rows are
+ * byte-identical to a serial walk.
+ *
+ * Scheduling model:
+ * - Every directory to enumerate is a DirJob
+ * - Each worker owns a deque: it pushes the subdirectories it discovers to
+ *   the back and pops from the back (depth-first, close to render order)
+ * - Idle workers steal from the front of other deques (shallow, large jobs)
+ * - The rendering thread claims any job it needs that nobody started yet
+ *   and runs it inline, so it never waits on a job that is still queued
+ *
+ * Each worker keeps its own TreeStats; they are merged into the caller's
+ * statistics by TreeWalker::finish().
+ */
+
+#ifndef WALKER_H
+#define WALKER_H
+
+#ifndef _WIN32
+
+#include "dirstream.h"
+#include "etree.h"
+#include "snapshot.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TreeWatcher;
+
+/**
+ * @struct DirAncestry
+ * @brief (device, inode) of a listed directory and of those above it
+ *
+ * A directory that is one of its own ancestors closes a loop (a symlink
+ * or a bind mount leading back up) and is not descended into. Each node
+ * is shared by the jobs below its directory.
+ */
+struct DirAncestry {
+  using Ptr = std::shared_ptr<DirAncestry>;
+
+  /// Levels between checks of directories not known to be reached
+  /// through a link (no d_type, old snapshots); -U checks the same way
+  static constexpr int kLoopCheck = 1024;
+
+  FileId id;  ///< Identity of the directory
+  Ptr parent; ///< Directory above it (null for the walk root)
+
+  DirAncestry(const FileId &i, Ptr p) : id(i), parent(std::move(p)) {}
+
+  /**
+   * @brief Drop the chain above without recursing once per level
+   */
+  ~DirAncestry();
+  DirAncestry(const DirAncestry &) = delete;
+  DirAncestry &operator=(const DirAncestry &) = delete;
+
+  /**
+   * @brief Whether a directory is on a chain
+   * @param chain Innermost directory of the chain (may be null)
+   * @param id Identity to look for
+   */
+  static bool contains(const DirAncestry *chain, const FileId &id);
+};
+
+/**
+ * @struct DirJob
+ * @brief One directory waiting to be (or already) enumerated
+ *
+ * The listing and the jobs for its subdirectories are filled by whichever
+ * thread claims the job first. children holds one job per directory entry
+ * of the listing, in listing order, unless the depth limit stops descent
+ * (with --du it does not: the totals need the whole subtree).
+ *
+ * Once listed, a job below the root gives up its path (its children have
+ * theirs), so the jobs open along a deep chain do not each hold a copy of
+ * nearly the same long path.
+ *
+ * A job reached through a symbolic link, and one every kLoopCheck levels
+ * (for links d_type does not show), is checked against its ancestors before
+ * it is listed; a loop fails with ELOOP like a path the kernel could not
+ * resolve.
+ */
+struct DirJob {
+  std::string path;           ///< Directory to enumerate (emptied when
+                              ///< listed, except for the root and errors)
+  int level = 1;              ///< Depth level of this directory (1 = root)
+  IgnoreFrame::Ptr ignore;    ///< Rules inherited from the parent directory
+  uint32_t snap = kSnapNone;  ///< Record in the --refresh snapshot
+  int watch = -1;             ///< inotify watch descriptor (--watch)
+  uint32_t node = UINT32_MAX; ///< Node in the --watch tree (set by parent)
+  bool stored = false;        ///< Listing was handed to the watcher
+  std::atomic<int> state{0};  ///< 0 = queued, 1 = running, 2 = done
+  int matches = -1; ///< -P: subtree has a match (-1 = unknown; renderer only)
+  DuTotals usage;   ///< --du: totals of the subtree (renderer only)
+  DirListing listing;         ///< Filtered, sorted entries (valid when done)
+  std::vector<std::shared_ptr<DirJob>> children; ///< Subdirectory jobs
+  DirAncestry::Ptr ancestors; ///< Directories above this one
+  bool viaLink = false;       ///< Entry in the parent is a symbolic link
+#ifdef __linux__
+  DirAnchor::Ptr anchor;      ///< Ancestor path is opened from (or null)
+#endif
+
+  DirJob(std::string p, int l, IgnoreFrame::Ptr i, uint32_t s = kSnapNone)
+      : path(std::move(p)), level(l), ignore(std::move(i)), snap(s) {}
+};
+
+/**
+ * @class TreeWalker
+ * @brief Produces directory listings, serially or with a work-stealing pool
+ *
+ * With jobs <= 1 no threads are started and acquire() simply enumerates the
+ * requested directory inline, which is exactly the classic serial walk.
+ */
+class TreeWalker {
+public:
+  /**
+   * @brief Create the walker and start the worker threads (if any)
+   * @param args Command-line arguments (filters, depth limit, -j count)
+   * @param stats Statistics of the rendering thread; workers merge into it
+   * @param snapshot Previous snapshot to reuse unchanged directories from
+   *        (--refresh; may be null)
+   * @param watcher Watcher to register every directory with before it is
+   *        listed, and to hand every listing to as it is first acquired
+   *        (--watch; may be null)
+   */
+  TreeWalker(const Args &args, TreeStats &stats,
+             const SnapshotReader *snapshot = nullptr,
+             TreeWatcher *watcher = nullptr);
+
+  /**
+   * @brief Stop and join the workers (calls finish() if still running)
+   */
+  ~TreeWalker();
+
+  TreeWalker(const TreeWalker &) = delete;
+  TreeWalker &operator=(const TreeWalker &) = delete;
+
+  /**
+   * @brief Create the job for the root directory and hand it to the pool
+   * @param dir Root directory path
+   * @param level Depth level of the root directory
+   * @param ignore Ignore rules that apply to the root (--gitignore)
+   * @param snap Record of the root in the --refresh snapshot
+   * @return Job to pass to acquire()
+   */
+  std::shared_ptr<DirJob> start(const std::filesystem::path &dir, int level,
+                                IgnoreFrame::Ptr ignore,
+                                uint32_t snap = kSnapNone);
+
+  /**
+   * @brief Get the listing of a job, enumerating it inline if still queued
+   *
+   * Only the rendering thread may call this.
+   *
+   * @param job Job whose listing is needed
+   * @return Reference to the finished listing (valid until release())
+   */
+  const DirListing &acquire(DirJob &job);
+
+  /**
+   * @brief Free a job's listing once its whole subtree has been rendered
+   * @param job Job previously returned by acquire()
+   */
+  void release(DirJob &job);
+
+  /**
+   * @brief Stop the workers and merge their statistics into the caller's
+   */
+  void finish();
+
+private:
+  void run(DirJob &job, TreeStats &stats, size_t queue);
+  bool closesLoop(const DirJob &job) const;
+  void push(size_t queue, const std::shared_ptr<DirJob> &job);
+  std::shared_ptr<DirJob> pop(size_t queue);
+  void workerLoop(size_t index);
+
+  /// Per-thread job deque; owner uses the back, thieves use the front
+  struct JobQueue {
+    std::mutex mutex;
+    std::deque<std::shared_ptr<DirJob>> jobs;
+  };
+
+  const Args &args_;
+  const SnapshotReader *snapshot_;          ///< --refresh source (or null)
+  TreeWatcher *watcher_;                    ///< --watch registry (or null)
+  TreeStats &stats_;                        ///< Rendering thread statistics
+  std::vector<TreeStats> workerStats_;      ///< One TreeStats per worker
+  std::vector<std::unique_ptr<JobQueue>> queues_; ///< Workers + renderer
+  std::vector<std::thread> threads_;
+
+  std::mutex workMutex_;             ///< Guards waiting for work
+  std::condition_variable workCv_;   ///< Signalled on new jobs / release
+  std::atomic<size_t> queued_{0};    ///< Jobs sitting in any deque
+  std::atomic<size_t> buffered_{0};  ///< Listings finished but not released
+  size_t bufferLimit_ = 0;           ///< Soft cap on buffered listings
+  int rootLevel_ = 1;                ///< Level of the job made by start()
+  bool stop_ = false;                ///< Set by finish(), guarded by workMutex_
+
+  std::mutex doneMutex_;           ///< Guards waiting for job completion
+  std::condition_variable doneCv_; ///< Signalled whenever a job completes
+
+  std::mutex spareMutex_;          ///< Guards spare_
+  std::vector<DirListing> spare_;  ///< Released listings kept for reuse
+};
+
+#endif
+
+#endif
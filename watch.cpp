@@ -0,0 +1,706 @@
+/**
+ * @file watch.cpp
+ * @brief Live tree update implementation for eTree (--watch)
+ *
+ * Events only mark directories; the work happens once per burst in
+ * apply(), parents before children, so a directory that disappears with
+ * its parent is never listed. A re-listed directory is compared with its
+ * stored children by name, and only the subdirectories that are new to it
+ * are walked (and watched). Directory listing itself is listDirectory(), so
+ * every filter of the first walk (-a, -I, -P, -d, --gitignore) applies to
+ * the changes as well.
+ */
+
+#include "watch.h"
+
+#ifndef _WIN32
+
+#include "args.h"
+#include "meta.h"
+#include "output.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+/// Quiet time that ends a burst of events
+constexpr int kSettleMs = 50;
+
+/// Longest a burst is collected before its changes are printed anyway
+constexpr auto kMaxBurst = std::chrono::milliseconds(500);
+
+#ifdef __linux__
+/// Events that change what a directory listing shows
+constexpr uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE |
+                                IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF |
+                                IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+#endif
+
+/// Output order of the change kinds at the same path
+int kindRank(char kind) { return kind == '-' ? 0 : kind == '~' ? 1 : 2; }
+
+} // namespace
+
+/**
+ * @brief Create an idle watcher
+ * @param args Command-line arguments and options
+ */
+TreeWatcher::TreeWatcher(const Args &args)
+    : args_(args), fields_(planMetadata(args)) {}
+
+/**
+ * @brief Close the inotify descriptor
+ */
+TreeWatcher::~TreeWatcher() {
+  if (fd_ >= 0)
+    close(fd_);
+}
+
+/**
+ * @brief Create the inotify instance (non-blocking, close-on-exec)
+ *
+ * @param why Receives the reason on failure
+ * @return false if change notification is not available
+ */
+bool TreeWatcher::open(std::string &why) {
+#ifdef __linux__
+  fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd_ < 0) {
+    why = std::string("Could not start watching: ") + std::strerror(errno);
+    return false;
+  }
+  return true;
+#else
+  why = "--watch needs inotify (Linux)";
+  return false;
+#endif
+}
+
+/**
+ * @brief Add an inotify watch for a directory
+ *
+ * When the watch limit (fs.inotify.max_user_watches) is reached, the
+ * remaining directories are shown but not followed; this is reported once.
+ *
+ * @param dir Directory path
+ * @return Watch descriptor, or -1
+ */
+int TreeWatcher::addWatch(const fs::path &dir) {
+#ifdef __linux__
+  if (fd_ < 0)
+    return -1;
+  int wd = inotify_add_watch(fd_, dir.c_str(), kWatchMask);
+  if (wd < 0 && errno == ENOSPC && !limitWarned_.exchange(true))
+    std::cerr << "[etree] inotify watch limit reached "
+                 "(fs.inotify.max_user_watches); some directories are "
+                 "not watched"
+              << std::endl;
+  return wd < 0 ? -1 : wd;
+#else
+  (void)dir;
+  return -1;
+#endif
+}
+
+/**
+ * @brief Watch a directory that is about to be listed
+ *
+ * Only the descriptor is stored in the job; add() files it under the
+ * directory's node on the rendering thread.
+ *
+ * @param job Directory job
+ */
+void TreeWatcher::watch(DirJob &job) { job.watch = addWatch(job.path); }
+
+/**
+ * @brief Store a listing of the first walk
+ *
+ * The first job is the root. Every other job's node was set when its
+ * parent was stored, since the walker creates one subdirectory job per
+ * directory entry, in listing order.
+ *
+ * @param job Directory job
+ * @param listing Its listing
+ */
+void TreeWatcher::add(DirJob &job, const DirListing &listing) {
+  if (job.node == kNoNode) {
+    if (store_.size() > 0)
+      return; // Not part of the tree (cannot happen with one printTree())
+    job.node = store_.addRoot(job.path);
+    rootPath_ = job.path;
+    rootIgnore_ = job.ignore;
+  }
+  if (job.watch >= 0)
+    track(job.node, job.watch);
+  if (!listing.ok)
+    return;
+
+  const uint32_t first = store_.setChildren(job.node, listing);
+  if (listing.ignore != job.ignore)
+    rules_[job.node] = listing.ignore;
+
+  size_t c = 0;
+  for (size_t i = 0; i < listing.entries.size() && c < job.children.size();
+       ++i) {
+    if (listing.entries[i].isDir)
+      job.children[c++]->node = first + static_cast<uint32_t>(i);
+  }
+}
+
+/**
+ * @brief Print changes as they happen
+ *
+ * Sleeps in poll() until the first event, then keeps reading until the
+ * queue has been quiet for kSettleMs (or kMaxBurst has passed), so a burst
+ * such as an unpacked archive is applied and printed once.
+ *
+ * @param out Output sink for the change lines
+ * @param colors Whether colored output is enabled
+ * @return Process exit code
+ */
+int TreeWatcher::run(OutputWriter &out, bool colors) {
+  if (store_.size() == 0 || fd_ < 0)
+    return 0;
+
+  pollfd pfd{fd_, POLLIN, 0};
+  for (;;) {
+    if (!out.flush()) {
+      std::cerr << "Error: Could not write the tree output" << std::endl;
+      return 1;
+    }
+
+    if (poll(&pfd, 1, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      std::cerr << "Error: Could not wait for changes: "
+                << std::strerror(errno) << std::endl;
+      return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    do {
+      drain();
+    } while (std::chrono::steady_clock::now() - start < kMaxBurst &&
+             poll(&pfd, 1, kSettleMs) > 0);
+
+    apply();
+    emit(out, colors);
+
+    if (rootGone_) {
+      out.flush();
+      std::cerr << "[etree] " << rootPath_.string()
+                << " was removed or moved; stopping" << std::endl;
+      return 0;
+    }
+  }
+}
+
+/**
+ * @brief Read every queued event and note it
+ */
+void TreeWatcher::drain() {
+#ifdef __linux__
+  alignas(struct inotify_event) char buffer[64 * 1024];
+  for (;;) {
+    ssize_t n = read(fd_, buffer, sizeof(buffer));
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR)
+        continue;
+      return; // EAGAIN: queue empty
+    }
+    for (ssize_t off = 0; off < n;) {
+      const auto *ev = reinterpret_cast<const inotify_event *>(buffer + off);
+      note(ev->wd, ev->mask, ev->len > 0 ? ev->name : "");
+      off += static_cast<ssize_t>(sizeof(inotify_event) + ev->len);
+    }
+  }
+#endif
+}
+
+/**
+ * @brief Record one event against its directory
+ *
+ * @param wd Watch descriptor the event arrived on
+ * @param mask Event mask
+ * @param name Entry name, or "" for the directory itself
+ */
+void TreeWatcher::note(int wd, uint32_t mask, const char *name) {
+#ifdef __linux__
+  if (mask & IN_Q_OVERFLOW) {
+    overflow_ = true;
+    return;
+  }
+  auto it = watches_.find(wd);
+  if (it == watches_.end())
+    return;
+  const uint32_t dir = it->second;
+
+  if (mask & IN_IGNORED) {
+    // The kernel dropped the watch (directory deleted or unmounted)
+    dirWatch_.erase(dir);
+    watches_.erase(it);
+    return;
+  }
+  if (mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+    // Reported through the parent, except for the root itself
+    if (dir == 0)
+      rootGone_ = true;
+    return;
+  }
+  if (name[0] == '\0')
+    return; // Attribute change of the directory itself: shown by its parent
+
+  Pending &pending = pending_[dir];
+  if (mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))
+    pending.relist = true;
+  else
+    pending.touched.insert(name);
+
+  // New ignore rules can hide or reveal entries anywhere below
+  if (args_.gitignore &&
+      (std::strcmp(name, ".gitignore") == 0 || std::strcmp(name, ".ignore") == 0))
+    pending.relist = true;
+#else
+  (void)wd;
+  (void)mask;
+  (void)name;
+#endif
+}
+
+/**
+ * @brief Apply the collected events, parents before children
+ *
+ * Re-listing a directory gives its subdirectories new nodes, and their
+ * pending events move with them, so the directories are handled in rounds
+ * until nothing is left.
+ */
+void TreeWatcher::apply() {
+  if (overflow_) {
+    overflow_ = false;
+    std::cerr << "[etree] Change queue overflowed; listing every directory "
+                 "again"
+              << std::endl;
+    markAll(0);
+  }
+
+  std::vector<std::pair<int, uint32_t>> order;
+  while (!pending_.empty()) {
+    order.clear();
+    for (const auto &p : pending_)
+      order.emplace_back(store_.level(p.first), p.first);
+    std::sort(order.begin(), order.end());
+
+    // Entries are erased as directories are handled (or removed), so a
+    // missing entry means there is nothing left to do for it
+    for (const auto &o : order) {
+      if (pending_.count(o.second))
+        update(o.second, false);
+    }
+  }
+
+  if (store_.wantsCompaction())
+    compact();
+}
+
+/**
+ * @brief Mark a whole subtree for re-listing (after lost events)
+ * @param dir Top of the subtree
+ */
+void TreeWatcher::markAll(uint32_t dir) {
+  pending_[dir].relist = true;
+  const uint32_t first = store_[dir].children;
+  for (uint32_t c = 0; c < store_.childCount(dir); ++c) {
+    if (store_[first + c].isDir())
+      markAll(first + c);
+  }
+}
+
+/**
+ * @brief Handle a directory's pending events
+ *
+ * @param dir Directory
+ * @param rescan List it again even without events (its rules changed)
+ */
+void TreeWatcher::update(uint32_t dir, bool rescan) {
+  Pending pending;
+  auto it = pending_.find(dir);
+  if (it != pending_.end()) {
+    pending = std::move(it->second);
+    pending_.erase(it);
+  }
+  if (rescan || pending.relist)
+    relist(dir, pending);
+  else
+    touch(dir, pending);
+}
+
+/**
+ * @brief List a directory again and report the difference
+ *
+ * Entries are matched by name; an entry that changed between file and
+ * directory counts as removed and added. The new listing becomes a new
+ * block of nodes: kept subdirectories hand their children, watches and
+ * pending events over to their new nodes. With --gitignore, a change of
+ * the rules in effect inside the directory re-lists its kept
+ * subdirectories as well.
+ *
+ * @param dir Directory
+ * @param pending Its events (modified names are reported as such)
+ */
+void TreeWatcher::relist(uint32_t dir, const Pending &pending) {
+  DirListing fresh;
+  TreeStats scratch;
+  const int level = store_.level(dir);
+  const IgnoreFrame::Ptr inherited = rulesFor(dir);
+  listDirectory(dirPath(dir), args_, level, inherited, scratch, fresh);
+  if (!fresh.ok)
+    return; // Gone: its parent's events remove it
+
+  const bool rulesChanged =
+      IgnoreFrame::digest(fresh.ignore) != IgnoreFrame::digest(rulesInside(dir));
+
+  // Old children stay readable after setChildren(): they only become garbage
+  std::unordered_map<std::string_view, uint32_t> old;
+  const uint32_t oldFirst = store_[dir].children;
+  old.reserve(store_.childCount(dir));
+  for (uint32_t c = 0; c < store_.childCount(dir); ++c)
+    old.emplace(store_.name(oldFirst + c), oldFirst + c);
+
+  const uint32_t first = store_.setChildren(dir, fresh);
+  if (fresh.ignore != inherited)
+    rules_[dir] = fresh.ignore;
+  else
+    rules_.erase(dir);
+
+  const bool descend = args_.maxLevel <= 0 || level + 1 <= args_.maxLevel;
+  std::vector<uint32_t> rescans;
+  for (size_t i = 0; i < fresh.entries.size(); ++i) {
+    const WalkEntry &e = fresh.entries[i];
+    const uint32_t node = first + static_cast<uint32_t>(i);
+    auto o = old.find(e.name);
+    if (o == old.end() || store_[o->second].isDir() != e.isDir) {
+      report(node, '+');
+      if (e.isDir && descend)
+        populate(node);
+      continue;
+    }
+
+    // Directory sizes and times change with their contents, which their
+    // own events report; only their permissions are compared here
+    const Node &before = store_[o->second];
+    const Node &after = store_[node];
+    const bool metaChanged =
+        (before.flags & after.flags & Node::MetaValid) &&
+        (before.mode != after.mode ||
+         (!e.isDir && (before.size != after.size || before.mtime != after.mtime)));
+    if (metaChanged || pending.touched.count(std::string(e.name)))
+      report(node, '~');
+    if (e.isDir) {
+      moveDir(o->second, node);
+      if (rulesChanged && descend)
+        rescans.push_back(node);
+    }
+    old.erase(o);
+  }
+
+  // What is left disappeared (or changed type)
+  for (const auto &o : old) {
+    report(o.second, '-');
+    if (store_[o.second].isDir())
+      remove(o.second);
+  }
+
+  for (uint32_t child : rescans)
+    update(child, true);
+}
+
+/**
+ * @brief Report modified entries of an otherwise unchanged directory
+ *
+ * @param dir Directory
+ * @param pending Its events
+ */
+void TreeWatcher::touch(uint32_t dir, const Pending &pending) {
+  const uint32_t first = store_[dir].children;
+  for (uint32_t c = 0; c < store_.childCount(dir); ++c) {
+    const uint32_t node = first + c;
+    if (!pending.touched.count(std::string(store_.name(node))))
+      continue;
+    Node &n = store_[node];
+    if (fields_) {
+      FileMeta meta;
+      const std::string path = (dirPath(dir) / store_.name(node)).native();
+      if (fetchMeta(AT_FDCWD, path.c_str(), fields_, meta)) {
+        n.flags |= Node::MetaValid;
+        n.mode = static_cast<uint16_t>(meta.mode);
+        if (!n.isDir())
+          n.size = meta.size;
+        n.mtime = meta.mtime;
+      }
+    }
+    report(node, '~');
+  }
+}
+
+/**
+ * @brief Watch, list and report a directory that is new to the tree
+ * @param dir Directory (its children are filled)
+ */
+void TreeWatcher::populate(uint32_t dir) {
+  const fs::path path = dirPath(dir);
+  const int wd = addWatch(path);
+  if (wd >= 0)
+    track(dir, wd);
+
+  DirListing listing;
+  TreeStats scratch;
+  const int level = store_.level(dir);
+  const IgnoreFrame::Ptr inherited = rulesFor(dir);
+  listDirectory(path, args_, level, inherited, scratch, listing);
+  if (!listing.ok)
+    return;
+
+  const uint32_t first = store_.setChildren(dir, listing);
+  if (listing.ignore != inherited)
+    rules_[dir] = listing.ignore;
+
+  const bool descend = args_.maxLevel <= 0 || level + 1 <= args_.maxLevel;
+  for (size_t i = 0; i < listing.entries.size(); ++i) {
+    const uint32_t node = first + static_cast<uint32_t>(i);
+    report(node, '+');
+    if (listing.entries[i].isDir && descend)
+      populate(node);
+  }
+}
+
+/**
+ * @brief Report and drop a subtree that disappeared
+ * @param dir Top of the subtree (its own entry is reported by the caller)
+ */
+void TreeWatcher::remove(uint32_t dir) {
+  const uint32_t first = store_[dir].children;
+  const uint32_t count = store_.childCount(dir);
+  for (uint32_t c = 0; c < count; ++c) {
+    report(first + c, '-');
+    if (store_[first + c].isDir())
+      remove(first + c);
+  }
+  store_.retire(count);
+  rules_.erase(dir);
+  unwatch(dir);
+}
+
+/**
+ * @brief File a watch descriptor under a directory
+ *
+ * A directory reached a second time (bind mount) gets the same watch
+ * descriptor, which then belongs to the newer node.
+ */
+void TreeWatcher::track(uint32_t dir, int wd) {
+  watches_[wd] = dir;
+  dirWatch_[dir] = wd;
+}
+
+/**
+ * @brief Stop watching a directory and forget its pending events
+ * @param dir Directory
+ */
+void TreeWatcher::unwatch(uint32_t dir) {
+  pending_.erase(dir);
+  auto d = dirWatch_.find(dir);
+  if (d == dirWatch_.end())
+    return;
+  auto it = watches_.find(d->second);
+  if (it != watches_.end() && it->second == dir) {
+#ifdef __linux__
+    inotify_rm_watch(fd_, d->second); // Fails harmlessly if already gone
+#endif
+    watches_.erase(it);
+  }
+  dirWatch_.erase(d);
+}
+
+/**
+ * @brief Hand a kept directory's state over to its new node
+ *
+ * @param from Node in the directory's old parent block
+ * @param to Node in the new block
+ */
+void TreeWatcher::moveDir(uint32_t from, uint32_t to) {
+  store_.moveChildren(from, to);
+
+  auto d = dirWatch_.find(from);
+  if (d != dirWatch_.end()) {
+    const int wd = d->second;
+    dirWatch_.erase(d);
+    dirWatch_[to] = wd;
+    auto it = watches_.find(wd);
+    if (it != watches_.end() && it->second == from)
+      it->second = to;
+  }
+
+  auto r = rules_.find(from);
+  if (r != rules_.end()) {
+    rules_[to] = std::move(r->second);
+    rules_.erase(from);
+  }
+
+  auto p = pending_.find(from);
+  if (p != pending_.end()) {
+    pending_[to] = std::move(p->second);
+    pending_.erase(from);
+  }
+}
+
+/**
+ * @brief Drop the unreachable nodes and renumber everything that refers
+ *        to a node
+ */
+void TreeWatcher::compact() {
+  const std::vector<uint32_t> remap = store_.compact();
+
+  for (auto it = watches_.begin(); it != watches_.end();) {
+    it->second = remap[it->second];
+    it = it->second == kNoNode ? watches_.erase(it) : std::next(it);
+  }
+
+  std::unordered_map<uint32_t, int> dirWatch;
+  for (const auto &d : dirWatch_) {
+    if (remap[d.first] != kNoNode)
+      dirWatch.emplace(remap[d.first], d.second);
+  }
+  dirWatch_.swap(dirWatch);
+
+  std::unordered_map<uint32_t, IgnoreFrame::Ptr> rules;
+  for (auto &r : rules_) {
+    if (remap[r.first] != kNoNode)
+      rules.emplace(remap[r.first], std::move(r.second));
+  }
+  rules_.swap(rules);
+}
+
+/**
+ * @brief Path of a directory (the root path joined with its relative path)
+ */
+fs::path TreeWatcher::dirPath(uint32_t dir) const {
+  std::string relative;
+  store_.path(dir, relative);
+  return relative.empty() ? rootPath_ : rootPath_ / relative;
+}
+
+/**
+ * @brief Ignore rules in effect inside a directory (--gitignore)
+ */
+IgnoreFrame::Ptr TreeWatcher::rulesInside(uint32_t dir) const {
+  if (rules_.empty())
+    return rootIgnore_;
+  for (uint32_t n = dir; n != kNoNode; n = store_[n].parent) {
+    auto it = rules_.find(n);
+    if (it != rules_.end())
+      return it->second;
+  }
+  return rootIgnore_;
+}
+
+/**
+ * @brief Ignore rules a directory inherits from its parent (--gitignore)
+ */
+IgnoreFrame::Ptr TreeWatcher::rulesFor(uint32_t dir) const {
+  const uint32_t parent = store_[dir].parent;
+  return parent == kNoNode ? rootIgnore_ : rulesInside(parent);
+}
+
+/**
+ * @brief Add a line for an entry
+ *
+ * With -P, the directories kept only because a match may lie below them
+ * are not shown by themselves.
+ *
+ * @param node Entry that changed
+ * @param kind '+', '-' or '~'
+ */
+void TreeWatcher::report(uint32_t node, char kind) {
+  const Node &n = store_[node];
+  if (!args_.include.empty() && !(n.flags & Node::Matched))
+    return;
+  Change change;
+  store_.path(node, change.path);
+  change.kind = kind;
+  change.isDir = args_.showDirsOnly || n.isDir();
+  change.meta = store_.meta(node);
+  changes_.push_back(std::move(change));
+}
+
+/**
+ * @brief Print the burst's changes in path order
+ *
+ * Lines carry the same columns as the tree (-s, -p) and directories end
+ * in '/'.
+ *
+ * @param out Output sink
+ * @param colors Whether colored output is enabled
+ */
+void TreeWatcher::emit(OutputWriter &out, bool colors) {
+  std::stable_sort(changes_.begin(), changes_.end(),
+                   [](const Change &a, const Change &b) {
+                     if (a.path != b.path)
+                       return a.path < b.path;
+                     return kindRank(a.kind) < kindRank(b.kind);
+                   });
+
+  for (const Change &c : changes_) {
+    out.put(c.kind);
+    out.put(' ');
+    if (colors)
+      out.write(c.isDir ? dircolor : filecolor);
+    out.write(c.path);
+    if (c.isDir)
+      out.put('/');
+    if (colors)
+      out.write(resetcolor);
+
+    if (c.kind != '-') {
+      if (args_.showSize) {
+        if (colors)
+          out.write(sizecolor);
+        out.write(" [");
+        writeSize(out, c.isDir ? 0 : c.meta.size);
+        out.put(']');
+        if (colors)
+          out.write(resetcolor);
+      }
+      if (args_.showPerms) {
+        char perms[9];
+        if (colors)
+          out.write(permcolor);
+        out.write(" (");
+        if (c.meta.valid) {
+          formatPermissions(c.meta.mode, perms);
+          out.write(perms, sizeof(perms));
+        } else {
+          out.put('-');
+        }
+        out.put(')');
+        if (colors)
+          out.write(resetcolor);
+      }
+    }
+    out.endLine();
+  }
+  changes_.clear();
+}
+
+#endif
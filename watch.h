@@ -0,0 +1,155 @@
+/**
+ * @file watch.h
+ * @brief Live tree updates for eTree (--watch, Linux inotify)
+ *
+ * This header declares TreeWatcher. With --watch the walker hands every
+ * listing to the watcher as the renderer first takes it, and the watcher
+ * copies it into a compact NodeStore (32 bytes per entry, interned names),
+ * which is the tree kept in memory afterwards. Each directory gets an
+ * inotify watch before it is listed, so no change between the first walk
+ * and the event loop is missed.
+ *
+ * After the tree and its summary are printed, the watcher blocks on the
+ * inotify descriptor. A burst of events is collected until it settles and
+ * coalesced per directory: a created, deleted or renamed entry re-lists
+ * only its own directory, a modified file is only stat'ed again. The
+ * difference to the stored tree is printed as one line per entry:
+ *
+ *   + path   entry appeared (with -s/-p columns)
+ *   - path   entry disappeared
+ *   ~ path   entry was modified
+ *
+ * New subdirectories are listed and watched as they appear, removed ones
+ * drop their watches. With no events the process sleeps in poll(), so CPU
+ * use follows the rate of change, not the size of the tree. If the kernel
+ * event queue overflows, every directory is listed again once.
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#ifndef _WIN32
+
+#include "nodes.h"
+#include "walker.h"
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class OutputWriter;
+
+/**
+ * @class TreeWatcher
+ * @brief Keeps a walked tree up to date from inotify events
+ *
+ * watch() may be called from any walker thread; everything else runs on
+ * the rendering thread.
+ */
+class TreeWatcher {
+public:
+  /**
+   * @brief Create an idle watcher
+   * @param args Command-line arguments and options (filters, columns)
+   */
+  explicit TreeWatcher(const Args &args);
+
+  /**
+   * @brief Close the inotify descriptor
+   */
+  ~TreeWatcher();
+
+  TreeWatcher(const TreeWatcher &) = delete;
+  TreeWatcher &operator=(const TreeWatcher &) = delete;
+
+  /**
+   * @brief Create the inotify instance
+   * @param why Receives the reason on failure
+   * @return false if change notification is not available
+   */
+  bool open(std::string &why);
+
+  /**
+   * @brief Watch a directory that is about to be listed
+   * @param job Directory job (its watch descriptor is stored in it)
+   */
+  void watch(DirJob &job);
+
+  /**
+   * @brief Store a listing of the first walk
+   *
+   * Called once per job, parents before children; links the job's
+   * subdirectory jobs to their nodes.
+   *
+   * @param job Directory job (the first one is the root)
+   * @param listing Its listing
+   */
+  void add(DirJob &job, const DirListing &listing);
+
+  /**
+   * @brief Print changes as they happen (returns only on error or when
+   *        the root directory goes away)
+   *
+   * @param out Output sink for the change lines
+   * @param colors Whether colored output is enabled
+   * @return Process exit code
+   */
+  int run(OutputWriter &out, bool colors);
+
+private:
+  /// Events collected for one directory during a burst
+  struct Pending {
+    bool relist = false;                    ///< Entries added or removed
+    std::unordered_set<std::string> touched; ///< Entries modified
+  };
+
+  /// One line of output
+  struct Change {
+    std::string path; ///< Path relative to the root
+    char kind;        ///< '+', '-' or '~'
+    bool isDir;
+    FileMeta meta;
+  };
+
+  int addWatch(const std::filesystem::path &dir);
+  void drain();
+  void note(int wd, uint32_t mask, const char *name);
+  void apply();
+  void markAll(uint32_t dir);
+  void update(uint32_t dir, bool rescan);
+  void relist(uint32_t dir, const Pending &pending);
+  void touch(uint32_t dir, const Pending &pending);
+  void populate(uint32_t dir);
+  void remove(uint32_t dir);
+  void track(uint32_t dir, int wd);
+  void unwatch(uint32_t dir);
+  void moveDir(uint32_t from, uint32_t to);
+  void compact();
+  std::filesystem::path dirPath(uint32_t dir) const;
+  IgnoreFrame::Ptr rulesInside(uint32_t dir) const;
+  IgnoreFrame::Ptr rulesFor(uint32_t dir) const;
+  void report(uint32_t node, char kind);
+  void emit(OutputWriter &out, bool colors);
+
+  const Args &args_;
+  int fd_ = -1;                       ///< inotify instance
+  NodeStore store_;                   ///< The tree (node 0 is the root)
+  std::filesystem::path rootPath_;    ///< Path of the root directory
+  IgnoreFrame::Ptr rootIgnore_;       ///< Rules inherited by the root
+  std::unordered_map<int, uint32_t> watches_;  ///< Watch descriptor -> dir
+  std::unordered_map<uint32_t, int> dirWatch_; ///< Dir -> watch descriptor
+  std::unordered_map<uint32_t, IgnoreFrame::Ptr>
+      rules_; ///< Rules inside dirs with their own ignore files
+  std::atomic<bool> limitWarned_{false}; ///< Watch limit message printed
+  std::unordered_map<uint32_t, Pending> pending_; ///< Current burst
+  bool overflow_ = false;             ///< Events were lost: re-list all
+  bool rootGone_ = false;             ///< Root deleted or moved
+  unsigned fields_ = 0;               ///< planMetadata() of this run
+  std::vector<Change> changes_;       ///< Lines of the current burst
+};
+
+#endif
+
+#endif